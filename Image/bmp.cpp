@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <vector>
 #include <Util/exceptions.h>
 #include "bmp.h"
 
@@ -138,78 +139,141 @@ static void LongWriteLE( LONG x , FILE *fp )
 	putc( b4 , fp );
 }
 
+/* Reads and checks the headers, returning the dimensions and the (padded) length of a line of pixels */
+static void BMPReadHeader( FILE *fp , int &width , int &height , int &lineLength )
+{
+	BITMAPFILEHEADER bmfh;
+	BITMAPINFOHEADER bmih;
+
+	if( !fp ) THROW( "Empty file pointer" );
+
+	/* Read file header */
+
+	/* fread(&bmfh, sizeof(bmfh), 1, fp); */
+	/* fread won't work on different platforms because of endian
+	* issues.  Sigh... */
+	bmfh.bfType = WordReadLE(fp);
+	bmfh.bfSize = DWordReadLE(fp);
+	bmfh.bfReserved1 = WordReadLE(fp);
+	bmfh.bfReserved2 = WordReadLE(fp);
+	bmfh.bfOffBits = DWordReadLE(fp);
+
+	/* Check file header */
+	if( bmfh.bfType!=BMP_BF_TYPE ) THROW( "Inavlid header" );
+	/* ignore bmfh.bfSize */
+	/* ignore bmfh.bfReserved1 */
+	/* ignore bmfh.bfReserved2 */
+	/* the pixels follow the headers, as bmfh.bfOffBits is the size of the headers */
+	if( bmfh.bfOffBits!=BMP_BF_OFF_BITS ) THROW( "Inavlid header" );
+
+	/* Read info header */
+
+	/* fread(&bmih, sizeof(bmih), 1, fp); */
+	/* same problem as above... */
+
+	bmih.biSize = DWordReadLE(fp);
+	bmih.biWidth = LongReadLE(fp);
+	bmih.biHeight = LongReadLE(fp);
+	bmih.biPlanes = WordReadLE(fp);
+	bmih.biBitCount = WordReadLE(fp);
+	bmih.biCompression = DWordReadLE(fp);
+	bmih.biSizeImage = DWordReadLE(fp);
+	bmih.biXPelsPerMeter = LongReadLE(fp);
+	bmih.biYPelsPerMeter = LongReadLE(fp);
+	bmih.biClrUsed = DWordReadLE(fp);
+	bmih.biClrImportant = DWordReadLE(fp);
+	/* Check info header */
+	if( bmih.biSize!=BMP_BI_SIZE ) THROW( "Bad size" );
+	if( bmih.biWidth<=0 ) THROW( "Bad width: %d <= 0" , bmih.biWidth );
+	if( bmih.biHeight<=0 ) THROW( "Bad height: %d <= 0" , bmih.biHeight );
+	if( bmih.biPlanes!=1 ) THROW( "Bad number of planes: %d != 1" , bmih.biPlanes );
+	if( bmih.biBitCount!=24 ) THROW( "Bad bit count: %d != 24" , bmih.biBitCount );
+	if( bmih.biCompression!=BI_RGB ) THROW( "Bad compression type: %d != %d" , bmih.biCompression , BI_RGB );
+	lineLength = bmih.biWidth * 3;	/* RGB */
+	if( (lineLength % 4)!=0 ) lineLength = (lineLength / 4 + 1) * 4;
+	if( bmih.biSizeImage!=(DWORD) lineLength * (DWORD) bmih.biHeight ) THROW( "Image size doesn't match line-length times height: %d != %d x %d" , bmih.biSizeImage , bmih.biHeight , bmih.biHeight );
+
+	/* ignore bmih.biXPelsPerMeter */
+	/* ignore bmih.biYPelsPerMeter */
+	/* ignore bmih.biClrUsed - we assume a true color display, and
+	* won't use palettes */
+	/* ignore bmih.biClrImportant - same reason */
+
+	width = bmih.biWidth;
+	height = bmih.biHeight;
+}
+
+/* Writes the headers of an image with the prescribed dimensions, returning the (padded) length of a line of pixels */
+static int BMPWriteHeader( FILE *fp , int width , int height )
+{
+	BITMAPFILEHEADER bmfh;
+	BITMAPINFOHEADER bmih;
+	int lineLength;
+
+	lineLength = width * 3;	/* RGB */
+	if( (lineLength % 4)!=0 ) lineLength = (lineLength / 4 + 1) * 4;
+
+	/* Write file header */
+
+	bmfh.bfType = BMP_BF_TYPE;
+	bmfh.bfSize = BMP_BF_OFF_BITS + lineLength * height;
+	bmfh.bfReserved1 = 0;
+	bmfh.bfReserved2 = 0;
+	bmfh.bfOffBits = BMP_BF_OFF_BITS;
+
+	WordWriteLE( bmfh.bfType , fp );
+	DWordWriteLE( bmfh.bfSize , fp );
+	WordWriteLE( bmfh.bfReserved1 , fp );
+	WordWriteLE( bmfh.bfReserved2 , fp );
+	DWordWriteLE( bmfh.bfOffBits , fp );
+
+	/* Write info header */
+
+	bmih.biSize = BMP_BI_SIZE;
+	bmih.biWidth = width;
+	bmih.biHeight = height;
+	bmih.biPlanes = 1;
+	bmih.biBitCount = 24;		/* RGB */
+	bmih.biCompression = BI_RGB;	/* RGB */
+	bmih.biSizeImage = lineLength * (DWORD) bmih.biHeight;	/* RGB */
+	bmih.biXPelsPerMeter = 2925;
+	bmih.biYPelsPerMeter = 2925;
+	bmih.biClrUsed = 0;
+	bmih.biClrImportant = 0;
+
+	DWordWriteLE( bmih.biSize , fp );
+	LongWriteLE ( bmih.biWidth , fp );
+	LongWriteLE ( bmih.biHeight , fp );
+	WordWriteLE ( bmih.biPlanes , fp );
+	WordWriteLE ( bmih.biBitCount , fp );
+	DWordWriteLE( bmih.biCompression , fp );
+	DWordWriteLE( bmih.biSizeImage , fp );
+	LongWriteLE ( bmih.biXPelsPerMeter , fp );
+	LongWriteLE ( bmih.biYPelsPerMeter , fp );
+	DWordWriteLE( bmih.biClrUsed , fp );
+	DWordWriteLE( bmih.biClrImportant , fp );
+
+	return lineLength;
+}
+
 namespace Image
 {
 	void BMPReadImage( FILE *fp , Image32& img )
 	{
-		BITMAPFILEHEADER bmfh;
-		BITMAPINFOHEADER bmih;
 		int x, y;
-		int lineLength;
-
-		if( !fp ) THROW( "Empty file pointer" );
-
-		/* Read file header */
-
-		/* fread(&bmfh, sizeof(bmfh), 1, fp); */
-		/* fread won't work on different platforms because of endian
-		* issues.  Sigh... */
-		bmfh.bfType = WordReadLE(fp);
-		bmfh.bfSize = DWordReadLE(fp);
-		bmfh.bfReserved1 = WordReadLE(fp);
-		bmfh.bfReserved2 = WordReadLE(fp);
-		bmfh.bfOffBits = DWordReadLE(fp);
-
-		/* Check file header */
-		if( bmfh.bfType!=BMP_BF_TYPE ) THROW( "Inavlid header" );
-		/* ignore bmfh.bfSize */
-		/* ignore bmfh.bfReserved1 */
-		/* ignore bmfh.bfReserved2 */
-		if( bmfh.bfOffBits!=BMP_BF_OFF_BITS ) THROW( "Inavlid header" );
-
-		/* Read info header */
-
-		/* fread(&bmih, sizeof(bmih), 1, fp); */
-		/* same problem as above... */
-
-		bmih.biSize = DWordReadLE(fp);
-		bmih.biWidth = LongReadLE(fp);
-		bmih.biHeight = LongReadLE(fp);
-		bmih.biPlanes = WordReadLE(fp);
-		bmih.biBitCount = WordReadLE(fp);
-		bmih.biCompression = DWordReadLE(fp);
-		bmih.biSizeImage = DWordReadLE(fp);
-		bmih.biXPelsPerMeter = LongReadLE(fp);
-		bmih.biYPelsPerMeter = LongReadLE(fp);
-		bmih.biClrUsed = DWordReadLE(fp);
-		bmih.biClrImportant = DWordReadLE(fp);
-		/* Check info header */
-		if( bmih.biSize!=BMP_BI_SIZE ) THROW( "Bad size" );
-		if( bmih.biWidth<=0 ) THROW( "Bad width: %d <= 0" , bmih.biWidth );
-		if( bmih.biHeight<=0 ) THROW( "Bad height: %d <= 0" , bmih.biHeight );
-		if( bmih.biPlanes!=1 ) THROW( "Bad number of planes: %d != 1" , bmih.biPlanes );
-		if( bmih.biBitCount!=24 ) THROW( "Bad bit count: %d != 24" , bmih.biBitCount );
-		if( bmih.biCompression!=BI_RGB ) THROW( "Bad compression type: %d != %d" , bmih.biCompression , BI_RGB );
-		lineLength = bmih.biWidth * 3;	/* RGB */
-		if( (lineLength % 4)!=0 ) lineLength = (lineLength / 4 + 1) * 4;
-		if( bmih.biSizeImage!=(DWORD) lineLength * (DWORD) bmih.biHeight ) THROW( "Image size doesn't match line-length times height: %d != %d x %d" , bmih.biSizeImage , bmih.biHeight , bmih.biHeight );
-
-		/* ignore bmih.biXPelsPerMeter */
-		/* ignore bmih.biYPelsPerMeter */
-		/* ignore bmih.biClrUsed - we assume a true color display, and
-		* won't use palettes */
-		/* ignore bmih.biClrImportant - same reason */
+		int width , height , lineLength;
+
+		BMPReadHeader( fp , width , height , lineLength );
 
 		/* Creates the image */
 		//    img = new Image(bmih.biWidth, bmih.biHeight);
-		img.setSize( bmih.biWidth , bmih.biHeight );
+		img.setSize( width , height );
 		/* Read triples */
 		/* RGB */
 		{
 			RGBTRIPLE *triples;
 			triples = new RGBTRIPLE[lineLength];
 			if( !triples ) THROW( "Could not allocate triples[%d]" , lineLength );
-			fseek( fp , (long) bmfh.bfOffBits , SEEK_SET );
 
 			for( y=0 ; y<img.height() ; y++ )
 			{
@@ -241,54 +305,10 @@ namespace Image
 
 	void BMPWriteImage( const Image32& img , FILE *fp )
 	{
-		BITMAPFILEHEADER bmfh;
-		BITMAPINFOHEADER bmih;
 		int x, y;
-		int lineLength;
 		Pixel32 p;
 
-		lineLength = img.width() * 3;	/* RGB */
-		if( (lineLength % 4)!=0 ) lineLength = (lineLength / 4 + 1) * 4;
-
-		/* Write file header */
-
-		bmfh.bfType = BMP_BF_TYPE;
-		bmfh.bfSize = BMP_BF_OFF_BITS + lineLength * img.height();
-		bmfh.bfReserved1 = 0;
-		bmfh.bfReserved2 = 0;
-		bmfh.bfOffBits = BMP_BF_OFF_BITS;
-
-		WordWriteLE( bmfh.bfType , fp );
-		DWordWriteLE( bmfh.bfSize , fp );
-		WordWriteLE( bmfh.bfReserved1 , fp );
-		WordWriteLE( bmfh.bfReserved2 , fp );
-		DWordWriteLE( bmfh.bfOffBits , fp );
-
-		/* Write info header */
-
-		bmih.biSize = BMP_BI_SIZE;
-		bmih.biWidth = img.width();
-		bmih.biHeight = img.height();
-		bmih.biPlanes = 1;
-		bmih.biBitCount = 24;		/* RGB */
-		bmih.biCompression = BI_RGB;	/* RGB */
-		bmih.biSizeImage = lineLength * (DWORD) bmih.biHeight;	/* RGB */
-		bmih.biXPelsPerMeter = 2925;
-		bmih.biYPelsPerMeter = 2925;
-		bmih.biClrUsed = 0;
-		bmih.biClrImportant = 0;
-
-		DWordWriteLE( bmih.biSize , fp );
-		LongWriteLE ( bmih.biWidth , fp );
-		LongWriteLE ( bmih.biHeight , fp );
-		WordWriteLE ( bmih.biPlanes , fp );
-		WordWriteLE ( bmih.biBitCount , fp );
-		DWordWriteLE( bmih.biCompression , fp );
-		DWordWriteLE( bmih.biSizeImage , fp );
-		LongWriteLE ( bmih.biXPelsPerMeter , fp );
-		LongWriteLE ( bmih.biYPelsPerMeter , fp );
-		DWordWriteLE( bmih.biClrUsed , fp );
-		DWordWriteLE( bmih.biClrImportant , fp );
+		BMPWriteHeader( fp , img.width() , img.height() );
 
 		/* Write pixels */
 		for( y=0 ; y<img.height() ; y++ )
@@ -312,6 +332,69 @@ namespace Image
 		}
 	}
 
+	////////////////////
+	// BMPImageReader //
+	////////////////////
+	BMPImageReader::BMPImageReader( FILE *fp ) : _fp(fp) , _rows(0)
+	{
+		BMPReadHeader( fp , _width , _height , _lineLength );
+		_offset = ftell( fp );
+		if( _offset<0 ) THROW( "BMP file is not seekable" );
+		_line.resize( _lineLength );
+	}
+
+	void BMPImageReader::readRow( Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been read" , _height );
+		// The lines are stored from the bottom up
+		if( fseek( _fp , _offset + (long)( _height-1-_rows )*_lineLength , SEEK_SET ) ) THROW( "Failed to seek to BMP row %d" , _rows );
+		if( fread( &_line[0] , 1 , _lineLength , _fp )!=(size_t)_lineLength ) THROW( "Could not read triples" );
+		_rows++;
+
+		const unsigned char *b = &_line[0];
+		for( int i=0 ; i<_width ; i++ , b+=3 ) row[i].r = b[2] , row[i].g = b[1] , row[i].b = b[0] , row[i].a = 255;
+	}
+
+	////////////////////
+	// BMPImageWriter //
+	////////////////////
+	BMPImageWriter::BMPImageWriter( FILE *fp , int width , int height ) : _fp(fp) , _width(width) , _height(height) , _rows(0)
+	{
+		if( width<=0 || height<=0 ) THROW( "Bad image dimensions: %d x %d" , width , height );
+		_lineLength = BMPWriteHeader( fp , width , height );
+		_offset = ftell( fp );
+		if( _offset<0 ) THROW( "BMP file is not seekable" );
+		// The padding at the end of each line stays zero
+		_line.resize( _lineLength , 0 );
+	}
+
+	void BMPImageWriter::writeRow( const Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been written" , _height );
+		unsigned char *b = &_line[0];
+		for( int i=0 ; i<_width ; i++ ) *b++ = row[i].b , *b++ = row[i].g , *b++ = row[i].r;
+		// The lines are stored from the bottom up
+		if( fseek( _fp , _offset + (long)( _height-1-_rows )*_lineLength , SEEK_SET ) ) THROW( "Failed to seek to BMP row %d" , _rows );
+		if( fwrite( &_line[0] , 1 , _lineLength , _fp )!=(size_t)_lineLength ) THROW( "Failed to write BMP data" );
+		// Leave the file positioned at its end
+		if( ++_rows==_height && ( fseek( _fp , _offset + (long)_height*_lineLength , SEEK_SET ) || fflush( _fp ) ) ) THROW( "Failed to write BMP data" );
+	}
+
+	///////////////////
+	// BMPImageCodec //
+	///////////////////
+	ImageReader *BMPImageCodec::newReader( FILE *fp ) const
+	{
+		if( ftell( fp )<0 ) return new BufferedImageReader( fp , *this );
+		else                return new BMPImageReader( fp );
+	}
+
+	ImageWriter *BMPImageCodec::newWriter( FILE *fp , int width , int height ) const
+	{
+		if( ftell( fp )<0 ) return new BufferedImageWriter( fp , width , height , *this );
+		else                return new BMPImageWriter( fp , width , height );
+	}
+
 	void BMPReadImage( std::string fileName , Image32& img )
 	{
 		FILE *fp;
@@ -1,7 +1,9 @@
 #ifndef BMP_INCLUDED
 #define BMP_INCLUDED
 
+#include <vector>
 #include "image.h"
+#include "codec.h"
 
 namespace Image
 {
@@ -14,5 +16,67 @@ namespace Image
 	void BMPWriteImage( const Image32& img , std::string fileName );
 	/** This function writes out a BMP file, returning 0 on failure.*/
 	void BMPWriteImage( const Image32& img , FILE *fp );
+
+	/** This class reads in a BMP file a row at a time, seeking to each row, as the rows are stored from the bottom up */
+	class BMPImageReader : public ImageReader
+	{
+		/** The file being read */
+		FILE *_fp;
+
+		/** The position of the pixels in the file */
+		long _offset;
+
+		/** The dimensions and the (padded) length of a line in the file */
+		int _width , _height , _lineLength;
+
+		/** The number of rows read */
+		int _rows;
+
+		/** The bytes of a line */
+		std::vector< unsigned char > _line;
+	public:
+		/** The constructor reads the header of the file, which must be seekable */
+		BMPImageReader( FILE *fp );
+
+		int width( void ) const { return _width; }
+		int height( void ) const { return _height; }
+		void readRow( Pixel32 *row );
+	};
+
+	/** This class writes out a BMP file a row at a time, seeking to the line of each row, as the rows are stored from the bottom up */
+	class BMPImageWriter : public ImageWriter
+	{
+		/** The file being written */
+		FILE *_fp;
+
+		/** The position of the pixels in the file */
+		long _offset;
+
+		/** The dimensions and the (padded) length of a line in the file */
+		int _width , _height , _lineLength;
+
+		/** The number of rows written */
+		int _rows;
+
+		/** The bytes of a line */
+		std::vector< unsigned char > _line;
+	public:
+		/** The constructor writes out the header, so the file must be seekable */
+		BMPImageWriter( FILE *fp , int width , int height );
+
+		void writeRow( const Pixel32 *row );
+	};
+
+	/** The codec of BMP files, which are streamed when the file is seekable, and otherwise read and written as a whole */
+	class BMPImageCodec : public ImageCodec
+	{
+	public:
+		const char *extensions( void ) const { return "bmp"; }
+		bool sniff( const unsigned char *header , size_t size ) const { return size>=2 && header[0]=='B' && header[1]=='M'; }
+		ImageReader *newReader( FILE *fp ) const;
+		ImageWriter *newWriter( FILE *fp , int width , int height ) const;
+		double read( FILE *fp , Image32& img , double scale=1. ) const { BMPReadImage( fp , img ) ; return 1.; }
+		void write( const Image32& img , FILE *fp ) const { BMPWriteImage( img , fp ); }
+	};
 }
 #endif // BMP_INCLUDED
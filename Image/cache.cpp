@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#ifdef WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#include <sys/utime.h>
+#else // !WIN32
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#endif // WIN32
+#include "Util/exceptions.h"
+#include "cache.h"
+
+using namespace Util;
+using namespace Image;
+
+namespace
+{
+	const char _Extension[] = ".qoi";
+
+	/** This function returns the names of the files in the directory */
+	std::vector< std::string > _ListDirectory( const std::string &directory )
+	{
+		std::vector< std::string > fileNames;
+#ifdef WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE handle = FindFirstFileA( ( directory + "/*" ).c_str() , &data );
+		if( handle!=INVALID_HANDLE_VALUE )
+		{
+			do if( !( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) ) fileNames.push_back( data.cFileName );
+			while( FindNextFileA( handle , &data ) );
+			FindClose( handle );
+		}
+#else // !WIN32
+		DIR *dir = opendir( directory.c_str() );
+		if( dir )
+		{
+			for( struct dirent *entry=readdir( dir ) ; entry ; entry=readdir( dir ) ) fileNames.push_back( entry->d_name );
+			closedir( dir );
+		}
+#endif // WIN32
+		return fileNames;
+	}
+
+	/** This function creates the directory, if it does not exist */
+	void _MakeDirectory( const std::string &directory )
+	{
+#ifdef WIN32
+		int result = _mkdir( directory.c_str() );
+#else // !WIN32
+		int result = mkdir( directory.c_str() , 0755 );
+#endif // WIN32
+		if( result && errno!=EEXIST ) THROW( "Failed to create directory: %s" , directory.c_str() );
+	}
+
+	/** This function returns a name for a temporary file that is distinct across the processes and threads writing to the cache */
+	std::string _TemporaryName( void )
+	{
+		static std::atomic< unsigned int > count( 0 );
+#ifdef WIN32
+		long long pid = _getpid();
+#else // !WIN32
+		long long pid = getpid();
+#endif // WIN32
+		return std::to_string( pid ) + "." + std::to_string( (unsigned long long)std::hash< std::thread::id >()( std::this_thread::get_id() ) ) + "." + std::to_string( count++ );
+	}
+}
+
+////////////////
+// ImageCache //
+////////////////
+ImageCache::ImageCache( std::string directory , long long capacity ) : _directory(directory) , _capacity(capacity) , _size(0) , _used(0) , _hits(0) , _stores(0)
+{
+	_MakeDirectory( _directory );
+
+	// Order the cached files by modification time, removing temporary files left behind
+	std::vector< std::pair< time_t , std::string > > files;
+	for( const std::string &fileName : _ListDirectory( _directory ) )
+	{
+		size_t length = fileName.size() , extension = sizeof(_Extension)-1;
+		if( length<=extension || fileName.compare( length-extension , extension , _Extension ) ) continue;
+		std::string key = fileName.substr( 0 , length-extension );
+		struct stat info;
+		if( stat( ( _directory + "/" + fileName ).c_str() , &info ) ) continue;
+		if( key.find( '.' )!=std::string::npos )
+		{
+			if( time( NULL )-info.st_mtime>60*60 ) remove( ( _directory + "/" + fileName ).c_str() );
+			continue;
+		}
+		files.push_back( std::make_pair( info.st_mtime , key ) );
+		_entries[key].size = (long long)info.st_size;
+		_size += (long long)info.st_size;
+	}
+	std::sort( files.begin() , files.end() );
+	for( size_t i=0 ; i<files.size() ; i++ ) _entries[ files[i].second ].used = _used++;
+
+	std::lock_guard< std::mutex > lock( _mutex );
+	_evict();
+}
+
+std::string ImageCache::_fileName( const std::string &key ) const { return _directory + "/" + key + _Extension; }
+
+void ImageCache::_evict( void )
+{
+	while( _size>_capacity && _entries.size() )
+	{
+		auto oldest = _entries.begin();
+		for( auto iter=_entries.begin() ; iter!=_entries.end() ; iter++ ) if( iter->second.used<oldest->second.used ) oldest = iter;
+		remove( _fileName( oldest->first ).c_str() );
+		_size -= oldest->second.size;
+		_entries.erase( oldest );
+	}
+}
+
+bool ImageCache::load( const std::string &key , Image32 &image )
+{
+	// The file may have been written, or removed, by another process
+	std::string fileName = _fileName( key );
+	struct stat info;
+	if( stat( fileName.c_str() , &info ) ) return false;
+	Image32 cached;
+	try{ cached.read( fileName ); }
+	catch( const std::exception & ){ return false; }
+	image = std::move( cached );
+	utime( fileName.c_str() , NULL );
+
+	std::lock_guard< std::mutex > lock( _mutex );
+	auto iter = _entries.find( key );
+	if( iter==_entries.end() )
+	{
+		iter = _entries.insert( std::make_pair( key , _Entry() ) ).first;
+		iter->second.size = (long long)info.st_size;
+		_size += (long long)info.st_size;
+	}
+	iter->second.used = _used++;
+	_hits++;
+	_evict();
+	return true;
+}
+
+void ImageCache::store( const std::string &key , const Image32 &image )
+{
+	std::string fileName = _fileName( key ) , temporary = _directory + "/" + key + "." + _TemporaryName() + _Extension;
+	try{ image.write( temporary ); }
+	catch( const std::exception & ){ remove( temporary.c_str() ) ; return; }
+	struct stat info;
+	if( stat( temporary.c_str() , &info ) ){ remove( temporary.c_str() ) ; return; }
+#ifdef WIN32
+	remove( fileName.c_str() );
+#endif // WIN32
+	if( rename( temporary.c_str() , fileName.c_str() ) ){ remove( temporary.c_str() ) ; return; }
+
+	std::lock_guard< std::mutex > lock( _mutex );
+	_Entry &entry = _entries[key];
+	_size += (long long)info.st_size - entry.size;
+	entry.size = (long long)info.st_size;
+	entry.used = _used++;
+	_stores++;
+	_evict();
+}
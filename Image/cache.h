@@ -0,0 +1,68 @@
+#ifndef CACHE_INCLUDED
+#define CACHE_INCLUDED
+
+#include <string>
+#include <map>
+#include <mutex>
+#include "image.h"
+
+namespace Image
+{
+	/** This class is a cache of images in a directory on the local disk, keyed by (hexadecimal) digests, with each image stored as a (lossless) QOI file.
+	*** When the files exceed the capacity, the least recently used ones are removed. The recency of a file is its modification time, which is updated
+	*** whenever it is loaded, so the order carries over between the processes sharing the directory. Files are written under a temporary name and then
+	*** renamed, so a process never loads a partly written file. */
+	class ImageCache
+	{
+		/** This structure describes a cached file */
+		struct _Entry
+		{
+			/** The size of the file, in bytes */
+			long long size;
+
+			/** The order in which the file was last used */
+			long long used;
+		};
+
+		/** The directory holding the files */
+		std::string _directory;
+
+		/** The maximum number of bytes held by the files */
+		long long _capacity;
+
+		/** The cached files, by key, their total size, and the last use */
+		std::map< std::string , _Entry > _entries;
+		long long _size , _used;
+
+		/** The number of images loaded and stored */
+		long long _hits , _stores;
+
+		/** The lock guarding the entries */
+		std::mutex _mutex;
+
+		/** This method returns the name of the file holding the image with the prescribed key */
+		std::string _fileName( const std::string &key ) const;
+
+		/** This method removes the least recently used files until the total size is within the capacity. The lock must be held. */
+		void _evict( void );
+	public:
+		/** The constructor opens the cache in the directory, creating it if needed, and removes the least recently used files beyond the capacity (in bytes) */
+		ImageCache( std::string directory , long long capacity );
+
+		ImageCache( const ImageCache & ) = delete;
+		ImageCache &operator = ( const ImageCache & ) = delete;
+
+		/** This method returns true, setting the image, if an image is cached with the prescribed key */
+		bool load( const std::string &key , Image32 &image );
+
+		/** This method caches the image with the prescribed key. Failures are ignored, as the image can always be computed again. */
+		void store( const std::string &key , const Image32 &image );
+
+		/** This method returns the number of images loaded */
+		long long hits( void ) const { return _hits; }
+
+		/** This method returns the number of images stored */
+		long long stores( void ) const { return _stores; }
+	};
+}
+#endif // CACHE_INCLUDED
@@ -0,0 +1,320 @@
+#include <string.h>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif // WIN32
+#include <Util/cmdLineParser.h>
+#include <Util/exceptions.h>
+#include <Util/profiler.h>
+#include "codec.h"
+#include "bmp.h"
+#include "jpeg.h"
+#include "png.h"
+#include "ppm.h"
+#include "qoi.h"
+
+using namespace Util;
+
+namespace Image
+{
+	////////////////
+	// ImageCodec //
+	////////////////
+	double ImageCodec::read( FILE *fp , Image32& img , double scale ) const
+	{
+		ImageReader *reader = newReader( fp );
+		try{ ReadImage( *reader , img ); }
+		catch( ... ){ delete reader ; throw; }
+		delete reader;
+		return 1.;
+	}
+
+	void ImageCodec::write( const Image32& img , FILE *fp ) const
+	{
+		ImageWriter *writer = newWriter( fp , img.width() , img.height() );
+		try{ WriteImage( img , *writer ); }
+		catch( ... ){ delete writer ; throw; }
+		delete writer;
+	}
+
+	/////////////////////////
+	// BufferedImageReader //
+	/////////////////////////
+	BufferedImageReader::BufferedImageReader( FILE *fp , const ImageCodec &codec ) : _rows(0) { codec.read( fp , _img ); }
+
+	void BufferedImageReader::readRow( Pixel32 *row )
+	{
+		if( _rows==_img.height() ) THROW( "All %d rows have been read" , _img.height() );
+		memcpy( row , _img.row( _rows++ ) , sizeof(Pixel32)*_img.width() );
+	}
+
+	/////////////////////////
+	// BufferedImageWriter //
+	/////////////////////////
+	BufferedImageWriter::BufferedImageWriter( FILE *fp , int width , int height , const ImageCodec &codec ) : _fp(fp) , _codec(codec) , _rows(0)
+	{
+		if( width<=0 || height<=0 ) THROW( "Bad image dimensions: %d x %d" , width , height );
+		_img.setSize( width , height );
+	}
+
+	void BufferedImageWriter::writeRow( const Pixel32 *row )
+	{
+		if( _rows==_img.height() ) THROW( "All %d rows have been written" , _img.height() );
+		memcpy( _img.row( _rows++ ) , row , sizeof(Pixel32)*_img.width() );
+		if( _rows==_img.height() ) _codec.write( _img , _fp );
+	}
+
+	//////////////
+	// Registry //
+	//////////////
+	/** This class holds the registered codecs: the factories, indexed by the name of the format, and the codecs they created, most recently registered first */
+	class _ImageCodecRegistry
+	{
+		std::unordered_map< std::string , BaseFactory< ImageCodec > * > _factories;
+	public:
+		std::vector< std::pair< std::string , const ImageCodec * > > codecs;
+
+		/** The constructor registers the built-in codecs, from the lowest to the highest precedence */
+		_ImageCodecRegistry( void )
+		{
+			add( "QOI" , new DerivedFactory< ImageCodec , QOIImageCodec >() );
+			add( "PAM" , new DerivedFactory< ImageCodec , PAMImageCodec >() );
+			add( "PGM" , new DerivedFactory< ImageCodec , PGMImageCodec >() );
+			add( "PPM" , new DerivedFactory< ImageCodec , PPMImageCodec >() );
+			add( "PNG" , new DerivedFactory< ImageCodec , PNGImageCodec >() );
+			add( "JPEG" , new DerivedFactory< ImageCodec , JPEGImageCodec >() );
+			add( "BMP" , new DerivedFactory< ImageCodec , BMPImageCodec >() );
+		}
+
+		/** The destructor deletes the factories, which delete the codecs they created */
+		~_ImageCodecRegistry( void ){ for( auto &f : _factories ) delete f.second; }
+
+		/** This method registers the codec created by the factory, replacing the one registered under the same name */
+		void add( const std::string &name , BaseFactory< ImageCodec > *factory )
+		{
+			auto iter = _factories.find( name );
+			if( iter!=_factories.end() )
+			{
+				for( size_t i=0 ; i<codecs.size() ; i++ ) if( codecs[i].first==name ){ codecs.erase( codecs.begin()+i ) ; break; }
+				delete iter->second;
+			}
+			_factories[name] = factory;
+			codecs.insert( codecs.begin() , std::make_pair( name , factory->create() ) );
+		}
+	};
+
+	/** This function returns the registry, creating it (with the built-in codecs) on first use */
+	static _ImageCodecRegistry &_Registry( void )
+	{
+		static _ImageCodecRegistry registry;
+		return registry;
+	}
+
+	void RegisterImageCodec( std::string name , BaseFactory< ImageCodec > *factory )
+	{
+		if( !factory ) THROW( "No factory for image codec: %s" , name.c_str() );
+		_Registry().add( name , factory );
+	}
+
+	const ImageCodec *ImageCodecFromName( std::string name )
+	{
+		for( const auto &codec : _Registry().codecs ) if( codec.first==name ) return codec.second;
+		return NULL;
+	}
+
+	const ImageCodec *ImageCodecFromExtension( std::string ext )
+	{
+		ext = ToLower( ext );
+		for( const auto &codec : _Registry().codecs )
+		{
+			std::stringstream extensions( codec.second->extensions() );
+			std::string e;
+			while( extensions >> e ) if( e==ext ) return codec.second;
+		}
+		return NULL;
+	}
+
+	const ImageCodec *ImageCodecFromMagic( const unsigned char *header , size_t size )
+	{
+		for( const auto &codec : _Registry().codecs ) if( codec.second->sniff( header , size ) ) return codec.second;
+		return NULL;
+	}
+
+	const ImageCodec &ImageCodecForWriting( std::string &fileName )
+	{
+		const ImageCodec *codec;
+		std::string ext;
+		if( fileName=="-" ) codec = ImageCodecFromName( "PNG" ) , ext = "png";
+		else if( fileName.size()>2 && fileName.compare( fileName.size()-2 , 2 , ":-" )==0 )
+		{
+			ext = fileName.substr( 0 , fileName.size()-2 );
+			codec = ImageCodecFromExtension( ext );
+			fileName = "-";
+		}
+		else codec = ImageCodecFromExtension( ext = GetFileExtension( fileName ) );
+		if( !codec ) THROW( "Unrecognized file extension: %s" , ext.c_str() );
+		return *codec;
+	}
+
+	/////////////////////////
+	// Reading and writing //
+	/////////////////////////
+	/** This function switches the standard input or output to binary mode (which only matters on Windows) */
+	static void _SetBinary( FILE *fp )
+	{
+#ifdef WIN32
+		_setmode( _fileno( fp ) , _O_BINARY );
+#endif // WIN32
+	}
+
+	/** This function opens the contents of the buffer, which must outlive the file, for reading */
+	static FILE *_OpenBuffer( std::vector< unsigned char > &buffer )
+	{
+#ifdef WIN32
+		FILE *fp = tmpfile();
+		if( fp && ( fwrite( &buffer[0] , 1 , buffer.size() , fp )!=buffer.size() || fseek( fp , 0 , SEEK_SET ) ) ) fclose( fp ) , fp = NULL;
+#else // !WIN32
+		FILE *fp = fmemopen( &buffer[0] , buffer.size() , "rb" );
+#endif // WIN32
+		if( !fp ) THROW( "Failed to open buffered input" );
+		return fp;
+	}
+
+	////////////////////
+	// ImageInputFile //
+	////////////////////
+	ImageInputFile::ImageInputFile( std::string fileName ) : _codec(NULL)
+	{
+		bool standardInput = fileName=="-";
+		_file = _fp = standardInput ? stdin : fopen( fileName.c_str() , "rb" );
+		if( !_file ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
+		if( standardInput ) _SetBinary( _file ) , fileName = "standard input";
+
+		try
+		{
+			// Identify the format from the first bytes, reading a pipe into memory so that the bytes can be read again
+			unsigned char header[ ImageCodecMagicSize ];
+			size_t size;
+			if( ftell( _file )<0 )
+			{
+				size_t read = 0;
+				do
+				{
+					_buffer.resize( std::max< size_t >( 2*_buffer.size() , 1<<16 ) );
+					read += fread( &_buffer[read] , 1 , _buffer.size()-read , _file );
+				}
+				while( read==_buffer.size() );
+				_buffer.resize( read );
+				size = std::min< size_t >( read , ImageCodecMagicSize );
+				if( size ) memcpy( header , &_buffer[0] , size );
+			}
+			else
+			{
+				size = fread( header , 1 , ImageCodecMagicSize , _file );
+				if( fseek( _file , -(long)size , SEEK_CUR ) ) THROW( "Failed to rewind file: %s" , fileName.c_str() );
+			}
+
+			_codec = ImageCodecFromMagic( header , size );
+			if( !_codec && !standardInput ) _codec = ImageCodecFromExtension( GetFileExtension( fileName ) );
+			if( !_codec ) THROW( "Unrecognized image format: %s" , fileName.c_str() );
+			if( _buffer.size() ) _fp = _OpenBuffer( _buffer );
+		}
+		catch( ... )
+		{
+			_close();
+			throw;
+		}
+	}
+
+	ImageInputFile::~ImageInputFile( void ){ _close(); }
+
+	void ImageInputFile::_close( void )
+	{
+		if( _fp!=_file ) fclose( _fp );
+		if( _file!=stdin ) fclose( _file );
+		_fp = _file = NULL;
+	}
+
+	/////////////////////
+	// ImageOutputFile //
+	/////////////////////
+	ImageOutputFile::ImageOutputFile( std::string fileName )
+	{
+		bool standardOutput = fileName=="-";
+		_fp = standardOutput ? stdout : fopen( fileName.c_str() , "wb" );
+		if( !_fp ) THROW( "Failed to open file for writing: %s" , fileName.c_str() );
+		if( standardOutput ) _SetBinary( _fp );
+	}
+
+	ImageOutputFile::~ImageOutputFile( void )
+	{
+		if( _fp==stdout ) fflush( _fp );
+		else fclose( _fp );
+	}
+
+	/////////////////////
+	// ImageFileReader //
+	/////////////////////
+	ImageFileReader::ImageFileReader( std::string fileName ) : _file( fileName ) { _reader = _file.codec().newReader( _file.fp() ); }
+
+	ImageFileReader::~ImageFileReader( void ){ delete _reader; }
+
+	/////////////////////
+	// ImageFileWriter //
+	/////////////////////
+	ImageFileWriter::ImageFileWriter( std::string fileName , int width , int height , const ImageCodec *codec ) : _file(NULL) , _writer(NULL)
+	{
+		if( !codec ) codec = &ImageCodecForWriting( fileName );
+		_file = new ImageOutputFile( fileName );
+		try{ _writer = codec->newWriter( _file->fp() , width , height ); }
+		catch( ... )
+		{
+			delete _file;
+			throw;
+		}
+	}
+
+	ImageFileWriter::~ImageFileWriter( void )
+	{
+		delete _writer;
+		delete _file;
+	}
+
+	void ReadImage( ImageReader &reader , Image32& img )
+	{
+		img.setSize( reader.width() , reader.height() );
+		for( int j=0 ; j<img.height() ; j++ ) reader.readRow( img.row(j) );
+	}
+
+	void WriteImage( const Image32& img , ImageWriter &writer )
+	{
+		for( int j=0 ; j<img.height() ; j++ ) writer.writeRow( img.row(j) );
+	}
+
+	double ReadImage( std::string fileName , Image32& img , double scale )
+	{
+		ProfileScope scope( "read" , "codec" , fileName.c_str() );
+		ImageInputFile file( fileName );
+		double s = file.codec().read( file.fp() , img , scale );
+		Profiler::Count( "pixels decoded" , (double)img.width()*img.height() );
+		return s;
+	}
+
+	void WriteImage( const Image32& img , std::string fileName , const ImageCodec &codec )
+	{
+		ProfileScope scope( "write" , "codec" , fileName.c_str() );
+		ImageOutputFile file( fileName );
+		codec.write( img , file.fp() );
+		Profiler::Count( "pixels encoded" , (double)img.width()*img.height() );
+	}
+
+	void WriteImage( const Image32& img , std::string fileName )
+	{
+		const ImageCodec &codec = ImageCodecForWriting( fileName );
+		WriteImage( img , fileName , codec );
+	}
+}
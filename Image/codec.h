@@ -0,0 +1,238 @@
+#ifndef CODEC_INCLUDED
+#define CODEC_INCLUDED
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <Util/factory.h>
+#include "image.h"
+
+namespace Image
+{
+	/** This class is the interface of a streaming image decoder, which hands out the image a row at a time, from the top down.
+	*** The dimensions are known once the reader has been constructed (and the header parsed). */
+	class ImageReader
+	{
+	public:
+		virtual ~ImageReader( void ){}
+
+		/** This method returns the width of the image */
+		virtual int width( void ) const = 0;
+
+		/** This method returns the height of the image */
+		virtual int height( void ) const = 0;
+
+		/** This method decodes the next row of the image into the array of width() pixels.
+		*** An exception is thrown if the data is corrupt or all the rows have been read. */
+		virtual void readRow( Pixel32 *row ) = 0;
+	};
+
+	/** This class is the interface of a streaming image encoder, which is handed the image a row at a time, from the top down.
+	*** The dimensions are given to the writer when it is constructed, and the file is completed when the last row is written. */
+	class ImageWriter
+	{
+	public:
+		virtual ~ImageWriter( void ){}
+
+		/** This method encodes the next row of the image from the array of pixels.
+		*** An exception is thrown if the data cannot be written or all the rows have been written. */
+		virtual void writeRow( const Pixel32 *row ) = 0;
+	};
+
+	/** This class describes an image file format, creating the streaming readers and writers of its files.
+	*** The codecs are kept in a registry, indexed by the name of the format, with each codec created by a factory (see RegisterImageCodec). */
+	class ImageCodec
+	{
+	public:
+		virtual ~ImageCodec( void ){}
+
+		/** This method returns the (lower-case, space-separated) file extensions of the format */
+		virtual const char *extensions( void ) const = 0;
+
+		/** This method returns true if the first bytes of a file (at most ImageCodecMagicSize of them) identify the format.
+		*** By default, the format is only identified by the extension. */
+		virtual bool sniff( const unsigned char *header , size_t size ) const { return false; }
+
+		/** This method creates a reader for the file, positioned at its start */
+		virtual ImageReader *newReader( FILE *fp ) const = 0;
+
+		/** This method creates a writer of an image with the prescribed dimensions to the file */
+		virtual ImageWriter *newWriter( FILE *fp , int width , int height ) const = 0;
+
+		/** This method reads in the whole image, returning the factor by which the image was reduced while decoding (see JPEGReadImage).
+		*** By default, the image is read a row at a time and not reduced. */
+		virtual double read( FILE *fp , Image32& img , double scale=1. ) const;
+
+		/** This method writes out the whole image, by default a row at a time */
+		virtual void write( const Image32& img , FILE *fp ) const;
+	};
+
+	/** This class adapts a codec that reads in whole images (by overriding ImageCodec::read) to the streaming interface */
+	class BufferedImageReader : public ImageReader
+	{
+		/** The image read in and the number of rows handed out */
+		Image32 _img;
+		int _rows;
+	public:
+		/** The constructor reads in the whole image */
+		BufferedImageReader( FILE *fp , const ImageCodec &codec );
+
+		int width( void ) const { return _img.width(); }
+		int height( void ) const { return _img.height(); }
+		void readRow( Pixel32 *row );
+	};
+
+	/** This class adapts a codec that writes out whole images (by overriding ImageCodec::write) to the streaming interface */
+	class BufferedImageWriter : public ImageWriter
+	{
+		/** The file being written and the codec writing it */
+		FILE *_fp;
+		const ImageCodec &_codec;
+
+		/** The image and the number of rows written into it */
+		Image32 _img;
+		int _rows;
+	public:
+		/** The constructor allocates the image, which is written out when its last row is */
+		BufferedImageWriter( FILE *fp , int width , int height , const ImageCodec &codec );
+
+		void writeRow( const Pixel32 *row );
+	};
+
+	/** The number of bytes at the start of a file that are used to identify its format */
+	const size_t ImageCodecMagicSize = 16;
+
+	/** This function registers the codec created by the factory under the name of the format, taking ownership of the factory.
+	*** A codec registered under an existing name replaces it, and the extensions and magic bytes of the most recently registered codecs take precedence.
+	*** The built-in codecs (BMP, JPEG, PNG, PPM, PGM, PAM, and QOI) are registered first. Registration is not thread-safe. */
+	void RegisterImageCodec( std::string name , Util::BaseFactory< ImageCodec > *factory );
+
+	/** This function registers a (default-constructible) codec under the name of the format */
+	template< typename Codec >
+	void RegisterImageCodec( std::string name ){ RegisterImageCodec( name , new Util::DerivedFactory< ImageCodec , Codec >() ); }
+
+	/** This function returns the codec registered under the name of the format, or NULL if there is none */
+	const ImageCodec *ImageCodecFromName( std::string name );
+
+	/** This function returns the codec for the file extension, or NULL if there is none */
+	const ImageCodec *ImageCodecFromExtension( std::string ext );
+
+	/** This function returns the codec identified by the first bytes of a file, or NULL if there is none */
+	const ImageCodec *ImageCodecFromMagic( const unsigned char *header , size_t size );
+
+	/** This function returns the codec for writing out the file, chosen by the file's extension.
+	*** A file name of the form "<ext>:-" stands for the standard output in the format with that extension, and is replaced by "-",
+	*** while "-" alone stands for the standard output in PNG format. An exception is thrown if there is no codec for the extension. */
+	const ImageCodec &ImageCodecForWriting( std::string &fileName );
+
+	/** This class opens an image file, or the standard input if the file name is "-", for reading, choosing the codec by the file's first bytes and falling back to its extension.
+	*** As the start of a pipe cannot be read twice, a pipe is read into memory. */
+	class ImageInputFile
+	{
+		/** The file opened, the stream the codec reads (which differs from the file if it was read into memory), and the contents read into memory */
+		FILE *_file , *_fp;
+		std::vector< unsigned char > _buffer;
+
+		/** The codec of the file */
+		const ImageCodec *_codec;
+
+		/** This method closes the streams */
+		void _close( void );
+	public:
+		/** The constructor opens the file and identifies its format */
+		ImageInputFile( std::string fileName );
+
+		/** The destructor closes the file (but not the standard input) */
+		~ImageInputFile( void );
+
+		ImageInputFile( const ImageInputFile& ) = delete;
+		ImageInputFile& operator = ( const ImageInputFile& ) = delete;
+
+		/** This method returns the stream to read, positioned at the start of the file */
+		FILE *fp( void ) const { return _fp; }
+
+		/** This method returns the codec of the file */
+		const ImageCodec &codec( void ) const { return *_codec; }
+	};
+
+	/** This class opens an image file, or the standard output if the file name is "-", for writing */
+	class ImageOutputFile
+	{
+		/** The file opened */
+		FILE *_fp;
+	public:
+		/** The constructor opens the file */
+		ImageOutputFile( std::string fileName );
+
+		/** The destructor closes the file (or flushes the standard output) */
+		~ImageOutputFile( void );
+
+		ImageOutputFile( const ImageOutputFile& ) = delete;
+		ImageOutputFile& operator = ( const ImageOutputFile& ) = delete;
+
+		/** This method returns the stream to write */
+		FILE *fp( void ) const { return _fp; }
+	};
+
+	/** This class reads an image file (see ImageInputFile) a row at a time */
+	class ImageFileReader : public ImageReader
+	{
+		ImageInputFile _file;
+		ImageReader *_reader;
+	public:
+		/** The constructor opens the file and reads its header */
+		ImageFileReader( std::string fileName );
+
+		/** The destructor frees the reader and closes the file */
+		~ImageFileReader( void );
+
+		ImageFileReader( const ImageFileReader& ) = delete;
+		ImageFileReader& operator = ( const ImageFileReader& ) = delete;
+
+		/** This method returns true if the codec reads in the whole image rather than streaming it (see BufferedImageReader) */
+		bool buffered( void ) const { return dynamic_cast< const BufferedImageReader * >( _reader )!=NULL; }
+
+		int width( void ) const { return _reader->width(); }
+		int height( void ) const { return _reader->height(); }
+		void readRow( Pixel32 *row ){ _reader->readRow( row ); }
+	};
+
+	/** This class writes an image file (see ImageOutputFile) a row at a time, with the prescribed codec or the codec for the file name (see ImageCodecForWriting) */
+	class ImageFileWriter : public ImageWriter
+	{
+		ImageOutputFile *_file;
+		ImageWriter *_writer;
+	public:
+		/** The constructor opens the file and starts the image */
+		ImageFileWriter( std::string fileName , int width , int height , const ImageCodec *codec=NULL );
+
+		/** The destructor frees the writer and closes the file */
+		~ImageFileWriter( void );
+
+		ImageFileWriter( const ImageFileWriter& ) = delete;
+		ImageFileWriter& operator = ( const ImageFileWriter& ) = delete;
+
+		/** This method returns true if the codec writes out the whole image rather than streaming it (see BufferedImageWriter) */
+		bool buffered( void ) const { return dynamic_cast< const BufferedImageWriter * >( _writer )!=NULL; }
+
+		void writeRow( const Pixel32 *row ){ _writer->writeRow( row ); }
+	};
+
+	/** This function reads all the rows of the reader into the image */
+	void ReadImage( ImageReader &reader , Image32& img );
+
+	/** This function writes all the rows of the image to the writer */
+	void WriteImage( const Image32& img , ImageWriter &writer );
+
+	/** This function reads in an image file, or the standard input if the file name is "-", choosing the codec by the file's first bytes and falling back to its extension.
+	*** It returns the factor by which the image was reduced while decoding (see ImageCodec::read).
+	*** As the start of a pipe cannot be read twice, a pipe is read into memory before it is decoded. */
+	double ReadImage( std::string fileName , Image32& img , double scale=1. );
+
+	/** This function writes out an image file, or the standard output if the file name is "-", with the codec */
+	void WriteImage( const Image32& img , std::string fileName , const ImageCodec &codec );
+
+	/** This function writes out an image file, or the standard output, with the codec for the file name (see ImageCodecForWriting) */
+	void WriteImage( const Image32& img , std::string fileName );
+}
+#endif // CODEC_INCLUDED
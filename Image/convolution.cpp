@@ -0,0 +1,403 @@
+#include <math.h>
+#include <fstream>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include <Util/parallel.h>
+#include <Util/profiler.h>
+#include <Util/fft.h>
+#include <SVD/SVD.h>
+#include "convolution.h"
+
+using namespace Util;
+using namespace Image;
+
+////////////
+// Kernel //
+////////////
+Kernel::Kernel( void ) : _width(0) , _height(0) {}
+
+Kernel::Kernel( int width , int height ) : _width(width) , _height(height)
+{
+	if( width<=0 || height<=0 ) THROW( "Kernel dimensions must be positive: %d x %d" , width , height );
+	_values.resize( (size_t)width*height , 0 );
+}
+
+int Kernel::width( void ) const { return _width; }
+
+int Kernel::height( void ) const { return _height; }
+
+double& Kernel::operator() ( int x , int y )
+{
+	if( x<0 || x>=_width || y<0 || y>=_height ) THROW( "Kernel index out of range: ( %d , %d ) not in [ 0 , %d ) x [ 0 , %d )" , x , y , _width , _height );
+	return _values[ (size_t)y*_width + x ];
+}
+
+const double& Kernel::operator() ( int x , int y ) const
+{
+	if( x<0 || x>=_width || y<0 || y>=_height ) THROW( "Kernel index out of range: ( %d , %d ) not in [ 0 , %d ) x [ 0 , %d )" , x , y , _width , _height );
+	return _values[ (size_t)y*_width + x ];
+}
+
+double Kernel::sum( void ) const
+{
+	double s = 0;
+	for( size_t i=0 ; i<_values.size() ; i++ ) s += _values[i];
+	return s;
+}
+
+void Kernel::normalize( void )
+{
+	double s = sum();
+	if( s ) for( size_t i=0 ; i<_values.size() ; i++ ) _values[i] /= s;
+}
+
+bool Kernel::separable( std::vector< double > &horizontal , std::vector< double > &vertical , double epsilon ) const
+{
+	if( !_width || !_height ) return false;
+	horizontal.resize( _width ) , vertical.resize( _height );
+	if( _width==1 || _height==1 )
+	{
+		for( int x=0 ; x<_width ; x++ ) horizontal[x] = _height==1 ? (*this)(x,0) : 1.;
+		for( int y=0 ; y<_height ; y++ ) vertical[y] = _height==1 ? 1. : (*this)(0,y);
+		return true;
+	}
+
+	// The kernel is the (height x width) matrix K = U W V^t, and it is separable if K = w_0 u_0 v_0^t
+	int m = _height , n = _width , mn = std::min< int >( m , n ) , mx = std::max< int >( m , n );
+	std::vector< double > u( (size_t)m*mx ) , w( mx ) , vt( (size_t)mx*n );
+	num_svd( &_values[0] , m , n , &u[0] , &w[0] , &vt[0] );
+	double w0 = fabs( w[0] );
+	for( int i=1 ; i<mn ; i++ ) if( fabs( w[i] )>epsilon*w0 ) return false;
+
+	double s = sqrt( w0 ) , sign = w[0]<0 ? -1. : 1.;
+	for( int y=0 ; y<m ; y++ ) vertical[y] = u[ (size_t)y*mn ] * s * sign;
+	for( int x=0 ; x<n ; x++ ) horizontal[x] = vt[x] * s;
+	return true;
+}
+
+void Kernel::read( std::string fileName )
+{
+	std::ifstream istream;
+	istream.open( fileName );
+	if( !istream ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
+	istream >> *this;
+}
+
+Kernel Kernel::Gaussian( double sigma , int radius )
+{
+	if( sigma<=0 ) THROW( "Standard deviation must be positive: %g" , sigma );
+	if( radius<0 ) THROW( "Radius must be non-negative: %d" , radius );
+	Kernel kernel( 2*radius+1 , 2*radius+1 );
+	for( int y=-radius ; y<=radius ; y++ ) for( int x=-radius ; x<=radius ; x++ ) kernel( x+radius , y+radius ) = exp( -( x*x + y*y ) / ( 2.*sigma*sigma ) );
+	kernel.normalize();
+	return kernel;
+}
+
+namespace Image
+{
+	std::ostream &operator << ( std::ostream &stream , const Kernel &kernel )
+	{
+		stream << kernel.width() << " " << kernel.height() << std::endl;
+		for( int y=0 ; y<kernel.height() ; y++ )
+		{
+			for( int x=0 ; x<kernel.width() ; x++ ) stream << " " << kernel(x,y);
+			stream << std::endl;
+		}
+		return stream;
+	}
+
+	std::istream &operator >> ( std::istream &stream , Kernel &kernel )
+	{
+		int width , height;
+		if( !( stream >> width >> height ) ) THROW( "Failed to read kernel dimensions" );
+		kernel = Kernel( width , height );
+		for( int y=0 ; y<height ; y++ ) for( int x=0 ; x<width ; x++ ) if( !( stream >> kernel(x,y) ) ) THROW( "Failed to read kernel value: ( %d , %d )" , x , y );
+		return stream;
+	}
+}
+
+///////////////////////
+// ConvolutionMethod //
+///////////////////////
+const char *ConvolutionMethod::Names[] = { "auto" , "direct" , "separable" , "fft" };
+
+// Non-separable kernels with more taps than this are convolved in the frequency domain when the method is AUTO
+static const int FFTKernelSize = 15*15;
+
+int ConvolutionMethod::Parse( const std::string &name )
+{
+	for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+	THROW( "Unrecognized convolution method: %s" , name.c_str() );
+	return -1;
+}
+
+// Converts a row of pixels into interleaved RGB floats, padded with "left" and "right" copies of the end pixels
+static void _PadRow( const Pixel32 *pixels , int width , int left , int right , float *buffer )
+{
+	for( int i=-left ; i<width+right ; i++ )
+	{
+		const Pixel32 &p = pixels[ i<0 ? 0 : i>=width ? width-1 : i ];
+		buffer[0] = p.r , buffer[1] = p.g , buffer[2] = p.b;
+		buffer += 3;
+	}
+}
+
+// Writes out the interleaved RGB floats as a row of pixels, copying the alpha from the source row
+static void _UnpadRow( const float *buffer , const Pixel32 *source , int width , Pixel32 *pixels )
+{
+	auto Clamp = []( float v ){ return v<0.f ? (unsigned char)0 : v>254.5f ? (unsigned char)255 : (unsigned char)( v+0.5f ); };
+	for( int i=0 ; i<width ; i++ , buffer+=3 ) pixels[i].r = Clamp( buffer[0] ) , pixels[i].g = Clamp( buffer[1] ) , pixels[i].b = Clamp( buffer[2] ) , pixels[i].a = source[i].a;
+}
+
+// Iterates over the rows of the image, in parallel over bands of rows.
+// For each row j, the functor is passed the padded rows j-top through j+bottom (with clamping at the top and bottom of the image).
+// Each band keeps its own ring of padded rows, so every source row is converted only once per band.
+template< typename RowFunction >
+static void _ForEachPaddedRow( const Image32 &img , int top , int bottom , int left , int right , RowFunction F )
+{
+	const int width = img.width() , height = img.height() , BandSize = 32 , rowCount = top + bottom + 1;
+	const size_t rowSize = 3 * (size_t)( width + left + right );
+	auto Row = [&]( int j ){ return img.row( j<0 ? 0 : j>=height ? height-1 : j ); };
+
+	ParallelFor( 0 , ( height + BandSize - 1 ) / BandSize , [&]( unsigned int , size_t band )
+	{
+		std::vector< float > buffer( rowSize * rowCount );
+		std::vector< float * > rows( rowCount );
+		int start = (int)band * BandSize , end = std::min< int >( start+BandSize , height );
+		for( int y=0 ; y<rowCount ; y++ )
+		{
+			rows[y] = &buffer[ rowSize*y ];
+			_PadRow( Row( start-top+y ) , width , left , right , rows[y] );
+		}
+		for( int j=start ; j<end ; j++ )
+		{
+			if( j>start )
+			{
+				std::rotate( rows.begin() , rows.begin()+1 , rows.end() );
+				_PadRow( Row( j+bottom ) , width , left , right , rows[rowCount-1] );
+			}
+			F( j , (const float * const *)&rows[0] );
+		}
+	} );
+}
+
+/////////////
+// Image32 //
+/////////////
+Image32 Image32::convolve( const Kernel &kernel , int method ) const
+{
+	ProfileScope scope( "convolve" );
+	if( !kernel.width() || !kernel.height() ) THROW( "Empty kernel" );
+
+	std::vector< double > horizontal , vertical;
+	bool isSeparable = kernel.separable( horizontal , vertical );
+	if( method==ConvolutionMethod::AUTO )
+	{
+		if( isSeparable ) method = ConvolutionMethod::SEPARABLE;
+		else if( kernel.width()*kernel.height()>FFTKernelSize ) method = ConvolutionMethod::FFT;
+		else method = ConvolutionMethod::DIRECT;
+	}
+	if( method==ConvolutionMethod::FFT ) return convolveFFT( kernel );
+	if( method==ConvolutionMethod::SEPARABLE && !isSeparable ) THROW( "Kernel is not separable" );
+
+	Image32 img;
+	img.setSize( _width , _height );
+	if( !_width || !_height ) return img;
+
+	// Convolution is performed as a correlation with the flipped kernel, whose center is at ( kw-1-kw/2 , kh-1-kh/2 )
+	const int kw = kernel.width() , kh = kernel.height();
+	const int left = kw-1-kw/2 , right = kw/2 , top = kh-1-kh/2 , bottom = kh/2;
+	const int paddedWidth = _width + left + right;
+
+	switch( method )
+	{
+		case ConvolutionMethod::DIRECT:
+		{
+			std::vector< float > weights( (size_t)kw*kh );
+			for( int y=0 ; y<kh ; y++ ) for( int x=0 ; x<kw ; x++ ) weights[ (size_t)y*kw+x ] = (float)kernel( kw-1-x , kh-1-y );
+			_ForEachPaddedRow( *this , top , bottom , left , right , [&]( int j , const float * const *rows )
+			{
+				std::vector< float > sum( 3*_width , 0.f );
+				for( int y=0 ; y<kh ; y++ ) for( int x=0 ; x<kw ; x++ )
+				{
+					const float w = weights[ (size_t)y*kw+x ];
+					if( !w ) continue;
+					const float *r = rows[y] + 3*x;
+					for( int i=0 ; i<3*_width ; i++ ) sum[i] += w * r[i];
+				}
+				_UnpadRow( &sum[0] , row(j) , _width , img.row(j) );
+			} );
+			break;
+		}
+		case ConvolutionMethod::SEPARABLE:
+		{
+			std::vector< float > hWeights( kw ) , vWeights( kh );
+			for( int x=0 ; x<kw ; x++ ) hWeights[x] = (float)horizontal[kw-1-x];
+			for( int y=0 ; y<kh ; y++ ) vWeights[y] = (float)vertical[kh-1-y];
+			_ForEachPaddedRow( *this , top , bottom , left , right , [&]( int j , const float * const *rows )
+			{
+				// Filter the padded rows vertically and then filter the result horizontally
+				std::vector< float > column( 3*paddedWidth , 0.f ) , sum( 3*_width , 0.f );
+				for( int y=0 ; y<kh ; y++ )
+				{
+					const float w = vWeights[y];
+					const float *r = rows[y];
+					for( int i=0 ; i<3*paddedWidth ; i++ ) column[i] += w * r[i];
+				}
+				for( int x=0 ; x<kw ; x++ )
+				{
+					const float w = hWeights[x];
+					const float *c = &column[3*x];
+					for( int i=0 ; i<3*_width ; i++ ) sum[i] += w * c[i];
+				}
+				_UnpadRow( &sum[0] , row(j) , _width , img.row(j) );
+			} );
+			break;
+		}
+		default: THROW( "Unrecognized convolution method: %d" , method );
+	}
+	return img;
+}
+
+// Fills the (power-of-two sized) complex buffers with the red+i*green and blue channels of the region of the image starting at (x0,y0),
+// clamping the indices into the image.
+static void _Gather( const Image32 &img , int x0 , int y0 , int width , int height , std::complex< float > *rg , std::complex< float > *b , bool mirror )
+{
+	auto Index = [&]( int i , int size )
+	{
+		if( mirror )
+		{
+			if( i<0 ) i = -i-1;
+			if( i>=size ) i = 2*size-1-i;
+		}
+		return i<0 ? 0 : i>=size ? size-1 : i;
+	};
+	for( int y=0 ; y<height ; y++ )
+	{
+		const Pixel32 *pixels = img.row( Index( y0+y , img.height() ) );
+		for( int x=0 ; x<width ; x++ )
+		{
+			const Pixel32 &p = pixels[ Index( x0+x , img.width() ) ];
+			rg[ (size_t)y*width+x ] = std::complex< float >( p.r , p.g );
+			b [ (size_t)y*width+x ] = std::complex< float >( p.b , 0.f );
+		}
+	}
+}
+
+Image32 Image32::convolveFFT( const Kernel &kernel ) const
+{
+	ProfileScope scope( "convolveFFT" );
+	if( !kernel.width() || !kernel.height() ) THROW( "Empty kernel" );
+
+	Image32 img;
+	img.setSize( _width , _height );
+	if( !_width || !_height ) return img;
+
+	const int kw = kernel.width() , kh = kernel.height();
+	const int left = kw-1-kw/2 , top = kh-1-kh/2;
+
+	// Overlap-save: each tile produces (size - kernel size + 1) valid outputs per dimension,
+	// so the tiles are made a few times larger than the kernel, but no larger than needed to cover the whole image.
+	const int tileSize = std::max< int >( 64 , FFT::PowerOfTwo( 4*std::max< int >( kw , kh ) ) );
+	const int tw = std::min< int >( tileSize , FFT::PowerOfTwo( _width +kw-1 ) );
+	const int th = std::min< int >( tileSize , FFT::PowerOfTwo( _height+kh-1 ) );
+	const int validWidth = tw-kw+1 , validHeight = th-kh+1;
+	const int tilesX = ( _width + validWidth - 1 ) / validWidth , tilesY = ( _height + validHeight - 1 ) / validHeight;
+	FFT2D fft( tw , th );
+
+	// The transform of the (zero-padded) kernel
+	std::vector< std::complex< float > > spectrum( (size_t)tw*th );
+	for( int y=0 ; y<kh ; y++ ) for( int x=0 ; x<kw ; x++ ) spectrum[ (size_t)y*tw+x ] = (float)kernel(x,y);
+	fft.forward( &spectrum[0] );
+
+	// Since the kernel is real, convolving red+i*green gives the convolution of the red channel plus i times the convolution of the green.
+	// When there is only one tile the threads are used within the transforms instead.
+	const bool parallelTiles = tilesX*tilesY>1;
+	ParallelFor( 0 , tilesX*tilesY , [&]( unsigned int , size_t tile )
+	{
+		std::vector< std::complex< float > > rg( (size_t)tw*th ) , b( (size_t)tw*th );
+		int x0 = (int)( tile % tilesX ) * validWidth , y0 = (int)( tile / tilesX ) * validHeight;
+		_Gather( *this , x0-left , y0-top , tw , th , &rg[0] , &b[0] , false );
+		fft.forward( &rg[0] , !parallelTiles ) , fft.forward( &b[0] , !parallelTiles );
+		for( size_t i=0 ; i<(size_t)tw*th ; i++ ) rg[i] *= spectrum[i] , b[i] *= spectrum[i];
+		fft.inverse( &rg[0] , !parallelTiles ) , fft.inverse( &b[0] , !parallelTiles );
+
+		auto Clamp = []( float v ){ return v<0.f ? (unsigned char)0 : v>254.5f ? (unsigned char)255 : (unsigned char)( v+0.5f ); };
+		for( int y=0 ; y<validHeight && y0+y<_height ; y++ )
+		{
+			const Pixel32 *inRow = row( y0+y );
+			Pixel32 *outRow = img.row( y0+y );
+			const std::complex< float > *_rg = &rg[ (size_t)(y+kh-1)*tw + kw-1 ] , *_b = &b[ (size_t)(y+kh-1)*tw + kw-1 ];
+			for( int x=0 ; x<validWidth && x0+x<_width ; x++ )
+			{
+				Pixel32 &p = outRow[x0+x];
+				p.r = Clamp( _rg[x].real() ) , p.g = Clamp( _rg[x].imag() ) , p.b = Clamp( _b[x].real() ) , p.a = inRow[x0+x].a;
+			}
+		}
+	} );
+	return img;
+}
+
+// Multiplies the spectrum of the image by the (real, even) transfer function, which takes the radial frequency as a fraction of the Nyquist frequency.
+// The image is mirrored into power-of-two sized buffers to reduce the wrap-around discontinuities, and the offset is added to the filtered values.
+template< typename TransferFunction >
+static Image32 _FrequencyFilter( const Image32 &in , TransferFunction H , float offset )
+{
+	Image32 out;
+	out.setSize( in.width() , in.height() );
+	if( !in.width() || !in.height() ) return out;
+
+	const int w = FFT::PowerOfTwo( in.width() ) , h = FFT::PowerOfTwo( in.height() );
+	FFT2D fft( w , h );
+	std::vector< std::complex< float > > rg( (size_t)w*h ) , b( (size_t)w*h );
+	_Gather( in , 0 , 0 , w , h , &rg[0] , &b[0] , true );
+	fft.forward( &rg[0] ) , fft.forward( &b[0] );
+	ParallelFor( 0 , h , [&]( unsigned int , size_t y )
+	{
+		double fy = ( (int)y<=h/2 ? (double)y : (double)y-h ) / h;
+		for( int x=0 ; x<w ; x++ )
+		{
+			double fx = ( x<=w/2 ? (double)x : (double)x-w ) / w;
+			float s = (float)H( sqrt( fx*fx + fy*fy ) / 0.5 );
+			rg[ y*w+x ] *= s , b[ y*w+x ] *= s;
+		}
+	} , 16 );
+	fft.inverse( &rg[0] ) , fft.inverse( &b[0] );
+
+	auto Clamp = []( float v ){ return v<0.f ? (unsigned char)0 : v>254.5f ? (unsigned char)255 : (unsigned char)( v+0.5f ); };
+	for( int y=0 ; y<in.height() ; y++ )
+	{
+		const Pixel32 *inRow = in.row(y);
+		Pixel32 *outRow = out.row(y);
+		for( int x=0 ; x<in.width() ; x++ )
+		{
+			const std::complex< float > &_rg = rg[ (size_t)y*w+x ] , &_b = b[ (size_t)y*w+x ];
+			outRow[x].r = Clamp( _rg.real()+offset ) , outRow[x].g = Clamp( _rg.imag()+offset ) , outRow[x].b = Clamp( _b.real()+offset ) , outRow[x].a = inRow[x].a;
+		}
+	}
+	return out;
+}
+
+// The Gaussian low-pass transfer function, with the cutoff (the standard deviation) given as a fraction of the Nyquist frequency
+static double _LowPass( double frequency , double cutoff ){ return cutoff>0 ? exp( -frequency*frequency / ( 2.*cutoff*cutoff ) ) : 0.; }
+
+Image32 Image32::lowPass( double cutoff ) const
+{
+	ProfileScope scope( "lowPass" );
+	if( cutoff<0 ) THROW( "Cutoff must be non-negative: %g" , cutoff );
+	return _FrequencyFilter( *this , [&]( double f ){ return _LowPass( f , cutoff ); } , 0.f );
+}
+
+Image32 Image32::highPass( double cutoff ) const
+{
+	ProfileScope scope( "highPass" );
+	if( cutoff<0 ) THROW( "Cutoff must be non-negative: %g" , cutoff );
+	return _FrequencyFilter( *this , [&]( double f ){ return 1. - _LowPass( f , cutoff ); } , 128.f );
+}
+
+Image32 Image32::bandPass( double low , double high ) const
+{
+	ProfileScope scope( "bandPass" );
+	if( low<0 || high<low ) THROW( "Invalid cutoff range: [ %g , %g ]" , low , high );
+	return _FrequencyFilter( *this , [&]( double f ){ return _LowPass( f , high ) - _LowPass( f , low ); } , 128.f );
+}
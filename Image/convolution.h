@@ -0,0 +1,65 @@
+#ifndef CONVOLUTION_INCLUDED
+#define CONVOLUTION_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "image.h"
+
+namespace Image
+{
+	/** This class represents a rectangular convolution kernel.
+	*** The kernel is centered at ( width/2 , height/2 ). */
+	class Kernel
+	{
+		/** The dimensions of the kernel */
+		int _width , _height;
+
+		/** The kernel values, stored in row-major order */
+		std::vector< double > _values;
+	public:
+		/** The default constructor */
+		Kernel( void );
+
+		/** This constructor instantiates a kernel of the prescribed dimensions with all values set to zero */
+		Kernel( int width , int height );
+
+		/** This method returns the width of the kernel */
+		int width( void ) const;
+
+		/** This method returns the height of the kernel */
+		int height( void ) const;
+
+		/** This method returns a reference to the indexed kernel value.
+		*** An exception is thrown if the index is out of bounds. */
+		double& operator() ( int x , int y );
+
+		/** This method returns a reference to the indexed kernel value.
+		*** An exception is thrown if the index is out of bounds. */
+		const double& operator() ( int x , int y ) const;
+
+		/** This method returns the sum of the kernel values */
+		double sum( void ) const;
+
+		/** This method scales the kernel values so that they sum to one (if the sum is non-zero) */
+		void normalize( void );
+
+		/** This method tests if the kernel is the outer product of a horizontal and a vertical kernel, using a rank-1 singular-value decomposition.
+		*** If it is, the method sets the horizontal (width) and vertical (height) factors and returns true.
+		*** The kernel is treated as separable if the second singular value is smaller than epsilon times the first. */
+		bool separable( std::vector< double > &horizontal , std::vector< double > &vertical , double epsilon=1e-6 ) const;
+
+		/** This method reads in the kernel from the specified file */
+		void read( std::string fileName );
+
+		/** This static method returns a normalized Gaussian kernel of size (2*radius+1) x (2*radius+1) with the prescribed standard deviation */
+		static Kernel Gaussian( double sigma , int radius );
+	};
+
+	/** Functionality for outputing a kernel to a stream: the width and height, followed by the values in row-major order. */
+	std::ostream &operator << ( std::ostream &stream , const Kernel &kernel );
+
+	/** Functionality for inputing a kernel from a stream: the width and height, followed by the values in row-major order. */
+	std::istream &operator >> ( std::istream &stream , Kernel &kernel );
+}
+#endif // CONVOLUTION_INCLUDED
@@ -0,0 +1,175 @@
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include <Util/parallel.h>
+#include <Util/profiler.h>
+#include "image.h"
+
+using namespace Util;
+using namespace Image;
+
+//////////////////
+// EdgeOperator //
+//////////////////
+const char *EdgeOperator::Names[] = { "sobel" , "scharr" };
+
+int EdgeOperator::Parse( const std::string &name )
+{
+	for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+	THROW( "Unrecognized edge operator: %s" , name.c_str() );
+	return -1;
+}
+
+// Computes the (fixed-point) luminance of a row, replicating the end samples into the padding on either side
+static void _LuminanceRow( const Pixel32 *pixels , int width , int *luminance )
+{
+	for( int i=0 ; i<width ; i++ ) luminance[i+1] = ( 19661*pixels[i].r + 38666*pixels[i].g + 7209*pixels[i].b )>>16;
+	luminance[0] = luminance[1] , luminance[width+1] = luminance[width];
+}
+
+// The row-buffered gradient engine.
+// The operator is applied separably, in integer arithmetic, to the luminance of the image, keeping only three padded rows of luminance around.
+// The functor is called with the row index, the horizontal and vertical derivatives, and the normalization mapping the derivatives into the range [-255,255]
+// (the sum of the smoothing weights, as a derivative is the difference of two smoothed luminances, each at most 255 times that sum).
+template< typename RowFunction >
+static void _Gradients( const Image32 &img , int edgeOperator , RowFunction F )
+{
+	int side , center;
+	switch( edgeOperator )
+	{
+		case EdgeOperator::SOBEL:  side = 1 , center =  2 ; break;
+		case EdgeOperator::SCHARR: side = 3 , center = 10 ; break;
+		default: THROW( "Unrecognized edge operator: %d" , edgeOperator );
+	}
+	const int normalization = side + center + side;
+	const int width = img.width() , height = img.height() , BandSize = 32;
+
+	// Bands of rows are processed independently, each re-reading the row above and below it
+	ParallelFor( 0 , ( height + BandSize - 1 ) / BandSize , [&]( unsigned int , size_t band )
+	{
+		std::vector< int > buffer( 3*(width+2) ) , smooth( width+2 ) , diff( width+2 ) , dx( width ) , dy( width );
+		int *rows[] = { &buffer[0] , &buffer[width+2] , &buffer[2*(width+2)] };
+		int start = (int)band * BandSize , end = std::min< int >( start+BandSize , height );
+
+		_LuminanceRow( img.row( std::max< int >( start-1 , 0 ) ) , width , rows[0] );
+		_LuminanceRow( img.row( start ) , width , rows[1] );
+		for( int j=start ; j<end ; j++ )
+		{
+			_LuminanceRow( img.row( std::min< int >( j+1 , height-1 ) ) , width , rows[2] );
+			const int *r0 = rows[0] , *r1 = rows[1] , *r2 = rows[2];
+
+			// Vertical pass: smooth and differentiate along the columns
+			for( int i=0 ; i<width+2 ; i++ ) smooth[i] = side * ( r0[i] + r2[i] ) + center * r1[i] , diff[i] = r2[i] - r0[i];
+			// Horizontal pass: differentiate the smoothed values and smooth the differences along the row
+			for( int i=0 ; i<width ; i++ ) dx[i] = smooth[i+2] - smooth[i] , dy[i] = side * ( diff[i] + diff[i+2] ) + center * diff[i+1];
+
+			F( j , &dx[0] , &dy[0] , normalization );
+
+			int *temp = rows[0];
+			rows[0] = rows[1] , rows[1] = rows[2] , rows[2] = temp;
+		}
+	} );
+}
+
+/////////////
+// Image32 //
+/////////////
+Image32 Image32::gradientMagnitude( int edgeOperator ) const
+{
+	ProfileScope scope( "gradientMagnitude" );
+	Image32 img;
+	img.setSize( _width , _height );
+	if( !_width || !_height ) return img;
+
+	_Gradients( *this , edgeOperator , [&]( int j , const int *dx , const int *dy , int normalization )
+	{
+		const Pixel32 *inRow = row(j);
+		Pixel32 *outRow = img.row(j);
+		float scale = 1.f / normalization;
+		for( int i=0 ; i<_width ; i++ )
+		{
+			float m = sqrtf( (float)( dx[i]*dx[i] + dy[i]*dy[i] ) ) * scale;
+			unsigned char v = m>255.f ? 255 : (unsigned char)m;
+			outRow[i].r = outRow[i].g = outRow[i].b = v;
+			outRow[i].a = inRow[i].a;
+		}
+	} );
+	return img;
+}
+
+Image32 Image32::canny( double lowThreshold , double highThreshold , int edgeOperator ) const
+{
+	ProfileScope scope( "canny" );
+	if( lowThreshold>highThreshold ) THROW( "Low threshold exceeds high threshold: %g > %g" , lowThreshold , highThreshold );
+
+	Image32 img;
+	img.setSize( _width , _height );
+	if( !_width || !_height ) return img;
+
+	// The gradient magnitudes and the quantized gradient directions:
+	// 0 -> horizontal, 1 -> diagonal (down-right), 2 -> vertical, 3 -> anti-diagonal (up-right)
+	std::vector< float > magnitude( (size_t)_width * _height );
+	std::vector< unsigned char > direction( (size_t)_width * _height );
+	_Gradients( *this , edgeOperator , [&]( int j , const int *dx , const int *dy , int normalization )
+	{
+		// tan( 22.5 degrees ) and tan( 67.5 degrees ) in 15-bit fixed-point
+		const long long Tan22 = 13573 , Tan67 = 79109;
+		float scale = 1.f / normalization;
+		float *m = &magnitude[ (size_t)j*_width ];
+		unsigned char *d = &direction[ (size_t)j*_width ];
+		for( int i=0 ; i<_width ; i++ )
+		{
+			long long ax = abs( dx[i] ) , ay = abs( dy[i] );
+			m[i] = sqrtf( (float)( dx[i]*dx[i] + dy[i]*dy[i] ) ) * scale;
+			if     ( ( ay<<15 ) < ax*Tan22 ) d[i] = 0;
+			else if( ( ay<<15 ) > ax*Tan67 ) d[i] = 2;
+			else d[i] = ( dx[i]<0 )==( dy[i]<0 ) ? 1 : 3;
+		}
+	} );
+
+	// Non-maximum suppression, classifying the surviving pixels as strong (2) or weak (1) edges
+	enum { NONE , WEAK , STRONG };
+	std::vector< unsigned char > edges( (size_t)_width * _height , NONE );
+	const int offsets[][2] = { { 1 , 0 } , { 1 , 1 } , { 0 , 1 } , { 1 , -1 } };
+	ParallelFor( 1 , _height>1 ? _height-1 : 1 , [&]( unsigned int , size_t j )
+	{
+		for( int i=1 ; i<_width-1 ; i++ )
+		{
+			size_t idx = j*_width + i;
+			float m = magnitude[idx];
+			if( m<lowThreshold ) continue;
+			const int *o = offsets[ direction[idx] ];
+			float m1 = magnitude[ idx + o[0] + o[1]*_width ] , m2 = magnitude[ idx - o[0] - o[1]*_width ];
+			if( m>=m1 && m>m2 ) edges[idx] = m>=highThreshold ? STRONG : WEAK;
+		}
+	} , 16 );
+
+	// Hysteresis: promote weak edges that are (transitively) connected to strong ones
+	std::vector< size_t > stack;
+	for( size_t idx=0 ; idx<edges.size() ; idx++ ) if( edges[idx]==STRONG ) stack.push_back( idx );
+	while( stack.size() )
+	{
+		size_t idx = stack.back();
+		stack.pop_back();
+		int i = (int)( idx % _width ) , j = (int)( idx / _width );
+		for( int y=std::max< int >( j-1 , 0 ) ; y<=std::min< int >( j+1 , _height-1 ) ; y++ ) for( int x=std::max< int >( i-1 , 0 ) ; x<=std::min< int >( i+1 , _width-1 ) ; x++ )
+		{
+			size_t _idx = (size_t)y*_width + x;
+			if( edges[_idx]==WEAK ) edges[_idx] = STRONG , stack.push_back( _idx );
+		}
+	}
+
+	for( int j=0 ; j<_height ; j++ )
+	{
+		const Pixel32 *inRow = row(j);
+		Pixel32 *outRow = img.row(j);
+		for( int i=0 ; i<_width ; i++ )
+		{
+			outRow[i].r = outRow[i].g = outRow[i].b = edges[ (size_t)j*_width+i ]==STRONG ? 255 : 0;
+			outRow[i].a = inRow[i].a;
+		}
+	}
+	return img;
+}
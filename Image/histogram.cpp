@@ -0,0 +1,219 @@
+#include <math.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <Util/exceptions.h>
+#include <Util/parallel.h>
+#include <Util/profiler.h>
+#include "histogram.h"
+
+using namespace Util;
+using namespace Image;
+
+static unsigned char _Clamp( double v ){ return v<0 ? 0 : v>255 ? 255 : (unsigned char)v; }
+
+// Look-up tables for the weighted channel contributions to the luminance
+struct _LuminanceTables
+{
+	double r[256] , g[256] , b[256];
+	_LuminanceTables( void ){ for( int i=0 ; i<256 ; i++ ) r[i] = i*0.3 , g[i] = i*0.59 , b[i] = i*0.11; }
+};
+static const _LuminanceTables _luminanceTables;
+
+// Applies the per-channel look-up tables (in RGBA order) to the pixels of the image
+static void _ApplyLUT( const Image32 &in , Image32 &out , const unsigned char lut[4][256] )
+{
+	out.setSize( in.width() , in.height() );
+	ParallelFor( 0 , in.height() , [&]( unsigned int , size_t j )
+	{
+		const Pixel32 *inRow = in.row( (int)j );
+		Pixel32 *outRow = out.row( (int)j );
+		for( int i=0 ; i<in.width() ; i++ )
+		{
+			outRow[i].r = lut[0][ inRow[i].r ];
+			outRow[i].g = lut[1][ inRow[i].g ];
+			outRow[i].b = lut[2][ inRow[i].b ];
+			outRow[i].a = lut[3][ inRow[i].a ];
+		}
+	} , 16 );
+}
+
+//////////////////////
+// ChannelHistogram //
+//////////////////////
+ChannelHistogram::ChannelHistogram( void ){ clear(); }
+
+void ChannelHistogram::clear( void ){ memset( bins , 0 , sizeof(bins) ); }
+
+ChannelHistogram &ChannelHistogram::operator += ( const ChannelHistogram &h )
+{
+	for( int i=0 ; i<256 ; i++ ) bins[i] += h.bins[i];
+	return *this;
+}
+
+unsigned long long ChannelHistogram::count( void ) const
+{
+	unsigned long long c = 0;
+	for( int i=0 ; i<256 ; i++ ) c += bins[i];
+	return c;
+}
+
+unsigned char ChannelHistogram::min( void ) const
+{
+	for( int i=0 ; i<256 ; i++ ) if( bins[i] ) return i;
+	return 0;
+}
+
+unsigned char ChannelHistogram::max( void ) const
+{
+	for( int i=255 ; i>=0 ; i-- ) if( bins[i] ) return i;
+	return 0;
+}
+
+unsigned long long ChannelHistogram::sum( void ) const
+{
+	unsigned long long s = 0;
+	for( int i=0 ; i<256 ; i++ ) s += bins[i] * i;
+	return s;
+}
+
+double ChannelHistogram::mean( void ) const
+{
+	unsigned long long c = count();
+	return c ? (double)sum() / c : 0.;
+}
+
+double ChannelHistogram::variance( void ) const
+{
+	unsigned long long c = count();
+	if( !c ) return 0.;
+	double m = mean() , v = 0;
+	for( int i=0 ; i<256 ; i++ ) v += bins[i] * ( i-m ) * ( i-m );
+	return v / c;
+}
+
+double ChannelHistogram::standardDeviation( void ) const { return sqrt( variance() ); }
+
+unsigned char ChannelHistogram::percentile( double fraction ) const
+{
+	unsigned long long c = count();
+	if( !c ) return 0;
+	fraction = fraction<0 ? 0 : fraction>1 ? 1 : fraction;
+	unsigned long long target = (unsigned long long)ceil( fraction * c );
+	if( !target ) target = 1;
+	unsigned long long cdf = 0;
+	for( int i=0 ; i<256 ; i++ ) if( ( cdf += bins[i] )>=target ) return i;
+	return 255;
+}
+
+void ChannelHistogram::cumulative( unsigned long long cdf[256] ) const
+{
+	cdf[0] = bins[0];
+	for( int i=1 ; i<256 ; i++ ) cdf[i] = cdf[i-1] + bins[i];
+}
+
+/////////////////////
+// ImageStatistics //
+/////////////////////
+const char *ImageStatistics::Names[] = { "red" , "green" , "blue" , "alpha" , "luminance" };
+
+void ImageStatistics::clear( void ){ for( int c=0 ; c<COUNT ; c++ ) channels[c].clear(); }
+
+unsigned char ImageStatistics::Luminance( const Pixel32 &p ){ return _Clamp( _luminanceTables.r[p.r] + _luminanceTables.b[p.b] + _luminanceTables.g[p.g] ); }
+
+void ImageStatistics::add( const Pixel32 *pixels , size_t count )
+{
+	unsigned long long *r = channels[RED].bins , *g = channels[GREEN].bins , *b = channels[BLUE].bins , *a = channels[ALPHA].bins , *l = channels[LUMINANCE].bins;
+	for( size_t i=0 ; i<count ; i++ )
+	{
+		const Pixel32 &p = pixels[i];
+		r[p.r]++ , g[p.g]++ , b[p.b]++ , a[p.a]++;
+		l[ Luminance(p) ]++;
+	}
+}
+
+void ImageStatistics::add( const Image32 &img , int x1 , int y1 , int x2 , int y2 )
+{
+	x1 = std::max< int >( x1 , 0 ) , x2 = std::min< int >( x2 , img.width() );
+	y1 = std::max< int >( y1 , 0 ) , y2 = std::min< int >( y2 , img.height() );
+	if( x2<=x1 ) return;
+	for( int j=y1 ; j<y2 ; j++ ) add( img.row(j)+x1 , x2-x1 );
+}
+
+ImageStatistics &ImageStatistics::operator += ( const ImageStatistics &s )
+{
+	for( int c=0 ; c<COUNT ; c++ ) channels[c] += s.channels[c];
+	return *this;
+}
+
+ChannelHistogram &ImageStatistics::operator[] ( int c ){ return channels[c]; }
+
+const ChannelHistogram &ImageStatistics::operator[] ( int c ) const { return channels[c]; }
+
+std::ostream &Image::operator << ( std::ostream &stream , const ImageStatistics &s )
+{
+	for( int c=0 ; c<ImageStatistics::COUNT ; c++ )
+	{
+		const ChannelHistogram &h = s[c];
+		stream << ImageStatistics::Names[c] << ": min=" << (int)h.min() << " max=" << (int)h.max() << " mean=" << h.mean() << " std-dev=" << h.standardDeviation();
+		stream << " median=" << (int)h.percentile( 0.5 ) << std::endl;
+	}
+	return stream;
+}
+
+/////////////
+// Image32 //
+/////////////
+ImageStatistics Image32::stats( void ) const
+{
+	ProfileScope scope( "stats" );
+	// Accumulate per-thread histograms over bands of rows and reduce them at the end
+	const int BandSize = 16;
+	std::vector< ImageStatistics > threadStats( ThreadCount() );
+	ParallelFor( 0 , ( _height + BandSize - 1 ) / BandSize , [&]( unsigned int t , size_t band )
+	{
+		threadStats[t].add( *this , 0 , (int)band*BandSize , _width , (int)band*BandSize+BandSize );
+	} );
+	ImageStatistics s;
+	for( unsigned int t=0 ; t<threadStats.size() ; t++ ) s += threadStats[t];
+	return s;
+}
+
+Image32 Image32::equalize( void ) const
+{
+	ProfileScope scope( "equalize" );
+	ImageStatistics s = stats();
+	unsigned char lut[4][256];
+	for( int i=0 ; i<256 ; i++ ) lut[3][i] = i;
+	for( int c=0 ; c<3 ; c++ )
+	{
+		unsigned long long cdf[256];
+		s[c].cumulative( cdf );
+		unsigned long long cdfMin = s[c].bins[ s[c].min() ] , total = cdf[255];
+		for( int i=0 ; i<256 ; i++ )
+			if( total>cdfMin ) lut[c][i] = _Clamp( floor( (double)( cdf[i]>cdfMin ? cdf[i]-cdfMin : 0 ) / ( total-cdfMin ) * 255. + 0.5 ) );
+			else lut[c][i] = i;
+	}
+	Image32 img;
+	_ApplyLUT( *this , img , lut );
+	return img;
+}
+
+Image32 Image32::autoLevels( double low , double high ) const
+{
+	ProfileScope scope( "autoLevels" );
+	if( low<0 || high>1 || low>=high ) THROW( "Invalid percentile range: [ %g , %g ]" , low , high );
+	ImageStatistics s = stats();
+	unsigned char lut[4][256];
+	for( int i=0 ; i<256 ; i++ ) lut[3][i] = i;
+	for( int c=0 ; c<3 ; c++ )
+	{
+		int lo = s[c].percentile( low ) , hi = s[c].percentile( high );
+		for( int i=0 ; i<256 ; i++ )
+			if( hi>lo ) lut[c][i] = _Clamp( floor( (double)( i-lo ) / ( hi-lo ) * 255. + 0.5 ) );
+			else lut[c][i] = i;
+	}
+	Image32 img;
+	_ApplyLUT( *this , img , lut );
+	return img;
+}
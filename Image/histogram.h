@@ -0,0 +1,100 @@
+#ifndef HISTOGRAM_INCLUDED
+#define HISTOGRAM_INCLUDED
+
+#include "image.h"
+
+namespace Image
+{
+	/** This class represents the histogram of a single 8-bit channel.
+	*** All the moments of the channel are derived from the histogram, so they are exact and can be merged across tiles. */
+	class ChannelHistogram
+	{
+	public:
+		/** The number of samples falling into each of the bins */
+		unsigned long long bins[256];
+
+		/** The default constructor instantiates an empty histogram */
+		ChannelHistogram( void );
+
+		/** This method resets the bin counts to zero */
+		void clear( void );
+
+		/** This method adds the counts of the input histogram to the current one */
+		ChannelHistogram &operator += ( const ChannelHistogram &h );
+
+		/** This method returns the total number of samples */
+		unsigned long long count( void ) const;
+
+		/** This method returns the smallest value with a non-zero count (or zero if the histogram is empty) */
+		unsigned char min( void ) const;
+
+		/** This method returns the largest value with a non-zero count (or zero if the histogram is empty) */
+		unsigned char max( void ) const;
+
+		/** This method returns the sum of the samples */
+		unsigned long long sum( void ) const;
+
+		/** This method returns the average value of the samples */
+		double mean( void ) const;
+
+		/** This method returns the variance of the samples */
+		double variance( void ) const;
+
+		/** This method returns the standard deviation of the samples */
+		double standardDeviation( void ) const;
+
+		/** This method returns the smallest value such that at least the prescribed fraction, in the range [0,1], of the samples is less than or equal to it. */
+		unsigned char percentile( double fraction ) const;
+
+		/** This method computes the cumulative distribution of the samples, so that cdf[i] is the number of samples less than or equal to i. */
+		void cumulative( unsigned long long cdf[256] ) const;
+	};
+
+	/** This class represents the per-channel histograms of an image (or of a tile of an image).
+	*** Statistics of disjoint tiles can be computed independently and then summed. */
+	class ImageStatistics
+	{
+	public:
+		/** The types of channels */
+		enum
+		{
+			RED ,
+			GREEN ,
+			BLUE ,
+			ALPHA ,
+			LUMINANCE ,
+			COUNT
+		};
+
+		/** The names of the channels */
+		static const char *Names[];
+
+		/** The histograms of the channels */
+		ChannelHistogram channels[COUNT];
+
+		/** This method resets the histograms */
+		void clear( void );
+
+		/** This method accumulates the values of a contiguous run of pixels into the histograms */
+		void add( const Pixel32 *pixels , size_t count );
+
+		/** This method accumulates the values of the pixels within the rectangle [x1,x2) x [y1,y2) of the image into the histograms */
+		void add( const Image32 &img , int x1 , int y1 , int x2 , int y2 );
+
+		/** This method adds the histograms of the input statistics to the current ones */
+		ImageStatistics &operator += ( const ImageStatistics &s );
+
+		/** This method returns the histogram of the indexed channel */
+		ChannelHistogram &operator[] ( int c );
+
+		/** This method returns the histogram of the indexed channel */
+		const ChannelHistogram &operator[] ( int c ) const;
+
+		/** This static method returns the (truncated) luminance of a pixel, using the 30:59:11 weighting of the red, green, and blue components. */
+		static unsigned char Luminance( const Pixel32 &p );
+	};
+
+	/** This function writes out a summary of the statistics */
+	std::ostream &operator << ( std::ostream &stream , const ImageStatistics &s );
+}
+#endif // HISTOGRAM_INCLUDED
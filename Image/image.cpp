@@ -3,8 +3,10 @@
 #include "image.h"
 #include <Util/cmdLineParser.h>
 #include <Util/exceptions.h>
+#include <Util/profiler.h>
 #include <Image/bmp.h>
 #include <Image/jpeg.h>
+#include <Image/codec.h>
 #include <iostream>
 
 using namespace std;
@@ -56,12 +58,14 @@ void Image32::setSize( int width , int height )
 {
 	if( _width!=width || _height!=height )
 	{
-		if( _pixels ) delete[] _pixels;
+		if( _pixels ) delete[] _pixels , Profiler::Allocate( -(long long)sizeof(Pixel32)*_width*_height );
 		_pixels = NULL;
 		_width = _height = 0;
-		if( !width*height ) return;
-		_pixels = new Pixel32[width*height];
+		if( width<0 || height<0 ) THROW( "Negative image dimensions: %d x %d" , width , height );
+		if( !width || !height ) return;
+		_pixels = new Pixel32[ (size_t)width*height ];
 		if( !_pixels ) THROW( "Failed to allocate memory for image: %d x %d" , width , height );;
+		Profiler::Allocate( (long long)sizeof(Pixel32)*width*height );
 	}
 	_width = width;
 	_height = height;
@@ -76,13 +80,25 @@ void Image32::_assertInBounds( int x , int y ) const
 Pixel32& Image32::operator() ( int x , int y )
 {
 	_assertInBounds( x , y );
-	return _pixels[x+y*_width];
+	return _pixels[ x+(size_t)y*_width ];
 }
 
 const Pixel32& Image32::operator() ( int x , int y ) const
 {
 	_assertInBounds( x , y );
-	return _pixels[x+y*_width];
+	return _pixels[ x+(size_t)y*_width ];
+}
+
+Pixel32* Image32::row( int y )
+{
+	_assertInBounds( 0 , y );
+	return _pixels + (size_t)y*_width;
+}
+
+const Pixel32* Image32::row( int y ) const
+{
+	_assertInBounds( 0 , y );
+	return _pixels + (size_t)y*_width;
 }
 
 int Image32::width( void ) const { return _width; }
@@ -91,6 +107,7 @@ int Image32::height( void ) const { return _height; }
 
 Image32 Image32::BeierNeelyMorph( const Image32& source , const Image32& destination , const OrientedLineSegmentPairs& olsp , double timeStep )
 {
+	ProfileScope scope( "BeierNeelyMorph" );
 	OrientedLineSegmentPairs olsp1 , olsp2;
 	OrientedLineSegment ols;
 	Image32 temp1 , temp2;
@@ -118,19 +135,21 @@ Image32 Image32::BeierNeelyMorph( const Image32& source , const Image32& destina
 	return CrossDissolve( temp1 , temp2 , timeStep );
 }
 
-void Image32::read( string fileName )
+void Image32::read( string fileName ){ ReadImage( fileName , *this ); }
+
+void Image32::read( string fileName , double scale )
 {
-	string ext = ToLower( GetFileExtension( fileName ) );
-	if     ( ext=="bmp" ) BMPReadImage( fileName , *this );
-	else if( ext=="jpg" || ext=="jpeg" ) JPEGReadImage( fileName , *this );
-	else THROW( "Unrecognized file extension: %s" , ext.c_str() );
+	if( scale<=0 ) THROW( "Scale must be positive: %g" , scale );
+	double s = ReadImage( fileName , *this , scale );
+	if( s!=scale ) *this = scaleGaussian( scale / s );
 }
 
-void Image32::write( string fileName ) const
+void Image32::write( string fileName ) const { write( fileName , JPEGWriteOptions() ); }
+
+void Image32::write( string fileName , const JPEGWriteOptions &jpegOptions ) const
 {
-	string ext = ToLower( GetFileExtension( fileName ) );
-	if( !( width()*height() ) ) THROW( "Cannot write empty image: %s" , fileName.c_str() );
-	if     ( ext=="bmp" ) BMPWriteImage( *this , fileName );
-	else if( ext=="jpg" || ext=="jpeg" ) JPEGWriteImage( *this , fileName );
-	else THROW( "Unrecognized file extension: %s" , ext.c_str() );
+	if( !width() || !height() ) THROW( "Cannot write empty image: %s" , fileName.c_str() );
+	const ImageCodec &codec = ImageCodecForWriting( fileName );
+	if( dynamic_cast< const JPEGImageCodec * >( &codec ) ) WriteImage( *this , fileName , JPEGImageCodec( jpegOptions ) );
+	else                                                   WriteImage( *this , fileName , codec );
 }
\ No newline at end of file
@@ -9,6 +9,11 @@
 
 namespace Image
 {
+	class ImageStatistics;
+	class Kernel;
+	class Palette;
+	class JPEGWriteOptions;
+
 	/** This class represents a 4-channel, 32-bit, RGBA pixel. */
 	class Pixel32
 	{
@@ -30,6 +35,89 @@ namespace Image
 	};
 
 
+	/** This class describes the gradient operators that can be used for edge detection. */
+	class EdgeOperator
+	{
+	public:
+		/** The types of operators */
+		enum
+		{
+			SOBEL ,
+			SCHARR ,
+			COUNT
+		};
+
+		/** The names of the operators */
+		static const char *Names[];
+
+		/** This static method returns the type of the operator with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
+	/** This class describes the strategies that can be used for convolving an image with a kernel. */
+	class ConvolutionMethod
+	{
+	public:
+		/** The types of strategies */
+		enum
+		{
+			AUTO ,
+			DIRECT ,
+			SEPARABLE ,
+			FFT ,
+			COUNT
+		};
+
+		/** The names of the strategies */
+		static const char *Names[];
+
+		/** This static method returns the type of the strategy with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
+	/** This class describes the strategies that can be used for computing a color palette. */
+	class PaletteMethod
+	{
+	public:
+		/** The types of strategies */
+		enum
+		{
+			MEDIAN_CUT ,
+			K_MEANS ,
+			COUNT
+		};
+
+		/** The names of the strategies */
+		static const char *Names[];
+
+		/** This static method returns the type of the strategy with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
+	/** This class describes the dithering that can be applied when mapping an image to a color palette. */
+	class DitherMode
+	{
+	public:
+		/** The types of dithering */
+		enum
+		{
+			NONE ,
+			ORDERED ,
+			FLOYD_STEINBERG ,
+			COUNT
+		};
+
+		/** The names of the types of dithering */
+		static const char *Names[];
+
+		/** This static method returns the type of dithering with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
 	/** This class represents an RGBA image with 8 bits per channel. */
 	class Image32
 	{
@@ -77,12 +165,29 @@ namespace Image
 		*** An exception is thrown if the index is out of bounds. */
 		const Pixel32& operator() ( int x , int y ) const;
 
-		/** This method reads in an image from the specified file. It uses the file extension to determine if the file should be read in as a BMP file or as a JPEG file. */
+		/** This method returns a pointer to the (contiguous) pixels of the indexed row.
+		*** An exception is thrown if the index is out of bounds. */
+		Pixel32* row( int y );
+
+		/** This method returns a pointer to the (contiguous) pixels of the indexed row.
+		*** An exception is thrown if the index is out of bounds. */
+		const Pixel32* row( int y ) const;
+
+		/** This method reads in an image from the specified file, or from the standard input if the file name is "-".
+		*** The format is identified by the first bytes of the file, falling back to the file extension (see ReadImage in codec.h). */
 		void read( std::string fileName );
 
-		/** This method writes in an image out to the specified file. It uses the file extension to determine if the file should be written out as a BMP file or as a JPEG file. */
+		/** This method reads in an image from the specified file, scaled by the prescribed factor.
+		*** JPEG files are reduced by a power of two (up to 1/8) while decoding, and the remaining scaling is done with Gaussian resampling. */
+		void read( std::string fileName , double scale );
+
+		/** This method writes in an image out to the specified file, or to the standard output if the file name is "-" or "<ext>:-".
+		*** The format is determined by the file extension (see ImageCodecForWriting in codec.h). */
 		void write( std::string fileName ) const;
 
+		/** This method writes in an image out to the specified file, using the prescribed parameters if the file is written out as a JPEG file. */
+		void write( std::string fileName , const JPEGWriteOptions &jpegOptions ) const;
+
 		/** This method outputs a new image image with random noise added to each pixel.
 		*** The value of the input parameter should be in the range [0,1] representing the fraction
 		*** of noise that should be added. The actual amount of noise added is in the range [-noise,noise]. */
@@ -123,12 +228,51 @@ namespace Image
 		*** The value of the input parameter is the number of bits that should be used to represent a color component in the output image. */
 		Image32 floydSteinbergDither( int bits ) const;
 
+		/** This method outputs a new image whose colors are drawn from a palette of (at most) the prescribed number of colors, computed from the image.
+		*** The alpha-channel is copied from the input. */
+		Image32 quantizePalette( int colors , int method=PaletteMethod::MEDIAN_CUT , int dither=DitherMode::NONE ) const;
+
+		/** This method outputs a new image in which each color is replaced by its nearest palette color, using the palette's inverse-lookup table.
+		*** The alpha-channel is copied from the input. */
+		Image32 mapPalette( const Palette &palette , int dither=DitherMode::NONE ) const;
+
 		/** This method outputs a blur of the image using a 3x3 mask. */
 		Image32 blur3X3( void ) const;
 
 		/** This method outpus a new image highlighting the edges in the input using a 3x3 mask. */
 		Image32 edgeDetect3X3( void ) const;
 
+		/** This method outputs a gray-scale image whose values are the magnitudes of the luminance gradients.
+		*** The gradients are computed in a single pass, in integer arithmetic, using the prescribed (separable) edge operator.
+		*** Each derivative is normalized into [-255,255], so a step from black to white has magnitude 255 (and larger magnitudes, up to 255*sqrt(2), are clamped). */
+		Image32 gradientMagnitude( int edgeOperator=EdgeOperator::SOBEL ) const;
+
+		/** This method outputs a binary image marking the edges detected by the Canny edge detector.
+		*** Local maxima of the gradient magnitude above the high threshold are edges, as are those above the low threshold that are connected to them.
+		*** The thresholds are on the scale of gradientMagnitude (before clamping), from 0 to 255*sqrt(2), with a step from black to white at 255. */
+		Image32 canny( double lowThreshold , double highThreshold , int edgeOperator=EdgeOperator::SOBEL ) const;
+
+		/** This method outputs the convolution of the image with the kernel, with the image extended by replicating its boundary pixels.
+		*** The alpha-channel is copied from the input. When the method is AUTO, separable kernels (detected by a rank-1 SVD) are
+		*** applied as a vertical followed by a horizontal pass, large kernels are applied in the frequency domain, and other kernels are applied directly. */
+		Image32 convolve( const Kernel &kernel , int method=ConvolutionMethod::AUTO ) const;
+
+		/** This method outputs the convolution of the image with the kernel, computed in the frequency domain.
+		*** The image is processed in overlap-save tiles whose size is a power of two a few times larger than the kernel. */
+		Image32 convolveFFT( const Kernel &kernel ) const;
+
+		/** This method outputs a new image in which the frequencies above the cutoff have been attenuated by a Gaussian transfer function.
+		*** The cutoff is given as a fraction of the Nyquist frequency. */
+		Image32 lowPass( double cutoff ) const;
+
+		/** This method outputs the complement of the low-pass filtered image, offset by 128 so that zero maps to mid-gray.
+		*** The cutoff is given as a fraction of the Nyquist frequency. */
+		Image32 highPass( double cutoff ) const;
+
+		/** This method outputs the difference of the low-pass filtered images with the high and low cutoffs, offset by 128 so that zero maps to mid-gray.
+		*** The cutoffs are given as fractions of the Nyquist frequency. */
+		Image32 bandPass( double low , double high ) const;
+
 		/** This method outputs a scaled image which is obtained using nearest-point sampling.
 		* The value of the input parameter is the factor by which the image is to be scaled.
 		*/
@@ -169,6 +313,16 @@ namespace Image
 		/** This method computes a gaussian blur of mask size n and given sigma */
 		Image32 blurNXN(double n, double sigma) const;
 
+		/** This method returns the per-channel histograms of the image, from which the min/max, moments, and percentiles can be obtained.
+		*** The histograms are accumulated in a single pass, in parallel over bands of rows. */
+		ImageStatistics stats( void ) const;
+
+		/** This method outputs a new image in which the histogram of each color channel has been equalized. */
+		Image32 equalize( void ) const;
+
+		/** This method outputs a new image in which each color channel has been linearly stretched so that the values at the prescribed percentiles, in the range [0,1], map to 0 and 255. */
+		Image32 autoLevels( double low , double high ) const;
+
 		/** This method outputs the results of a fun-filter. */
 		Image32 funFilter(int numBuckets, int radius) const;
 
@@ -1,9 +1,13 @@
 #include <algorithm>
 #include "image.h"
+#include "histogram.h"
 #include <stdlib.h>
 #include <math.h>
 #include <Util/exceptions.h>
 #include <random>
+#include <vector>
+#include <Util/parallel.h>
+#include <Util/profiler.h>
 
 using namespace Util;
 using namespace Image;
@@ -25,22 +29,12 @@ bool checkBounds(double val, int size)
 	return val > size - 1 ? false : val < 0 ? false : true;
 }
 
-unsigned char mean(Image32 img)
-{
-	long sum = 0;
-	for (int i = 0; i < img.width(); i++) {
-		for (int j = 0; j < img.height(); j++) {
-			sum += clamp((static_cast<double>((img)(i, j).r) * 0.3) + (static_cast<double>((img)(i, j).b) * 0.11) + (static_cast<double>((img)(i, j).g) * 0.59));
-		}
-	}
-	return static_cast<unsigned char>((sum / static_cast<long>((img.width() * img.height()))));
-}
-
 /////////////
 // Image32 //
 /////////////
 Image32 Image32::addRandomNoise(double noise) const
 {
+	ProfileScope scope("addRandomNoise");
 	std::random_device rd;
 	std::mt19937 gen(rd());
 	std::uniform_real_distribution<> distr(-noise, noise);
@@ -60,6 +54,7 @@ Image32 Image32::addRandomNoise(double noise) const
 
 Image32 Image32::brighten(double brightness) const
 {
+	ProfileScope scope("brighten");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 	for (int i = 0; i < _width; i++) {
@@ -75,6 +70,7 @@ Image32 Image32::brighten(double brightness) const
 
 Image32 Image32::luminance(void) const
 {
+	ProfileScope scope("luminance");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 	for (int i = 0; i < _width; i++) {
@@ -91,7 +87,16 @@ Image32 Image32::luminance(void) const
 
 Image32 Image32::contrast(double contrast) const
 {
-	unsigned char avg = mean(luminance());
+	ProfileScope scope("contrast");
+	// Average luminance of the gray-scale image, obtained from the luminance histogram
+	const ChannelHistogram& hist = stats()[ImageStatistics::LUMINANCE];
+	unsigned long long sum = 0;
+	for (int l = 0; l < 256; l++) {
+		Pixel32 gray;
+		gray.r = gray.g = gray.b = l;
+		sum += hist.bins[l] * ImageStatistics::Luminance(gray);
+	}
+	unsigned char avg = hist.count() ? static_cast<unsigned char>(sum / hist.count()) : 0;
 
 	Image32 newImg;
 	newImg.setSize(_width, _height);
@@ -108,6 +113,7 @@ Image32 Image32::contrast(double contrast) const
 
 Image32 Image32::saturate(double saturation) const
 {
+	ProfileScope scope("saturate");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 	for (int i = 0; i < _width; i++) {
@@ -124,6 +130,7 @@ Image32 Image32::saturate(double saturation) const
 
 Image32 Image32::quantize(int bits) const
 {
+	ProfileScope scope("quantize");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 	for (int i = 0; i < _width; i++) {
@@ -139,6 +146,7 @@ Image32 Image32::quantize(int bits) const
 
 Image32 Image32::randomDither(int bits) const
 {
+	ProfileScope scope("randomDither");
 	std::random_device rd;
 	std::mt19937 gen(rd());
 	std::uniform_real_distribution<> distr(-1.0, 1.0);
@@ -158,6 +166,7 @@ Image32 Image32::randomDither(int bits) const
 
 Image32 Image32::orderedDither2X2(int bits) const
 {
+	ProfileScope scope("orderedDither2X2");
 	double thresholds[2][2] = { {1, 3}, {4, 2} };
 
 	Image32 newImg;
@@ -213,6 +222,7 @@ Image32 Image32::orderedDither2X2(int bits) const
 
 Image32 Image32::floydSteinbergDither(int bits) const
 {
+	ProfileScope scope("floydSteinbergDither");
 	Image32 oldImg(*this);
 	Image32 newImg;
 	newImg.setSize(_width, _height);
@@ -253,6 +263,7 @@ Image32 Image32::floydSteinbergDither(int bits) const
 
 Image32 Image32::blur3X3(void) const
 {
+	ProfileScope scope("blur3X3");
 	double mask[9] =
 	{
 		1.0 / 16.0, 2.0 / 16.0, 1.0 / 16.0,
@@ -285,77 +296,70 @@ Image32 Image32::blur3X3(void) const
 
 Image32 Image32::edgeDetect3X3(void) const
 {
+	ProfileScope scope("edgeDetect3X3");
 	double threshold = 20.0;
 
-	double mask[9] =
-	{
-		-1.0 / 8.0, -1.0 / 8.0, -1.0 / 8.0,
-		-1.0 / 8.0,        1.0, -1.0 / 8.0,
-		-1.0 / 8.0, -1.0 / 8.0, -1.0 / 8.0
-	};
-
-	double* ptr = &mask[4];
-
-	double maxRedErr = 0;
-	double minRedErr = 0;
-	double maxGreenErr = 0;
-	double minGreenErr = 0;
-	double maxBlueErr = 0;
-	double minBlueErr = 0;
-
-	for (int i = 0; i < _width; i++) {
-		for (int j = 0; j < _height; j++) {
-			double redErr = 0, blueErr = 0, greenErr = 0;
-			for (int x = -1; x < 2; x++) {
-				for (int y = -1; y < 2; y++) {
-					redErr += (*this)(clampIndex(i + x, _width), clampIndex(j + y, _height)).r * ptr[(x * 3) + y];
-					blueErr += (*this)(clampIndex(i + x, _width), clampIndex(j + y, _height)).b * ptr[(x * 3) + y];
-					greenErr += (*this)(clampIndex(i + x, _width), clampIndex(j + y, _height)).g * ptr[(x * 3) + y];
+	// The mask is applied in integer arithmetic, scaled by 8 (center weight 8, neighbor weights -1).
+	// The responses are buffered so that the image is only filtered once, with the range of responses
+	// accumulated per band of rows and then used to normalize the buffered values.
+	const int BandSize = 16;
+	const int bands = (_height + BandSize - 1) / BandSize;
+	std::vector<int> err(3 * static_cast<size_t>(_width) * _height);
+	std::vector<int> minErr(3 * bands, 0), maxErr(3 * bands, 0);
+
+	ParallelFor(0, bands, [&](unsigned int, size_t band) {
+		int* bandMin = &minErr[3 * band];
+		int* bandMax = &maxErr[3 * band];
+		for (int j = static_cast<int>(band) * BandSize; j < std::min(_height, static_cast<int>(band + 1) * BandSize); j++) {
+			const Pixel32* rows[3] = { row(clampIndex(j - 1, _height)), row(j), row(clampIndex(j + 1, _height)) };
+			int* e = &err[3 * static_cast<size_t>(j) * _width];
+			for (int i = 0; i < _width; i++) {
+				int x[3] = { clampIndex(i - 1, _width), i, clampIndex(i + 1, _width) };
+				int red = 0, green = 0, blue = 0;
+				for (int y = 0; y < 3; y++) {
+					for (int k = 0; k < 3; k++) {
+						red += rows[y][x[k]].r;
+						green += rows[y][x[k]].g;
+						blue += rows[y][x[k]].b;
+					}
+				}
+				e[3 * i + 0] = 9 * rows[1][i].r - red;
+				e[3 * i + 1] = 9 * rows[1][i].g - green;
+				e[3 * i + 2] = 9 * rows[1][i].b - blue;
+				for (int c = 0; c < 3; c++) {
+					bandMin[c] = std::min(bandMin[c], e[3 * i + c]);
+					bandMax[c] = std::max(bandMax[c], e[3 * i + c]);
 				}
-			}
-			if (redErr > maxRedErr) {
-				maxRedErr = redErr;
-			}
-			else if (redErr < minRedErr) {
-				minRedErr = redErr;
-			}
-			if (greenErr > maxGreenErr) {
-				maxGreenErr = greenErr;
-			}
-			else if (greenErr < minGreenErr) {
-				minGreenErr = greenErr;
-			}
-			if (blueErr > maxBlueErr) {
-				maxBlueErr = blueErr;
-			}
-			else if (blueErr < minBlueErr) {
-				minBlueErr = blueErr;
 			}
 		}
+	});
+
+	int minRedErr = 0, minGreenErr = 0, minBlueErr = 0;
+	int maxRedErr = 0, maxGreenErr = 0, maxBlueErr = 0;
+	for (int b = 0; b < bands; b++) {
+		minRedErr = std::min(minRedErr, minErr[3 * b + 0]), maxRedErr = std::max(maxRedErr, maxErr[3 * b + 0]);
+		minGreenErr = std::min(minGreenErr, minErr[3 * b + 1]), maxGreenErr = std::max(maxGreenErr, maxErr[3 * b + 1]);
+		minBlueErr = std::min(minBlueErr, minErr[3 * b + 2]), maxBlueErr = std::max(maxBlueErr, maxErr[3 * b + 2]);
 	}
 
 	Image32 newImg;
 	newImg.setSize(_width, _height);
-	for (int i = 0; i < _width; i++) {
-		for (int j = 0; j < _height; j++) {
-			double redErr = 0, blueErr = 0, greenErr = 0;
-			for (int x = -1; x < 2; x++) {
-				for (int y = -1; y < 2; y++) {
-					redErr += (*this)(clampIndex(i + x, _width), clampIndex(j + y, _height)).r * ptr[(x * 3) + y];
-					blueErr += (*this)(clampIndex(i + x, _width), clampIndex(j + y, _height)).b * ptr[(x * 3) + y];
-					greenErr += (*this)(clampIndex(i + x, _width), clampIndex(j + y, _height)).g * ptr[(x * 3) + y];
-				}
-			}
-			newImg(i, j).r = clamp(((redErr - minRedErr) / (maxRedErr - minRedErr) * 255));
-			newImg(i, j).b = clamp(((blueErr - minBlueErr) / (maxBlueErr - minBlueErr) * 255));
-			newImg(i, j).g = clamp(((greenErr - minGreenErr) / (maxGreenErr - minGreenErr) * 255));
+	for (int j = 0; j < _height; j++) {
+		const Pixel32* inRow = row(j);
+		Pixel32* outRow = newImg.row(j);
+		const int* e = &err[3 * static_cast<size_t>(j) * _width];
+		for (int i = 0; i < _width; i++) {
+			int redErr = e[3 * i + 0], greenErr = e[3 * i + 1], blueErr = e[3 * i + 2];
+			outRow[i].r = clamp((static_cast<double>(redErr - minRedErr) / (maxRedErr - minRedErr) * 255));
+			outRow[i].b = clamp((static_cast<double>(blueErr - minBlueErr) / (maxBlueErr - minBlueErr) * 255));
+			outRow[i].g = clamp((static_cast<double>(greenErr - minGreenErr) / (maxGreenErr - minGreenErr) * 255));
 
-			newImg(i, j).a = (*this)(i, j).a;
+			outRow[i].a = inRow[i].a;
 
-			//Uncomment 356-358 and comment 349-351 for Method 1. Currently using method 2.
-			//newImg(i, j).r = abs(redErr) > threshold ? 255 : 0;
-			//newImg(i, j).b = abs(blueErr) > threshold ? 255 : 0;
-			//newImg(i, j).g = abs(greenErr) > threshold ? 255 : 0;
+			//Uncomment the lines below (and comment out the three above) for Method 1. Currently using method 2.
+			//outRow[i].r = abs(redErr) > 8 * threshold ? 255 : 0;
+			//outRow[i].b = abs(blueErr) > 8 * threshold ? 255 : 0;
+			//outRow[i].g = abs(greenErr) > 8 * threshold ? 255 : 0;
 		}
 	}
 	return newImg;
@@ -363,6 +367,7 @@ Image32 Image32::edgeDetect3X3(void) const
 
 Image32 Image32::scaleNearest(double scaleFactor) const
 {
+	ProfileScope scope("scaleNearest");
 	int width = static_cast<int>(_width * scaleFactor);
 	int height = static_cast<int>(_height * scaleFactor);
 
@@ -394,6 +399,7 @@ Image32 Image32::scaleNearest(double scaleFactor) const
 
 Image32 Image32::scaleBilinear(double scaleFactor) const
 {
+	ProfileScope scope("scaleBilinear");
 	int width = static_cast<int>(_width * scaleFactor);
 	int height = static_cast<int>(_height * scaleFactor);
 
@@ -430,6 +436,7 @@ Image32 Image32::scaleBilinear(double scaleFactor) const
 
 Image32 Image32::scaleGaussian(double scaleFactor) const
 {
+	ProfileScope scope("scaleGaussian");
 	int w = 1.0 / scaleFactor;
 	if (w < 1) w++;
 
@@ -484,6 +491,7 @@ Image32 Image32::scaleGaussian(double scaleFactor) const
 
 Image32 Image32::rotateNearest(double angle) const
 {
+	ProfileScope scope("rotateNearest");
 	double a = -angle;
 
 	int height = static_cast<int>((double)_width * abs(cos(a * (Pi / 180.0))) + (double)_height * abs(sin(a * (Pi / 180.0))));
@@ -517,6 +525,7 @@ Image32 Image32::rotateNearest(double angle) const
 
 Image32 Image32::rotateBilinear(double angle) const
 {
+	ProfileScope scope("rotateBilinear");
 	double a = -angle;
 
 	int height = static_cast<int>((double)_width * abs(cos(a * (Pi / 180.0))) + (double)_height * abs(sin(a * (Pi / 180.0))));
@@ -615,6 +624,7 @@ Image32 Image32::rotateBilinear(double angle) const
 
 Image32 Image32::rotateGaussian(double angle) const
 {
+	ProfileScope scope("rotateGaussian");
 	double a = -angle;
 
 	int height = static_cast<int>((double)_width * abs(cos(a * (Pi / 180.0))) + (double)_height * abs(sin(a * (Pi / 180.0))));
@@ -678,6 +688,7 @@ void Image32::setAlpha(const Image32& matte)
 
 Image32 Image32::composite(const Image32& overlay) const
 {
+	ProfileScope scope("composite");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 	if (_width != overlay.width() || _height != overlay.height()) {
@@ -728,6 +739,7 @@ Image32 Image32::composite(const Image32& overlay) const
 
 Image32 Image32::CrossDissolve(const Image32& source, const Image32& destination, double blendWeight)
 {
+	ProfileScope scope("CrossDissolve");
 	int width = destination.width();
 	int height = destination.height();
 	Image32 newImg;
@@ -748,6 +760,7 @@ Image32 Image32::CrossDissolve(const Image32& source, const Image32& destination
 
 Image32 Image32::warp(const OrientedLineSegmentPairs& olsp) const
 {
+	ProfileScope scope("warp");
 	Image32 newImg;
 	newImg.setSize(this->width(), this->height());
 	for (int j = 0; j < this->height(); j++)
@@ -815,6 +828,7 @@ Image32 Image32::warp(const OrientedLineSegmentPairs& olsp) const
 
 Image32 Image32::blurNXN(double n, double sigma) const
 {
+	ProfileScope scope("blurNXN");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 
@@ -855,6 +869,7 @@ Image32 Image32::blurNXN(double n, double sigma) const
 
 Image32 Image32::funFilter(int numBuckets, int radius) const
 {
+	ProfileScope scope("funFilter");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 
@@ -902,6 +917,7 @@ Image32 Image32::funFilter(int numBuckets, int radius) const
 
 Image32 Image32::crop(int x1, int y1, int x2, int y2) const
 {
+	ProfileScope scope("crop");
 	int width = x2 - x1;
 	int height = y2 - y1;
 
@@ -1062,6 +1078,7 @@ Pixel32 Image32::gaussianSample(Point2D p, double variance, double radius) const
 
 Image32 Image32::shiftChannel(int channel, int amount)
 {
+	ProfileScope scope("shiftChannel");
 	Image32 newImg;
 	newImg.setSize(_width, _height);
 	for (int j = 0; j < newImg.height(); j++) {
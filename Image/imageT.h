@@ -0,0 +1,155 @@
+#ifndef IMAGE_T_INCLUDED
+#define IMAGE_T_INCLUDED
+
+#include <vector>
+#include "image.h"
+#include "convolution.h"
+
+namespace Image
+{
+	/** This class describes the memory layouts of a multi-channel image */
+	class ImageLayout
+	{
+	public:
+		/** The types of layout */
+		enum
+		{
+			INTERLEAVED ,	// The channels of a pixel are adjacent (array of structures, as in Image32)
+			PLANAR ,		// Each channel is stored as a separate image (structure of arrays)
+			COUNT
+		};
+	};
+
+	/** This structure describes the range of values of a channel type: integer channels span [0,Max()] and are rounded and clamped
+	*** whenever a value is stored, while floating-point channels nominally span [0,1] and are stored as is. */
+	template< typename Channel > struct ChannelTraits;
+
+	template<> struct ChannelTraits< unsigned char >
+	{
+		static float Max( void ){ return 255.f; }
+		static unsigned char Store( float v ){ return v<=0 ? 0 : v>=255.f ? 255 : (unsigned char)( v+0.5f ); }
+	};
+
+	template<> struct ChannelTraits< unsigned short >
+	{
+		static float Max( void ){ return 65535.f; }
+		static unsigned short Store( float v ){ return v<=0 ? 0 : v>=65535.f ? 65535 : (unsigned short)( v+0.5f ); }
+	};
+
+	template<> struct ChannelTraits< float >
+	{
+		static float Max( void ){ return 1.f; }
+		static float Store( float v ){ return v; }
+	};
+
+	/** This templated class represents an RGBA image with the prescribed channel type and memory layout.
+	*** It provides the filters of Image32 that do not depend on the 8-bit representation, computed in single precision,
+	*** so that with floating-point channels a sequence of filters is quantized only once, when the result is converted back to an Image32.
+	*** In the planar layout, the values of a channel along a row are contiguous, so the filter loops vectorize. */
+	template< typename Channel , int Layout=ImageLayout::PLANAR >
+	class ImageT
+	{
+		/** The dimensions of the image */
+		int _width , _height;
+
+		/** The channel values */
+		std::vector< Channel > _values;
+
+		/** This method reads the prescribed channel of a row of the image into the array, converted to float and padded by replicating the first and last values */
+		void _readRow( int c , int y , float *values , int left=0 , int right=0 ) const;
+
+		/** This method writes the array into the prescribed channel of a row of the image */
+		void _writeRow( int c , int y , const float *values );
+
+		/** This method returns the image obtained by applying the functor, called as f( rgba ) on the (float) channel values of each pixel, in place */
+		template< typename PixelFunction >
+		ImageT _map( PixelFunction f ) const;
+
+		/** This method returns the image obtained by correlating the color channels with the kernel given as a vector of weights per row,
+		*** with the kernel's center at ( left , top ) and the edges of the image replicated. The alpha channel is copied. */
+		ImageT _correlate( const std::vector< std::vector< float > > &weights , int left , int top ) const;
+
+		/** This method returns the image obtained by correlating the color channels with the horizontal and then the vertical weights,
+		*** whose centers are at left and top. The alpha channel is copied. */
+		ImageT _correlateSeparable( const std::vector< float > &horizontal , int left , const std::vector< float > &vertical , int top ) const;
+	public:
+		/** The number of channels (red, green, blue, and alpha) */
+		static const int Channels = 4;
+
+		/** The distance between the values of a channel at consecutive pixels of a row */
+		static const int PixelStride = Layout==ImageLayout::PLANAR ? 1 : Channels;
+
+		/** The default constructor */
+		ImageT( void );
+
+		/** This constructor instantiates an image of the prescribed dimensions, with all values set to zero */
+		ImageT( int width , int height );
+
+		/** This constructor converts an Image32, rescaling the values to the range of the channel type */
+		explicit ImageT( const Image32 &img );
+
+		/** This constructor converts an image with a different channel type or layout, rescaling the values to the range of the channel type */
+		template< typename _Channel , int _Layout >
+		explicit ImageT( const ImageT< _Channel , _Layout > &img );
+
+		/** This method returns the image converted to an Image32, with the values rounded and clamped to the range [0,255] */
+		Image32 toImage32( void ) const;
+
+		/** This method sets the dimensions of the image, setting all values to zero */
+		void setSize( int width , int height );
+
+		/** This method returns the width of the image */
+		int width( void ) const { return _width; }
+
+		/** This method returns the height of the image */
+		int height( void ) const { return _height; }
+
+		/** This method returns a pointer to the value of the channel at the first pixel of the row, with the values at consecutive pixels PixelStride apart */
+		Channel *row( int c , int y ){ return &_values[ Layout==ImageLayout::PLANAR ? ( (size_t)c*_height + y ) * _width : (size_t)y*_width*Channels + c ]; }
+
+		/** This method returns a pointer to the value of the channel at the first pixel of the row, with the values at consecutive pixels PixelStride apart */
+		const Channel *row( int c , int y ) const { return &_values[ Layout==ImageLayout::PLANAR ? ( (size_t)c*_height + y ) * _width : (size_t)y*_width*Channels + c ]; }
+
+		/** This method returns a reference to the value of the channel at the pixel */
+		Channel &operator() ( int x , int y , int c ){ return row( c , y )[ (size_t)x*PixelStride ]; }
+
+		/** This method returns a reference to the value of the channel at the pixel */
+		const Channel &operator() ( int x , int y , int c ) const { return row( c , y )[ (size_t)x*PixelStride ]; }
+
+		/** This method outputs a new image that is brighter (or darker) by the prescribed factor (see Image32::brighten) */
+		ImageT brighten( double brightness ) const;
+
+		/** This method outputs a gray-scale image (see Image32::luminance) */
+		ImageT luminance( void ) const;
+
+		/** This method outputs a new image with the contrast changed relative to the average luminance (see Image32::contrast) */
+		ImageT contrast( double contrast ) const;
+
+		/** This method outputs a new image with the saturation changed relative to the luminance of each pixel (see Image32::saturate) */
+		ImageT saturate( double saturation ) const;
+
+		/** This method outputs the image blurred with the 3x3 binomial kernel (see Image32::blur3X3) */
+		ImageT blur3X3( void ) const;
+
+		/** This method outputs the response to the 3x3 Laplacian-like mask, normalized to the range of the channel type (see Image32::edgeDetect3X3) */
+		ImageT edgeDetect3X3( void ) const;
+
+		/** This method outputs the convolution of the color channels with the kernel, replicating the edges of the image.
+		*** Separable kernels are applied as a pair of one-dimensional filters. */
+		ImageT convolve( const Kernel &kernel ) const;
+
+		/** This method outputs the image scaled with bilinear sampling (see Image32::scaleBilinear) */
+		ImageT scaleBilinear( double scaleFactor ) const;
+
+		/** This method outputs the image cropped to the rectangle with corners (x1,y1) and (x2,y2) (see Image32::crop) */
+		ImageT crop( int x1 , int y1 , int x2 , int y2 ) const;
+	};
+
+	/** An image with planar float channels */
+	typedef ImageT< float , ImageLayout::PLANAR > ImageF;
+
+	/** An image with planar 16-bit channels */
+	typedef ImageT< unsigned short , ImageLayout::PLANAR > Image16;
+}
+#include "imageT.inl"
+#endif // IMAGE_T_INCLUDED
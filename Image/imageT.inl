@@ -0,0 +1,363 @@
+#include <math.h>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include <Util/parallel.h>
+
+namespace Image
+{
+	////////////
+	// ImageT //
+	////////////
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout >::ImageT( void ) : _width(0) , _height(0) {}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout >::ImageT( int width , int height ) : _width(0) , _height(0) { setSize( width , height ); }
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout >::ImageT( const Image32 &img ) : _width(0) , _height(0)
+	{
+		setSize( img.width() , img.height() );
+		const float scale = ChannelTraits< Channel >::Max() / 255.f;
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			const Pixel32 *in = img.row( (int)j );
+			Channel *r = row( 0 , (int)j ) , *g = row( 1 , (int)j ) , *b = row( 2 , (int)j ) , *a = row( 3 , (int)j );
+			for( int i=0 ; i<_width ; i++ )
+			{
+				r[i*PixelStride] = ChannelTraits< Channel >::Store( in[i].r * scale );
+				g[i*PixelStride] = ChannelTraits< Channel >::Store( in[i].g * scale );
+				b[i*PixelStride] = ChannelTraits< Channel >::Store( in[i].b * scale );
+				a[i*PixelStride] = ChannelTraits< Channel >::Store( in[i].a * scale );
+			}
+		} , 8 );
+	}
+
+	template< typename Channel , int Layout >
+	template< typename _Channel , int _Layout >
+	ImageT< Channel , Layout >::ImageT( const ImageT< _Channel , _Layout > &img ) : _width(0) , _height(0)
+	{
+		setSize( img.width() , img.height() );
+		const float scale = ChannelTraits< Channel >::Max() / ChannelTraits< _Channel >::Max();
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			for( int c=0 ; c<Channels ; c++ )
+			{
+				const _Channel *in = img.row( c , (int)j );
+				Channel *out = row( c , (int)j );
+				for( int i=0 ; i<_width ; i++ ) out[i*PixelStride] = ChannelTraits< Channel >::Store( in[ i*ImageT< _Channel , _Layout >::PixelStride ] * scale );
+			}
+		} , 8 );
+	}
+
+	template< typename Channel , int Layout >
+	Image32 ImageT< Channel , Layout >::toImage32( void ) const
+	{
+		Image32 img;
+		img.setSize( _width , _height );
+		const float scale = 255.f / ChannelTraits< Channel >::Max();
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			Pixel32 *out = img.row( (int)j );
+			const Channel *r = row( 0 , (int)j ) , *g = row( 1 , (int)j ) , *b = row( 2 , (int)j ) , *a = row( 3 , (int)j );
+			for( int i=0 ; i<_width ; i++ )
+			{
+				out[i].r = ChannelTraits< unsigned char >::Store( r[i*PixelStride] * scale );
+				out[i].g = ChannelTraits< unsigned char >::Store( g[i*PixelStride] * scale );
+				out[i].b = ChannelTraits< unsigned char >::Store( b[i*PixelStride] * scale );
+				out[i].a = ChannelTraits< unsigned char >::Store( a[i*PixelStride] * scale );
+			}
+		} , 8 );
+		return img;
+	}
+
+	template< typename Channel , int Layout >
+	void ImageT< Channel , Layout >::setSize( int width , int height )
+	{
+		if( width<0 || height<0 ) THROW( "Bad image dimensions: %d x %d" , width , height );
+		_width = width , _height = height;
+		_values.assign( (size_t)width * height * Channels , (Channel)0 );
+	}
+
+	template< typename Channel , int Layout >
+	void ImageT< Channel , Layout >::_readRow( int c , int y , float *values , int left , int right ) const
+	{
+		const Channel *r = row( c , y );
+		for( int i=0 ; i<_width ; i++ ) values[left+i] = (float)r[i*PixelStride];
+		for( int i=0 ; i<left ; i++ ) values[i] = values[left];
+		for( int i=0 ; i<right ; i++ ) values[left+_width+i] = values[left+_width-1];
+	}
+
+	template< typename Channel , int Layout >
+	void ImageT< Channel , Layout >::_writeRow( int c , int y , const float *values )
+	{
+		Channel *r = row( c , y );
+		for( int i=0 ; i<_width ; i++ ) r[i*PixelStride] = ChannelTraits< Channel >::Store( values[i] );
+	}
+
+	template< typename Channel , int Layout >
+	template< typename PixelFunction >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::_map( PixelFunction f ) const
+	{
+		ImageT img( _width , _height );
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			const Channel *in[Channels];
+			Channel *out[Channels];
+			for( int c=0 ; c<Channels ; c++ ) in[c] = row( c , (int)j ) , out[c] = img.row( c , (int)j );
+			for( int i=0 ; i<_width ; i++ )
+			{
+				float rgba[Channels];
+				for( int c=0 ; c<Channels ; c++ ) rgba[c] = (float)in[c][i*PixelStride];
+				f( rgba );
+				for( int c=0 ; c<Channels ; c++ ) out[c][i*PixelStride] = ChannelTraits< Channel >::Store( rgba[c] );
+			}
+		} , 8 );
+		return img;
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::_correlate( const std::vector< std::vector< float > > &weights , int left , int top ) const
+	{
+		const int kh = (int)weights.size() , kw = (int)weights[0].size() , right = kw-1-left;
+		ImageT img( _width , _height );
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			std::vector< float > padded( _width+kw-1 ) , sum( _width );
+			for( int c=0 ; c<3 ; c++ )
+			{
+				std::fill( sum.begin() , sum.end() , 0.f );
+				for( int y=0 ; y<kh ; y++ )
+				{
+					_readRow( c , std::min< int >( std::max< int >( (int)j+y-top , 0 ) , _height-1 ) , &padded[0] , left , right );
+					for( int x=0 ; x<kw ; x++ )
+					{
+						const float w = weights[y][x];
+						if( !w ) continue;
+						const float *p = &padded[x];
+						for( int i=0 ; i<_width ; i++ ) sum[i] += w * p[i];
+					}
+				}
+				img._writeRow( c , (int)j , &sum[0] );
+			}
+			const Channel *in = row( 3 , (int)j );
+			Channel *out = img.row( 3 , (int)j );
+			for( int i=0 ; i<_width ; i++ ) out[i*PixelStride] = in[i*PixelStride];
+		} , 8 );
+		return img;
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::_correlateSeparable( const std::vector< float > &horizontal , int left , const std::vector< float > &vertical , int top ) const
+	{
+		const int kw = (int)horizontal.size() , kh = (int)vertical.size();
+		ImageT img( _width , _height );
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			// Filter the rows vertically, and then filter the (padded) result horizontally
+			std::vector< float > in( _width ) , column( _width+kw-1 ) , sum( _width );
+			for( int c=0 ; c<3 ; c++ )
+			{
+				float *_column = &column[left];
+				std::fill( column.begin() , column.end() , 0.f );
+				for( int y=0 ; y<kh ; y++ )
+				{
+					const float w = vertical[y];
+					if( !w ) continue;
+					_readRow( c , std::min< int >( std::max< int >( (int)j+y-top , 0 ) , _height-1 ) , &in[0] );
+					for( int i=0 ; i<_width ; i++ ) _column[i] += w * in[i];
+				}
+				for( int i=0 ; i<left ; i++ ) column[i] = _column[0];
+				for( int i=left+_width ; i<_width+kw-1 ; i++ ) column[i] = _column[_width-1];
+
+				std::fill( sum.begin() , sum.end() , 0.f );
+				for( int x=0 ; x<kw ; x++ )
+				{
+					const float w = horizontal[x];
+					if( !w ) continue;
+					const float *p = &column[x];
+					for( int i=0 ; i<_width ; i++ ) sum[i] += w * p[i];
+				}
+				img._writeRow( c , (int)j , &sum[0] );
+			}
+			const Channel *a = row( 3 , (int)j );
+			Channel *out = img.row( 3 , (int)j );
+			for( int i=0 ; i<_width ; i++ ) out[i*PixelStride] = a[i*PixelStride];
+		} , 8 );
+		return img;
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::brighten( double brightness ) const
+	{
+		const float b = (float)brightness;
+		return _map( [&]( float *p ){ p[0] *= b , p[1] *= b , p[2] *= b; } );
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::luminance( void ) const
+	{
+		return _map( []( float *p ){ p[0] = p[1] = p[2] = 0.3f*p[0] + 0.59f*p[1] + 0.11f*p[2]; } );
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::contrast( double contrast ) const
+	{
+		// The average luminance, accumulated per row
+		std::vector< double > sums( _height , 0 );
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			const Channel *r = row( 0 , (int)j ) , *g = row( 1 , (int)j ) , *b = row( 2 , (int)j );
+			double sum = 0;
+			for( int i=0 ; i<_width ; i++ ) sum += 0.3*r[i*PixelStride] + 0.59*g[i*PixelStride] + 0.11*b[i*PixelStride];
+			sums[j] = sum;
+		} , 8 );
+		double sum = 0;
+		for( int j=0 ; j<_height ; j++ ) sum += sums[j];
+		const float c = (float)contrast , average = _width && _height ? (float)( sum / _width / _height ) : 0.f;
+		const float offset = ( 1.f - c ) * average;
+		return _map( [&]( float *p ){ p[0] = offset + c*p[0] , p[1] = offset + c*p[1] , p[2] = offset + c*p[2]; } );
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::saturate( double saturation ) const
+	{
+		const float s = (float)saturation;
+		return _map( [&]( float *p )
+		{
+			float l = ( 1.f - s ) * ( 0.3f*p[0] + 0.59f*p[1] + 0.11f*p[2] );
+			p[0] = l + s*p[0] , p[1] = l + s*p[1] , p[2] = l + s*p[2];
+		} );
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::blur3X3( void ) const
+	{
+		if( !_width || !_height ) return *this;
+		std::vector< float > weights = { 0.25f , 0.5f , 0.25f };
+		return _correlateSeparable( weights , 1 , weights , 1 );
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::edgeDetect3X3( void ) const
+	{
+		if( !_width || !_height ) return *this;
+
+		// The responses are buffered, with their range accumulated per row (starting from zero, as in Image32::edgeDetect3X3)
+		std::vector< float > responses( (size_t)3*_width*_height );
+		std::vector< float > minResponses( 3*(size_t)_height , 0.f ) , maxResponses( 3*(size_t)_height , 0.f );
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			std::vector< float > rows[3];
+			for( int y=0 ; y<3 ; y++ ) rows[y].resize( _width+2 );
+			for( int c=0 ; c<3 ; c++ )
+			{
+				for( int y=0 ; y<3 ; y++ ) _readRow( c , std::min< int >( std::max< int >( (int)j+y-1 , 0 ) , _height-1 ) , &rows[y][0] , 1 , 1 );
+				float *e = &responses[ ( (size_t)c*_height + j ) * _width ];
+				float &minE = minResponses[3*j+c] , &maxE = maxResponses[3*j+c];
+				for( int i=0 ; i<_width ; i++ )
+				{
+					float sum = 0;
+					for( int y=0 ; y<3 ; y++ ) sum += rows[y][i] + rows[y][i+1] + rows[y][i+2];
+					e[i] = 9.f * rows[1][i+1] - sum;
+					minE = std::min< float >( minE , e[i] ) , maxE = std::max< float >( maxE , e[i] );
+				}
+			}
+		} , 8 );
+
+		float minE[3] = { 0 , 0 , 0 } , maxE[3] = { 0 , 0 , 0 };
+		for( int j=0 ; j<_height ; j++ ) for( int c=0 ; c<3 ; c++ ) minE[c] = std::min< float >( minE[c] , minResponses[3*j+c] ) , maxE[c] = std::max< float >( maxE[c] , maxResponses[3*j+c] );
+
+		ImageT img( _width , _height );
+		Util::ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+		{
+			std::vector< float > values( _width );
+			for( int c=0 ; c<3 ; c++ )
+			{
+				const float *e = &responses[ ( (size_t)c*_height + j ) * _width ];
+				const float scale = maxE[c]>minE[c] ? ChannelTraits< Channel >::Max() / ( maxE[c]-minE[c] ) : 0.f;
+				for( int i=0 ; i<_width ; i++ ) values[i] = ( e[i]-minE[c] ) * scale;
+				img._writeRow( c , (int)j , &values[0] );
+			}
+			const Channel *a = row( 3 , (int)j );
+			Channel *out = img.row( 3 , (int)j );
+			for( int i=0 ; i<_width ; i++ ) out[i*PixelStride] = a[i*PixelStride];
+		} , 8 );
+		return img;
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::convolve( const Kernel &kernel ) const
+	{
+		if( !kernel.width() || !kernel.height() ) THROW( "Empty kernel" );
+		if( !_width || !_height ) return *this;
+
+		// Convolution is performed as a correlation with the flipped kernel, whose center is at ( kw-1-kw/2 , kh-1-kh/2 )
+		const int kw = kernel.width() , kh = kernel.height() , left = kw-1-kw/2 , top = kh-1-kh/2;
+		std::vector< double > horizontal , vertical;
+		if( kernel.separable( horizontal , vertical ) )
+		{
+			std::vector< float > hWeights( kw ) , vWeights( kh );
+			for( int x=0 ; x<kw ; x++ ) hWeights[x] = (float)horizontal[kw-1-x];
+			for( int y=0 ; y<kh ; y++ ) vWeights[y] = (float)vertical[kh-1-y];
+			return _correlateSeparable( hWeights , left , vWeights , top );
+		}
+		else
+		{
+			std::vector< std::vector< float > > weights( kh , std::vector< float >( kw ) );
+			for( int y=0 ; y<kh ; y++ ) for( int x=0 ; x<kw ; x++ ) weights[y][x] = (float)kernel( kw-1-x , kh-1-y );
+			return _correlate( weights , left , top );
+		}
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::scaleBilinear( double scaleFactor ) const
+	{
+		if( scaleFactor<=0 ) THROW( "Scale factor must be positive: %g" , scaleFactor );
+		const int width = (int)( _width * scaleFactor ) , height = (int)( _height * scaleFactor );
+		ImageT img( width , height );
+		if( !_width || !_height ) return img;
+
+		// The source pixels and weights, sampled as in Image32::scaleBilinear
+		auto Clamp = []( int i , int size ){ return i<0 ? 0 : i>size-1 ? size-1 : i; };
+		std::vector< int > u1( width ) , u2( width );
+		std::vector< float > du( width );
+		for( int i=0 ; i<width ; i++ )
+		{
+			u1[i] = Clamp( (int)floor( i / scaleFactor ) , _width ) , u2[i] = Clamp( u1[i]+1 , _width );
+			du[i] = (float)( i / scaleFactor - u1[i] );
+		}
+		Util::ParallelFor( 0 , height , [&]( unsigned int , size_t j )
+		{
+			const int v1 = Clamp( (int)floor( j / scaleFactor ) , _height ) , v2 = Clamp( v1+1 , _height );
+			const float dv = (float)( j / scaleFactor - v1 );
+			std::vector< float > values( width );
+			for( int c=0 ; c<Channels ; c++ )
+			{
+				const Channel *r1 = row( c , v1 ) , *r2 = row( c , v2 );
+				for( int i=0 ; i<width ; i++ )
+				{
+					float a = r1[ u1[i]*PixelStride ] * ( 1.f-du[i] ) + r1[ u2[i]*PixelStride ] * du[i];
+					float b = r2[ u1[i]*PixelStride ] * ( 1.f-du[i] ) + r2[ u2[i]*PixelStride ] * du[i];
+					values[i] = a * ( 1.f-dv ) + b * dv;
+				}
+				img._writeRow( c , (int)j , &values[0] );
+			}
+		} , 8 );
+		return img;
+	}
+
+	template< typename Channel , int Layout >
+	ImageT< Channel , Layout > ImageT< Channel , Layout >::crop( int x1 , int y1 , int x2 , int y2 ) const
+	{
+		if( x1<0 || y1<0 || x2>_width || y2>_height || x2<x1 || y2<y1 ) THROW( "Bad crop rectangle: ( %d , %d ) x ( %d , %d )" , x1 , y1 , x2 , y2 );
+		ImageT img( x2-x1 , y2-y1 );
+		for( int j=0 ; j<img._height ; j++ ) for( int c=0 ; c<Channels ; c++ )
+		{
+			const Channel *in = row( c , y1+j ) + (size_t)x1*PixelStride;
+			Channel *out = img.row( c , j );
+			for( int i=0 ; i<img._width ; i++ ) out[i*PixelStride] = in[i*PixelStride];
+		}
+		return img;
+	}
+}
@@ -10,7 +10,14 @@ extern "C"
 }
 #endif // WIN32
 #include <setjmp.h>
+#include <vector>
+#include <algorithm>
+#include <string.h>
 #include <Util/exceptions.h>
+#include <Util/parallel.h>
+
+// The JCS_EXT_RGBA rows are read into and written from the image memory directly
+static_assert( sizeof( Image::Pixel32 )==4 , "Pixel32 is not packed RGBA" );
 
 struct my_error_mgr
 {
@@ -34,33 +41,304 @@ my_error_exit( j_common_ptr cinfo )
 	longjmp( myerr->setjmp_buffer , 1 );
 }
 
+/* Source manager reading from a caller-owned memory buffer, which is handed to the library in one piece */
+METHODDEF(void)
+memory_init_source( j_decompress_ptr cinfo ){}
+
+METHODDEF(boolean)
+memory_fill_input_buffer( j_decompress_ptr cinfo )
+{
+	/* The data ran out before the end of the image: as the stdio source does, insert a fake EOI marker */
+	static const JOCTET eoi[] = { 0xFF , JPEG_EOI };
+	cinfo->src->next_input_byte = eoi;
+	cinfo->src->bytes_in_buffer = 2;
+	return TRUE;
+}
+
+METHODDEF(void)
+memory_skip_input_data( j_decompress_ptr cinfo , long num_bytes )
+{
+	if( num_bytes<=0 ) return;
+	if( (size_t)num_bytes>cinfo->src->bytes_in_buffer ) (void) memory_fill_input_buffer( cinfo );
+	else cinfo->src->next_input_byte += num_bytes , cinfo->src->bytes_in_buffer -= num_bytes;
+}
+
+METHODDEF(void)
+memory_term_source( j_decompress_ptr cinfo ){}
+
+static void set_memory_source( j_decompress_ptr cinfo , struct jpeg_source_mgr *src , const void *buffer , size_t size )
+{
+	cinfo->src = src;
+	src->init_source = memory_init_source;
+	src->fill_input_buffer = memory_fill_input_buffer;
+	src->skip_input_data = memory_skip_input_data;
+	src->resync_to_restart = jpeg_resync_to_restart;
+	src->term_source = memory_term_source;
+	src->next_input_byte = (const JOCTET *)buffer;
+	src->bytes_in_buffer = size;
+}
+
+/* Destination manager writing into a std::vector, which is grown (by doubling) as the compressed data comes in */
+struct vector_destination_mgr
+{
+	struct jpeg_destination_mgr pub;
+	std::vector< unsigned char > *buffer;
+};
+
+METHODDEF(void)
+vector_init_destination( j_compress_ptr cinfo )
+{
+	vector_destination_mgr *dest = (vector_destination_mgr *)cinfo->dest;
+	// Reuse whatever storage the vector already has
+	dest->buffer->resize( std::max< size_t >( dest->buffer->capacity() , 1<<16 ) );
+	dest->pub.next_output_byte = &(*dest->buffer)[0];
+	dest->pub.free_in_buffer = dest->buffer->size();
+}
+
+METHODDEF(boolean)
+vector_empty_output_buffer( j_compress_ptr cinfo )
+{
+	vector_destination_mgr *dest = (vector_destination_mgr *)cinfo->dest;
+	size_t used = dest->buffer->size();
+	dest->buffer->resize( 2*used );
+	dest->pub.next_output_byte = &(*dest->buffer)[used];
+	dest->pub.free_in_buffer = dest->buffer->size() - used;
+	return TRUE;
+}
+
+METHODDEF(void)
+vector_term_destination( j_compress_ptr cinfo )
+{
+	vector_destination_mgr *dest = (vector_destination_mgr *)cinfo->dest;
+	dest->buffer->resize( dest->buffer->size() - dest->pub.free_in_buffer );
+}
+
+static void set_vector_destination( j_compress_ptr cinfo , vector_destination_mgr *dest , std::vector< unsigned char > &buffer )
+{
+	cinfo->dest = &dest->pub;
+	dest->pub.init_destination = vector_init_destination;
+	dest->pub.empty_output_buffer = vector_empty_output_buffer;
+	dest->pub.term_destination = vector_term_destination;
+	dest->buffer = &buffer;
+}
+
 namespace Image
 {
-	void JPEGReadImage( std::string fileName , Image32& img )
+	/** This function reads in a JPEG from the source installed by the functor, called as setSource( j_decompress_ptr ) */
+	template< typename SetSource >
+	double _JPEGReadImage( SetSource setSource , Image32& img , double scale );
+
+	/** This function writes out the rows [rowBegin,rowEnd) of the image as a JPEG to the destination installed by the functor, called as setDestination( j_compress_ptr ) */
+	template< typename SetDestination >
+	void _JPEGWriteImage( const Image32& img , SetDestination setDestination , const JPEGWriteOptions &options , int rowBegin , int rowEnd );
+
+	/** This function writes out the rows [rowBegin,rowEnd) of the image as a JPEG into the buffer */
+	static void _JPEGWriteImageRows( const Image32& img , std::vector< unsigned char > &buffer , const JPEGWriteOptions &options , int rowBegin , int rowEnd );
+
+	/** The number of pixels below which a band (or strip) is not worth a thread of its own, as starting the thread and setting up the library cost more than decoding it */
+	static const size_t _MinParallelPixels = 1<<16;
+
+	/** This function reads in a JPEG with restart markers from memory, decoding bands of MCU rows on separate threads.
+	*** It returns false if the JPEG cannot be split into bands or a band fails to decode, in which case the image contents are undefined. */
+	static bool _JPEGReadImageBanded( const unsigned char *data , size_t size , Image32& img , double scale , double &s );
+
+	/** This function writes out a JPEG into the buffer, encoding strips of MCU rows on separate threads and splicing their restart segments together.
+	*** It returns false if the image is too small to be split or the options do not allow it. */
+	static bool _JPEGWriteImageStrips( const Image32& img , const JPEGWriteOptions &options , std::vector< unsigned char > &buffer );
+
+	/////////////////////
+	// JPEGSubsampling //
+	/////////////////////
+	const char *JPEGSubsampling::Names[] = { "444" , "422" , "420" };
+
+	int JPEGSubsampling::Parse( const std::string &name )
+	{
+		for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+		THROW( "Unrecognized JPEG subsampling: %s" , name.c_str() );
+		return -1;
+	}
+
+	///////////////////
+	// JPEGDCTMethod //
+	///////////////////
+	const char *JPEGDCTMethod::Names[] = { "islow" , "ifast" , "float" };
+
+	int JPEGDCTMethod::Parse( const std::string &name )
+	{
+		for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+		THROW( "Unrecognized JPEG DCT method: %s" , name.c_str() );
+		return -1;
+	}
+
+	///////////////////
+	// JPEGTransform //
+	///////////////////
+	const char *JPEGTransform::Names[] = { "none" , "flipH" , "flipV" , "transpose" , "transverse" , "rot90" , "rot180" , "rot270" };
+
+	int JPEGTransform::Parse( const std::string &name )
+	{
+		for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+		THROW( "Unrecognized JPEG transform: %s" , name.c_str() );
+		return -1;
+	}
+
+	//////////////////////
+	// JPEGWriteOptions //
+	//////////////////////
+	JPEGWriteOptions::JPEGWriteOptions( int quality ) : quality(quality) , optimize(false) , progressive(false) , subsampling(JPEGSubsampling::S420) , restartRows(1) , dctMethod(JPEGDCTMethod::ISLOW) {}
+
+	/** This function reads the rest of the stream into the buffer (reusing its storage), returning the number of bytes read */
+	static size_t _ReadStream( FILE *fp , std::vector< unsigned char > &buffer )
+	{
+		buffer.resize( 0 );
+		size_t read = 0;
+		do
+		{
+			buffer.resize( std::max< size_t >( 2*buffer.size() , 1<<16 ) );
+			read += fread( &buffer[read] , 1 , buffer.size()-read , fp );
+		}
+		while( read==buffer.size() );
+		return read;
+	}
+
+	/** This function reads the whole file into the buffer (reusing its storage), returning the number of bytes read */
+	static size_t _ReadFile( std::string fileName , std::vector< unsigned char > &buffer )
+	{
+		FILE *fp = fopen( fileName.c_str() , "rb" );
+		if( !fp ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
+		size_t read = _ReadStream( fp , buffer );
+		fclose( fp );
+		return read;
+	}
+
+	/** This function writes the buffer out to the file */
+	static void _WriteFile( std::string fileName , const std::vector< unsigned char > &buffer )
+	{
+		FILE *fp = fopen( fileName.c_str() , "wb" );
+		if( !fp ) THROW( "Failed to open file for writing: %s" , fileName.c_str() );
+		size_t written = fwrite( &buffer[0] , 1 , buffer.size() , fp );
+		fclose( fp );
+		if( written!=buffer.size() ) THROW( "Failed to write JPEG data: %s" , fileName.c_str() );
+	}
+
+	double JPEGReadImage( std::string fileName , Image32& img , double scale )
 	{
 		FILE *fp = fopen( fileName.c_str() , "rb" );
 		if( !fp ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
-		JPEGReadImage( fp , img );
+
+		// Read the whole file so that it can be decoded in bands (falling back to streaming if its length cannot be determined)
+		long size = -1;
+		if( !fseek( fp , 0 , SEEK_END ) ) size = ftell( fp ) , rewind( fp );
+		if( size<=0 )
+		{
+			double s = JPEGReadImage( fp , img , scale );
+			fclose(fp);
+			return s;
+		}
+		std::vector< unsigned char > buffer( size );
+		size_t read = fread( &buffer[0] , 1 , buffer.size() , fp );
 		fclose(fp);
+		return JPEGReadImage( &buffer[0] , read , img , scale );
 	}
 
-	void JPEGWriteImage( const Image32& img , std::string fileName , int quality )
+	void JPEGWriteImage( const Image32& img , std::string fileName , int quality ){ JPEGWriteImage( img , fileName , JPEGWriteOptions( quality ) ); }
+
+	void JPEGWriteImage( const Image32& img , std::string fileName , const JPEGWriteOptions &options )
 	{
 		FILE *fp = fopen( fileName.c_str() , "wb" );
 		if( !fp ) THROW( "Failed to open file for writing: %s" , fileName.c_str() );
-		JPEGWriteImage( img , fp , quality );
+		JPEGWriteImage( img , fp , options );
 		fclose(fp);
 	}
 
-	void JPEGReadImage( FILE *fp , Image32& img )
+	double JPEGReadImage( FILE *fp , Image32& img , double scale )
+	{
+		return _JPEGReadImage( [&]( j_decompress_ptr cinfo ){ jpeg_stdio_src( cinfo , fp ); } , img , scale );
+	}
+
+	double JPEGReadImage( const void *buffer , size_t size , Image32& img , double scale )
+	{
+		double s;
+		if( _JPEGReadImageBanded( (const unsigned char *)buffer , size , img , scale , s ) ) return s;
+
+		struct jpeg_source_mgr src;
+		return _JPEGReadImage( [&]( j_decompress_ptr cinfo ){ set_memory_source( cinfo , &src , buffer , size ); } , img , scale );
+	}
+
+	void JPEGWriteImage( const Image32& img , FILE *fp , int quality ){ JPEGWriteImage( img , fp , JPEGWriteOptions( quality ) ); }
+
+	void JPEGWriteImage( const Image32& img , FILE *fp , const JPEGWriteOptions &options )
+	{
+		std::vector< unsigned char > buffer;
+		if( _JPEGWriteImageStrips( img , options , buffer ) )
+		{
+			if( fwrite( &buffer[0] , 1 , buffer.size() , fp )!=buffer.size() ) THROW( "Failed to write JPEG data" );
+		}
+		else _JPEGWriteImage( img , [&]( j_compress_ptr cinfo ){ jpeg_stdio_dest( cinfo , fp ); } , options , 0 , img.height() );
+	}
+
+	void JPEGWriteImage( const Image32& img , std::vector< unsigned char > &buffer , int quality ){ JPEGWriteImage( img , buffer , JPEGWriteOptions( quality ) ); }
+
+	void JPEGWriteImage( const Image32& img , std::vector< unsigned char > &buffer , const JPEGWriteOptions &options )
+	{
+		if( !_JPEGWriteImageStrips( img , options , buffer ) ) _JPEGWriteImageRows( img , buffer , options , 0 , img.height() );
+	}
+
+	static void _JPEGWriteImageRows( const Image32& img , std::vector< unsigned char > &buffer , const JPEGWriteOptions &options , int rowBegin , int rowEnd )
+	{
+		vector_destination_mgr dest;
+		_JPEGWriteImage( img , [&]( j_compress_ptr cinfo ){ set_vector_destination( cinfo , &dest , buffer ); } , options , rowBegin , rowEnd );
+	}
+
+	/** This function sets the decompression parameters, returning false if the JPEG's color space cannot be read into an Image32 */
+	static bool _SetDecompressParameters( j_decompress_ptr cinfo , double scale )
+	{
+		// Let the decoder drop the high frequencies of each block (using the reduced-size inverse DCTs) when a smaller image is requested
+		cinfo->scale_num = 1 , cinfo->scale_denom = 1;
+		while( cinfo->scale_denom<8 && scale*cinfo->scale_denom*2<=1. ) cinfo->scale_denom *= 2;
+
+		// Have the color converter write (opaque) RGBA pixels, which have the layout of a Pixel32, straight into the image rows
+		if( cinfo->jpeg_color_space!=JCS_GRAYSCALE && cinfo->jpeg_color_space!=JCS_YCbCr && cinfo->jpeg_color_space!=JCS_RGB ) return false;
+		cinfo->out_color_space = JCS_EXT_RGBA;
+		return true;
+	}
+
+	/** This function decodes the JPEG from the installed source into the image, using the vector to hold the row pointers.
+	*** It returns the scale factor that was applied, or zero if the JPEG's color space cannot be read into an Image32 (in which case the decompression is aborted).
+	*** Either way, the decompression object is left ready for the next image. */
+	static double _Decompress( j_decompress_ptr cinfo , Image32& img , double scale , std::vector< JSAMPROW > &rows )
+	{
+		(void) jpeg_read_header( cinfo , TRUE );
+
+		if( !_SetDecompressParameters( cinfo , scale ) )
+		{
+			jpeg_abort_decompress( cinfo );
+			return 0;
+		}
+
+		(void) jpeg_start_decompress( cinfo );
+
+		int width = cinfo->output_width , height = cinfo->output_height;
+
+		img.setSize( width , height );
+
+		rows.resize( height );
+		for( int j=0 ; j<height ; j++ ) rows[j] = (JSAMPROW)img.row(j);
+		while( cinfo->output_scanline<cinfo->output_height )
+			(void) jpeg_read_scanlines( cinfo , &rows[ cinfo->output_scanline ] , cinfo->output_height-cinfo->output_scanline );
+
+		double s = (double)cinfo->scale_num / cinfo->scale_denom;
+		(void) jpeg_finish_decompress( cinfo );
+		return s;
+	}
+
+	template< typename SetSource >
+	double _JPEGReadImage( SetSource setSource , Image32& img , double scale )
 	{
 		struct jpeg_decompress_struct cinfo;
 		struct my_error_mgr jerr;
 
-		JSAMPARRAY buffer;            /* Output row buffer */
-		int row_stride;               /* physical row width in output buffer */
-		int width,height;
-		Pixel32 p;
+		std::vector< JSAMPROW > rows;
 
 		cinfo.err = jpeg_std_error( &jerr.pub );
 		jerr.pub.error_exit = my_error_exit;
@@ -72,96 +350,740 @@ namespace Image
 		}
 
 		jpeg_create_decompress( &cinfo );
-		jpeg_stdio_src( &cinfo , fp );
+		setSource( &cinfo );
 
-		(void) jpeg_read_header( &cinfo , TRUE );
-		(void) jpeg_start_decompress( &cinfo );
+		double s = _Decompress( &cinfo , img , scale , rows );
+		int components = cinfo.num_components;
+		jpeg_destroy_decompress( &cinfo );
+		if( !s ) THROW( "Wrong number of components: %d" , components );
+		return s;
+	}
 
-		row_stride = cinfo.output_width * cinfo.output_components;
+	/** This function sets the compression parameters for an image with the prescribed dimensions */
+	static void _SetCompressParameters( j_compress_ptr cinfo , int width , int height , const JPEGWriteOptions &options )
+	{
+		/* First we supply a description of the input image.                                                    
+		* Four fields of the cinfo struct must be filled in:
+		*/
+		cinfo->image_width = width;           /* image width and height, in pixels */
+		cinfo->image_height = height;
+		cinfo->input_components = 4;          /* # of color components per pixel */
+		cinfo->in_color_space = JCS_EXT_RGBA; /* colorspace of input image (the alpha is ignored) */
 
-		// my code (MK borrowed from PM)
-		if( cinfo.output_components!=1 && cinfo.output_components!=3 ) THROW( "Wrong number of components: %d" , cinfo.output_components );
+		jpeg_set_defaults( cinfo );
+		jpeg_set_quality( cinfo , options.quality , TRUE );
 
-		width = cinfo.output_width;
-		height = cinfo.output_height;
+		// The luminance sampling factors (relative to the single-sampled chrominance) determine the subsampling
+		switch( options.subsampling )
+		{
+			case JPEGSubsampling::S444: cinfo->comp_info[0].h_samp_factor = 1 , cinfo->comp_info[0].v_samp_factor = 1 ; break;
+			case JPEGSubsampling::S422: cinfo->comp_info[0].h_samp_factor = 2 , cinfo->comp_info[0].v_samp_factor = 1 ; break;
+			case JPEGSubsampling::S420: cinfo->comp_info[0].h_samp_factor = 2 , cinfo->comp_info[0].v_samp_factor = 2 ; break;
+			default: THROW( "Unrecognized JPEG subsampling: %d" , options.subsampling );
+		}
 
-		img.setSize( width , height );
+		switch( options.dctMethod )
+		{
+			case JPEGDCTMethod::ISLOW: cinfo->dct_method = JDCT_ISLOW ; break;
+			case JPEGDCTMethod::IFAST: cinfo->dct_method = JDCT_IFAST ; break;
+			case JPEGDCTMethod::FLOAT: cinfo->dct_method = JDCT_FLOAT ; break;
+			default: THROW( "Unrecognized JPEG DCT method: %d" , options.dctMethod );
+		}
+
+		// By default, a restart marker follows every MCU row, so that the output can be decoded in bands (at the cost of a few bytes per row)
+		if( options.restartRows<0 ) THROW( "Negative number of restart rows: %d" , options.restartRows );
+		cinfo->restart_in_rows = options.restartRows;
+
+		// Have the encoder gather the symbol statistics in a first pass and write Huffman tables fit to the image
+		cinfo->optimize_coding = options.optimize ? TRUE : FALSE;
+
+		// Replace the single sequential scan with the standard progression (spectral selection followed by successive approximation).
+		// Progressive output is always Huffman-optimized.
+		if( options.progressive ) jpeg_simple_progression( cinfo );
+	}
+
+	/** This function encodes the rows [rowBegin,rowEnd) of the image to the installed destination, leaving the compression object ready for the next image */
+	static void _Compress( j_compress_ptr cinfo , const Image32& img , const JPEGWriteOptions &options , int rowBegin , int rowEnd )
+	{
+		JSAMPROW row_pointer[1];      /* pointer to JSAMPLE row[s] */
+
+		/* Step 3: set parameters for compression */
+		_SetCompressParameters( cinfo , img.width() , rowEnd-rowBegin , options );
 
-		buffer = (*cinfo.mem->alloc_sarray)( (j_common_ptr) &cinfo , JPOOL_IMAGE , row_stride , 1 );
-		while( cinfo.output_scanline<cinfo.output_height )
+		jpeg_start_compress( cinfo , TRUE );
+
+		while( cinfo->next_scanline<cinfo->image_height )
+		{
+			/* jpeg_write_scanlines expects an array of pointers to scanlines.                                    
+			* Here the array is only one element long, but you could pass                                        
+			* more than one scanline at a time if that's more convenient.                                        
+			*/
+			row_pointer[0] = (JSAMPROW)img.row( rowBegin + cinfo->next_scanline );
+			(void) jpeg_write_scanlines( cinfo , row_pointer , 1 );
+		}
+
+		jpeg_finish_compress( cinfo );
+	}
+
+	template< typename SetDestination >
+	void _JPEGWriteImage( const Image32& img , SetDestination setDestination , const JPEGWriteOptions &options , int rowBegin , int rowEnd )
+	{
+		struct jpeg_compress_struct cinfo;
+		struct jpeg_error_mgr jerr;
+
+		/* Step 1: allocate and initialize JPEG compression object */
+		cinfo.err = jpeg_std_error( &jerr );
+		jpeg_create_compress( &cinfo );
+
+		setDestination( &cinfo );
+
+		_Compress( &cinfo , img , options , rowBegin , rowEnd );
+
+		jpeg_destroy_compress( &cinfo );
+	}
+
+	//////////////////////////
+	// Banded JPEG decoding //
+	//////////////////////////
+
+	/** The structure of a single-scan JPEG with restart markers */
+	struct _RestartLayout
+	{
+		/** The offset of the height field of the frame header and the offset just past the scan header */
+		size_t heightOffset , headerEnd;
+
+		/** The dimensions of the image, in pixels */
+		unsigned int width , height;
+
+		/** The height of an MCU row (in pixels), the number of MCU rows, and the number of MCUs in a row */
+		unsigned int mcuHeight , mcuRows , mcusPerRow;
+
+		/** The number of MCUs between restart markers */
+		unsigned int restartInterval;
+
+		/** The [begin,end) byte ranges of the entropy-coded segments delimited by the restart markers */
+		std::vector< std::pair< size_t , size_t > > segments;
+	};
+
+	/** This function parses the markers of a baseline or extended sequential JPEG and finds its restart segments.
+	*** It returns false if the JPEG is progressive, has multiple scans, or has no (or inconsistent) restart markers. */
+	static bool _GetRestartLayout( const unsigned char *data , size_t size , _RestartLayout &layout )
+	{
+		if( size<4 || data[0]!=0xFF || data[1]!=0xD8 ) return false;
+
+		unsigned int components = 0 , hMax = 1 , vMax = 1;
+		layout.restartInterval = 0;
+		size_t pos = 2;
+		for( ;; )
 		{
-			(void) jpeg_read_scanlines( &cinfo , buffer , 1 );
-			for( int i=0 ; i<row_stride ; i++ )
+			if( pos+4>size || data[pos]!=0xFF ) return false;
+			unsigned char marker = data[pos+1];
+			if( marker==0xFF ){ pos++ ; continue; }
+			size_t length = ( data[pos+2]<<8 ) | data[pos+3];
+			if( length<2 || pos+2+length>size ) return false;
+			const unsigned char *segment = data + pos + 4;
+
+			if( marker==0xC0 || marker==0xC1 )
 			{
-				p.a=255;
-				if( cinfo.output_components==1 ) p.r=buffer[0][i] , p.g=buffer[0][i] , p.b=buffer[0][i];
-				else
+				if( length<8 || segment[0]!=8 ) return false;
+				layout.heightOffset = pos + 5;
+				layout.height = ( segment[1]<<8 ) | segment[2];
+				layout.width  = ( segment[3]<<8 ) | segment[4];
+				components = segment[5];
+				if( !layout.height || !layout.width || !components || length<8+3*components ) return false;
+				for( unsigned int c=0 ; c<components ; c++ )
 				{
-					if     ( i%3==0 ) p.r = buffer[0][i];
-					else if( i%3==1 ) p.g = buffer[0][i];
-					else if( i%3==2 ) p.b = buffer[0][i];
+					hMax = std::max< unsigned int >( hMax , segment[7+3*c]>>4 );
+					vMax = std::max< unsigned int >( vMax , segment[7+3*c]&15 );
 				}
-				if( cinfo.output_components==1 ) img( i   , cinfo.output_scanline-1 ) = p;
-				else                             img( i/3 , cinfo.output_scanline-1 ) = p;
 			}
+			// Any other frame type (progressive, lossless, arithmetic-coded)
+			else if( marker>=0xC2 && marker<=0xCF && marker!=0xC4 && marker!=0xC8 && marker!=0xCC ) return false;
+			else if( marker==0xDD )
+			{
+				if( length<4 ) return false;
+				layout.restartInterval = ( segment[0]<<8 ) | segment[1];
+			}
+			else if( marker==0xDA )
+			{
+				// The scan has to contain all the components
+				if( !components || segment[0]!=components ) return false;
+				layout.headerEnd = pos + 2 + length;
+				break;
+			}
+			pos += 2 + length;
 		}
+		if( !layout.restartInterval ) return false;
 
-		(void) jpeg_finish_decompress( &cinfo );
-		jpeg_destroy_decompress( &cinfo );
+		// A single-component scan is not interleaved, so its MCU is a single block
+		unsigned int mcuWidth = components==1 ? 8 : 8*hMax;
+		layout.mcuHeight = components==1 ? 8 : 8*vMax;
+		layout.mcusPerRow = ( layout.width + mcuWidth - 1 ) / mcuWidth;
+		layout.mcuRows = ( layout.height + layout.mcuHeight - 1 ) / layout.mcuHeight;
+
+		// Split the entropy-coded data at the restart markers (a zero byte after 0xFF is stuffing, and 0xFF bytes may pad a marker)
+		layout.segments.clear();
+		size_t begin = layout.headerEnd;
+		pos = begin;
+		for( ;; )
+		{
+			const unsigned char *ff = (const unsigned char *)memchr( data+pos , 0xFF , size-pos );
+			if( !ff || ff+1>=data+size ) return false;
+			pos = ff - data;
+			unsigned char marker = data[pos+1];
+			if( marker==0x00 ) pos += 2;
+			else if( marker==0xFF ) pos++;
+			else if( marker>=0xD0 && marker<=0xD7 )
+			{
+				layout.segments.push_back( std::pair< size_t , size_t >( begin , pos ) );
+				begin = pos = pos+2;
+			}
+			else
+			{
+				// The scan has to be the last one
+				if( marker!=0xD9 ) return false;
+				layout.segments.push_back( std::pair< size_t , size_t >( begin , pos ) );
+				break;
+			}
+		}
+		size_t mcus = (size_t)layout.mcusPerRow * layout.mcuRows;
+		return layout.segments.size()==( mcus + layout.restartInterval - 1 ) / layout.restartInterval;
+	}
+
+	static bool _JPEGReadImageBanded( const unsigned char *data , size_t size , Image32& img , double scale , double &s )
+	{
+		_RestartLayout layout;
+		if( Util::ThreadCount()<2 || !_GetRestartLayout( data , size , layout ) ) return false;
+
+		// MCU row r starts a restart segment iff r*mcusPerRow is a multiple of the restart interval, i.e. every <step> rows
+		unsigned int step = layout.restartInterval;
+		{
+			unsigned int a = layout.restartInterval , b = layout.mcusPerRow % layout.restartInterval;
+			while( b ){ unsigned int t = a % b ; a = b , b = t; }
+			step /= a;
+		}
+		unsigned int groups = ( layout.mcuRows + step - 1 ) / step;
+		unsigned int bands = std::min< unsigned int >( Util::ThreadCount() , groups );
+		bands = (unsigned int)std::min< size_t >( bands , (size_t)layout.width * layout.height / _MinParallelPixels );
+		if( bands<2 ) return false;
+
+		// Get the output dimensions (and check the color space) from the full header
+		unsigned int outWidth , outHeight , outRowsPerMCU;
+		{
+			struct jpeg_decompress_struct cinfo;
+			struct my_error_mgr jerr;
+			struct jpeg_source_mgr src;
+			cinfo.err = jpeg_std_error( &jerr.pub );
+			jerr.pub.error_exit = my_error_exit;
+			if( setjmp( jerr.setjmp_buffer ) )
+			{
+				jpeg_destroy_decompress( &cinfo );
+				return false;
+			}
+			jpeg_create_decompress( &cinfo );
+			set_memory_source( &cinfo , &src , data , size );
+			(void) jpeg_read_header( &cinfo , TRUE );
+			bool supported = _SetDecompressParameters( &cinfo , scale );
+			jpeg_calc_output_dimensions( &cinfo );
+			outWidth = cinfo.output_width , outHeight = cinfo.output_height;
+			outRowsPerMCU = layout.mcuHeight * cinfo.scale_num / cinfo.scale_denom;
+			s = (double)cinfo.scale_num / cinfo.scale_denom;
+			jpeg_destroy_decompress( &cinfo );
+			if( !supported ) return false;
+		}
+
+		img.setSize( outWidth , outHeight );
+		std::vector< char > success( bands , 0 );
+
+		// Each band decodes a stand-alone JPEG made of the headers (with the height patched) and its restart segments (renumbered from zero).
+		// As the upsampler of the first and last rows of a band needs the neighboring chroma rows, the band also decodes the restart group
+		// preceding it and the MCU row following it, and discards those rows.
+		Util::ParallelFor( 0 , bands , [&]( unsigned int , size_t b )
+		{
+			unsigned int keepBegin = (unsigned int)( ( groups*b ) / bands ) * step , keepEnd = std::min< unsigned int >( (unsigned int)( ( groups*(b+1) ) / bands ) * step , layout.mcuRows );
+			unsigned int decodeBegin = keepBegin ? keepBegin-step : 0 , decodeEnd = std::min< unsigned int >( keepEnd+1 , layout.mcuRows );
+			size_t firstSegment = ( (size_t)decodeBegin * layout.mcusPerRow ) / layout.restartInterval;
+			size_t lastSegment = std::min< size_t >( ( (size_t)decodeEnd * layout.mcusPerRow + layout.restartInterval - 1 ) / layout.restartInterval , layout.segments.size() ) - 1;
+			unsigned int height = std::min< unsigned int >( decodeEnd*layout.mcuHeight , layout.height ) - decodeBegin*layout.mcuHeight;
+
+			std::vector< unsigned char > stream;
+			stream.reserve( layout.headerEnd + layout.segments[lastSegment].second - layout.segments[firstSegment].first + 2 );
+			stream.insert( stream.end() , data , data+layout.headerEnd );
+			stream[ layout.heightOffset ] = (unsigned char)( height>>8 ) , stream[ layout.heightOffset+1 ] = (unsigned char)( height&255 );
+			for( size_t i=firstSegment ; i<=lastSegment ; i++ )
+			{
+				stream.insert( stream.end() , data+layout.segments[i].first , data+layout.segments[i].second );
+				stream.push_back( 0xFF ) , stream.push_back( i<lastSegment ? (unsigned char)( 0xD0 + ( (i-firstSegment)&7 ) ) : 0xD9 );
+			}
+
+			struct jpeg_decompress_struct cinfo;
+			struct my_error_mgr jerr;
+			struct jpeg_source_mgr src;
+			std::vector< JSAMPROW > rows;
+			std::vector< Pixel32 > discard( outWidth );
+			cinfo.err = jpeg_std_error( &jerr.pub );
+			jerr.pub.error_exit = my_error_exit;
+			if( setjmp( jerr.setjmp_buffer ) )
+			{
+				jpeg_destroy_decompress( &cinfo );
+				return;
+			}
+			jpeg_create_decompress( &cinfo );
+			set_memory_source( &cinfo , &src , &stream[0] , stream.size() );
+			(void) jpeg_read_header( &cinfo , TRUE );
+			_SetDecompressParameters( &cinfo , scale );
+			(void) jpeg_start_decompress( &cinfo );
+
+			// Only read up to the last kept row, so the decoder does not need to see the rest of the data
+			unsigned int offset = decodeBegin*outRowsPerMCU , begin = keepBegin*outRowsPerMCU , end = std::min< unsigned int >( keepEnd*outRowsPerMCU , outHeight );
+			if( cinfo.output_width==outWidth && offset+cinfo.output_height>=end )
+			{
+				rows.resize( end-offset );
+				for( unsigned int j=0 ; j<rows.size() ; j++ ) rows[j] = (JSAMPROW)( offset+j<begin ? &discard[0] : img.row( offset+j ) );
+				while( cinfo.output_scanline<rows.size() ) (void) jpeg_read_scanlines( &cinfo , &rows[ cinfo.output_scanline ] , (JDIMENSION)rows.size()-cinfo.output_scanline );
+				success[b] = 1;
+			}
+			jpeg_destroy_decompress( &cinfo );
+		} );
+
+		for( unsigned int b=0 ; b<bands ; b++ ) if( !success[b] ) return false;
+		return true;
+	}
+
+	static bool _JPEGWriteImageStrips( const Image32& img , const JPEGWriteOptions &options , std::vector< unsigned char > &buffer )
+	{
+		// Optimized Huffman tables are fit to the whole image, and a progressive JPEG has multiple scans, so neither can be spliced
+		if( Util::ThreadCount()<2 || options.optimize || options.progressive || options.restartRows<=0 ) return false;
+
+		// Get the MCU size from the parameters the encoder will use
+		int mcuWidth = 8 , mcuHeight = 8;
+		{
+			struct jpeg_compress_struct cinfo;
+			struct jpeg_error_mgr jerr;
+			cinfo.err = jpeg_std_error( &jerr );
+			jpeg_create_compress( &cinfo );
+			_SetCompressParameters( &cinfo , img.width() , img.height() , options );
+			if( cinfo.num_components>1 ) for( int c=0 ; c<cinfo.num_components ; c++ )
+			{
+				mcuWidth = std::max< int >( mcuWidth , 8*cinfo.comp_info[c].h_samp_factor );
+				mcuHeight = std::max< int >( mcuHeight , 8*cinfo.comp_info[c].v_samp_factor );
+			}
+			jpeg_destroy_compress( &cinfo );
+		}
+		// The library clamps the restart interval to 65535 MCUs, after which the markers no longer fall on row boundaries
+		if( (long long)options.restartRows * ( ( img.width() + mcuWidth - 1 ) / mcuWidth )>65535 ) return false;
+
+		// Strips start at restart boundaries, i.e. every <restartRows> MCU rows
+		int mcuRows = ( img.height() + mcuHeight - 1 ) / mcuHeight;
+		int groups = ( mcuRows + options.restartRows - 1 ) / options.restartRows;
+		int strips = std::min< int >( Util::ThreadCount() , groups );
+		strips = (int)std::min< size_t >( strips , (size_t)img.width() * img.height() / _MinParallelPixels );
+		if( strips<2 ) return false;
+
+		// Encode each strip as a stand-alone JPEG.
+		// As the strips start at restart markers, a strip's entropy-coded segments are exactly those of the corresponding rows of the full image.
+		std::vector< std::vector< unsigned char > > encoded( strips );
+		std::vector< _RestartLayout > layouts( strips );
+		std::vector< char > success( strips , 0 );
+		Util::ParallelFor( 0 , strips , [&]( unsigned int , size_t s )
+		{
+			int rowBegin = (int)( ( groups*s ) / strips ) * options.restartRows * mcuHeight , rowEnd = std::min< int >( (int)( ( groups*(s+1) ) / strips ) * options.restartRows * mcuHeight , img.height() );
+			_JPEGWriteImageRows( img , encoded[s] , options , rowBegin , rowEnd );
+			success[s] = _GetRestartLayout( &encoded[s][0] , encoded[s].size() , layouts[s] ) ? 1 : 0;
+		} );
+		for( int s=0 ; s<strips ; s++ ) if( !success[s] ) THROW( "Failed to parse encoded strip %d" , s );
+
+		// Splice the segments under the headers of the first strip, with the height patched and the restart markers renumbered
+		size_t size = layouts[0].headerEnd + 2;
+		for( int s=0 ; s<strips ; s++ ) for( size_t i=0 ; i<layouts[s].segments.size() ; i++ ) size += layouts[s].segments[i].second - layouts[s].segments[i].first + 2;
+		buffer.resize( 0 );
+		buffer.reserve( size );
+		buffer.insert( buffer.end() , encoded[0].begin() , encoded[0].begin()+layouts[0].headerEnd );
+		buffer[ layouts[0].heightOffset ] = (unsigned char)( img.height()>>8 ) , buffer[ layouts[0].heightOffset+1 ] = (unsigned char)( img.height()&255 );
+		unsigned int restart = 0;
+		for( int s=0 ; s<strips ; s++ ) for( size_t i=0 ; i<layouts[s].segments.size() ; i++ )
+		{
+			if( s || i ) buffer.push_back( 0xFF ) , buffer.push_back( (unsigned char)( 0xD0 + ( (restart++)&7 ) ) );
+			buffer.insert( buffer.end() , encoded[s].begin()+layouts[s].segments[i].first , encoded[s].begin()+layouts[s].segments[i].second );
+		}
+		buffer.push_back( 0xFF ) , buffer.push_back( 0xD9 );
+		return true;
 	}
 
-	void JPEGWriteImage( const Image32& img , FILE *fp , int quality )
+	///////////////
+	// JPEGCodec //
+	///////////////
+	struct JPEGCodec::_State
 	{
+		/** The decompression and compression objects, which live as long as the codec */
+		struct jpeg_decompress_struct dinfo;
 		struct jpeg_compress_struct cinfo;
-		struct jpeg_error_mgr jerr;
-		unsigned char *pixels;
-		int i;
+		struct my_error_mgr derr , cerr;
 
-		JSAMPROW row_pointer[1];      /* pointer to JSAMPLE row[s] */
-		int row_stride;               /* physical row width in image buffer */
+		/** The standard Huffman tables */
+		JHUFF_TBL dcHuffman[2] , acHuffman[2];
 
-									  /* Step 1: allocate and initialize JPEG compression object */
-		cinfo.err = jpeg_std_error( &jerr );
-		jpeg_create_compress( &cinfo );
+		/** The source and destination managers */
+		struct jpeg_source_mgr src;
+		vector_destination_mgr dest;
 
-		jpeg_stdio_dest( &cinfo , fp );
+		/** The row pointers of the decoded image */
+		std::vector< JSAMPROW > rows;
 
-		/* Step 3: set parameters for compression */
+		/** The contents of the last file read or written */
+		std::vector< unsigned char > buffer;
+	};
 
-		/* First we supply a description of the input image.                                                    
-		* Four fields of the cinfo struct must be filled in:
-		*/
-		cinfo.image_width = img.width();    /* image width and height, in pixels */
-		cinfo.image_height = img.height();
-		cinfo.input_components = 3;           /* # of color components per pixel */
-		cinfo.in_color_space = JCS_RGB;       /* colorspace of input image */
+	JPEGCodec::JPEGCodec( void ) : _state( new _State() )
+	{
+		_state->dinfo.err = jpeg_std_error( &_state->derr.pub );
+		_state->derr.pub.error_exit = my_error_exit;
+		_state->cinfo.err = jpeg_std_error( &_state->cerr.pub );
+		_state->cerr.pub.error_exit = my_error_exit;
+		if( setjmp( _state->derr.setjmp_buffer ) )
+		{
+			jpeg_destroy_decompress( &_state->dinfo );
+			delete _state;
+			THROW( "Failed to create JPEG decompressor" );
+		}
+		jpeg_create_decompress( &_state->dinfo );
+		if( setjmp( _state->cerr.setjmp_buffer ) )
+		{
+			jpeg_destroy_decompress( &_state->dinfo );
+			jpeg_destroy_compress( &_state->cinfo );
+			delete _state;
+			THROW( "Failed to create JPEG compressor" );
+		}
+		jpeg_create_compress( &_state->cinfo );
+
+		// Keep copies of the standard Huffman tables installed by the default parameters
+		_SetCompressParameters( &_state->cinfo , 1 , 1 , JPEGWriteOptions() );
+		for( int i=0 ; i<2 ; i++ ) _state->dcHuffman[i] = *_state->cinfo.dc_huff_tbl_ptrs[i] , _state->acHuffman[i] = *_state->cinfo.ac_huff_tbl_ptrs[i];
+	}
+
+	JPEGCodec::~JPEGCodec( void )
+	{
+		jpeg_destroy_decompress( &_state->dinfo );
+		jpeg_destroy_compress( &_state->cinfo );
+		delete _state;
+	}
+
+	double JPEGCodec::read( const void *buffer , size_t size , Image32& img , double scale )
+	{
+		double s;
+		if( _JPEGReadImageBanded( (const unsigned char *)buffer , size , img , scale , s ) ) return s;
+
+		if( setjmp( _state->derr.setjmp_buffer ) )
+		{
+			jpeg_abort_decompress( &_state->dinfo );
+			THROW( "JPEG error occured" );
+		}
+		set_memory_source( &_state->dinfo , &_state->src , buffer , size );
+		s = _Decompress( &_state->dinfo , img , scale , _state->rows );
+		if( !s ) THROW( "Wrong number of components: %d" , _state->dinfo.num_components );
+		return s;
+	}
 
-		jpeg_set_defaults( &cinfo );
-		jpeg_set_quality( &cinfo , quality , TRUE );
+	double JPEGCodec::read( FILE *fp , Image32& img , double scale )
+	{
+		size_t size = _ReadStream( fp , _state->buffer );
+		return this->read( &_state->buffer[0] , size , img , scale );
+	}
 
-		jpeg_start_compress( &cinfo , TRUE );
+	double JPEGCodec::read( std::string fileName , Image32& img , double scale )
+	{
+		size_t size = _ReadFile( fileName , _state->buffer );
+		return this->read( &_state->buffer[0] , size , img , scale );
+	}
 
-		row_stride = img.width() * 3;       /* JSAMPLEs per row in image_buffer */
-		pixels=new unsigned char[row_stride];
-		if( !pixels ) THROW( "Failed to allocate pixels[%d]" , row_stride );
+	void JPEGCodec::write( const Image32& img , std::vector< unsigned char > &buffer , const JPEGWriteOptions &options )
+	{
+		if( _JPEGWriteImageStrips( img , options , buffer ) ) return;
 
-		while( cinfo.next_scanline<cinfo.image_height )
+		if( setjmp( _state->cerr.setjmp_buffer ) )
 		{
-			for( i=0 ; i<row_stride/3 ; i++ )
+			jpeg_abort_compress( &_state->cinfo );
+			THROW( "JPEG error occured" );
+		}
+		set_vector_destination( &_state->cinfo , &_state->dest , buffer );
+
+		// Optimized Huffman tables are stored in the compression object, and as the default parameters keep existing tables, the standard ones are restored by hand
+		for( int i=0 ; i<2 ; i++ ) *_state->cinfo.dc_huff_tbl_ptrs[i] = _state->dcHuffman[i] , *_state->cinfo.ac_huff_tbl_ptrs[i] = _state->acHuffman[i];
+		_Compress( &_state->cinfo , img , options , 0 , img.height() );
+	}
+
+	void JPEGCodec::write( const Image32& img , std::string fileName , const JPEGWriteOptions &options )
+	{
+		write( img , _state->buffer , options );
+		_WriteFile( fileName , _state->buffer );
+	}
+
+	void JPEGCodec::write( const Image32& img , FILE *fp , const JPEGWriteOptions &options )
+	{
+		write( img , _state->buffer , options );
+		if( fwrite( &_state->buffer[0] , 1 , _state->buffer.size() , fp )!=_state->buffer.size() ) THROW( "Failed to write JPEG data" );
+	}
+
+	////////////////
+	// JPEGReader //
+	////////////////
+	struct JPEGReader::_State
+	{
+		struct jpeg_decompress_struct cinfo;
+		struct my_error_mgr jerr;
+	};
+
+	JPEGReader::JPEGReader( FILE *fp ) : _state( new _State() )
+	{
+		if( !fp ){ delete _state ; THROW( "Empty file pointer" ); }
+		_state->cinfo.err = jpeg_std_error( &_state->jerr.pub );
+		_state->jerr.pub.error_exit = my_error_exit;
+		if( setjmp( _state->jerr.setjmp_buffer ) )
+		{
+			jpeg_destroy_decompress( &_state->cinfo );
+			delete _state;
+			THROW( "JPEG error occured" );
+		}
+		jpeg_create_decompress( &_state->cinfo );
+		jpeg_stdio_src( &_state->cinfo , fp );
+		(void) jpeg_read_header( &_state->cinfo , TRUE );
+		if( !_SetDecompressParameters( &_state->cinfo , 1. ) )
+		{
+			int components = _state->cinfo.num_components;
+			jpeg_destroy_decompress( &_state->cinfo );
+			delete _state;
+			THROW( "Wrong number of components: %d" , components );
+		}
+		(void) jpeg_start_decompress( &_state->cinfo );
+	}
+
+	JPEGReader::~JPEGReader( void )
+	{
+		jpeg_destroy_decompress( &_state->cinfo );
+		delete _state;
+	}
+
+	int JPEGReader::width( void ) const { return _state->cinfo.output_width; }
+
+	int JPEGReader::height( void ) const { return _state->cinfo.output_height; }
+
+	void JPEGReader::readRow( Pixel32 *row )
+	{
+		if( _state->cinfo.output_scanline==_state->cinfo.output_height ) THROW( "All %d rows have been read" , (int)_state->cinfo.output_height );
+		if( setjmp( _state->jerr.setjmp_buffer ) ) THROW( "JPEG error occured" );
+		JSAMPROW rows[] = { (JSAMPROW)row };
+		(void) jpeg_read_scanlines( &_state->cinfo , rows , 1 );
+		if( _state->cinfo.output_scanline==_state->cinfo.output_height ) (void) jpeg_finish_decompress( &_state->cinfo );
+	}
+
+	////////////////
+	// JPEGWriter //
+	////////////////
+	struct JPEGWriter::_State
+	{
+		struct jpeg_compress_struct cinfo;
+		struct my_error_mgr jerr;
+	};
+
+	JPEGWriter::JPEGWriter( FILE *fp , int width , int height , const JPEGWriteOptions &options ) : _state( new _State() )
+	{
+		if( !fp ){ delete _state ; THROW( "Empty file pointer" ); }
+		if( width<=0 || height<=0 ){ delete _state ; THROW( "Bad image dimensions: %d x %d" , width , height ); }
+		_state->cinfo.err = jpeg_std_error( &_state->jerr.pub );
+		_state->jerr.pub.error_exit = my_error_exit;
+		if( setjmp( _state->jerr.setjmp_buffer ) )
+		{
+			jpeg_destroy_compress( &_state->cinfo );
+			delete _state;
+			THROW( "JPEG error occured" );
+		}
+		jpeg_create_compress( &_state->cinfo );
+		jpeg_stdio_dest( &_state->cinfo , fp );
+		try{ _SetCompressParameters( &_state->cinfo , width , height , options ); }
+		catch( ... )
+		{
+			jpeg_destroy_compress( &_state->cinfo );
+			delete _state;
+			throw;
+		}
+		jpeg_start_compress( &_state->cinfo , TRUE );
+	}
+
+	JPEGWriter::~JPEGWriter( void )
+	{
+		jpeg_destroy_compress( &_state->cinfo );
+		delete _state;
+	}
+
+	void JPEGWriter::writeRow( const Pixel32 *row )
+	{
+		if( _state->cinfo.next_scanline==_state->cinfo.image_height ) THROW( "All %d rows have been written" , (int)_state->cinfo.image_height );
+		if( setjmp( _state->jerr.setjmp_buffer ) ) THROW( "JPEG error occured" );
+		JSAMPROW rows[] = { (JSAMPROW)row };
+		(void) jpeg_write_scanlines( &_state->cinfo , rows , 1 );
+		if( _state->cinfo.next_scanline==_state->cinfo.image_height ) jpeg_finish_compress( &_state->cinfo );
+	}
+
+	//////////////////////////////////
+	// Lossless JPEG transformation //
+	//////////////////////////////////
+
+	void JPEGTransformImage( std::string inFileName , std::string outFileName , int transform , int x1 , int y1 , int x2 , int y2 )
+	{
+		std::vector< unsigned char > in , out;
+		size_t size = _ReadFile( inFileName , in );
+		JPEGTransformImage( &in[0] , size , out , transform , x1 , y1 , x2 , y2 );
+		_WriteFile( outFileName , out );
+	}
+
+	void JPEGTransformImage( const void *buffer , size_t size , std::vector< unsigned char > &outBuffer , int transform , int x1 , int y1 , int x2 , int y2 )
+	{
+		// A transformation maps an output position to the input position obtained by (optionally) swapping the coordinates and then (optionally) reversing them
+		bool transpose , flipX , flipY;
+		switch( transform )
+		{
+			case JPEGTransform::NONE:            transpose = false , flipX = false , flipY = false ; break;
+			case JPEGTransform::FLIP_HORIZONTAL: transpose = false , flipX = true  , flipY = false ; break;
+			case JPEGTransform::FLIP_VERTICAL:   transpose = false , flipX = false , flipY = true  ; break;
+			case JPEGTransform::TRANSPOSE:       transpose = true  , flipX = false , flipY = false ; break;
+			case JPEGTransform::TRANSVERSE:      transpose = true  , flipX = true  , flipY = true  ; break;
+			case JPEGTransform::ROTATE_90:       transpose = true  , flipX = false , flipY = true  ; break;
+			case JPEGTransform::ROTATE_180:      transpose = false , flipX = true  , flipY = true  ; break;
+			case JPEGTransform::ROTATE_270:      transpose = true  , flipX = true  , flipY = false ; break;
+			default: THROW( "Unrecognized JPEG transform: %d" , transform );
+		}
+
+		struct jpeg_decompress_struct srcinfo;
+		struct jpeg_compress_struct dstinfo;
+		struct my_error_mgr jsrcerr , jdsterr;
+		struct jpeg_source_mgr src;
+		vector_destination_mgr dest;
+		jvirt_barray_ptr dstCoefficients[ MAX_COMPONENTS ];
+
+		srcinfo.err = jpeg_std_error( &jsrcerr.pub );
+		jsrcerr.pub.error_exit = my_error_exit;
+		dstinfo.err = jpeg_std_error( &jdsterr.pub );
+		jdsterr.pub.error_exit = my_error_exit;
+		jpeg_create_decompress( &srcinfo );
+		jpeg_create_compress( &dstinfo );
+		if( setjmp( jsrcerr.setjmp_buffer ) )
+		{
+			jpeg_destroy_compress( &dstinfo );
+			jpeg_destroy_decompress( &srcinfo );
+			THROW( "JPEG error occured while reading the source" );
+		}
+		if( setjmp( jdsterr.setjmp_buffer ) )
+		{
+			jpeg_destroy_compress( &dstinfo );
+			jpeg_destroy_decompress( &srcinfo );
+			THROW( "JPEG error occured while writing the transformed image" );
+		}
+
+		set_memory_source( &srcinfo , &src , buffer , size );
+		(void) jpeg_read_header( &srcinfo , TRUE );
+
+		// The dimensions of an MCU, in pixels, before and after the transformation
+		int mcuWidth = srcinfo.max_h_samp_factor * DCTSIZE , mcuHeight = srcinfo.max_v_samp_factor * DCTSIZE;
+		int outMCUWidth = transpose ? mcuHeight : mcuWidth , outMCUHeight = transpose ? mcuWidth : mcuHeight;
+
+		// Trim the partial MCUs off the edges that are reversed
+		int width = srcinfo.image_width , height = srcinfo.image_height;
+		if( flipX ) width  = ( width  / mcuWidth  ) * mcuWidth;
+		if( flipY ) height = ( height / mcuHeight ) * mcuHeight;
+		int tWidth = transpose ? height : width , tHeight = transpose ? width : height;
+
+		// Crop the transformed image, starting on an MCU boundary
+		if( x2<0 ) x2 = tWidth;
+		if( y2<0 ) y2 = tHeight;
+		if( x1<0 || y1<0 || x1>=x2 || y1>=y2 || x2>tWidth || y2>tHeight )
+		{
+			jpeg_destroy_compress( &dstinfo );
+			jpeg_destroy_decompress( &srcinfo );
+			THROW( "Bad crop rectangle for %d x %d image: ( %d , %d ) x ( %d , %d )" , tWidth , tHeight , x1 , y1 , x2 , y2 );
+		}
+		int mcuX = x1 / outMCUWidth , mcuY = y1 / outMCUHeight;
+		int outWidth = x2 - mcuX*outMCUWidth , outHeight = y2 - mcuY*outMCUHeight;
+
+		// Request the output coefficient arrays (padded to whole MCUs) before the input is read, so that they are realized together with the input's
+		int outMCUsX = ( outWidth + outMCUWidth - 1 ) / outMCUWidth , outMCUsY = ( outHeight + outMCUHeight - 1 ) / outMCUHeight;
+		for( int c=0 ; c<srcinfo.num_components ; c++ )
+		{
+			const jpeg_component_info &comp = srcinfo.comp_info[c];
+			int hSamp = transpose ? comp.v_samp_factor : comp.h_samp_factor , vSamp = transpose ? comp.h_samp_factor : comp.v_samp_factor;
+			dstCoefficients[c] = (*srcinfo.mem->request_virt_barray)( (j_common_ptr)&srcinfo , JPOOL_IMAGE , FALSE , outMCUsX*hSamp , outMCUsY*vSamp , vSamp );
+		}
+
+		jvirt_barray_ptr *srcCoefficients = jpeg_read_coefficients( &srcinfo );
+
+		// Map the output blocks of each component to the input blocks
+		for( int c=0 ; c<srcinfo.num_components ; c++ )
+		{
+			const jpeg_component_info &comp = srcinfo.comp_info[c];
+			int hSamp = transpose ? comp.v_samp_factor : comp.h_samp_factor , vSamp = transpose ? comp.h_samp_factor : comp.v_samp_factor;
+
+			// The dimensions (in blocks) of the input, and of the (untrimmed) input array
+			int blocksX = ( width  / mcuWidth  ) * comp.h_samp_factor , blocksY = ( height / mcuHeight ) * comp.v_samp_factor;
+			int srcBlocksX = ( ( comp.width_in_blocks  + comp.h_samp_factor - 1 ) / comp.h_samp_factor ) * comp.h_samp_factor;
+			int srcBlocksY = ( ( comp.height_in_blocks + comp.v_samp_factor - 1 ) / comp.v_samp_factor ) * comp.v_samp_factor;
+
+			for( int by=0 ; by<outMCUsY*vSamp ; by+=vSamp )
 			{
-				pixels[ i*3+0 ] = img( i , cinfo.next_scanline ).r;
-				pixels[ i*3+1 ] = img( i , cinfo.next_scanline ).g;
-				pixels[ i*3+2 ] = img( i , cinfo.next_scanline ).b;
+				JBLOCKARRAY outRows = (*srcinfo.mem->access_virt_barray)( (j_common_ptr)&srcinfo , dstCoefficients[c] , by , vSamp , TRUE );
+				for( int j=0 ; j<vSamp ; j++ ) for( int bx=0 ; bx<outMCUsX*hSamp ; bx++ )
+				{
+					int x = bx + mcuX*hSamp , y = by + j + mcuY*vSamp;
+					if( transpose ) std::swap( x , y );
+					if( flipX ) x = blocksX - 1 - x;
+					if( flipY ) y = blocksY - 1 - y;
+
+					JCOEFPTR out = outRows[j][bx];
+					if( x<0 || y<0 || x>=srcBlocksX || y>=srcBlocksY ){ memset( out , 0 , sizeof( JBLOCK ) ) ; continue; }
+					JCOEFPTR in = (*srcinfo.mem->access_virt_barray)( (j_common_ptr)&srcinfo , srcCoefficients[c] , y , 1 , FALSE )[0][x];
+
+					// Reversing a block negates the coefficients of the odd frequencies in that direction
+					for( int k=0 ; k<DCTSIZE ; k++ ) for( int l=0 ; l<DCTSIZE ; l++ )
+					{
+						int r = transpose ? l : k , s = transpose ? k : l;
+						JCOEF v = in[ r*DCTSIZE+s ];
+						out[ k*DCTSIZE+l ] = ( ( flipX && (s&1) ) != ( flipY && (r&1) ) ) ? -v : v;
+					}
+				}
 			}
-			/* jpeg_write_scanlines expects an array of pointers to scanlines.                                    
-			* Here the array is only one element long, but you could pass                                        
-			* more than one scanline at a time if that's more convenient.                                        
-			*/
-			row_pointer[0] = pixels;
-			(void) jpeg_write_scanlines( &cinfo , row_pointer , 1 );
 		}
 
-		jpeg_finish_compress( &cinfo );
-		jpeg_destroy_compress( &cinfo );
+		// Set up the output with the input's quantization tables (transposed with the blocks) and sampling factors
+		jpeg_copy_critical_parameters( &srcinfo , &dstinfo );
+		dstinfo.image_width = outWidth;
+		dstinfo.image_height = outHeight;
+		if( transpose )
+		{
+			for( int c=0 ; c<dstinfo.num_components ; c++ ) std::swap( dstinfo.comp_info[c].h_samp_factor , dstinfo.comp_info[c].v_samp_factor );
+			for( int q=0 ; q<NUM_QUANT_TBLS ; q++ ) if( dstinfo.quant_tbl_ptrs[q] )
+				for( int k=0 ; k<DCTSIZE ; k++ ) for( int l=0 ; l<k ; l++ ) std::swap( dstinfo.quant_tbl_ptrs[q]->quantval[ k*DCTSIZE+l ] , dstinfo.quant_tbl_ptrs[q]->quantval[ l*DCTSIZE+k ] );
+		}
+		// As with the encoder, a restart marker follows every MCU row
+		dstinfo.restart_in_rows = 1;
+
+		set_vector_destination( &dstinfo , &dest , outBuffer );
+		jpeg_write_coefficients( &dstinfo , dstCoefficients );
+		jpeg_finish_compress( &dstinfo );
+		jpeg_destroy_compress( &dstinfo );
+
+		(void) jpeg_finish_decompress( &srcinfo );
+		jpeg_destroy_decompress( &srcinfo );
+	}
+
+	////////////////////
+	// JPEGImageCodec //
+	////////////////////
+	/** This function returns the codec of the calling thread, so that each batch worker and server connection keeps its decoder and encoder across images */
+	static JPEGCodec &_ThreadCodec( void )
+	{
+		static thread_local JPEGCodec codec;
+		return codec;
 	}
-}
\ No newline at end of file
+
+	double JPEGImageCodec::read( FILE *fp , Image32& img , double scale ) const { return _ThreadCodec().read( fp , img , scale ); }
+
+	void JPEGImageCodec::write( const Image32& img , FILE *fp ) const { _ThreadCodec().write( img , fp , options ); }
+}
@@ -1,18 +1,238 @@
 #ifndef JPEG_INCLUDED
 #define JPEG_INCLUDED
 
+#include <vector>
 #include "image.h"
+#include "codec.h"
 
 namespace Image
 {
-	/** This function read in a JPEG file, returning 0 on failure.*/
-	void JPEGReadImage( std::string fileName , Image32& img );
-	/** This function read in a JPEG file, returning 0 on failure.*/
-	void JPEGReadImage( FILE *fp , Image32& img );
+	/** This class describes the chroma subsampling used by the JPEG encoder */
+	class JPEGSubsampling
+	{
+	public:
+		/** The types of subsampling */
+		enum
+		{
+			S444 ,
+			S422 ,
+			S420 ,
+			COUNT
+		};
+
+		/** The names of the types of subsampling */
+		static const char *Names[];
+
+		/** This static method returns the type of subsampling with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
+	/** This class describes the (inverse) DCT implementations of the JPEG library */
+	class JPEGDCTMethod
+	{
+	public:
+		/** The types of DCT */
+		enum
+		{
+			ISLOW ,
+			IFAST ,
+			FLOAT ,
+			COUNT
+		};
+
+		/** The names of the types of DCT */
+		static const char *Names[];
+
+		/** This static method returns the type of DCT with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
+	/** This class describes the lossless transformations of a JPEG */
+	class JPEGTransform
+	{
+	public:
+		/** The types of transformation (rotations are clockwise) */
+		enum
+		{
+			NONE ,
+			FLIP_HORIZONTAL ,
+			FLIP_VERTICAL ,
+			TRANSPOSE ,
+			TRANSVERSE ,
+			ROTATE_90 ,
+			ROTATE_180 ,
+			ROTATE_270 ,
+			COUNT
+		};
+
+		/** The names of the types of transformation */
+		static const char *Names[];
+
+		/** This static method returns the type of transformation with the given name.
+		*** An exception is thrown if the name is not recognized. */
+		static int Parse( const std::string &name );
+	};
+
+	/** This class describes the parameters of the JPEG encoder */
+	class JPEGWriteOptions
+	{
+	public:
+		/** The quality, in the range [0,100] */
+		int quality;
+
+		/** Should the Huffman tables be optimized for the image (which takes a second pass over the data)? */
+		bool optimize;
+
+		/** Should a progressive JPEG be written? */
+		bool progressive;
+
+		/** The chroma subsampling */
+		int subsampling;
+
+		/** The number of MCU rows between restart markers (or zero for none) */
+		int restartRows;
+
+		/** The DCT implementation */
+		int dctMethod;
+
+		/** The constructor sets the defaults: baseline 4:2:0 output with standard Huffman tables, a restart marker after every MCU row, and the accurate integer DCT */
+		explicit JPEGWriteOptions( int quality=100 );
+	};
+
+	/** This function read in a JPEG file, returning 0 on failure.
+	*** If the scale is smaller than one, the decoder reduces the image in the DCT domain by the largest factor of 1/2, 1/4, or 1/8
+	*** that does not go below the scale, and the function returns the factor that was applied. */
+	double JPEGReadImage( std::string fileName , Image32& img , double scale=1. );
+	/** This function read in a JPEG file, returning 0 on failure.
+	*** If the scale is smaller than one, the decoder reduces the image in the DCT domain by the largest factor of 1/2, 1/4, or 1/8
+	*** that does not go below the scale, and the function returns the factor that was applied. */
+	double JPEGReadImage( FILE *fp , Image32& img , double scale=1. );
+	/** This function reads in a JPEG from the memory buffer, which must hold the whole compressed stream.
+	*** If the scale is smaller than one, the decoder reduces the image in the DCT domain by the largest factor of 1/2, 1/4, or 1/8
+	*** that does not go below the scale, and the function returns the factor that was applied. */
+	double JPEGReadImage( const void *buffer , size_t size , Image32& img , double scale=1. );
 
 	/** This function writes out a JPEG file, returning 0 on failure.*/
 	void JPEGWriteImage( const Image32& img , std::string , int quality=100 );
 	/** This function writes out a JPEG file, returning 0 on failure.*/
 	void JPEGWriteImage( const Image32& img , FILE *fp , int quality );
+	/** This function writes out a JPEG into the buffer, which is resized to the length of the compressed stream.
+	*** The buffer's existing storage is reused, so encoding repeatedly into the same buffer avoids reallocation. */
+	void JPEGWriteImage( const Image32& img , std::vector< unsigned char > &buffer , int quality=100 );
+
+	/** This function writes out a JPEG file with the prescribed encoder parameters */
+	void JPEGWriteImage( const Image32& img , std::string fileName , const JPEGWriteOptions &options );
+	/** This function writes out a JPEG file with the prescribed encoder parameters */
+	void JPEGWriteImage( const Image32& img , FILE *fp , const JPEGWriteOptions &options );
+	/** This function writes out a JPEG into the buffer with the prescribed encoder parameters */
+	void JPEGWriteImage( const Image32& img , std::vector< unsigned char > &buffer , const JPEGWriteOptions &options );
+
+	/** This function transforms a JPEG in the memory buffer without decoding it, by permuting (and transposing and negating the coefficients of) its DCT blocks,
+	*** and writes the result into the output buffer. The transformed image is then cropped to the rectangle with corners (x1,y1) and (x2,y2),
+	*** where negative values of x2 and y2 stand for the width and height of the transformed image.
+	*** As only whole MCUs can be moved, a partial MCU at an edge that the transformation moves to the top or left is trimmed off,
+	*** and the top-left corner of the crop is moved up and to the left to the nearest MCU boundary. */
+	void JPEGTransformImage( const void *buffer , size_t size , std::vector< unsigned char > &outBuffer , int transform , int x1=0 , int y1=0 , int x2=-1 , int y2=-1 );
+	/** This function transforms a JPEG file without decoding it (see above) */
+	void JPEGTransformImage( std::string inFileName , std::string outFileName , int transform , int x1=0 , int y1=0 , int x2=-1 , int y2=-1 );
+
+	/** This class decodes a JPEG file a row at a time, so that only the libjpeg buffers (a band of MCU rows) are held in memory */
+	class JPEGReader : public ImageReader
+	{
+		/** The libjpeg state */
+		struct _State;
+		_State *_state;
+	public:
+		/** The constructor reads the header of the file and starts the decompression */
+		JPEGReader( FILE *fp );
+
+		/** The destructor destroys the decompression object */
+		~JPEGReader( void );
+
+		JPEGReader( const JPEGReader& ) = delete;
+		JPEGReader& operator = ( const JPEGReader& ) = delete;
+
+		int width( void ) const;
+		int height( void ) const;
+		void readRow( Pixel32 *row );
+	};
+
+	/** This class encodes a JPEG file a row at a time */
+	class JPEGWriter : public ImageWriter
+	{
+		/** The libjpeg state */
+		struct _State;
+		_State *_state;
+	public:
+		/** The constructor starts the compression of an image with the prescribed dimensions */
+		JPEGWriter( FILE *fp , int width , int height , const JPEGWriteOptions &options=JPEGWriteOptions() );
+
+		/** The destructor destroys the compression object */
+		~JPEGWriter( void );
+
+		JPEGWriter( const JPEGWriter& ) = delete;
+		JPEGWriter& operator = ( const JPEGWriter& ) = delete;
+
+		void writeRow( const Pixel32 *row );
+	};
+
+	/** The codec of JPEG files, which are written with the prescribed options.
+	*** Whole images are read into memory and decoded in parallel bands when possible (see JPEGReadImage).
+	*** Otherwise, they are decoded and encoded with a JPEGCodec kept by the calling thread. */
+	class JPEGImageCodec : public ImageCodec
+	{
+	public:
+		/** The options used when writing */
+		JPEGWriteOptions options;
+
+		JPEGImageCodec( const JPEGWriteOptions &options=JPEGWriteOptions() ) : options(options) {}
+
+		const char *extensions( void ) const { return "jpg jpeg"; }
+		bool sniff( const unsigned char *header , size_t size ) const { return size>=3 && header[0]==0xff && header[1]==0xd8 && header[2]==0xff; }
+		ImageReader *newReader( FILE *fp ) const { return new JPEGReader( fp ); }
+		ImageWriter *newWriter( FILE *fp , int width , int height ) const { return new JPEGWriter( fp , width , height , options ); }
+		double read( FILE *fp , Image32& img , double scale=1. ) const;
+		void write( const Image32& img , FILE *fp ) const;
+	};
+
+	/** This class keeps a JPEG decoder and encoder alive across images, so that reading and writing many (small) JPEGs does not
+	*** set up and tear down the library state, and its memory pools, for each one. Between images the objects are reset rather than freed.
+	*** As with the functions above, images that can be split are decoded in bands (and encoded in strips) in parallel, with objects of their own.
+	*** A codec is not shared by threads, so a batch is processed with one codec per thread. */
+	class JPEGCodec
+	{
+		/** The libjpeg state */
+		struct _State;
+		_State *_state;
+	public:
+		/** The constructor creates the decompression and compression objects */
+		JPEGCodec( void );
+
+		/** The destructor destroys the decompression and compression objects */
+		~JPEGCodec( void );
+
+		JPEGCodec( const JPEGCodec& ) = delete;
+		JPEGCodec& operator = ( const JPEGCodec& ) = delete;
+
+		/** This method reads in a JPEG from the memory buffer, returning the factor by which the image was reduced while decoding (see JPEGReadImage) */
+		double read( const void *buffer , size_t size , Image32& img , double scale=1. );
+
+		/** This method reads in a JPEG file, returning the factor by which the image was reduced while decoding (see JPEGReadImage) */
+		double read( std::string fileName , Image32& img , double scale=1. );
+
+		/** This method reads in the rest of the stream as a JPEG, returning the factor by which the image was reduced while decoding (see JPEGReadImage) */
+		double read( FILE *fp , Image32& img , double scale=1. );
+
+		/** This method writes out a JPEG into the buffer, reusing the buffer's storage */
+		void write( const Image32& img , std::vector< unsigned char > &buffer , const JPEGWriteOptions &options=JPEGWriteOptions() );
+
+		/** This method writes out a JPEG file */
+		void write( const Image32& img , std::string fileName , const JPEGWriteOptions &options=JPEGWriteOptions() );
+
+		/** This method writes out a JPEG to the stream */
+		void write( const Image32& img , FILE *fp , const JPEGWriteOptions &options=JPEGWriteOptions() );
+	};
 }
 #endif // JPEG_INCLUDED
@@ -0,0 +1,358 @@
+#include <math.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <vector>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include <Util/parallel.h>
+#include <Util/profiler.h>
+#include "palette.h"
+
+using namespace Util;
+using namespace Image;
+
+static const int CellBits = Palette::CellBits , Cells = 1<<CellBits , CellShift = 8-CellBits;
+
+// The weights of the red, green and blue extents used to choose the axis along which to split a box (as in the JPEG library)
+static const int AxisWeights[] = { 2 , 3 , 1 };
+
+static int _CellIndex( int r , int g , int b ){ return ( r<<(2*CellBits) ) | ( g<<CellBits ) | b; }
+
+static int _SquaredDistance( int r1 , int g1 , int b1 , int r2 , int g2 , int b2 ){ return (r1-r2)*(r1-r2) + (g1-g2)*(g1-g2) + (b1-b2)*(b1-b2); }
+
+// A cell of the color histogram, storing the number of pixels falling into it and the sums of their colors
+struct _ColorCell
+{
+	unsigned long long count , r , g , b;
+	_ColorCell( void ) : count(0) , r(0) , g(0) , b(0) {}
+	_ColorCell &operator += ( const _ColorCell &c ){ count += c.count , r += c.r , g += c.g , b += c.b ; return *this; }
+	Pixel32 color( void ) const
+	{
+		Pixel32 p;
+		if( count ) p.r = (unsigned char)( ( r + count/2 ) / count ) , p.g = (unsigned char)( ( g + count/2 ) / count ) , p.b = (unsigned char)( ( b + count/2 ) / count );
+		return p;
+	}
+};
+
+// Computes the color histogram, with each thread accumulating into its own copy
+static std::vector< _ColorCell > _ColorHistogram( const Image32 &img )
+{
+	std::vector< std::vector< _ColorCell > > histograms( ThreadCount() );
+	ParallelFor( 0 , img.height() , [&]( unsigned int t , size_t j )
+	{
+		if( histograms[t].empty() ) histograms[t].resize( Cells*Cells*Cells );
+		std::vector< _ColorCell > &histogram = histograms[t];
+		const Pixel32 *pixels = img.row( (int)j );
+		for( int i=0 ; i<img.width() ; i++ )
+		{
+			_ColorCell &c = histogram[ _CellIndex( pixels[i].r>>CellShift , pixels[i].g>>CellShift , pixels[i].b>>CellShift ) ];
+			c.count++ , c.r += pixels[i].r , c.g += pixels[i].g , c.b += pixels[i].b;
+		}
+	} , 16 );
+
+	std::vector< _ColorCell > histogram( Cells*Cells*Cells );
+	for( size_t t=0 ; t<histograms.size() ; t++ ) if( histograms[t].size() ) for( size_t i=0 ; i<histogram.size() ; i++ ) histogram[i] += histograms[t][i];
+	return histogram;
+}
+
+// An axis-aligned box of histogram cells, with inclusive bounds
+struct _ColorBox
+{
+	int min[3] , max[3];
+	_ColorCell total;
+
+	// Shrinks the bounds to the non-empty cells inside the box and recomputes the total
+	void shrink( const std::vector< _ColorCell > &histogram )
+	{
+		int _min[] = { max[0] , max[1] , max[2] } , _max[] = { min[0] , min[1] , min[2] };
+		total = _ColorCell();
+		for( int r=min[0] ; r<=max[0] ; r++ ) for( int g=min[1] ; g<=max[1] ; g++ ) for( int b=min[2] ; b<=max[2] ; b++ )
+		{
+			const _ColorCell &c = histogram[ _CellIndex( r , g , b ) ];
+			if( !c.count ) continue;
+			total += c;
+			int idx[] = { r , g , b };
+			for( int d=0 ; d<3 ; d++ ) _min[d] = std::min< int >( _min[d] , idx[d] ) , _max[d] = std::max< int >( _max[d] , idx[d] );
+		}
+		if( total.count ) for( int d=0 ; d<3 ; d++ ) min[d] = _min[d] , max[d] = _max[d];
+	}
+
+	// Returns the weighted extent along the axis
+	int extent( int d ) const { return ( max[d] - min[d] ) * AxisWeights[d]; }
+
+	// Returns the (weighted) squared diagonal of the box
+	long long volume( void ) const { long long v = 0 ; for( int d=0 ; d<3 ; d++ ) v += (long long)extent(d)*extent(d) ; return v; }
+
+	bool splittable( void ) const { return max[0]>min[0] || max[1]>min[1] || max[2]>min[2]; }
+};
+
+/////////////
+// Palette //
+/////////////
+Palette::Palette( void ) {}
+
+Palette::Palette( const std::vector< Pixel32 > &colors ) : _colors( colors )
+{
+	if( colors.empty() || (int)colors.size()>MaxColors ) THROW( "Palette size must be in the range [ 1 , %d ]: %d" , MaxColors , (int)colors.size() );
+	_setInverse();
+}
+
+int Palette::size( void ) const { return (int)_colors.size(); }
+
+const Pixel32 &Palette::operator[] ( int i ) const
+{
+	if( i<0 || i>=(int)_colors.size() ) THROW( "Palette index out of range: %d not in [ 0 , %d )" , i , (int)_colors.size() );
+	return _colors[i];
+}
+
+int Palette::nearest( int r , int g , int b ) const
+{
+	int best = 0 , bestDistance = INT_MAX;
+	for( int i=0 ; i<(int)_colors.size() ; i++ )
+	{
+		int d = _SquaredDistance( r , g , b , _colors[i].r , _colors[i].g , _colors[i].b );
+		if( d<bestDistance ) bestDistance = d , best = i;
+	}
+	return best;
+}
+
+void Palette::_setInverse( void )
+{
+	// The table is filled in boxes of BoxCells^3 cells. For each box, the only candidates are the colors whose minimum distance
+	// to the box is no larger than the smallest maximum distance of any color to the box.
+	const int BoxCells = 4 , Boxes = Cells / BoxCells , CellSize = 1<<CellShift;
+	_inverse.resize( Cells*Cells*Cells );
+	ParallelFor( 0 , Boxes*Boxes*Boxes , [&]( unsigned int , size_t box )
+	{
+		int start[] = { (int)( box / (Boxes*Boxes) ) * BoxCells , (int)( ( box / Boxes ) % Boxes ) * BoxCells , (int)( box % Boxes ) * BoxCells };
+		// The range of cell centers in the box
+		int lo[3] , hi[3];
+		for( int d=0 ; d<3 ; d++ ) lo[d] = start[d]*CellSize + CellSize/2 , hi[d] = ( start[d]+BoxCells-1 )*CellSize + CellSize/2;
+
+		std::vector< int > minDistances( _colors.size() );
+		int minMaxDistance = INT_MAX;
+		for( size_t i=0 ; i<_colors.size() ; i++ )
+		{
+			int c[] = { _colors[i].r , _colors[i].g , _colors[i].b };
+			int minDistance = 0 , maxDistance = 0;
+			for( int d=0 ; d<3 ; d++ )
+			{
+				int below = c[d]-lo[d] , above = hi[d]-c[d];
+				if( below<0 ) minDistance += below*below;
+				else if( above<0 ) minDistance += above*above;
+				int far = std::max< int >( abs( below ) , abs( above ) );
+				maxDistance += far*far;
+			}
+			minDistances[i] = minDistance;
+			minMaxDistance = std::min< int >( minMaxDistance , maxDistance );
+		}
+		std::vector< int > candidates;
+		for( size_t i=0 ; i<_colors.size() ; i++ ) if( minDistances[i]<=minMaxDistance ) candidates.push_back( (int)i );
+
+		for( int r=start[0] ; r<start[0]+BoxCells ; r++ ) for( int g=start[1] ; g<start[1]+BoxCells ; g++ ) for( int b=start[2] ; b<start[2]+BoxCells ; b++ )
+		{
+			int _r = r*CellSize + CellSize/2 , _g = g*CellSize + CellSize/2 , _b = b*CellSize + CellSize/2;
+			int best = candidates[0] , bestDistance = INT_MAX;
+			for( size_t i=0 ; i<candidates.size() ; i++ )
+			{
+				const Pixel32 &c = _colors[ candidates[i] ];
+				int d = _SquaredDistance( _r , _g , _b , c.r , c.g , c.b );
+				if( d<bestDistance ) bestDistance = d , best = candidates[i];
+			}
+			_inverse[ _CellIndex( r , g , b ) ] = (unsigned char)best;
+		}
+	} );
+}
+
+void Palette::refine( const Image32 &img , int iterations )
+{
+	if( _colors.empty() ) THROW( "Cannot refine an empty palette" );
+
+	// The clustering is performed on the (non-empty) cells of the histogram, weighted by their counts
+	std::vector< _ColorCell > cells;
+	{
+		std::vector< _ColorCell > histogram = _ColorHistogram( img );
+		for( size_t i=0 ; i<histogram.size() ; i++ ) if( histogram[i].count ) cells.push_back( histogram[i] );
+	}
+	std::vector< Pixel32 > means( cells.size() );
+	for( size_t i=0 ; i<cells.size() ; i++ ) means[i] = cells[i].color();
+
+	std::vector< int > assignments( cells.size() , -1 );
+	for( int iter=0 ; iter<iterations ; iter++ )
+	{
+		std::vector< std::vector< _ColorCell > > clusters( ThreadCount() );
+		std::vector< char > changed( ThreadCount() , 0 );
+		ParallelFor( 0 , cells.size() , [&]( unsigned int t , size_t i )
+		{
+			if( clusters[t].empty() ) clusters[t].resize( _colors.size() );
+			int n = nearest( means[i].r , means[i].g , means[i].b );
+			if( n!=assignments[i] ) assignments[i] = n , changed[t] = 1;
+			clusters[t][n] += cells[i];
+		} , 256 );
+		if( std::find( changed.begin() , changed.end() , 1 )==changed.end() ) break;
+
+		std::vector< _ColorCell > totals( _colors.size() );
+		for( size_t t=0 ; t<clusters.size() ; t++ ) if( clusters[t].size() ) for( size_t i=0 ; i<totals.size() ; i++ ) totals[i] += clusters[t][i];
+		for( size_t i=0 ; i<_colors.size() ; i++ ) if( totals[i].count ) _colors[i] = totals[i].color();
+	}
+	_setInverse();
+}
+
+Palette Palette::MedianCut( const Image32 &img , int colors )
+{
+	if( colors<1 || colors>MaxColors ) THROW( "Palette size must be in the range [ 1 , %d ]: %d" , MaxColors , colors );
+	if( !img.width() || !img.height() ) THROW( "Cannot compute the palette of an empty image" );
+
+	std::vector< _ColorCell > histogram = _ColorHistogram( img );
+	std::vector< _ColorBox > boxes( 1 );
+	for( int d=0 ; d<3 ; d++ ) boxes[0].min[d] = 0 , boxes[0].max[d] = Cells-1;
+	boxes[0].shrink( histogram );
+
+	while( (int)boxes.size()<colors )
+	{
+		// Split by population for the first half of the colors, and by volume for the second
+		int which = -1;
+		bool byPopulation = 2*boxes.size()<=(size_t)colors;
+		for( int i=0 ; i<(int)boxes.size() ; i++ ) if( boxes[i].splittable() )
+		{
+			if( which==-1 ) which = i;
+			else if( byPopulation ? boxes[i].total.count>boxes[which].total.count : boxes[i].volume()>boxes[which].volume() ) which = i;
+		}
+		if( which==-1 ) break;
+
+		_ColorBox &box = boxes[which];
+		int axis = 0;
+		for( int d=1 ; d<3 ; d++ ) if( box.extent(d)>box.extent(axis) ) axis = d;
+
+		// Find the slice along the axis at which half of the population has been accumulated
+		unsigned long long accumulated = 0;
+		int split = box.min[axis];
+		for( ; split<box.max[axis]-1 ; split++ )
+		{
+			int idx[3];
+			idx[axis] = split;
+			int d1 = (axis+1)%3 , d2 = (axis+2)%3;
+			for( idx[d1]=box.min[d1] ; idx[d1]<=box.max[d1] ; idx[d1]++ ) for( idx[d2]=box.min[d2] ; idx[d2]<=box.max[d2] ; idx[d2]++ )
+				accumulated += histogram[ _CellIndex( idx[0] , idx[1] , idx[2] ) ].count;
+			if( 2*accumulated>=box.total.count ) break;
+		}
+
+		_ColorBox upper = box;
+		box.max[axis] = split , upper.min[axis] = split+1;
+		box.shrink( histogram ) , upper.shrink( histogram );
+		boxes.push_back( upper );
+	}
+
+	std::vector< Pixel32 > palette( boxes.size() );
+	for( size_t i=0 ; i<boxes.size() ; i++ ) palette[i] = boxes[i].total.color();
+	return Palette( palette );
+}
+
+Palette Palette::KMeans( const Image32 &img , int colors , int iterations )
+{
+	Palette palette = MedianCut( img , colors );
+	palette.refine( img , iterations );
+	return palette;
+}
+
+///////////////////
+// PaletteMethod //
+///////////////////
+const char *PaletteMethod::Names[] = { "medianCut" , "kMeans" };
+
+int PaletteMethod::Parse( const std::string &name )
+{
+	for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+	THROW( "Unrecognized palette method: %s" , name.c_str() );
+	return -1;
+}
+
+////////////////
+// DitherMode //
+////////////////
+const char *DitherMode::Names[] = { "none" , "ordered" , "floydSteinberg" };
+
+int DitherMode::Parse( const std::string &name )
+{
+	for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+	THROW( "Unrecognized dither mode: %s" , name.c_str() );
+	return -1;
+}
+
+/////////////
+// Image32 //
+/////////////
+Image32 Image32::quantizePalette( int colors , int method , int dither ) const
+{
+	ProfileScope scope( "quantizePalette" );
+	switch( method )
+	{
+		case PaletteMethod::MEDIAN_CUT: return mapPalette( Palette::MedianCut( *this , colors ) , dither );
+		case PaletteMethod::K_MEANS:    return mapPalette( Palette::KMeans( *this , colors ) , dither );
+		default: THROW( "Unrecognized palette method: %d" , method );
+	}
+	return Image32();
+}
+
+Image32 Image32::mapPalette( const Palette &palette , int dither ) const
+{
+	ProfileScope scope( "mapPalette" );
+	if( !palette.size() ) THROW( "Cannot map to an empty palette" );
+
+	Image32 img;
+	img.setSize( _width , _height );
+	if( !_width || !_height ) return img;
+
+	auto Clamp = []( int v ){ return v<0 ? (unsigned char)0 : v>255 ? (unsigned char)255 : (unsigned char)v; };
+	switch( dither )
+	{
+		case DitherMode::NONE:
+		case DitherMode::ORDERED:
+		{
+			// The ordered dither perturbs the colors by a 4x4 Bayer matrix, scaled by the expected spacing of the palette colors
+			const int Bayer[4][4] = { { 0 , 8 , 2 , 10 } , { 12 , 4 , 14 , 6 } , { 3 , 11 , 1 , 9 } , { 15 , 7 , 13 , 5 } };
+			const int spacing = dither==DitherMode::ORDERED ? (int)( 256. / cbrt( (double)palette.size() ) ) : 0;
+			ParallelFor( 0 , _height , [&]( unsigned int , size_t j )
+			{
+				const Pixel32 *inRow = row( (int)j );
+				Pixel32 *outRow = img.row( (int)j );
+				for( int i=0 ; i<_width ; i++ )
+				{
+					int offset = ( ( 2*Bayer[j&3][i&3] + 1 - 16 ) * spacing ) / 32;
+					outRow[i] = palette[ palette.lookup( Clamp( inRow[i].r+offset ) , Clamp( inRow[i].g+offset ) , Clamp( inRow[i].b+offset ) ) ];
+					outRow[i].a = inRow[i].a;
+				}
+			} , 16 );
+			break;
+		}
+		case DitherMode::FLOYD_STEINBERG:
+		{
+			// The errors propagated to the current and next rows, padded by one pixel on either side
+			std::vector< int > current( 3*(_width+2) , 0 ) , next( 3*(_width+2) , 0 );
+			for( int j=0 ; j<_height ; j++ )
+			{
+				const Pixel32 *inRow = row(j);
+				Pixel32 *outRow = img.row(j);
+				std::fill( next.begin() , next.end() , 0 );
+				for( int i=0 ; i<_width ; i++ )
+				{
+					int *e = &current[ 3*(i+1) ] , *_e = &next[ 3*(i+1) ];
+					int c[] = { inRow[i].r + ( e[0]>>4 ) , inRow[i].g + ( e[1]>>4 ) , inRow[i].b + ( e[2]>>4 ) };
+					for( int d=0 ; d<3 ; d++ ) c[d] = Clamp( c[d] );
+					outRow[i] = palette[ palette.lookup( c[0] , c[1] , c[2] ) ];
+					outRow[i].a = inRow[i].a;
+					int error[] = { c[0]-outRow[i].r , c[1]-outRow[i].g , c[2]-outRow[i].b };
+					for( int d=0 ; d<3 ; d++ )
+					{
+						e[3+d] += 7*error[d];
+						_e[d-3] += 3*error[d] , _e[d] += 5*error[d] , _e[3+d] += error[d];
+					}
+				}
+				std::swap( current , next );
+			}
+			break;
+		}
+		default: THROW( "Unrecognized dither mode: %d" , dither );
+	}
+	return img;
+}
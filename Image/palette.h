@@ -0,0 +1,64 @@
+#ifndef PALETTE_INCLUDED
+#define PALETTE_INCLUDED
+
+#include <vector>
+#include "image.h"
+
+namespace Image
+{
+	/** This class represents a palette of at most 256 colors, together with an inverse-lookup table mapping colors to palette entries.
+	*** As in the two-pass quantizer of the JPEG library, the table has one cell per 5-bit (per channel) color and is filled a box of cells at a time,
+	*** testing the cells of a box only against the palette colors that could be nearest to some cell in the box. */
+	class Palette
+	{
+		/** The palette colors */
+		std::vector< Pixel32 > _colors;
+
+		/** The index of the palette color nearest to the center of each cell */
+		std::vector< unsigned char > _inverse;
+
+		/** This method fills in the inverse-lookup table */
+		void _setInverse( void );
+	public:
+		/** The number of bits per channel used to index the inverse-lookup table */
+		static const int CellBits = 5;
+
+		/** The maximum number of colors in a palette */
+		static const int MaxColors = 256;
+
+		/** The default constructor instantiates an empty palette */
+		Palette( void );
+
+		/** This constructor instantiates a palette with the prescribed colors.
+		*** An exception is thrown if there are no colors or more than MaxColors. */
+		Palette( const std::vector< Pixel32 > &colors );
+
+		/** This method returns the number of colors in the palette */
+		int size( void ) const;
+
+		/** This method returns the indexed palette color */
+		const Pixel32 &operator[] ( int i ) const;
+
+		/** This method returns the index of the palette color closest (in RGB space) to the input color, using an exhaustive search */
+		int nearest( int r , int g , int b ) const;
+
+		/** This method returns the index of the palette color closest to the center of the inverse-lookup cell containing the input color */
+		int lookup( unsigned char r , unsigned char g , unsigned char b ) const
+		{
+			const int shift = 8-CellBits;
+			return _inverse[ ( ( r>>shift )<<(2*CellBits) ) | ( ( g>>shift )<<CellBits ) | ( b>>shift ) ];
+		}
+
+		/** This method refines the palette colors with (at most) the prescribed number of iterations of k-means clustering of the image colors */
+		void refine( const Image32 &img , int iterations );
+
+		/** This static method returns a palette with (at most) the prescribed number of colors, obtained by recursively splitting
+		*** the box of image colors with the largest population (or, once half the colors have been found, the largest volume)
+		*** at the median along its longest axis. */
+		static Palette MedianCut( const Image32 &img , int colors );
+
+		/** This static method returns the median-cut palette refined with (at most) the prescribed number of k-means iterations */
+		static Palette KMeans( const Image32 &img , int colors , int iterations=8 );
+	};
+}
+#endif // PALETTE_INCLUDED
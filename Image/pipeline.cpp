@@ -0,0 +1,157 @@
+#include <string.h>
+#include <deque>
+#include <mutex>
+#include <exception>
+#include <Util/exceptions.h>
+#include <Util/parallel.h>
+#include <Util/profiler.h>
+#include "pipeline.h"
+
+using namespace Util;
+
+namespace Image
+{
+	/** This structure describes a band of consecutive rows of the image */
+	struct _Band
+	{
+		/** The index of the first row */
+		int y;
+
+		/** The rows */
+		Image32 rows;
+	};
+
+	/** This class records the first failure of the stages of the pipeline, so that the other stages stop early and the failure is reported by the caller */
+	class _PipelineStatus
+	{
+		std::mutex _mutex;
+		std::exception_ptr _exception;
+		std::atomic< bool > _failed;
+	public:
+		_PipelineStatus( void ) : _failed(false) {}
+
+		/** This method returns true if a stage has failed */
+		bool failed( void ) const { return _failed; }
+
+		/** This method records the exception being handled */
+		void fail( void )
+		{
+			std::lock_guard< std::mutex > lock( _mutex );
+			if( !_exception ) _exception = std::current_exception();
+			_failed = true;
+		}
+
+		/** This method rethrows the recorded exception, if any */
+		void rethrow( void ){ if( _exception ) std::rethrow_exception( _exception ); }
+	};
+
+	/** This function reads bands of rows from the reader into the queue, closing it when done */
+	static void _DecodeStage( ImageReader &reader , BoundedQueue< _Band > &out , int bandHeight , _PipelineStatus &status )
+	{
+		try
+		{
+			const int width = reader.width() , height = reader.height();
+			for( int y=0 ; y<height && !status.failed() ; y+=bandHeight )
+			{
+				_Band band;
+				band.y = y;
+				{
+					ProfileScope scope( "decode band" , "pipeline" );
+					band.rows.setSize( width , std::min< int >( bandHeight , height-y ) );
+					for( int j=0 ; j<band.rows.height() ; j++ ) reader.readRow( band.rows.row(j) );
+				}
+				Profiler::Count( "pixels decoded" , (double)width*band.rows.height() );
+				out.push( std::move( band ) );
+			}
+		}
+		catch( ... ){ status.fail(); }
+		out.close();
+	}
+
+	/** This function filters the bands of rows from the input queue into the output queue, closing it when done.
+	*** The input rows are held in a sliding window, and an output band is filtered once the rows within the filter's radius of it have arrived. */
+	static void _FilterStage( BoundedQueue< _Band > &in , const BandFilter &filter , BoundedQueue< _Band > &out , int width , int height , int bandHeight , _PipelineStatus &status )
+	{
+		// The window holds the input rows [start,start+window.size()), and the rows [0,next) have been output
+		std::deque< std::vector< Pixel32 > > window;
+		int start = 0 , next = 0;
+		const int radius = std::max< int >( filter.radius , 0 );
+
+		auto Emit = [&]( int end )
+		{
+			// Filter the rows [next,end) along with the rows within the radius of them
+			const int begin = std::max< int >( next-radius , 0 ) , _end = std::min< int >( end+radius , height );
+			Image32 rows;
+			rows.setSize( width , _end-begin );
+			for( int j=begin ; j<_end ; j++ ) memcpy( rows.row(j-begin) , &window[j-start][0] , sizeof(Pixel32)*width );
+			Image32 filtered = filter.filter( rows );
+			if( filtered.width()!=rows.width() || filtered.height()!=rows.height() ) THROW( "Band filter changed the dimensions: %d x %d -> %d x %d" , rows.width() , rows.height() , filtered.width() , filtered.height() );
+
+			_Band band;
+			band.y = next;
+			band.rows.setSize( width , end-next );
+			for( int j=next ; j<end ; j++ ) memcpy( band.rows.row(j-next) , filtered.row(j-begin) , sizeof(Pixel32)*width );
+			out.push( std::move( band ) );
+
+			// Drop the rows that later bands do not depend on
+			next = end;
+			while( start<next-radius ) window.pop_front() , start++;
+		};
+
+		_Band band;
+		try
+		{
+			while( in.pop( band ) && !status.failed() )
+			{
+				for( int j=0 ; j<band.rows.height() ; j++ ) window.push_back( std::vector< Pixel32 >( band.rows.row(j) , band.rows.row(j)+width ) );
+				const int received = start + (int)window.size();
+				while( next<height )
+				{
+					int end = std::min< int >( next+bandHeight , height );
+					if( received<std::min< int >( end+radius , height ) ) break;
+					Emit( end );
+				}
+			}
+		}
+		catch( ... ){ status.fail(); }
+
+		// Drain the input so that the stage before does not wait on a full queue
+		while( in.pop( band ) ) ;
+		out.close();
+	}
+
+	void StreamImage( ImageReader &reader , const std::vector< BandFilter > &filters , ImageWriter &writer , int bandHeight , size_t depth )
+	{
+		if( bandHeight<=0 ) THROW( "Band height must be positive: %d" , bandHeight );
+		const int width = reader.width() , height = reader.height();
+
+		// The queues between the stages: queues[0] holds the decoded bands and queues[i+1] the bands output by the i-th filter
+		std::vector< BoundedQueue< _Band > * > queues( filters.size()+1 );
+		for( size_t i=0 ; i<queues.size() ; i++ ) queues[i] = new BoundedQueue< _Band >( depth );
+		_PipelineStatus status;
+
+		std::vector< std::thread > stages;
+		stages.push_back( std::thread( [&]( void ){ _DecodeStage( reader , *queues[0] , bandHeight , status ); } ) );
+		for( size_t i=0 ; i<filters.size() ; i++ ) stages.push_back( std::thread( [&,i]( void ){ _FilterStage( *queues[i] , filters[i] , *queues[i+1] , width , height , bandHeight , status ); } ) );
+
+		// Encode on the calling thread
+		_Band band;
+		int rows = 0;
+		try
+		{
+			while( queues.back()->pop( band ) && !status.failed() )
+			{
+				ProfileScope scope( "encode band" , "pipeline" );
+				for( int j=0 ; j<band.rows.height() ; j++ , rows++ ) writer.writeRow( band.rows.row(j) );
+				Profiler::Count( "pixels encoded" , (double)width*band.rows.height() );
+			}
+		}
+		catch( ... ){ status.fail(); }
+		while( queues.back()->pop( band ) ) ;
+
+		for( size_t i=0 ; i<stages.size() ; i++ ) stages[i].join();
+		for( size_t i=0 ; i<queues.size() ; i++ ) delete queues[i];
+		status.rethrow();
+		if( rows!=height ) THROW( "Streamed %d of %d rows" , rows , height );
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef PIPELINE_INCLUDED
+#define PIPELINE_INCLUDED
+
+#include <vector>
+#include <functional>
+#include "codec.h"
+
+namespace Image
+{
+	/** This structure describes a filter that can be applied to an image a band of rows (or a tile, see FilterTiles) at a time.
+	*** The filter maps an image to one with the same dimensions, and each output pixel depends only on the input pixels within the prescribed radius of it, both across and down.
+	*** (How the filter treats the edges of its input does not matter, as the pipeline only keeps the pixels that are far enough from the band's edges.) */
+	struct BandFilter
+	{
+		/** The number of rows above and below (and columns to the left and right of) an output pixel that it depends on */
+		int radius;
+
+		/** The function filtering a band of rows */
+		std::function< Image32 ( const Image32 & ) > filter;
+
+		BandFilter( int radius , std::function< Image32 ( const Image32 & ) > filter ) : radius(radius) , filter(filter) {}
+	};
+
+	/** This function streams the image from the reader through the filters to the writer, in bands of the prescribed number of rows.
+	*** The decoder, each of the filters, and the encoder run as concurrent stages connected by queues holding at most the prescribed number of bands,
+	*** so that a filter starts as soon as the rows it needs have been decoded, and each stage holds O(bandHeight+radius) rows rather than the whole image.
+	*** The bound only holds for a reader and writer that stream: a BufferedImageReader or BufferedImageWriter (as for a BMP that is not seekable) holds the whole image.
+	*** The output is the same as that of applying the filters to the whole image in turn. */
+	void StreamImage( ImageReader &reader , const std::vector< BandFilter > &filters , ImageWriter &writer , int bandHeight=64 , size_t depth=2 );
+}
+#endif // PIPELINE_INCLUDED
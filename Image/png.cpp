@@ -0,0 +1,364 @@
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include "png.h"
+
+using namespace Util;
+
+// The rows are filtered from and written to the image memory directly
+static_assert( sizeof( Image::Pixel32 )==4 , "Pixel32 is not packed RGBA" );
+
+static const unsigned char PNGSignature[] = { 0x89 , 'P' , 'N' , 'G' , '\r' , '\n' , 0x1a , '\n' };
+
+static unsigned int ReadBE( const unsigned char *b ){ return ( (unsigned int)b[0]<<24 ) | ( b[1]<<16 ) | ( b[2]<<8 ) | b[3]; }
+
+static void WriteBE( unsigned int v , unsigned char *b ){ b[0] = (unsigned char)( v>>24 ) , b[1] = (unsigned char)( v>>16 ) , b[2] = (unsigned char)( v>>8 ) , b[3] = (unsigned char)v; }
+
+/** The Paeth predictor of the PNG specification */
+static inline unsigned char Paeth( int a , int b , int c )
+{
+	int p = a + b - c;
+	int pa = abs( p-a ) , pb = abs( p-b ) , pc = abs( p-c );
+	if( pa<=pb && pa<=pc ) return (unsigned char)a;
+	else if( pb<=pc ) return (unsigned char)b;
+	else return (unsigned char)c;
+}
+
+/** The number of samples per pixel of the color types */
+static int Channels( int colorType )
+{
+	switch( colorType )
+	{
+	case 0: return 1;
+	case 2: return 3;
+	case 3: return 1;
+	case 4: return 2;
+	case 6: return 4;
+	default: THROW( "Bad PNG color type: %d" , colorType );
+	}
+	return 0;
+}
+
+namespace Image
+{
+	///////////////
+	// PNGReader //
+	///////////////
+	PNGReader::PNGReader( FILE *fp ) : _fp(fp) , _width(0) , _height(0) , _rows(0) , _hasTransparent(false) , _remaining(0) , _crc(0) , _idatDone(false) , _inflater(NULL)
+	{
+		if( !fp ) THROW( "Empty file pointer" );
+		unsigned char signature[8];
+		if( fread( signature , 1 , 8 , fp )!=8 || memcmp( signature , PNGSignature , 8 ) ) THROW( "Bad PNG signature" );
+
+		// Read the chunks up to the first IDAT
+		std::vector< unsigned char > data;
+		while( true )
+		{
+			char type[4];
+			unsigned int length = _readChunkHeader( type );
+			if( !_width && memcmp( type , "IHDR" , 4 ) ) THROW( "PNG does not start with an IHDR chunk" );
+			if( !memcmp( type , "IDAT" , 4 ) )
+			{
+				_remaining = length;
+				_crc = CRC32( (const unsigned char *)type , 4 );
+				break;
+			}
+
+			data.resize( length+4 );
+			if( fread( &data[0] , 1 , length+4 , fp )!=length+4 ) THROW( "Truncated PNG chunk" );
+			unsigned int crc = CRC32( (const unsigned char *)type , 4 );
+			if( CRC32( &data[0] , length , crc )!=ReadBE( &data[length] ) ) THROW( "CRC mismatch in PNG chunk %.4s" , type );
+
+			if( !memcmp( type , "IHDR" , 4 ) )
+			{
+				if( length!=13 ) THROW( "Bad PNG header length: %u" , length );
+				_width = (int)ReadBE( &data[0] ) , _height = (int)ReadBE( &data[4] );
+				_bitDepth = data[8] , _colorType = data[9] , _interlace = data[12];
+				if( _width<=0 || _height<=0 ) THROW( "Bad PNG dimensions: %d x %d" , _width , _height );
+				if( data[10] || data[11] || _interlace>1 ) THROW( "Unsupported PNG compression, filter, or interlace method: %d %d %d" , data[10] , data[11] , _interlace );
+				bool valid;
+				switch( _colorType )
+				{
+				case 0: valid = _bitDepth==1 || _bitDepth==2 || _bitDepth==4 || _bitDepth==8 || _bitDepth==16 ; break;
+				case 3: valid = _bitDepth==1 || _bitDepth==2 || _bitDepth==4 || _bitDepth==8 ; break;
+				case 2: case 4: case 6: valid = _bitDepth==8 || _bitDepth==16 ; break;
+				default: valid = false;
+				}
+				if( !valid ) THROW( "Bad PNG bit depth for color type: %d %d" , _bitDepth , _colorType );
+			}
+			else if( !memcmp( type , "PLTE" , 4 ) )
+			{
+				if( length%3 || length>3*256 ) THROW( "Bad PNG palette length: %u" , length );
+				_palette.resize( length/3 );
+				for( size_t i=0 ; i<_palette.size() ; i++ ) _palette[i].r = data[3*i] , _palette[i].g = data[3*i+1] , _palette[i].b = data[3*i+2] , _palette[i].a = 255;
+			}
+			else if( !memcmp( type , "tRNS" , 4 ) )
+			{
+				if( _colorType==3 ) for( size_t i=0 ; i<length && i<_palette.size() ; i++ ) _palette[i].a = data[i];
+				else if( ( _colorType==0 && length==2 ) || ( _colorType==2 && length==6 ) )
+				{
+					_hasTransparent = true;
+					for( unsigned int i=0 ; i<length/2 ; i++ ) _transparent[i] = (unsigned short)( ( data[2*i]<<8 ) | data[2*i+1] );
+				}
+			}
+			else if( !memcmp( type , "IEND" , 4 ) ) THROW( "PNG has no image data" );
+			else if( !( type[0] & 0x20 ) ) THROW( "Unsupported critical PNG chunk: %.4s" , type );
+		}
+		if( _colorType==3 && _palette.empty() ) THROW( "PNG is missing its palette" );
+
+		_inflater = new Inflater( [this]( unsigned char *buffer , size_t size ){ return _readData( buffer , size ); } );
+		if( _interlace )
+		{
+			// The Adam7 passes: the offset and spacing of the pixels in each one
+			static const int X0[] = { 0 , 4 , 0 , 2 , 0 , 1 , 0 } , Y0[] = { 0 , 0 , 4 , 0 , 2 , 0 , 1 };
+			static const int DX[] = { 8 , 8 , 4 , 4 , 2 , 2 , 1 } , DY[] = { 8 , 8 , 8 , 4 , 4 , 2 , 2 };
+			try
+			{
+				_pixels.resize( (size_t)_width * _height );
+				for( int p=0 ; p<7 ; p++ )
+				{
+					int w = ( _width - X0[p] + DX[p] - 1 ) / DX[p] , h = ( _height - Y0[p] + DY[p] - 1 ) / DY[p];
+					if( w<=0 || h<=0 ) continue;
+					_previous.assign( ( (size_t)w * Channels( _colorType ) * _bitDepth + 7 ) / 8 , 0 );
+					for( int j=0 ; j<h ; j++ )
+					{
+						_readRawRow( w );
+						_convertRow( w , &_pixels[ (size_t)( Y0[p] + j*DY[p] ) * _width + X0[p] ] , DX[p] );
+					}
+				}
+			}
+			catch( ... )
+			{
+				delete _inflater;
+				throw;
+			}
+		}
+		else _previous.assign( ( (size_t)_width * Channels( _colorType ) * _bitDepth + 7 ) / 8 , 0 );
+	}
+
+	PNGReader::~PNGReader( void ){ delete _inflater; }
+
+	unsigned int PNGReader::_readChunkHeader( char type[4] )
+	{
+		unsigned char header[8];
+		if( fread( header , 1 , 8 , _fp )!=8 ) THROW( "Truncated PNG file" );
+		unsigned int length = ReadBE( header );
+		if( length>0x7fffffff ) THROW( "Bad PNG chunk length: %u" , length );
+		memcpy( type , header+4 , 4 );
+		return length;
+	}
+
+	size_t PNGReader::_readData( unsigned char *buffer , size_t size )
+	{
+		size_t count = 0;
+		while( count<size && !_idatDone )
+		{
+			if( !_remaining )
+			{
+				// Check the CRC of the finished chunk and move on to the next one, stopping at the first chunk that is not an IDAT
+				unsigned char crc[4];
+				if( fread( crc , 1 , 4 , _fp )!=4 ) THROW( "Truncated PNG file" );
+				if( ReadBE( crc )!=_crc ) THROW( "CRC mismatch in PNG chunk IDAT" );
+				char type[4];
+				unsigned int length = _readChunkHeader( type );
+				if( memcmp( type , "IDAT" , 4 ) ){ _idatDone = true ; break; }
+				_remaining = length;
+				_crc = CRC32( (const unsigned char *)type , 4 );
+				continue;
+			}
+			size_t n = fread( buffer+count , 1 , std::min< size_t >( size-count , _remaining ) , _fp );
+			if( !n ) THROW( "Truncated PNG file" );
+			_crc = CRC32( buffer+count , n , _crc );
+			_remaining -= (unsigned int)n;
+			count += n;
+		}
+		return count;
+	}
+
+	void PNGReader::_readRawRow( int width )
+	{
+		size_t size = ( (size_t)width * Channels( _colorType ) * _bitDepth + 7 ) / 8;
+		size_t bpp = std::max< int >( 1 , Channels( _colorType ) * _bitDepth / 8 );
+		_current.resize( size+1 );
+		if( _inflater->read( &_current[0] , size+1 )!=size+1 ) THROW( "Truncated PNG image data" );
+
+		unsigned char *x = &_current[1];
+		const unsigned char *b = &_previous[0];
+		switch( _current[0] )
+		{
+		case 0: break;
+		case 1: for( size_t i=bpp ; i<size ; i++ ) x[i] += x[i-bpp] ; break;
+		case 2: for( size_t i=0 ; i<size ; i++ ) x[i] += b[i] ; break;
+		case 3:
+			for( size_t i=0   ; i<bpp  ; i++ ) x[i] += b[i]>>1;
+			for( size_t i=bpp ; i<size ; i++ ) x[i] += ( x[i-bpp] + b[i] )>>1;
+			break;
+		case 4:
+			for( size_t i=0   ; i<bpp  ; i++ ) x[i] += b[i];
+			for( size_t i=bpp ; i<size ; i++ ) x[i] += Paeth( x[i-bpp] , b[i] , b[i-bpp] );
+			break;
+		default: THROW( "Bad PNG filter type: %d" , _current[0] );
+		}
+		memcpy( &_previous[0] , x , size );
+	}
+
+	void PNGReader::_convertRow( int width , Pixel32 *row , int stride ) const
+	{
+		const unsigned char *p = &_previous[0];
+		int depth = _bitDepth;
+		auto Sample = [&]( size_t i ) -> unsigned int
+		{
+			if     ( depth==8  ) return p[i];
+			else if( depth==16 ) return ( p[2*i]<<8 ) | p[2*i+1];
+			else return ( p[ (i*depth)>>3 ] >> ( 8 - depth - ( (i*depth) & 7 ) ) ) & ( (1<<depth)-1 );
+		};
+		// Reduce 16-bit samples (with rounding), and expand low bit depths to the full range
+		auto Scale = [&]( unsigned int v ) -> unsigned char
+		{
+			if     ( depth==8  ) return (unsigned char)v;
+			else if( depth==16 ) return (unsigned char)( ( v*255 + 32895 )>>16 );
+			else return (unsigned char)( v*255 / ( (1<<depth)-1 ) );
+		};
+
+		for( int i=0 ; i<width ; i++ , row+=stride )
+			switch( _colorType )
+			{
+			case 0:
+			{
+				unsigned int g = Sample( i );
+				row->r = row->g = row->b = Scale( g );
+				row->a = _hasTransparent && g==_transparent[0] ? 0 : 255;
+				break;
+			}
+			case 2:
+			{
+				unsigned int r = Sample( 3*i ) , g = Sample( 3*i+1 ) , b = Sample( 3*i+2 );
+				row->r = Scale( r ) , row->g = Scale( g ) , row->b = Scale( b );
+				row->a = _hasTransparent && r==_transparent[0] && g==_transparent[1] && b==_transparent[2] ? 0 : 255;
+				break;
+			}
+			case 3:
+			{
+				unsigned int idx = Sample( i );
+				if( idx>=_palette.size() ) THROW( "PNG palette index out of range: %u" , idx );
+				*row = _palette[idx];
+				break;
+			}
+			case 4: row->r = row->g = row->b = Scale( Sample( 2*i ) ) , row->a = Scale( Sample( 2*i+1 ) ) ; break;
+			case 6: row->r = Scale( Sample( 4*i ) ) , row->g = Scale( Sample( 4*i+1 ) ) , row->b = Scale( Sample( 4*i+2 ) ) , row->a = Scale( Sample( 4*i+3 ) ) ; break;
+			}
+	}
+
+	void PNGReader::readRow( Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been read" , _height );
+		if( _interlace ) memcpy( row , &_pixels[ (size_t)_rows * _width ] , sizeof(Pixel32)*_width );
+		else
+		{
+			_readRawRow( _width );
+			_convertRow( _width , row , 1 );
+		}
+		_rows++;
+
+		// Once all the rows are decoded, read to the end of the compressed stream so that its checksum is verified
+		if( _rows==_height )
+		{
+			unsigned char extra;
+			if( _inflater->read( &extra , 1 ) ) THROW( "Extra PNG image data" );
+		}
+	}
+
+	///////////////
+	// PNGWriter //
+	///////////////
+	PNGWriter::PNGWriter( FILE *fp , int width , int height , int level ) : _fp(fp) , _width(width) , _height(height) , _rows(0) , _deflater(NULL)
+	{
+		if( !fp ) THROW( "Empty file pointer" );
+		if( width<=0 || height<=0 ) THROW( "Bad image dimensions: %d x %d" , width , height );
+		if( fwrite( PNGSignature , 1 , 8 , fp )!=8 ) THROW( "Failed to write PNG signature" );
+
+		unsigned char header[13];
+		WriteBE( width , header ) , WriteBE( height , header+4 );
+		header[ 8] = 8;	// Bit depth
+		header[ 9] = 6;	// Color type: RGBA
+		header[10] = 0;	// Compression method: deflate
+		header[11] = 0;	// Filter method: adaptive
+		header[12] = 0;	// No interlacing
+		_writeChunk( "IHDR" , header , 13 );
+
+		_deflater = new Deflater( [this]( const unsigned char *data , size_t size )
+		{
+			_data.insert( _data.end() , data , data+size );
+			if( _data.size()>=(1<<16) )
+			{
+				_writeChunk( "IDAT" , &_data[0] , _data.size() );
+				_data.resize( 0 );
+			}
+		} , level );
+		_previous.resize( (size_t)width*4 , 0 );
+		for( int f=0 ; f<5 ; f++ ) _filtered[f].resize( (size_t)width*4+1 ) , _filtered[f][0] = (unsigned char)f;
+	}
+
+	PNGWriter::~PNGWriter( void ){ delete _deflater; }
+
+	void PNGWriter::_writeChunk( const char *type , const unsigned char *data , size_t size )
+	{
+		unsigned char b[4];
+		WriteBE( (unsigned int)size , b );
+		unsigned int crc = CRC32( (const unsigned char *)type , 4 );
+		crc = CRC32( data , size , crc );
+		bool success = fwrite( b , 1 , 4 , _fp )==4 && fwrite( type , 1 , 4 , _fp )==4 && ( !size || fwrite( data , 1 , size , _fp )==size );
+		WriteBE( crc , b );
+		if( !success || fwrite( b , 1 , 4 , _fp )!=4 ) THROW( "Failed to write PNG chunk %.4s" , type );
+	}
+
+	void PNGWriter::writeRow( const Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been written" , _height );
+		_rows++;
+
+		const unsigned char *x = (const unsigned char *)row , *b = &_previous[0];
+		size_t size = _previous.size();
+		const size_t bpp = 4;
+
+		// Filter the row with each filter, keeping the one whose output (as signed bytes) has the smallest sum of absolute values
+		int best = 0;
+		unsigned long long bestCost = (unsigned long long)-1;
+		unsigned char *y[5];
+		for( int f=0 ; f<5 ; f++ ) y[f] = &_filtered[f][1];
+		for( size_t i=0 ; i<bpp ; i++ )
+		{
+			y[0][i] = x[i];
+			y[1][i] = x[i];
+			y[2][i] = (unsigned char)( x[i] - b[i] );
+			y[3][i] = (unsigned char)( x[i] - ( b[i]>>1 ) );
+			y[4][i] = (unsigned char)( x[i] - b[i] );
+		}
+		for( size_t i=bpp ; i<size ; i++ )
+		{
+			y[0][i] = x[i];
+			y[1][i] = (unsigned char)( x[i] - x[i-bpp] );
+			y[2][i] = (unsigned char)( x[i] - b[i] );
+			y[3][i] = (unsigned char)( x[i] - ( ( x[i-bpp] + b[i] )>>1 ) );
+			y[4][i] = (unsigned char)( x[i] - Paeth( x[i-bpp] , b[i] , b[i-bpp] ) );
+		}
+		for( int f=0 ; f<5 ; f++ )
+		{
+			unsigned long long cost = 0;
+			for( size_t i=0 ; i<size ; i++ ) cost += abs( (signed char)y[f][i] );
+			if( cost<bestCost ) bestCost = cost , best = f;
+		}
+		_deflater->write( &_filtered[best][0] , size+1 );
+		memcpy( &_previous[0] , x , size );
+
+		if( _rows==_height )
+		{
+			_deflater->finish();
+			if( _data.size() ) _writeChunk( "IDAT" , &_data[0] , _data.size() );
+			_data.resize( 0 );
+			_writeChunk( "IEND" , NULL , 0 );
+			fflush( _fp );
+		}
+	}
+}
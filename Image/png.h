@@ -0,0 +1,116 @@
+#ifndef PNG_INCLUDED
+#define PNG_INCLUDED
+
+#include <string.h>
+#include <vector>
+#include <Util/deflate.h>
+#include "codec.h"
+
+namespace Image
+{
+	/** This class reads in a PNG file a row at a time, inflating the image data as the rows are requested.
+	*** All bit depths and color types are supported, with 16-bit samples reduced to 8 bits and transparency (tRNS) converted to alpha.
+	*** An interlaced (Adam7) file cannot be streamed, so it is decoded in full when the reader is constructed. */
+	class PNGReader : public ImageReader
+	{
+		/** The file being read */
+		FILE *_fp;
+
+		/** The dimensions, bit depth, color type, and interlace method from the header */
+		int _width , _height , _bitDepth , _colorType , _interlace;
+
+		/** The number of rows read */
+		int _rows;
+
+		/** The palette (with its alpha) */
+		std::vector< Pixel32 > _palette;
+
+		/** The raw sample values that are transparent, if the file has a tRNS chunk for a grayscale or truecolor image */
+		bool _hasTransparent;
+		unsigned short _transparent[3];
+
+		/** The number of image data bytes left in the current IDAT chunk, and the CRC of the chunk */
+		unsigned int _remaining , _crc;
+		bool _idatDone;
+
+		/** The decompressor of the image data */
+		Util::Inflater *_inflater;
+
+		/** The filtered and the previous (unfiltered) row */
+		std::vector< unsigned char > _current , _previous;
+
+		/** The pixels of an interlaced image */
+		std::vector< Pixel32 > _pixels;
+
+		/** This method reads the next chunk header, returning the length and setting the type */
+		unsigned int _readChunkHeader( char type[4] );
+
+		/** This method pulls image data out of the IDAT chunks, returning the number of bytes read */
+		size_t _readData( unsigned char *buffer , size_t size );
+
+		/** This method inflates and unfilters the next row of a (sub-)image with the prescribed number of pixels */
+		void _readRawRow( int width );
+
+		/** This method converts the unfiltered row of raw samples into pixels, writing them with the prescribed stride */
+		void _convertRow( int width , Pixel32 *row , int stride ) const;
+	public:
+		/** The constructor reads the chunks preceding the image data */
+		PNGReader( FILE *fp );
+
+		/** The destructor frees the decompressor */
+		~PNGReader( void );
+
+		PNGReader( const PNGReader& ) = delete;
+		PNGReader& operator = ( const PNGReader& ) = delete;
+
+		int width( void ) const { return _width; }
+		int height( void ) const { return _height; }
+		void readRow( Pixel32 *row );
+	};
+
+	/** This class writes out an 8-bit RGBA PNG file a row at a time.
+	*** Each row is filtered with the filter minimizing the sum of the absolute values of its (signed) output, and the deflated data is written in 64K IDAT chunks. */
+	class PNGWriter : public ImageWriter
+	{
+		/** The file being written */
+		FILE *_fp;
+
+		/** The dimensions */
+		int _width , _height;
+
+		/** The number of rows written */
+		int _rows;
+
+		/** The compressor of the image data and the compressed bytes not yet written out */
+		Util::Deflater *_deflater;
+		std::vector< unsigned char > _data;
+
+		/** The previous row, and the row filtered with each of the five filters (preceded by the filter type) */
+		std::vector< unsigned char > _previous , _filtered[5];
+
+		/** This method writes out a chunk */
+		void _writeChunk( const char *type , const unsigned char *data , size_t size );
+	public:
+		/** The constructor writes out the signature and the header */
+		PNGWriter( FILE *fp , int width , int height , int level=6 );
+
+		/** The destructor frees the compressor */
+		~PNGWriter( void );
+
+		PNGWriter( const PNGWriter& ) = delete;
+		PNGWriter& operator = ( const PNGWriter& ) = delete;
+
+		void writeRow( const Pixel32 *row );
+	};
+
+	/** The codec of PNG files */
+	class PNGImageCodec : public ImageCodec
+	{
+	public:
+		const char *extensions( void ) const { return "png"; }
+		bool sniff( const unsigned char *header , size_t size ) const { return size>=8 && !memcmp( header , "\x89PNG\r\n\x1a\n" , 8 ); }
+		ImageReader *newReader( FILE *fp ) const { return new PNGReader( fp ); }
+		ImageWriter *newWriter( FILE *fp , int width , int height ) const { return new PNGWriter( fp , width , height ); }
+	};
+}
+#endif // PNG_INCLUDED
@@ -0,0 +1,131 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include "ppm.h"
+
+/** Reads the next white-space delimited token of a PNM header, skipping comments */
+static std::string ReadToken( FILE *fp )
+{
+	std::string token;
+	int c = getc( fp );
+	while( c!=EOF )
+	{
+		if( c=='#' ) while( c!=EOF && c!='\n' ) c = getc( fp );
+		else if( isspace( c ) ) c = getc( fp );
+		else break;
+	}
+	while( c!=EOF && !isspace( c ) && c!='#' ) token += (char)c , c = getc( fp );
+	// The single white-space character following the last token of the header is consumed with it
+	if( c=='#' ) ungetc( c , fp );
+	return token;
+}
+
+/** Reads a positive integer from a PNM header */
+static int ReadInteger( FILE *fp , const char *name )
+{
+	std::string token = ReadToken( fp );
+	int value = atoi( token.c_str() );
+	if( value<=0 ) THROW( "Bad PNM %s: %s" , name , token.c_str() );
+	return value;
+}
+
+namespace Image
+{
+	///////////////
+	// PNMReader //
+	///////////////
+	PNMReader::PNMReader( FILE *fp ) : _fp(fp) , _rows(0)
+	{
+		if( !fp ) THROW( "Empty file pointer" );
+		std::string magic = ReadToken( fp );
+		if( magic=="P5" || magic=="P6" )
+		{
+			_channels = magic=="P5" ? 1 : 3;
+			_width = ReadInteger( fp , "width" );
+			_height = ReadInteger( fp , "height" );
+			_maxValue = ReadInteger( fp , "maximum value" );
+		}
+		else if( magic=="P7" )
+		{
+			_width = _height = _channels = _maxValue = 0;
+			std::string tupleType;
+			while( true )
+			{
+				std::string token = ReadToken( fp );
+				if     ( token=="ENDHDR" ) break;
+				else if( token=="WIDTH"  ) _width = ReadInteger( fp , "width" );
+				else if( token=="HEIGHT" ) _height = ReadInteger( fp , "height" );
+				else if( token=="DEPTH"  ) _channels = ReadInteger( fp , "depth" );
+				else if( token=="MAXVAL" ) _maxValue = ReadInteger( fp , "maximum value" );
+				else if( token=="TUPLTYPE" ) tupleType = ReadToken( fp );
+				else if( token.empty() ) THROW( "Truncated PAM header" );
+				else THROW( "Unrecognized PAM header field: %s" , token.c_str() );
+			}
+			if( !_width || !_height || !_channels || !_maxValue ) THROW( "Incomplete PAM header" );
+			if( _channels>4 ) THROW( "Unsupported PAM depth: %d" , _channels );
+			if( tupleType.size() && tupleType!="GRAYSCALE" && tupleType!="GRAYSCALE_ALPHA" && tupleType!="RGB" && tupleType!="RGB_ALPHA" ) THROW( "Unsupported PAM tuple type: %s" , tupleType.c_str() );
+		}
+		else THROW( "Unsupported PNM type: %s" , magic.c_str() );
+		if( _maxValue>65535 ) THROW( "Bad PNM maximum value: %d" , _maxValue );
+		_buffer.resize( (size_t)_width * _channels * ( _maxValue>255 ? 2 : 1 ) );
+	}
+
+	void PNMReader::readRow( Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been read" , _height );
+		if( fread( &_buffer[0] , 1 , _buffer.size() , _fp )!=_buffer.size() ) THROW( "Truncated PNM data" );
+		_rows++;
+
+		int samples = _width * _channels;
+		if( _maxValue>255 )
+			for( int i=0 ; i<samples ; i++ )
+			{
+				unsigned int v = ( _buffer[2*i]<<8 ) | _buffer[2*i+1];
+				_buffer[i] = (unsigned char)( ( std::min< unsigned int >( v , _maxValue )*255 + _maxValue/2 ) / _maxValue );
+			}
+		else if( _maxValue<255 )
+			for( int i=0 ; i<samples ; i++ ) _buffer[i] = (unsigned char)( ( std::min< int >( _buffer[i] , _maxValue )*255 + _maxValue/2 ) / _maxValue );
+
+		const unsigned char *b = &_buffer[0];
+		switch( _channels )
+		{
+		case 1: for( int i=0 ; i<_width ; i++ , b+=1 ) row[i].r = row[i].g = row[i].b = b[0] , row[i].a = 255 ; break;
+		case 2: for( int i=0 ; i<_width ; i++ , b+=2 ) row[i].r = row[i].g = row[i].b = b[0] , row[i].a = b[1] ; break;
+		case 3: for( int i=0 ; i<_width ; i++ , b+=3 ) row[i].r = b[0] , row[i].g = b[1] , row[i].b = b[2] , row[i].a = 255 ; break;
+		case 4: for( int i=0 ; i<_width ; i++ , b+=4 ) row[i].r = b[0] , row[i].g = b[1] , row[i].b = b[2] , row[i].a = b[3] ; break;
+		}
+	}
+
+	///////////////
+	// PNMWriter //
+	///////////////
+	PNMWriter::PNMWriter( FILE *fp , int width , int height , int type ) : _fp(fp) , _width(width) , _height(height) , _rows(0)
+	{
+		if( !fp ) THROW( "Empty file pointer" );
+		if( width<=0 || height<=0 ) THROW( "Bad image dimensions: %d x %d" , width , height );
+		switch( type )
+		{
+		case PGM: _channels = 1 ; fprintf( fp , "P5\n%d %d\n255\n" , width , height ) ; break;
+		case PPM: _channels = 3 ; fprintf( fp , "P6\n%d %d\n255\n" , width , height ) ; break;
+		case PAM: _channels = 4 ; fprintf( fp , "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n" , width , height ) ; break;
+		default: THROW( "Unrecognized PNM type: %d" , type );
+		}
+		_buffer.resize( (size_t)_width * _channels );
+	}
+
+	void PNMWriter::writeRow( const Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been written" , _height );
+		unsigned char *b = &_buffer[0];
+		switch( _channels )
+		{
+		case 1: for( int i=0 ; i<_width ; i++ ) *b++ = (unsigned char)( ( 299*row[i].r + 587*row[i].g + 114*row[i].b + 500 ) / 1000 ) ; break;
+		case 3: for( int i=0 ; i<_width ; i++ ) *b++ = row[i].r , *b++ = row[i].g , *b++ = row[i].b ; break;
+		case 4: memcpy( b , row , _buffer.size() ) ; break;
+		}
+		if( fwrite( &_buffer[0] , 1 , _buffer.size() , _fp )!=_buffer.size() ) THROW( "Failed to write PNM data" );
+		if( ++_rows==_height ) fflush( _fp );
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef PPM_INCLUDED
+#define PPM_INCLUDED
+
+#include <vector>
+#include "codec.h"
+
+namespace Image
+{
+	/** This class reads in a binary PGM (P5), PPM (P6), or PAM (P7) file a row at a time.
+	*** Samples with a maximum value other than 255 (including 16-bit samples) are rescaled to the range [0,255]. */
+	class PNMReader : public ImageReader
+	{
+		/** The file being read */
+		FILE *_fp;
+
+		/** The dimensions, the number of samples per pixel, and the maximum sample value */
+		int _width , _height , _channels , _maxValue;
+
+		/** The number of rows read */
+		int _rows;
+
+		/** The raw samples of a row */
+		std::vector< unsigned char > _buffer;
+	public:
+		/** The constructor reads the header of the file */
+		PNMReader( FILE *fp );
+
+		int width( void ) const { return _width; }
+		int height( void ) const { return _height; }
+		void readRow( Pixel32 *row );
+	};
+
+	/** This class writes out a binary PGM (P5), PPM (P6), or PAM (P7) file a row at a time */
+	class PNMWriter : public ImageWriter
+	{
+		/** The file being written */
+		FILE *_fp;
+
+		/** The dimensions and the number of samples per pixel */
+		int _width , _height , _channels;
+
+		/** The number of rows written */
+		int _rows;
+
+		/** The samples of a row */
+		std::vector< unsigned char > _buffer;
+	public:
+		/** The types of file */
+		enum
+		{
+			PGM ,
+			PPM ,
+			PAM
+		};
+
+		/** The constructor writes out the header of the file.
+		*** A PGM stores the luminance, a PPM the color, and a PAM the color and alpha of the pixels. */
+		PNMWriter( FILE *fp , int width , int height , int type );
+
+		void writeRow( const Pixel32 *row );
+	};
+
+	/** The codec of the binary PGM, PPM, or PAM files, all of which can be read by each codec */
+	template< int Type >
+	class PNMImageCodec : public ImageCodec
+	{
+	public:
+		const char *extensions( void ) const { return Type==PNMWriter::PGM ? "pgm" : Type==PNMWriter::PPM ? "ppm pnm" : "pam"; }
+		bool sniff( const unsigned char *header , size_t size ) const { return size>=2 && header[0]=='P' && header[1]==( Type==PNMWriter::PGM ? '5' : Type==PNMWriter::PPM ? '6' : '7' ); }
+		ImageReader *newReader( FILE *fp ) const { return new PNMReader( fp ); }
+		ImageWriter *newWriter( FILE *fp , int width , int height ) const { return new PNMWriter( fp , width , height , Type ); }
+	};
+
+	typedef PNMImageCodec< PNMWriter::PGM > PGMImageCodec;
+	typedef PNMImageCodec< PNMWriter::PPM > PPMImageCodec;
+	typedef PNMImageCodec< PNMWriter::PAM > PAMImageCodec;
+}
+#endif // PPM_INCLUDED
@@ -0,0 +1,173 @@
+#include <string.h>
+#include <algorithm>
+#include <Util/exceptions.h>
+#include "qoi.h"
+
+// The operations of the QOI format (https://qoiformat.org/qoi-specification.pdf)
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF  0x40
+#define QOI_OP_LUMA  0x80
+#define QOI_OP_RUN   0xc0
+#define QOI_OP_RGB   0xfe
+#define QOI_OP_RGBA  0xff
+#define QOI_MASK_2   0xc0
+
+static const unsigned char QOIMagic[] = { 'q' , 'o' , 'i' , 'f' };
+static const unsigned char QOIEnd[] = { 0 , 0 , 0 , 0 , 0 , 0 , 0 , 1 };
+
+static inline int QOIHash( Image::Pixel32 p ){ return ( p.r*3 + p.g*5 + p.b*7 + p.a*11 ) % 64; }
+
+// The pixel the index is initialized with (all channels zero, unlike the default-constructed pixel, which is opaque)
+static inline Image::Pixel32 QOIZero( void ){ Image::Pixel32 p ; p.r = p.g = p.b = p.a = 0 ; return p; }
+
+static inline bool QOISame( Image::Pixel32 p1 , Image::Pixel32 p2 ){ return p1.r==p2.r && p1.g==p2.g && p1.b==p2.b && p1.a==p2.a; }
+
+namespace Image
+{
+	///////////////
+	// QOIReader //
+	///////////////
+	QOIReader::QOIReader( FILE *fp ) : _fp(fp) , _rows(0) , _run(0) , _position(0) , _size(0)
+	{
+		if( !fp ) THROW( "Empty file pointer" );
+		unsigned char header[14];
+		if( fread( header , 1 , 14 , fp )!=14 ) THROW( "Truncated QOI header" );
+		if( memcmp( header , QOIMagic , 4 ) ) THROW( "Bad QOI magic" );
+		unsigned int width  = ( header[ 4]<<24 ) | ( header[ 5]<<16 ) | ( header[ 6]<<8 ) | header[ 7];
+		unsigned int height = ( header[ 8]<<24 ) | ( header[ 9]<<16 ) | ( header[10]<<8 ) | header[11];
+		if( !width || !height || width>(1u<<30) || height>(1u<<30) ) THROW( "Bad QOI dimensions: %u x %u" , width , height );
+		if( header[12]!=3 && header[12]!=4 ) THROW( "Bad QOI channel count: %d" , header[12] );
+		_width = (int)width , _height = (int)height;
+
+		_previous.r = _previous.g = _previous.b = 0 , _previous.a = 255;
+		std::fill( _index , _index+sizeof(_index)/sizeof(Pixel32) , QOIZero() );
+		_buffer.resize( 1<<16 );
+	}
+
+	unsigned char QOIReader::_next( void )
+	{
+		if( _position==_size )
+		{
+			_size = fread( &_buffer[0] , 1 , _buffer.size() , _fp );
+			_position = 0;
+			if( !_size ) THROW( "Truncated QOI data" );
+		}
+		return _buffer[ _position++ ];
+	}
+
+	void QOIReader::readRow( Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been read" , _height );
+		_rows++;
+
+		Pixel32 p = _previous;
+		for( int i=0 ; i<_width ; i++ )
+		{
+			if( _run ) _run--;
+			else
+			{
+				int b1 = _next();
+				if     ( b1==QOI_OP_RGB  ) p.r = _next() , p.g = _next() , p.b = _next();
+				else if( b1==QOI_OP_RGBA ) p.r = _next() , p.g = _next() , p.b = _next() , p.a = _next();
+				else if( ( b1 & QOI_MASK_2 )==QOI_OP_INDEX ) p = _index[b1];
+				else if( ( b1 & QOI_MASK_2 )==QOI_OP_DIFF )
+				{
+					p.r += ( ( b1>>4 ) & 3 ) - 2;
+					p.g += ( ( b1>>2 ) & 3 ) - 2;
+					p.b += ( ( b1    ) & 3 ) - 2;
+				}
+				else if( ( b1 & QOI_MASK_2 )==QOI_OP_LUMA )
+				{
+					int b2 = _next();
+					int dg = ( b1 & 0x3f ) - 32;
+					p.r += dg - 8 + ( ( b2>>4 ) & 0x0f );
+					p.g += dg;
+					p.b += dg - 8 + ( b2 & 0x0f );
+				}
+				else _run = b1 & 0x3f;
+				_index[ QOIHash( p ) ] = p;
+			}
+			row[i] = p;
+		}
+		_previous = p;
+
+		// Check for the end marker once the last pixel is decoded
+		if( _rows==_height ) for( int i=0 ; i<8 ; i++ ) if( _next()!=QOIEnd[i] ) THROW( "Missing QOI end marker" );
+	}
+
+	///////////////
+	// QOIWriter //
+	///////////////
+	QOIWriter::QOIWriter( FILE *fp , int width , int height ) : _fp(fp) , _width(width) , _height(height) , _rows(0) , _run(0)
+	{
+		if( !fp ) THROW( "Empty file pointer" );
+		if( width<=0 || height<=0 ) THROW( "Bad image dimensions: %d x %d" , width , height );
+		unsigned char header[14];
+		memcpy( header , QOIMagic , 4 );
+		for( int i=0 ; i<4 ; i++ ) header[4+i] = (unsigned char)( width>>(24-8*i) ) , header[8+i] = (unsigned char)( height>>(24-8*i) );
+		header[12] = 4;	// RGBA
+		header[13] = 0;	// sRGB with linear alpha
+		if( fwrite( header , 1 , 14 , fp )!=14 ) THROW( "Failed to write QOI header" );
+
+		_previous.r = _previous.g = _previous.b = 0 , _previous.a = 255;
+		std::fill( _index , _index+sizeof(_index)/sizeof(Pixel32) , QOIZero() );
+		// At most five bytes per pixel, plus the pending run and the end marker
+		_buffer.reserve( (size_t)width*5 + 16 );
+	}
+
+	void QOIWriter::writeRow( const Pixel32 *row )
+	{
+		if( _rows==_height ) THROW( "All %d rows have been written" , _height );
+		_rows++;
+		bool last = _rows==_height;
+
+		_buffer.resize( 0 );
+		for( int i=0 ; i<_width ; i++ )
+		{
+			Pixel32 p = row[i];
+			if( QOISame( p , _previous ) )
+			{
+				_run++;
+				if( _run==62 || ( last && i==_width-1 ) ) _buffer.push_back( (unsigned char)( QOI_OP_RUN | ( _run-1 ) ) ) , _run = 0;
+				continue;
+			}
+			if( _run ) _buffer.push_back( (unsigned char)( QOI_OP_RUN | ( _run-1 ) ) ) , _run = 0;
+
+			int h = QOIHash( p );
+			if( QOISame( _index[h] , p ) ) _buffer.push_back( (unsigned char)( QOI_OP_INDEX | h ) );
+			else
+			{
+				_index[h] = p;
+				if( p.a==_previous.a )
+				{
+					signed char dr = (signed char)( p.r - _previous.r );
+					signed char dg = (signed char)( p.g - _previous.g );
+					signed char db = (signed char)( p.b - _previous.b );
+					signed char dr_dg = (signed char)( dr - dg );
+					signed char db_dg = (signed char)( db - dg );
+					if( dr>-3 && dr<2 && dg>-3 && dg<2 && db>-3 && db<2 )
+						_buffer.push_back( (unsigned char)( QOI_OP_DIFF | ( (dr+2)<<4 ) | ( (dg+2)<<2 ) | (db+2) ) );
+					else if( dr_dg>-9 && dr_dg<8 && dg>-33 && dg<32 && db_dg>-9 && db_dg<8 )
+					{
+						_buffer.push_back( (unsigned char)( QOI_OP_LUMA | (dg+32) ) );
+						_buffer.push_back( (unsigned char)( ( (dr_dg+8)<<4 ) | (db_dg+8) ) );
+					}
+					else
+					{
+						_buffer.push_back( QOI_OP_RGB );
+						_buffer.push_back( p.r ) , _buffer.push_back( p.g ) , _buffer.push_back( p.b );
+					}
+				}
+				else
+				{
+					_buffer.push_back( QOI_OP_RGBA );
+					_buffer.push_back( p.r ) , _buffer.push_back( p.g ) , _buffer.push_back( p.b ) , _buffer.push_back( p.a );
+				}
+			}
+			_previous = p;
+		}
+		if( last ) _buffer.insert( _buffer.end() , QOIEnd , QOIEnd+8 );
+		if( _buffer.size() && fwrite( &_buffer[0] , 1 , _buffer.size() , _fp )!=_buffer.size() ) THROW( "Failed to write QOI data" );
+		if( last ) fflush( _fp );
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef QOI_INCLUDED
+#define QOI_INCLUDED
+
+#include <string.h>
+#include <vector>
+#include "codec.h"
+
+namespace Image
+{
+	/** This class reads in a QOI ("Quite OK Image") file a row at a time */
+	class QOIReader : public ImageReader
+	{
+		/** The file being read */
+		FILE *_fp;
+
+		/** The dimensions */
+		int _width , _height;
+
+		/** The number of rows read */
+		int _rows;
+
+		/** The previous pixel, the number of times it is still to be repeated, and the table of recently seen pixels */
+		Pixel32 _previous;
+		int _run;
+		Pixel32 _index[64];
+
+		/** The bytes read from the file and the next one to be decoded */
+		std::vector< unsigned char > _buffer;
+		size_t _position , _size;
+
+		/** This method returns the next byte of the file */
+		unsigned char _next( void );
+	public:
+		/** The constructor reads the header of the file */
+		QOIReader( FILE *fp );
+
+		int width( void ) const { return _width; }
+		int height( void ) const { return _height; }
+		void readRow( Pixel32 *row );
+	};
+
+	/** This class writes out a QOI file (with four channels) a row at a time */
+	class QOIWriter : public ImageWriter
+	{
+		/** The file being written */
+		FILE *_fp;
+
+		/** The dimensions */
+		int _width , _height;
+
+		/** The number of rows written */
+		int _rows;
+
+		/** The previous pixel, the number of times it has been repeated, and the table of recently seen pixels */
+		Pixel32 _previous;
+		int _run;
+		Pixel32 _index[64];
+
+		/** The encoded bytes of a row */
+		std::vector< unsigned char > _buffer;
+	public:
+		/** The constructor writes out the header of the file */
+		QOIWriter( FILE *fp , int width , int height );
+
+		void writeRow( const Pixel32 *row );
+	};
+
+	/** The codec of QOI files */
+	class QOIImageCodec : public ImageCodec
+	{
+	public:
+		const char *extensions( void ) const { return "qoi"; }
+		bool sniff( const unsigned char *header , size_t size ) const { return size>=4 && !memcmp( header , "qoif" , 4 ); }
+		ImageReader *newReader( FILE *fp ) const { return new QOIReader( fp ); }
+		ImageWriter *newWriter( FILE *fp , int width , int height ) const { return new QOIWriter( fp , width , height ); }
+	};
+}
+#endif // QOI_INCLUDED
@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifdef WIN32
+#include <stdio.h>
+#else // !WIN32
+#include <unistd.h>
+#endif // WIN32
+#include "Util/exceptions.h"
+#include "Util/profiler.h"
+#include "tiled.h"
+
+using namespace Util;
+using namespace Image;
+
+namespace
+{
+	/** This function creates a scratch file in the directory (or the system's temporary directory, if it is empty), which is removed when it is closed */
+	FILE *_ScratchFile( const std::string &directory )
+	{
+#ifdef WIN32
+		if( directory.empty() ) return tmpfile();
+		char *name = _tempnam( directory.c_str() , "tiles" );
+		if( !name ) return NULL;
+		FILE *fp = fopen( name , "w+bD" );
+		free( name );
+		return fp;
+#else // !WIN32
+		std::string path = directory;
+		if( path.empty() ) path = getenv( "TMPDIR" ) ? getenv( "TMPDIR" ) : "/tmp";
+		path += "/tiles.XXXXXX";
+		std::vector< char > name( path.begin() , path.end() );
+		name.push_back( 0 );
+		int fd = mkstemp( &name[0] );
+		if( fd<0 ) return NULL;
+		unlink( &name[0] );
+		FILE *fp = fdopen( fd , "w+b" );
+		if( !fp ) close( fd );
+		return fp;
+#endif // WIN32
+	}
+
+	/** This function moves the position in the file to the prescribed (64-bit) offset */
+	bool _Seek( FILE *fp , long long offset )
+	{
+#ifdef WIN32
+		return !_fseeki64( fp , offset , SEEK_SET );
+#else // !WIN32
+		return !fseeko( fp , (off_t)offset , SEEK_SET );
+#endif // WIN32
+	}
+}
+
+////////////////
+// TiledImage //
+////////////////
+TiledImage::TiledImage( long long width , long long height , int tileSize , long long cacheBytes , std::string scratchDirectory )
+	: _width(width) , _height(height) , _tileSize(tileSize) , _cacheBytes(cacheBytes) , _scratchDirectory(scratchDirectory) , _scratch(NULL) , _loads(0) , _stores(0)
+{
+	if( width<0 || height<0 ) THROW( "Negative image dimensions: %lld x %lld" , width , height );
+	if( tileSize<=0 ) THROW( "Tile size must be positive: %d" , tileSize );
+	_columns = ( width + tileSize - 1 ) / tileSize , _rows = ( height + tileSize - 1 ) / tileSize;
+	_capacity = (size_t)std::max< long long >( cacheBytes / ( (long long)sizeof(Pixel32) * tileSize * tileSize ) , 1 );
+	_stored.resize( (size_t)( _columns * _rows ) , false );
+}
+
+TiledImage::TiledImage( TiledImage &&img ) : _width(0) , _height(0) , _columns(0) , _rows(0) , _tileSize(0) , _cacheBytes(0) , _capacity(0) , _scratch(NULL) , _loads(0) , _stores(0) { *this = std::move( img ); }
+
+TiledImage &TiledImage::operator = ( TiledImage &&img )
+{
+	std::swap( _width , img._width ) , std::swap( _height , img._height ) , std::swap( _columns , img._columns ) , std::swap( _rows , img._rows );
+	std::swap( _tileSize , img._tileSize ) , std::swap( _cacheBytes , img._cacheBytes ) , std::swap( _capacity , img._capacity );
+	std::swap( _tiles , img._tiles ) , std::swap( _uses , img._uses ) , std::swap( _stored , img._stored );
+	std::swap( _scratchDirectory , img._scratchDirectory ) , std::swap( _scratch , img._scratch );
+	std::swap( _loads , img._loads ) , std::swap( _stores , img._stores );
+	return *this;
+}
+
+TiledImage::~TiledImage( void )
+{
+	for( auto &t : _tiles ) Profiler::Allocate( -(long long)( sizeof(Pixel32) * t.second.pixels.size() ) );
+	if( _scratch ) fclose( _scratch );
+}
+
+void TiledImage::_drop( void )
+{
+	long long index = _uses.back();
+	_Tile &tile = _tiles[ index ];
+	if( tile.dirty )
+	{
+		ProfileScope scope( "store tile" , "tiles" );
+		if( !_scratch && !( _scratch=_ScratchFile( _scratchDirectory ) ) ) THROW( "Failed to create scratch file in: %s" , _scratchDirectory.size() ? _scratchDirectory.c_str() : "temporary directory" );
+		if( !_Seek( _scratch , index * (long long)sizeof(Pixel32) * _tileSize * _tileSize ) || fwrite( &tile.pixels[0] , sizeof(Pixel32) , tile.pixels.size() , _scratch )!=tile.pixels.size() )
+			THROW( "Failed to write tile to scratch file" );
+		_stored[ (size_t)index ] = true;
+		_stores++;
+	}
+	Profiler::Allocate( -(long long)( sizeof(Pixel32) * tile.pixels.size() ) );
+	_tiles.erase( index );
+	_uses.pop_back();
+}
+
+TiledImage::_Tile &TiledImage::_tile( long long index )
+{
+	auto iter = _tiles.find( index );
+	if( iter!=_tiles.end() )
+	{
+		_uses.splice( _uses.begin() , _uses , iter->second.use );
+		return iter->second;
+	}
+
+	while( _tiles.size()>=_capacity ) _drop();
+	_Tile &tile = _tiles[ index ];
+	tile.pixels.resize( (size_t)_tileSize * _tileSize );
+	tile.dirty = false;
+	Profiler::Allocate( (long long)( sizeof(Pixel32) * tile.pixels.size() ) );
+	_uses.push_front( index );
+	tile.use = _uses.begin();
+	if( _stored[ (size_t)index ] )
+	{
+		ProfileScope scope( "load tile" , "tiles" );
+		if( !_Seek( _scratch , index * (long long)sizeof(Pixel32) * _tileSize * _tileSize ) || fread( &tile.pixels[0] , sizeof(Pixel32) , tile.pixels.size() , _scratch )!=tile.pixels.size() )
+			THROW( "Failed to read tile from scratch file" );
+		_loads++;
+	}
+	else
+	{
+		// Tiles that were never written are transparent black (rather than the opaque default pixel)
+		Pixel32 zero;
+		zero.r = zero.g = zero.b = zero.a = 0;
+		std::fill( tile.pixels.begin() , tile.pixels.end() , zero );
+	}
+	return tile;
+}
+
+void TiledImage::_copy( long long x , long long y , int width , int height , Pixel32 *pixels , size_t stride , bool toImage )
+{
+	if( x<0 || y<0 || width<0 || height<0 || x+width>_width || y+height>_height )
+		THROW( "Window out of range: %d x %d at ( %lld , %lld ) not in %lld x %lld" , width , height , x , y , _width , _height );
+	if( !width || !height ) return;
+
+	// Copy the part of the rectangle in each of the tiles it overlaps
+	for( long long ty=y/_tileSize ; ty<=(y+height-1)/_tileSize ; ty++ ) for( long long tx=x/_tileSize ; tx<=(x+width-1)/_tileSize ; tx++ )
+	{
+		_Tile &tile = _tile( ty*_columns + tx );
+		long long x0 = std::max< long long >( x , tx*_tileSize ) , x1 = std::min< long long >( x+width , (tx+1)*_tileSize );
+		long long y0 = std::max< long long >( y , ty*_tileSize ) , y1 = std::min< long long >( y+height , (ty+1)*_tileSize );
+		size_t count = sizeof(Pixel32) * (size_t)( x1-x0 );
+		for( long long j=y0 ; j<y1 ; j++ )
+		{
+			Pixel32 *t = &tile.pixels[ (size_t)( j-ty*_tileSize ) * _tileSize + (size_t)( x0-tx*_tileSize ) ];
+			Pixel32 *p = pixels + (size_t)( j-y ) * stride + (size_t)( x0-x );
+			if( toImage ) memcpy( t , p , count );
+			else          memcpy( p , t , count );
+		}
+		if( toImage ) tile.dirty = true;
+	}
+}
+
+void TiledImage::read( long long x , long long y , int width , int height , Image32 &window )
+{
+	window.setSize( width , height );
+	if( width && height ) _copy( x , y , width , height , window.row(0) , width , false );
+}
+
+void TiledImage::write( long long x , long long y , const Image32 &window , int left , int top , int width , int height )
+{
+	if( left<0 || top<0 || width<0 || height<0 || left+width>window.width() || top+height>window.height() )
+		THROW( "Rectangle out of range: %d x %d at ( %d , %d ) not in %d x %d" , width , height , left , top , window.width() , window.height() );
+	if( width && height ) _copy( x , y , width , height , const_cast< Pixel32 * >( window.row(top) ) + left , window.width() , true );
+}
+
+void TiledImage::read( ImageReader &reader )
+{
+	if( reader.width()!=_width || reader.height()!=_height ) THROW( "Dimensions differ: %d x %d != %lld x %lld" , reader.width() , reader.height() , _width , _height );
+	Image32 band;
+	for( long long y=0 ; y<_height ; y+=_tileSize )
+	{
+		int rows = (int)std::min< long long >( _tileSize , _height-y );
+		band.setSize( (int)_width , rows );
+		for( int j=0 ; j<rows ; j++ ) reader.readRow( band.row(j) );
+		write( 0 , y , band );
+	}
+}
+
+void TiledImage::write( ImageWriter &writer )
+{
+	Image32 band;
+	for( long long y=0 ; y<_height ; y+=_tileSize )
+	{
+		int rows = (int)std::min< long long >( _tileSize , _height-y );
+		read( 0 , y , (int)_width , rows , band );
+		for( int j=0 ; j<rows ; j++ ) writer.writeRow( band.row(j) );
+	}
+}
+
+/////////////////
+// FilterTiles //
+/////////////////
+TiledImage Image::FilterTiles( TiledImage &image , const BandFilter &filter )
+{
+	ProfileScope scope( "filter tiles" , "tiles" );
+	TiledImage filtered( image.width() , image.height() , image.tileSize() , image.cacheBytes() , image.scratchDirectory() );
+	long long size = image.tileSize() , r = filter.radius;
+	Image32 window;
+	for( long long y=0 ; y<image.height() ; y+=size ) for( long long x=0 ; x<image.width() ; x+=size )
+	{
+		long long w = std::min< long long >( size , image.width()-x ) , h = std::min< long long >( size , image.height()-y );
+		long long x0 = std::max< long long >( x-r , 0 ) , x1 = std::min< long long >( x+w+r , image.width() );
+		long long y0 = std::max< long long >( y-r , 0 ) , y1 = std::min< long long >( y+h+r , image.height() );
+		image.read( x0 , y0 , (int)( x1-x0 ) , (int)( y1-y0 ) , window );
+		Image32 out = filter.filter( window );
+		if( out.width()!=window.width() || out.height()!=window.height() ) THROW( "Filter changed the tile dimensions: %d x %d -> %d x %d" , window.width() , window.height() , out.width() , out.height() );
+		filtered.write( x , y , out , (int)( x-x0 ) , (int)( y-y0 ) , (int)w , (int)h );
+	}
+	return filtered;
+}
@@ -0,0 +1,125 @@
+#ifndef TILED_INCLUDED
+#define TILED_INCLUDED
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include "codec.h"
+#include "pipeline.h"
+
+namespace Image
+{
+	/** This class represents an image with 64-bit dimensions, stored as square tiles. At most the prescribed number of bytes of tiles are held in memory:
+	*** when room is needed, the least recently used tile is dropped, after being written out to a scratch file if it has changed since it was last stored.
+	*** An image far larger than memory can thus be read, filtered, and written a tile at a time. The scratch file is removed when the image is destroyed.
+	*** Pixels that have never been written are transparent black. */
+	class TiledImage
+	{
+		/** This structure describes a tile held in memory */
+		struct _Tile
+		{
+			/** The pixels, in rows of tileSize pixels */
+			std::vector< Pixel32 > pixels;
+
+			/** Has the tile changed since it was last stored */
+			bool dirty;
+
+			/** The position of the tile in the list of uses */
+			std::list< long long >::iterator use;
+		};
+
+		/** The dimensions of the image, and of the grid of tiles */
+		long long _width , _height , _columns , _rows;
+
+		/** The width and height of a tile */
+		int _tileSize;
+
+		/** The number of bytes of tiles held in memory, and the number of tiles this allows (at least one) */
+		long long _cacheBytes;
+		size_t _capacity;
+
+		/** The tiles held in memory, by index, and their indices from the most to the least recently used */
+		std::unordered_map< long long , _Tile > _tiles;
+		std::list< long long > _uses;
+
+		/** Has each tile been stored in the scratch file */
+		std::vector< bool > _stored;
+
+		/** The directory of the scratch file, and the file (opened when a tile is first stored) */
+		std::string _scratchDirectory;
+		FILE *_scratch;
+
+		/** The number of tiles loaded from, and stored to, the scratch file */
+		long long _loads , _stores;
+
+		/** This method returns the tile with the prescribed index, loading it (and dropping the least recently used tiles) if it is not in memory */
+		_Tile &_tile( long long index );
+
+		/** This method drops the least recently used tile, storing it first if it has changed */
+		void _drop( void );
+
+		/** This method copies a rectangle of pixels between the image and an array, with the prescribed stride, in the direction prescribed */
+		void _copy( long long x , long long y , int width , int height , Pixel32 *pixels , size_t stride , bool toImage );
+	public:
+		/** The constructor creates a transparent image of the prescribed dimensions, holding at most the prescribed number of bytes of tiles in memory.
+		*** The scratch file is created in the prescribed directory, or in the system's temporary directory if it is empty. */
+		TiledImage( long long width , long long height , int tileSize=256 , long long cacheBytes=1ll<<30 , std::string scratchDirectory=std::string() );
+
+		/** The move constructor */
+		TiledImage( TiledImage &&img );
+
+		/** The move assignment operator */
+		TiledImage &operator = ( TiledImage &&img );
+
+		/** The destructor removes the scratch file */
+		~TiledImage( void );
+
+		TiledImage( const TiledImage & ) = delete;
+		TiledImage &operator = ( const TiledImage & ) = delete;
+
+		/** This method returns the width of the image */
+		long long width( void ) const { return _width; }
+
+		/** This method returns the height of the image */
+		long long height( void ) const { return _height; }
+
+		/** This method returns the width and height of a tile */
+		int tileSize( void ) const { return _tileSize; }
+
+		/** This method returns the number of bytes of tiles held in memory */
+		long long cacheBytes( void ) const { return _cacheBytes; }
+
+		/** This method returns the directory of the scratch file */
+		const std::string &scratchDirectory( void ) const { return _scratchDirectory; }
+
+		/** This method returns the number of tiles loaded from the scratch file */
+		long long loads( void ) const { return _loads; }
+
+		/** This method returns the number of tiles stored to the scratch file */
+		long long stores( void ) const { return _stores; }
+
+		/** This method sets the window to the pixels of the rectangle with the prescribed corner and dimensions, which must lie within the image */
+		void read( long long x , long long y , int width , int height , Image32 &window );
+
+		/** This method writes the rectangle of the window with the prescribed corner and dimensions into the image, with its corner at ( x , y ).
+		*** The rectangle must lie within both the window and the image. */
+		void write( long long x , long long y , const Image32 &window , int left , int top , int width , int height );
+
+		/** This method writes the window into the image, with its corner at ( x , y ) */
+		void write( long long x , long long y , const Image32 &window ){ write( x , y , window , 0 , 0 , window.width() , window.height() ); }
+
+		/** This method reads the image in from the reader, which must have the same dimensions, a row of tiles at a time */
+		void read( ImageReader &reader );
+
+		/** This method writes the image out to the writer, a row of tiles at a time */
+		void write( ImageWriter &writer );
+	};
+
+	/** This function returns the tiled image obtained by applying the filter to each tile of the image, with the settings of the image.
+	*** Each tile is filtered along with the pixels within the filter's radius of it (clipped to the image), and only the tile's own pixels are kept,
+	*** so the output is the same as that of applying the filter to the whole image. An exception is thrown if the filter changes the dimensions. */
+	TiledImage FilterTiles( TiledImage &image , const BandFilter &filter );
+}
+#endif // TILED_INCLUDED
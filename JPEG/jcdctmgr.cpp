@@ -15,6 +15,7 @@
 #include "jinclude.h"
 #include "jpeglib.h"
 #include "jdct.h"		/* Private declarations for DCT subsystem */
+#include "jsimd.h"
 
 
 /* Private subobject for this module */
@@ -357,7 +358,7 @@ jinit_forward_dct (j_compress_ptr cinfo)
 #ifdef DCT_ISLOW_SUPPORTED
   case JDCT_ISLOW:
     fdct->pub.forward_DCT = forward_DCT;
-    fdct->do_dct = jpeg_fdct_islow;
+    fdct->do_dct = jsimd_can_fdct_islow() ? jsimd_fdct_islow : jpeg_fdct_islow;
     break;
 #endif
 #ifdef DCT_IFAST_SUPPORTED
@@ -18,6 +18,7 @@
 #ifdef JPEG_INTERNALS
 
 #undef RIGHT_SHIFT_IS_UNSIGNED
+#define USE_ARENA_MEMMGR	/* serve pool memory from a per-object arena (jmemnobs.c) */
 
 #endif /* JPEG_INTERNALS */
 
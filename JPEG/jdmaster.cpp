@@ -182,6 +182,7 @@ jpeg_calc_output_dimensions (j_decompress_ptr cinfo)
   case JCS_YCbCr:
     cinfo->out_color_components = 3;
     break;
+  case JCS_EXT_RGBA:
   case JCS_CMYK:
   case JCS_YCCK:
     cinfo->out_color_components = 4;
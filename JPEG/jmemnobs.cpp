@@ -13,6 +13,11 @@
  * but you'd better have lots of main memory (or virtual memory) if you want
  * to process big images.
  * Note that the max_memory_to_use option is ignored by this implementation.
+ *
+ * If USE_ARENA_MEMMGR is defined, the memory of each JPEG object is carved
+ * out of a single region reserved along with the object, so that a JPEG
+ * object reused for many images (via jpeg_abort or jpeg_finish_decompress/
+ * jpeg_finish_compress) stops calling malloc() and free() for every image.
  */
 
 #define JPEG_INTERNALS
@@ -26,6 +31,128 @@ extern void free JPP((void *ptr));
 #endif
 
 
+#ifdef USE_ARENA_MEMMGR
+
+#ifndef ARENA_MEMMGR_SIZE	/* so can override from jconfig.h */
+#define ARENA_MEMMGR_SIZE  1048576L	/* bytes of arena per JPEG object */
+#endif
+
+/*
+ * The first object requested for a JPEG object is the memory manager's
+ * control block (cinfo->mem is still NULL at that point); it is allocated
+ * together with the arena control block, which precedes it, and the arena
+ * region, which follows it.  The three are released together when the
+ * control block is freed by jpeg_destroy.
+ *
+ * The region is handed out with a bump pointer.  Each block starts with a
+ * header that links it to the block below it.  Freeing a block only marks
+ * it; the top of the region then drops past all the marked blocks at the
+ * top.  Since the image pool is allocated after the permanent pool and is
+ * released as a whole at the end of every image, the region is rewound to
+ * the end of the permanent pool between images and is reused as is.
+ * Requests that do not fit in the region are passed on to malloc().
+ */
+
+typedef union arena_block_struct {
+  struct {
+    size_t below;		/* offset of the block below, plus 1 (0 if none) */
+    size_t size;		/* bytes in the block, including this header */
+    boolean freed;		/* has the block been freed? */
+  } hdr;
+  double dummy;			/* included only to force alignment */
+} arena_block;
+
+typedef union arena_control_struct {
+  struct {
+    char * base;		/* the region */
+    size_t top;			/* offset of the first unused byte */
+    size_t last;		/* offset of the topmost block, plus 1 (0 if none) */
+  } hdr;
+  double dummy;			/* included only to force alignment */
+} arena_control;
+
+#define ARENA_OF(cinfo)  (((arena_control *) (cinfo)->mem) - 1)
+#define ROUND_UP(size)  ((((size) + SIZEOF(arena_block) - 1) / SIZEOF(arena_block)) * SIZEOF(arena_block))
+
+
+LOCAL(void *)
+arena_create (size_t sizeofobject)
+{
+  size_t control_size = SIZEOF(arena_control) + ROUND_UP(sizeofobject);
+  arena_control * arena;
+
+  arena = (arena_control *) malloc(control_size + ARENA_MEMMGR_SIZE);
+  if (arena == NULL)
+    return NULL;
+  arena->hdr.base = ((char *) arena) + control_size;
+  arena->hdr.top = 0;
+  arena->hdr.last = 0;
+  return (void *) (arena + 1);
+}
+
+
+LOCAL(void *)
+arena_alloc (arena_control * arena, size_t sizeofobject)
+{
+  size_t size = SIZEOF(arena_block) + ROUND_UP(sizeofobject);
+  arena_block * block;
+
+  if (size > (size_t) ARENA_MEMMGR_SIZE - arena->hdr.top)
+    return (void *) malloc(sizeofobject);
+  block = (arena_block *) (arena->hdr.base + arena->hdr.top);
+  block->hdr.below = arena->hdr.last;
+  block->hdr.size = size;
+  block->hdr.freed = FALSE;
+  arena->hdr.last = arena->hdr.top + 1;
+  arena->hdr.top += size;
+  return (void *) (block + 1);
+}
+
+
+LOCAL(void)
+arena_free (arena_control * arena, void * object)
+{
+  arena_block * block;
+
+  if ((char *) object < arena->hdr.base ||
+      (char *) object >= arena->hdr.base + ARENA_MEMMGR_SIZE) {
+    free(object);
+    return;
+  }
+  ((arena_block *) object - 1)->hdr.freed = TRUE;
+  while (arena->hdr.last) {
+    block = (arena_block *) (arena->hdr.base + arena->hdr.last - 1);
+    if (! block->hdr.freed)
+      break;
+    arena->hdr.top = arena->hdr.last - 1;
+    arena->hdr.last = block->hdr.below;
+  }
+}
+
+
+/*
+ * Memory allocation and freeing go through the arena.
+ */
+
+GLOBAL(void *)
+jpeg_get_small (j_common_ptr cinfo, size_t sizeofobject)
+{
+  if (cinfo->mem == NULL)
+    return arena_create(sizeofobject);
+  return arena_alloc(ARENA_OF(cinfo), sizeofobject);
+}
+
+GLOBAL(void)
+jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
+{
+  if (object == (void *) cinfo->mem)
+    free((void *) ARENA_OF(cinfo));
+  else
+    arena_free(ARENA_OF(cinfo), object);
+}
+
+#else /* ! USE_ARENA_MEMMGR */
+
 /*
  * Memory allocation and freeing are controlled by the regular library
  * routines malloc() and free().
@@ -43,6 +170,8 @@ jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
   free(object);
 }
 
+#endif /* USE_ARENA_MEMMGR */
+
 
 /*
  * "Large" objects are treated the same as "small" ones.
@@ -54,13 +183,13 @@ jpeg_free_small (j_common_ptr cinfo, void * object, size_t sizeofobject)
 GLOBAL(void FAR *)
 jpeg_get_large (j_common_ptr cinfo, size_t sizeofobject)
 {
-  return (void FAR *) malloc(sizeofobject);
+  return (void FAR *) jpeg_get_small(cinfo, sizeofobject);
 }
 
 GLOBAL(void)
 jpeg_free_large (j_common_ptr cinfo, void FAR * object, size_t sizeofobject)
 {
-  free(object);
+  jpeg_free_small(cinfo, (void *) object, sizeofobject);
 }
 
 
@@ -209,7 +209,10 @@ typedef enum {
 	JCS_RGB,		/* red/green/blue */
 	JCS_YCbCr,		/* Y/Cb/Cr (also known as YUV) */
 	JCS_CMYK,		/* C/M/Y/K */
-	JCS_YCCK		/* Y/Cb/Cr/K */
+	JCS_YCCK,		/* Y/Cb/Cr/K */
+	JCS_EXT_RGBA = 12	/* red/green/blue/alpha, as numbered by libjpeg-turbo;
+				 * alpha is ignored on input and is MAXJSAMPLE
+				 * on output */
 } J_COLOR_SPACE;
 
 /* DCT/IDCT algorithm options. */
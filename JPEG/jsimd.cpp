@@ -0,0 +1,945 @@
+/*
+ * jsimd.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This file contains SSE2 implementations of the slow-but-accurate integer
+ * forward and inverse DCTs, of the RGB<->YCbCr color conversions, and of
+ * the 2h1v and 2h2v (plain and fancy) upsamplers, together with the runtime
+ * tests that decide whether they can be used.
+ *
+ * Every routine reproduces the arithmetic of its portable counterpart
+ * (jfdctint.c, jidctint.c, jccolor.c, jdcolor.c, jdsample.c) exactly:
+ * the DCTs use the same constants and descaling, with the products summed
+ * in 32 bits, and the color conversions evaluate the same fixed-point
+ * expressions that the portable code tabulates.  Multiplies by constants
+ * that do not fit in 16 bits are split into a shift and a 16-bit multiply so
+ * that the 16x16->32 bit multiply-add instruction can be used.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"
+#include "jsimd.h"
+
+#if !defined(JSIMD_DISABLED) && BITS_IN_JSAMPLE == 8 && DCTSIZE == 8 && \
+    (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define JSIMD_SSE2_SUPPORTED
+#endif
+
+#ifdef JSIMD_SSE2_SUPPORTED
+
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+/* 32-bit GCC builds need to be told that these routines may use SSE2. */
+#if defined(__GNUC__) && !defined(__SSE2__)
+#define SSE2_TARGET  __attribute__((target("sse2")))
+#else
+#define SSE2_TARGET
+#endif
+
+
+/*
+ * Runtime detection.  The result is computed once; concurrent first calls
+ * can only store the same value.
+ */
+
+static int simd_support = -1;
+
+LOCAL(int)
+init_simd (void)
+{
+  if (simd_support < 0) {
+    int support = 0;
+    char * env;
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26))
+      support = 1;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & (1 << 26)))
+      support = 1;
+#endif
+    env = getenv("JSIMD_FORCENONE");
+    if (env != NULL && env[0] == '1' && env[1] == '\0')
+      support = 0;
+    simd_support = support;
+  }
+  return simd_support;
+}
+
+
+/*
+ * Helpers.
+ */
+
+/* A pair of 16-bit multipliers for _mm_madd_epi16, replicated in each lane */
+
+#define MADD_PAIR(lo,hi) \
+  _mm_set1_epi32((int) (((unsigned int) (hi) << 16) | ((unsigned int) (lo) & 0xFFFF)))
+
+/* Eight 32-bit lanes, held as the lanes 0-3 and 4-7 of eight 16-bit lanes */
+
+typedef struct {
+  __m128i lo, hi;
+} wide8;
+
+/* r = a * ka + b * kb lane-wise, for 16-bit a and b and the multiplier pair k */
+
+SSE2_TARGET LOCAL(void)
+wide_madd (__m128i a, __m128i b, __m128i k, wide8 * r)
+{
+  r->lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), k);
+  r->hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), k);
+}
+
+SSE2_TARGET LOCAL(void)
+wide_add (const wide8 * a, const wide8 * b, wide8 * r)
+{
+  r->lo = _mm_add_epi32(a->lo, b->lo);
+  r->hi = _mm_add_epi32(a->hi, b->hi);
+}
+
+SSE2_TARGET LOCAL(void)
+wide_sub (const wide8 * a, const wide8 * b, wide8 * r)
+{
+  r->lo = _mm_sub_epi32(a->lo, b->lo);
+  r->hi = _mm_sub_epi32(a->hi, b->hi);
+}
+
+/* DESCALE() of jdct.h, applied lane-wise */
+
+SSE2_TARGET LOCAL(void)
+wide_descale (wide8 * a, int n)
+{
+  __m128i round = _mm_set1_epi32(1 << (n-1));
+  __m128i shift = _mm_cvtsi32_si128(n);
+  a->lo = _mm_sra_epi32(_mm_add_epi32(a->lo, round), shift);
+  a->hi = _mm_sra_epi32(_mm_add_epi32(a->hi, round), shift);
+}
+
+/* Accumulate a nonzero lane into *bad if a lane is outside [-2^14, 2^14) */
+
+SSE2_TARGET LOCAL(void)
+wide_check (const wide8 * a, __m128i * bad)
+{
+  *bad = _mm_or_si128(*bad, _mm_xor_si128(_mm_srai_epi32(a->lo, 14),
+					  _mm_srai_epi32(a->lo, 31)));
+  *bad = _mm_or_si128(*bad, _mm_xor_si128(_mm_srai_epi32(a->hi, 14),
+					  _mm_srai_epi32(a->hi, 31)));
+}
+
+/* Transpose an 8x8 block of 16-bit values held one row per vector */
+
+SSE2_TARGET LOCAL(void)
+transpose_8x8 (__m128i * a)
+{
+  __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+  __m128i c0, c1, c2, c3, c4, c5, c6, c7;
+
+  b0 = _mm_unpacklo_epi16(a[0], a[1]);
+  b1 = _mm_unpackhi_epi16(a[0], a[1]);
+  b2 = _mm_unpacklo_epi16(a[2], a[3]);
+  b3 = _mm_unpackhi_epi16(a[2], a[3]);
+  b4 = _mm_unpacklo_epi16(a[4], a[5]);
+  b5 = _mm_unpackhi_epi16(a[4], a[5]);
+  b6 = _mm_unpacklo_epi16(a[6], a[7]);
+  b7 = _mm_unpackhi_epi16(a[6], a[7]);
+  c0 = _mm_unpacklo_epi32(b0, b2);
+  c1 = _mm_unpackhi_epi32(b0, b2);
+  c2 = _mm_unpacklo_epi32(b1, b3);
+  c3 = _mm_unpackhi_epi32(b1, b3);
+  c4 = _mm_unpacklo_epi32(b4, b6);
+  c5 = _mm_unpackhi_epi32(b4, b6);
+  c6 = _mm_unpacklo_epi32(b5, b7);
+  c7 = _mm_unpackhi_epi32(b5, b7);
+  a[0] = _mm_unpacklo_epi64(c0, c4);
+  a[1] = _mm_unpackhi_epi64(c0, c4);
+  a[2] = _mm_unpacklo_epi64(c1, c5);
+  a[3] = _mm_unpackhi_epi64(c1, c5);
+  a[4] = _mm_unpacklo_epi64(c2, c6);
+  a[5] = _mm_unpackhi_epi64(c2, c6);
+  a[6] = _mm_unpacklo_epi64(c3, c7);
+  a[7] = _mm_unpackhi_epi64(c3, c7);
+}
+
+
+/*
+ * Slow-but-accurate integer DCTs.
+ * The constants and the scaling match jfdctint.c and jidctint.c.  The
+ * rotations are regrouped so that each output is a sum of pmaddwd products
+ * of 16-bit terms; in exact integer arithmetic the regrouped sums equal the
+ * portable ones, e.g. the even part's
+ *   z1 + z3 * (-FIX_1_847759065), with z1 = (z2 + z3) * FIX_0_541196100,
+ * becomes
+ *   z2 * FIX_0_541196100 + z3 * (FIX_0_541196100 - FIX_1_847759065).
+ * The 16-bit terms must not overflow; see the range notes below.
+ */
+
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+#define FIX_0_298631336  2446		/* FIX(0.298631336) */
+#define FIX_0_390180644  3196		/* FIX(0.390180644) */
+#define FIX_0_541196100  4433		/* FIX(0.541196100) */
+#define FIX_0_765366865  6270		/* FIX(0.765366865) */
+#define FIX_0_899976223  7373		/* FIX(0.899976223) */
+#define FIX_1_175875602  9633		/* FIX(1.175875602) */
+#define FIX_1_501321110  12299		/* FIX(1.501321110) */
+#define FIX_1_847759065  15137		/* FIX(1.847759065) */
+#define FIX_1_961570560  16069		/* FIX(1.961570560) */
+#define FIX_2_053119869  16819		/* FIX(2.053119869) */
+#define FIX_2_562915447  20995		/* FIX(2.562915447) */
+#define FIX_3_072711026  25172		/* FIX(3.072711026) */
+
+/* The odd part shared by both DCTs.  Given the 16-bit terms t4..t7 (the
+ * portable code's tmp4..tmp7 in the FDCT, tmp0..tmp3 in the IDCT), it
+ * returns the four unscaled odd outputs in o[0..3], in the order
+ * o[0] = t4 term, o[1] = t5 term, o[2] = t6 term, o[3] = t7 term.
+ */
+
+SSE2_TARGET LOCAL(void)
+islow_odd (__m128i t4, __m128i t5, __m128i t6, __m128i t7, wide8 * o)
+{
+  wide8 z3, z4;
+  __m128i s3 = _mm_add_epi16(t4, t6);
+  __m128i s4 = _mm_add_epi16(t5, t7);
+
+  wide_madd(s3, s4, MADD_PAIR(FIX_1_175875602 - FIX_1_961570560,
+			      FIX_1_175875602), &z3);
+  wide_madd(s3, s4, MADD_PAIR(FIX_1_175875602,
+			      FIX_1_175875602 - FIX_0_390180644), &z4);
+
+  wide_madd(t4, t7, MADD_PAIR(FIX_0_298631336 - FIX_0_899976223,
+			      - FIX_0_899976223), &o[0]);
+  wide_madd(t5, t6, MADD_PAIR(FIX_2_053119869 - FIX_2_562915447,
+			      - FIX_2_562915447), &o[1]);
+  wide_madd(t5, t6, MADD_PAIR(- FIX_2_562915447,
+			      FIX_3_072711026 - FIX_2_562915447), &o[2]);
+  wide_madd(t4, t7, MADD_PAIR(- FIX_0_899976223,
+			      FIX_1_501321110 - FIX_0_899976223), &o[3]);
+
+  wide_add(&o[0], &z3, &o[0]);
+  wide_add(&o[1], &z4, &o[1]);
+  wide_add(&o[2], &z3, &o[2]);
+  wide_add(&o[3], &z4, &o[3]);
+}
+
+/* One 8-point forward DCT on each of eight 16-bit lanes; d[k] holds input k.
+ * In the first pass the even outputs are scaled up by PASS1_BITS and the
+ * others are descaled by CONST_BITS-PASS1_BITS; the second pass removes
+ * the PASS1_BITS scaling.
+ *
+ * For inputs in [-CENTERJSAMPLE, MAXJSAMPLE-CENTERJSAMPLE] the first pass
+ * outputs stay within +-4096, so no sum below exceeds 16 bits.
+ */
+
+SSE2_TARGET LOCAL(void)
+fdct_islow_1d (__m128i * d, boolean first_pass)
+{
+  __m128i tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  __m128i tmp10, tmp11, tmp12, tmp13;
+  wide8 out, odd[4];
+  int n = first_pass ? CONST_BITS-PASS1_BITS : CONST_BITS+PASS1_BITS;
+  int k;
+
+  tmp0 = _mm_add_epi16(d[0], d[7]);
+  tmp7 = _mm_sub_epi16(d[0], d[7]);
+  tmp1 = _mm_add_epi16(d[1], d[6]);
+  tmp6 = _mm_sub_epi16(d[1], d[6]);
+  tmp2 = _mm_add_epi16(d[2], d[5]);
+  tmp5 = _mm_sub_epi16(d[2], d[5]);
+  tmp3 = _mm_add_epi16(d[3], d[4]);
+  tmp4 = _mm_sub_epi16(d[3], d[4]);
+
+  /* Even part */
+
+  tmp10 = _mm_add_epi16(tmp0, tmp3);
+  tmp13 = _mm_sub_epi16(tmp0, tmp3);
+  tmp11 = _mm_add_epi16(tmp1, tmp2);
+  tmp12 = _mm_sub_epi16(tmp1, tmp2);
+
+  if (first_pass) {
+    d[0] = _mm_slli_epi16(_mm_add_epi16(tmp10, tmp11), PASS1_BITS);
+    d[4] = _mm_slli_epi16(_mm_sub_epi16(tmp10, tmp11), PASS1_BITS);
+  } else {
+    __m128i round = _mm_set1_epi16(1 << (PASS1_BITS-1));
+    d[0] = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(tmp10, tmp11), round),
+			  PASS1_BITS);
+    d[4] = _mm_srai_epi16(_mm_add_epi16(_mm_sub_epi16(tmp10, tmp11), round),
+			  PASS1_BITS);
+  }
+
+  wide_madd(tmp13, tmp12, MADD_PAIR(FIX_0_541196100 + FIX_0_765366865,
+				    FIX_0_541196100), &out);
+  wide_descale(&out, n);
+  d[2] = _mm_packs_epi32(out.lo, out.hi);
+  wide_madd(tmp13, tmp12, MADD_PAIR(FIX_0_541196100,
+				    FIX_0_541196100 - FIX_1_847759065), &out);
+  wide_descale(&out, n);
+  d[6] = _mm_packs_epi32(out.lo, out.hi);
+
+  /* Odd part */
+
+  islow_odd(tmp4, tmp5, tmp6, tmp7, odd);
+  for (k = 0; k < 4; k++)
+    wide_descale(&odd[k], n);
+  d[7] = _mm_packs_epi32(odd[0].lo, odd[0].hi);
+  d[5] = _mm_packs_epi32(odd[1].lo, odd[1].hi);
+  d[3] = _mm_packs_epi32(odd[2].lo, odd[2].hi);
+  d[1] = _mm_packs_epi32(odd[3].lo, odd[3].hi);
+}
+
+/* One 8-point inverse DCT on each of eight 16-bit lanes; d[k] holds input k.
+ * The 32-bit outputs are descaled by n bits.  No 16-bit sum below overflows
+ * if the inputs lie in [-2^14, 2^14), and no 32-bit sum overflows either.
+ */
+
+SSE2_TARGET LOCAL(void)
+idct_islow_1d (const __m128i * d, int n, wide8 * out)
+{
+  wide8 tmp0, tmp1, tmp2, tmp3;
+  wide8 tmp10, tmp11, tmp12, tmp13;
+  wide8 odd[4];
+  int k;
+
+  /* Even part */
+
+  wide_madd(d[2], d[6], MADD_PAIR(FIX_0_541196100,
+				  FIX_0_541196100 - FIX_1_847759065), &tmp2);
+  wide_madd(d[2], d[6], MADD_PAIR(FIX_0_541196100 + FIX_0_765366865,
+				  FIX_0_541196100), &tmp3);
+
+  /* (d0 +- d4) << CONST_BITS */
+  wide_madd(d[0], d[4], MADD_PAIR(1 << CONST_BITS, 1 << CONST_BITS), &tmp0);
+  wide_madd(d[0], d[4], MADD_PAIR(1 << CONST_BITS, -(1 << CONST_BITS)), &tmp1);
+
+  wide_add(&tmp0, &tmp3, &tmp10);
+  wide_sub(&tmp0, &tmp3, &tmp13);
+  wide_add(&tmp1, &tmp2, &tmp11);
+  wide_sub(&tmp1, &tmp2, &tmp12);
+
+  /* Odd part */
+
+  islow_odd(d[7], d[5], d[3], d[1], odd);
+
+  /* Final output stage */
+
+  wide_add(&tmp10, &odd[3], &out[0]);
+  wide_sub(&tmp10, &odd[3], &out[7]);
+  wide_add(&tmp11, &odd[2], &out[1]);
+  wide_sub(&tmp11, &odd[2], &out[6]);
+  wide_add(&tmp12, &odd[1], &out[2]);
+  wide_sub(&tmp12, &odd[1], &out[5]);
+  wide_add(&tmp13, &odd[0], &out[3]);
+  wide_sub(&tmp13, &odd[0], &out[4]);
+  for (k = 0; k < DCTSIZE; k++)
+    wide_descale(&out[k], n);
+}
+
+GLOBAL(boolean)
+jsimd_can_fdct_islow (void)
+{
+  if (SIZEOF(DCTELEM) != 4)
+    return FALSE;
+  return init_simd() ? TRUE : FALSE;
+}
+
+GLOBAL(boolean)
+jsimd_can_idct_islow (void)
+{
+  if (SIZEOF(ISLOW_MULT_TYPE) != 4 || SIZEOF(JCOEF) != 2)
+    return FALSE;
+  return init_simd() ? TRUE : FALSE;
+}
+
+/* The input samples are level-shifted by jcdctmgr.c, so they are within the
+ * range assumed by fdct_islow_1d().
+ */
+
+SSE2_TARGET GLOBAL(void)
+jsimd_fdct_islow (DCTELEM * data)
+{
+  __m128i row[DCTSIZE];
+  int i;
+
+  for (i = 0; i < DCTSIZE; i++)
+    row[i] = _mm_packs_epi32(_mm_loadu_si128((const __m128i *) (data + i*DCTSIZE)),
+			     _mm_loadu_si128((const __m128i *) (data + i*DCTSIZE + 4)));
+
+  /* Pass 1: process rows (the transposed rows are the lanes) */
+  transpose_8x8(row);
+  fdct_islow_1d(row, TRUE);
+
+  /* Pass 2: process columns */
+  transpose_8x8(row);
+  fdct_islow_1d(row, FALSE);
+
+  /* Sign-extend back to DCTELEMs */
+  for (i = 0; i < DCTSIZE; i++) {
+    _mm_storeu_si128((__m128i *) (data + i*DCTSIZE),
+		     _mm_srai_epi32(_mm_unpacklo_epi16(row[i], row[i]), 16));
+    _mm_storeu_si128((__m128i *) (data + i*DCTSIZE + 4),
+		     _mm_srai_epi32(_mm_unpackhi_epi16(row[i], row[i]), 16));
+  }
+}
+
+/* Blocks whose dequantized coefficients or intermediate values do not fit
+ * the 16-bit lanes (which does not happen for sensibly quantized data) are
+ * passed to the portable routine.
+ */
+
+SSE2_TARGET GLOBAL(void)
+jsimd_idct_islow (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		  JCOEFPTR coef_block,
+		  JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+  ISLOW_MULT_TYPE * quantptr = (ISLOW_MULT_TYPE *) compptr->dct_table;
+  __m128i row[DCTSIZE], coef, quant, lo, hi, bad, wrap, shift;
+  wide8 val[DCTSIZE];
+  int i;
+
+  /* Dequantize, forming the exact 32-bit products from their low and high
+   * 16-bit halves.
+   */
+  bad = _mm_setzero_si128();
+  for (i = 0; i < DCTSIZE; i++) {
+    coef = _mm_loadu_si128((const __m128i *) (coef_block + i*DCTSIZE));
+    quant = _mm_packs_epi32(_mm_loadu_si128((const __m128i *) (quantptr + i*DCTSIZE)),
+			    _mm_loadu_si128((const __m128i *) (quantptr + i*DCTSIZE + 4)));
+    lo = _mm_mullo_epi16(coef, quant);
+    hi = _mm_mulhi_epi16(coef, quant);
+    val[i].lo = _mm_unpacklo_epi16(lo, hi);
+    val[i].hi = _mm_unpackhi_epi16(lo, hi);
+    wide_check(&val[i], &bad);
+    /* A quantizer above 32767 saturated the pack */
+    bad = _mm_or_si128(bad, _mm_cmpeq_epi16(quant, _mm_set1_epi16(32767)));
+    row[i] = _mm_packs_epi32(val[i].lo, val[i].hi);
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF) {
+    jpeg_idct_islow(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  /* Pass 1: process columns (the rows are the lanes).  The portable code's
+   * shortcut for all-zero AC terms gives the same results, so it is omitted.
+   */
+  idct_islow_1d(row, CONST_BITS-PASS1_BITS, val);
+  for (i = 0; i < DCTSIZE; i++) {
+    wide_check(&val[i], &bad);
+    row[i] = _mm_packs_epi32(val[i].lo, val[i].hi);
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF) {
+    jpeg_idct_islow(cinfo, compptr, coef_block, output_buf, output_col);
+    return;
+  }
+
+  /* Pass 2: process rows */
+  transpose_8x8(row);
+  idct_islow_1d(row, CONST_BITS+PASS1_BITS+3, val);
+
+  /* Range-limit.  For 8-bit samples the table lookup
+   * range_limit[x & RANGE_MASK] equals clamping x + CENTERJSAMPLE to
+   * [0, MAXJSAMPLE] once x is wrapped into [-512, 511].
+   */
+  wrap = _mm_set1_epi32(RANGE_MASK);
+  shift = _mm_set1_epi32(512);
+  for (i = 0; i < DCTSIZE; i++) {
+    lo = _mm_and_si128(_mm_add_epi32(val[i].lo, shift), wrap);
+    hi = _mm_and_si128(_mm_add_epi32(val[i].hi, shift), wrap);
+    row[i] = _mm_sub_epi16(_mm_packs_epi32(lo, hi),
+			   _mm_set1_epi16(512 - CENTERJSAMPLE));
+  }
+  transpose_8x8(row);
+  for (i = 0; i < DCTSIZE; i++)
+    _mm_storel_epi64((__m128i *) (output_buf[i] + output_col),
+		     _mm_packus_epi16(row[i], row[i]));
+}
+
+
+/*
+ * Color conversion.
+ *
+ * With SCALEBITS = 16, jdcolor.c computes
+ *   R = Y + ((91881 * Cr' + 32768) >> 16)
+ *   G = Y + ((-22554 * Cb' - 46802 * Cr' + 32768) >> 16)
+ *   B = Y + ((116130 * Cb' + 32768) >> 16)
+ * with Cb' = Cb - 128 and Cr' = Cr - 128, and jccolor.c computes
+ *   Y  = (19595 * R + 38470 * G + 7471 * B + 32768) >> 16
+ *   Cb = (-11059 * R - 21709 * G + 32768 * B + (128 << 16) + 32767) >> 16
+ *   Cr = (32768 * R - 27439 * G - 5329 * B + (128 << 16) + 32767) >> 16
+ * The multipliers that do not fit in 16 bits are rewritten as a multiple of
+ * 65536 (which passes through the shift exactly) plus a 16-bit remainder.
+ *
+ * Besides RGB pixels, both routines handle the four-sample pixels of
+ * JCS_EXT_RGBA, which are (de)interleaved in vector registers.
+ */
+
+#define RGBA_PIXELSIZE  4
+
+/* Vector (de)interleaving of RGBA pixels assumes the default sample order */
+#if RGB_RED == 0 && RGB_GREEN == 1 && RGB_BLUE == 2
+#define RGBA_VECTOR_ORDER
+#endif
+
+GLOBAL(boolean)
+jsimd_can_rgb_ycc (void)
+{
+  return init_simd() ? TRUE : FALSE;
+}
+
+GLOBAL(boolean)
+jsimd_can_ycc_rgb (void)
+{
+  return init_simd() ? TRUE : FALSE;
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_rgb_ycc_convert (j_compress_ptr cinfo,
+		       JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		       JDIMENSION output_row, int num_rows)
+{
+  JSAMPROW inptr, outptr0, outptr1, outptr2;
+  JDIMENSION col, num_cols = cinfo->image_width;
+  JSAMPLE rbuf[8], gbuf[8], bbuf[8];
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+  const __m128i cbcr_offset = _mm_set1_epi32((CENTERJSAMPLE << 16) + 32767);
+  const __m128i mask = _mm_set1_epi32(0xFF);
+  __m128i r, g, b, rg, bt, rr, gb, bb, lo, hi, y, cb, cr;
+  int i, rv, gv, bv;
+  int pixelsize = cinfo->input_components;
+
+  while (--num_rows >= 0) {
+    inptr = *input_buf++;
+    outptr0 = output_buf[0][output_row];
+    outptr1 = output_buf[1][output_row];
+    outptr2 = output_buf[2][output_row];
+    output_row++;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+#ifdef RGBA_VECTOR_ORDER
+      if (pixelsize == RGBA_PIXELSIZE) {
+	lo = _mm_loadu_si128((const __m128i *) inptr);
+	hi = _mm_loadu_si128((const __m128i *) (inptr + 16));
+	inptr += 8 * RGBA_PIXELSIZE;
+	r = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+			    _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+			    _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+      } else
+#endif
+      {
+	for (i = 0; i < 8; i++, inptr += pixelsize) {
+	  rbuf[i] = inptr[RGB_RED];
+	  gbuf[i] = inptr[RGB_GREEN];
+	  bbuf[i] = inptr[RGB_BLUE];
+	}
+	r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) rbuf), zero);
+	g = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) gbuf), zero);
+	b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) bbuf), zero);
+      }
+
+      /* Y = G + ((19595 * R - 27066 * G + 7471 * B + 32768) >> 16) */
+      rg = _mm_unpacklo_epi16(r, g);
+      bt = _mm_unpacklo_epi16(b, two);
+      lo = _mm_add_epi32(_mm_madd_epi16(rg, MADD_PAIR(19595, -27066)),
+			 _mm_madd_epi16(bt, MADD_PAIR(7471, 16384)));
+      rg = _mm_unpackhi_epi16(r, g);
+      bt = _mm_unpackhi_epi16(b, two);
+      hi = _mm_add_epi32(_mm_madd_epi16(rg, MADD_PAIR(19595, -27066)),
+			 _mm_madd_epi16(bt, MADD_PAIR(7471, 16384)));
+      y = _mm_add_epi16(g, _mm_packs_epi32(_mm_srai_epi32(lo, 16),
+					   _mm_srai_epi32(hi, 16)));
+
+      /* Cb = (-11059 * R - 21709 * G + 16384 * (B + B) + offset) >> 16 */
+      bb = _mm_unpacklo_epi16(b, b);
+      lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), MADD_PAIR(-11059, -21709)),
+				       _mm_madd_epi16(bb, MADD_PAIR(16384, 16384))), cbcr_offset);
+      bb = _mm_unpackhi_epi16(b, b);
+      hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), MADD_PAIR(-11059, -21709)),
+				       _mm_madd_epi16(bb, MADD_PAIR(16384, 16384))), cbcr_offset);
+      cb = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+
+      /* Cr = (16384 * (R + R) - 27439 * G - 5329 * B + offset) >> 16 */
+      rr = _mm_unpacklo_epi16(r, r);
+      gb = _mm_unpacklo_epi16(g, b);
+      lo = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rr, MADD_PAIR(16384, 16384)),
+				       _mm_madd_epi16(gb, MADD_PAIR(-27439, -5329))), cbcr_offset);
+      rr = _mm_unpackhi_epi16(r, r);
+      gb = _mm_unpackhi_epi16(g, b);
+      hi = _mm_add_epi32(_mm_add_epi32(_mm_madd_epi16(rr, MADD_PAIR(16384, 16384)),
+				       _mm_madd_epi16(gb, MADD_PAIR(-27439, -5329))), cbcr_offset);
+      cr = _mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16));
+
+      _mm_storel_epi64((__m128i *) (outptr0 + col), _mm_packus_epi16(y, y));
+      _mm_storel_epi64((__m128i *) (outptr1 + col), _mm_packus_epi16(cb, cb));
+      _mm_storel_epi64((__m128i *) (outptr2 + col), _mm_packus_epi16(cr, cr));
+    }
+    for (; col < num_cols; col++, inptr += pixelsize) {
+      rv = GETJSAMPLE(inptr[RGB_RED]);
+      gv = GETJSAMPLE(inptr[RGB_GREEN]);
+      bv = GETJSAMPLE(inptr[RGB_BLUE]);
+      outptr0[col] = (JSAMPLE) ((19595 * rv + 38470 * gv + 7471 * bv + 32768) >> 16);
+      outptr1[col] = (JSAMPLE) ((-11059 * rv - 21709 * gv + 32768 * bv + (CENTERJSAMPLE << 16) + 32767) >> 16);
+      outptr2[col] = (JSAMPLE) ((32768 * rv - 27439 * gv - 5329 * bv + (CENTERJSAMPLE << 16) + 32767) >> 16);
+    }
+  }
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_ycc_rgb_convert (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+{
+  JSAMPROW outptr, inptr0, inptr1, inptr2;
+  JDIMENSION col, num_cols = cinfo->output_width;
+  JSAMPLE * range_limit = cinfo->sample_range_limit;
+  JSAMPLE rbuf[8], gbuf[8], bbuf[8];
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i two = _mm_set1_epi16(2);
+  const __m128i center = _mm_set1_epi16(CENTERJSAMPLE);
+  const __m128i one_half = _mm_set1_epi32(32768);
+  const __m128i alpha = _mm_set1_epi8((char) MAXJSAMPLE);
+  __m128i y, cb, cr, lo, hi, r, g, b, cbcr;
+  int i, yv, cbv, crv;
+  int pixelsize = cinfo->out_color_components;
+
+  while (--num_rows >= 0) {
+    inptr0 = input_buf[0][input_row];
+    inptr1 = input_buf[1][input_row];
+    inptr2 = input_buf[2][input_row];
+    input_row++;
+    outptr = *output_buf++;
+    for (col = 0; col + 8 <= num_cols; col += 8) {
+      y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr0 + col)), zero);
+      cb = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr1 + col)), zero), center);
+      cr = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr2 + col)), zero), center);
+
+      /* R = Y + Cr' + ((26345 * Cr' + 32768) >> 16) */
+      lo = _mm_madd_epi16(_mm_unpacklo_epi16(cr, two), MADD_PAIR(26345, 16384));
+      hi = _mm_madd_epi16(_mm_unpackhi_epi16(cr, two), MADD_PAIR(26345, 16384));
+      r = _mm_add_epi16(_mm_add_epi16(y, cr),
+			_mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16)));
+
+      /* G = Y - Cr' + ((-22554 * Cb' + 18734 * Cr' + 32768) >> 16) */
+      cbcr = _mm_unpacklo_epi16(cb, cr);
+      lo = _mm_add_epi32(_mm_madd_epi16(cbcr, MADD_PAIR(-22554, 18734)), one_half);
+      cbcr = _mm_unpackhi_epi16(cb, cr);
+      hi = _mm_add_epi32(_mm_madd_epi16(cbcr, MADD_PAIR(-22554, 18734)), one_half);
+      g = _mm_add_epi16(_mm_sub_epi16(y, cr),
+			_mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16)));
+
+      /* B = Y + 2 * Cb' + ((-14942 * Cb' + 32768) >> 16) */
+      lo = _mm_madd_epi16(_mm_unpacklo_epi16(cb, two), MADD_PAIR(-14942, 16384));
+      hi = _mm_madd_epi16(_mm_unpackhi_epi16(cb, two), MADD_PAIR(-14942, 16384));
+      b = _mm_add_epi16(_mm_add_epi16(y, _mm_add_epi16(cb, cb)),
+			_mm_packs_epi32(_mm_srai_epi32(lo, 16), _mm_srai_epi32(hi, 16)));
+
+      /* The saturating packs do the range-limiting */
+      r = _mm_packus_epi16(r, r);
+      g = _mm_packus_epi16(g, g);
+      b = _mm_packus_epi16(b, b);
+#ifdef RGBA_VECTOR_ORDER
+      if (pixelsize == RGBA_PIXELSIZE) {
+	lo = _mm_unpacklo_epi8(r, g);
+	hi = _mm_unpacklo_epi8(b, alpha);
+	_mm_storeu_si128((__m128i *) outptr, _mm_unpacklo_epi16(lo, hi));
+	_mm_storeu_si128((__m128i *) (outptr + 16), _mm_unpackhi_epi16(lo, hi));
+	outptr += 8 * RGBA_PIXELSIZE;
+	continue;
+      }
+#endif
+      _mm_storel_epi64((__m128i *) rbuf, r);
+      _mm_storel_epi64((__m128i *) gbuf, g);
+      _mm_storel_epi64((__m128i *) bbuf, b);
+      for (i = 0; i < 8; i++, outptr += pixelsize) {
+	outptr[RGB_RED] = rbuf[i];
+	outptr[RGB_GREEN] = gbuf[i];
+	outptr[RGB_BLUE] = bbuf[i];
+	if (pixelsize == RGBA_PIXELSIZE)
+	  outptr[RGBA_PIXELSIZE-1] = MAXJSAMPLE;
+      }
+    }
+    for (; col < num_cols; col++, outptr += pixelsize) {
+      yv = GETJSAMPLE(inptr0[col]);
+      cbv = GETJSAMPLE(inptr1[col]) - CENTERJSAMPLE;
+      crv = GETJSAMPLE(inptr2[col]) - CENTERJSAMPLE;
+      outptr[RGB_RED] = range_limit[yv + crv + ((26345 * crv + 32768) >> 16)];
+      outptr[RGB_GREEN] = range_limit[yv - crv + ((-22554 * cbv + 18734 * crv + 32768) >> 16)];
+      outptr[RGB_BLUE] = range_limit[yv + 2 * cbv + ((-14942 * cbv + 32768) >> 16)];
+      if (pixelsize == RGBA_PIXELSIZE)
+	outptr[RGBA_PIXELSIZE-1] = MAXJSAMPLE;
+    }
+  }
+}
+
+
+/*
+ * Upsampling.  The vector loops cover the columns for which every input
+ * they read lies inside the downsampled row; the edges are done as in
+ * jdsample.c.
+ */
+
+GLOBAL(boolean)
+jsimd_can_h2v1_upsample (void)
+{
+  return init_simd() ? TRUE : FALSE;
+}
+
+GLOBAL(boolean)
+jsimd_can_h2v2_upsample (void)
+{
+  return init_simd() ? TRUE : FALSE;
+}
+
+GLOBAL(boolean)
+jsimd_can_h2v1_fancy_upsample (void)
+{
+  return init_simd() ? TRUE : FALSE;
+}
+
+GLOBAL(boolean)
+jsimd_can_h2v2_fancy_upsample (void)
+{
+  return init_simd() ? TRUE : FALSE;
+}
+
+/* Replicate each sample of one row horizontally */
+
+SSE2_TARGET LOCAL(void)
+h2v1_row (JSAMPROW inptr, JSAMPROW outptr, JDIMENSION output_width)
+{
+  JSAMPROW outend = outptr + output_width;
+  __m128i x;
+
+  while (outend - outptr >= 32) {
+    x = _mm_loadu_si128((const __m128i *) inptr);
+    _mm_storeu_si128((__m128i *) outptr, _mm_unpacklo_epi8(x, x));
+    _mm_storeu_si128((__m128i *) (outptr + 16), _mm_unpackhi_epi8(x, x));
+    inptr += 16;
+    outptr += 32;
+  }
+  while (outptr < outend) {
+    *outptr++ = *inptr;
+    *outptr++ = *inptr++;
+  }
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_h2v1_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  int inrow;
+
+  for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++)
+    h2v1_row(input_data[inrow], output_data[inrow], cinfo->output_width);
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  int inrow, outrow;
+
+  inrow = outrow = 0;
+  while (outrow < cinfo->max_v_samp_factor) {
+    h2v1_row(input_data[inrow], output_data[outrow], cinfo->output_width);
+    jcopy_sample_rows(output_data, outrow, output_data, outrow+1,
+		      1, cinfo->output_width);
+    inrow++;
+    outrow += 2;
+  }
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+			   JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  JSAMPROW inptr, outptr;
+  JDIMENSION col, width = compptr->downsampled_width;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i two = _mm_set1_epi16(2);
+  __m128i prev, cur, next, cur3, even, odd;
+  int inrow, invalue;
+
+  for (inrow = 0; inrow < cinfo->max_v_samp_factor; inrow++) {
+    inptr = input_data[inrow];
+    outptr = output_data[inrow];
+
+    /* Special case for first column */
+    invalue = GETJSAMPLE(inptr[0]);
+    outptr[0] = (JSAMPLE) invalue;
+    outptr[1] = (JSAMPLE) ((invalue * 3 + GETJSAMPLE(inptr[1]) + 2) >> 2);
+
+    /* General case: 3/4 * nearer pixel + 1/4 * further pixel */
+    for (col = 1; col + 9 <= width; col += 8) {
+      prev = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr + col - 1)), zero);
+      cur = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr + col)), zero);
+      next = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr + col + 1)), zero);
+      cur3 = _mm_add_epi16(cur, _mm_add_epi16(cur, cur));
+      even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, prev), one), 2);
+      odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, next), two), 2);
+      _mm_storeu_si128((__m128i *) (outptr + 2*col),
+		       _mm_unpacklo_epi8(_mm_packus_epi16(even, even), _mm_packus_epi16(odd, odd)));
+    }
+    for (; col < width - 1; col++) {
+      invalue = GETJSAMPLE(inptr[col]) * 3;
+      outptr[2*col] = (JSAMPLE) ((invalue + GETJSAMPLE(inptr[col-1]) + 1) >> 2);
+      outptr[2*col+1] = (JSAMPLE) ((invalue + GETJSAMPLE(inptr[col+1]) + 2) >> 2);
+    }
+
+    /* Special case for last column */
+    invalue = GETJSAMPLE(inptr[col]);
+    outptr[2*col] = (JSAMPLE) ((invalue * 3 + GETJSAMPLE(inptr[col-1]) + 1) >> 2);
+    outptr[2*col+1] = (JSAMPLE) invalue;
+  }
+}
+
+SSE2_TARGET GLOBAL(void)
+jsimd_h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+			   JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+  JSAMPARRAY output_data = *output_data_ptr;
+  JSAMPROW inptr0, inptr1, outptr;
+  JDIMENSION col, width = compptr->downsampled_width;
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i seven = _mm_set1_epi16(7);
+  const __m128i eight = _mm_set1_epi16(8);
+  __m128i prev, cur, next, cur3, even, odd;
+  int thiscolsum, lastcolsum, nextcolsum;
+  int inrow, outrow, v;
+
+/* 3 * nearer row + further row, for eight columns starting at c */
+#define COLSUM(c) \
+  _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr0 + (c))), zero), \
+				_mm_set1_epi16(3)), \
+		_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (inptr1 + (c))), zero))
+#define SCALAR_COLSUM(c) \
+  (GETJSAMPLE(inptr0[c]) * 3 + GETJSAMPLE(inptr1[c]))
+
+  inrow = outrow = 0;
+  while (outrow < cinfo->max_v_samp_factor) {
+    for (v = 0; v < 2; v++) {
+      /* inptr0 points to nearest input row, inptr1 points to next nearest */
+      inptr0 = input_data[inrow];
+      inptr1 = input_data[v == 0 ? inrow-1 : inrow+1];
+      outptr = output_data[outrow++];
+
+      /* Special case for first column */
+      thiscolsum = SCALAR_COLSUM(0);
+      nextcolsum = SCALAR_COLSUM(1);
+      outptr[0] = (JSAMPLE) ((thiscolsum * 4 + 8) >> 4);
+      outptr[1] = (JSAMPLE) ((thiscolsum * 3 + nextcolsum + 7) >> 4);
+
+      /* General case: 9/16, 3/16, 3/16, 1/16 weighting */
+      for (col = 1; col + 9 <= width; col += 8) {
+	prev = COLSUM(col - 1);
+	cur = COLSUM(col);
+	next = COLSUM(col + 1);
+	cur3 = _mm_add_epi16(cur, _mm_add_epi16(cur, cur));
+	even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, prev), eight), 4);
+	odd = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, next), seven), 4);
+	_mm_storeu_si128((__m128i *) (outptr + 2*col),
+			 _mm_unpacklo_epi8(_mm_packus_epi16(even, even), _mm_packus_epi16(odd, odd)));
+      }
+      for (; col < width - 1; col++) {
+	thiscolsum = SCALAR_COLSUM(col);
+	lastcolsum = SCALAR_COLSUM(col - 1);
+	nextcolsum = SCALAR_COLSUM(col + 1);
+	outptr[2*col] = (JSAMPLE) ((thiscolsum * 3 + lastcolsum + 8) >> 4);
+	outptr[2*col+1] = (JSAMPLE) ((thiscolsum * 3 + nextcolsum + 7) >> 4);
+      }
+
+      /* Special case for last column */
+      thiscolsum = SCALAR_COLSUM(col);
+      lastcolsum = SCALAR_COLSUM(col - 1);
+      outptr[2*col] = (JSAMPLE) ((thiscolsum * 3 + lastcolsum + 8) >> 4);
+      outptr[2*col+1] = (JSAMPLE) ((thiscolsum * 4 + 7) >> 4);
+    }
+    inrow++;
+  }
+
+#undef COLSUM
+#undef SCALAR_COLSUM
+}
+
+#else /* !JSIMD_SSE2_SUPPORTED */
+
+/* Without SSE2 every capability test fails, so the stubs below are never
+ * selected; they exist only to satisfy the references in the selectors.
+ */
+
+GLOBAL(boolean) jsimd_can_fdct_islow (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_idct_islow (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_rgb_ycc (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_ycc_rgb (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_h2v1_upsample (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_h2v2_upsample (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_h2v1_fancy_upsample (void) { return FALSE; }
+GLOBAL(boolean) jsimd_can_h2v2_fancy_upsample (void) { return FALSE; }
+
+GLOBAL(void)
+jsimd_fdct_islow (DCTELEM * data)
+{
+}
+
+GLOBAL(void)
+jsimd_idct_islow (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		  JCOEFPTR coef_block,
+		  JSAMPARRAY output_buf, JDIMENSION output_col)
+{
+}
+
+GLOBAL(void)
+jsimd_rgb_ycc_convert (j_compress_ptr cinfo,
+		       JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+		       JDIMENSION output_row, int num_rows)
+{
+}
+
+GLOBAL(void)
+jsimd_ycc_rgb_convert (j_decompress_ptr cinfo,
+		       JSAMPIMAGE input_buf, JDIMENSION input_row,
+		       JSAMPARRAY output_buf, int num_rows)
+{
+}
+
+GLOBAL(void)
+jsimd_h2v1_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+}
+
+GLOBAL(void)
+jsimd_h2v2_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+		     JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+}
+
+GLOBAL(void)
+jsimd_h2v1_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+			   JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+}
+
+GLOBAL(void)
+jsimd_h2v2_fancy_upsample (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+			   JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr)
+{
+}
+
+#endif /* JSIMD_SSE2_SUPPORTED */
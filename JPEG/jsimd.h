@@ -0,0 +1,77 @@
+/*
+ * jsimd.h
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This include file declares the SIMD (SSE2) replacements for the most
+ * time-consuming per-block and per-pixel routines.  They are private to the
+ * modules that select them (jcdctmgr.c, jddctmgr.c, jccolor.c, jdcolor.c,
+ * jdsample.c).  The SIMD DCT routines are declared in jdct.h.
+ *
+ * Each jsimd_can_xxx() routine returns TRUE if the processor supports the
+ * instructions needed by jsimd_xxx(), in which case jsimd_xxx() may be used
+ * in place of the portable routine; the results are bit-identical.
+ * Defining JSIMD_DISABLED when compiling jsimd.c, or setting the environment
+ * variable JSIMD_FORCENONE=1 at run time, forces the portable routines.
+ */
+
+#ifndef JSIMD_H
+#define JSIMD_H
+
+
+/* Short forms of external names for systems with brain-damaged linkers. */
+
+#ifdef NEED_SHORT_EXTERNAL_NAMES
+#define jsimd_can_fdct_islow		jSCfdct
+#define jsimd_can_idct_islow		jSCidct
+#define jsimd_can_rgb_ycc		jSCrgbycc
+#define jsimd_can_ycc_rgb		jSCyccrgb
+#define jsimd_can_h2v1_upsample		jSCh2v1
+#define jsimd_can_h2v2_upsample		jSCh2v2
+#define jsimd_can_h2v1_fancy_upsample	jSCh2v1f
+#define jsimd_can_h2v2_fancy_upsample	jSCh2v2f
+#define jsimd_rgb_ycc_convert		jSrgbycc
+#define jsimd_ycc_rgb_convert		jSyccrgb
+#define jsimd_h2v1_upsample		jSh2v1
+#define jsimd_h2v2_upsample		jSh2v2
+#define jsimd_h2v1_fancy_upsample	jSh2v1f
+#define jsimd_h2v2_fancy_upsample	jSh2v2f
+#endif /* NEED_SHORT_EXTERNAL_NAMES */
+
+/* Runtime capability tests */
+
+EXTERN(boolean) jsimd_can_fdct_islow JPP((void));
+EXTERN(boolean) jsimd_can_idct_islow JPP((void));
+EXTERN(boolean) jsimd_can_rgb_ycc JPP((void));
+EXTERN(boolean) jsimd_can_ycc_rgb JPP((void));
+EXTERN(boolean) jsimd_can_h2v1_upsample JPP((void));
+EXTERN(boolean) jsimd_can_h2v2_upsample JPP((void));
+EXTERN(boolean) jsimd_can_h2v1_fancy_upsample JPP((void));
+EXTERN(boolean) jsimd_can_h2v2_fancy_upsample JPP((void));
+
+/* Color conversion (same interfaces as the color_convert methods) */
+
+EXTERN(void) jsimd_rgb_ycc_convert
+    JPP((j_compress_ptr cinfo, JSAMPARRAY input_buf, JSAMPIMAGE output_buf,
+	 JDIMENSION output_row, int num_rows));
+EXTERN(void) jsimd_ycc_rgb_convert
+    JPP((j_decompress_ptr cinfo, JSAMPIMAGE input_buf, JDIMENSION input_row,
+	 JSAMPARRAY output_buf, int num_rows));
+
+/* Upsampling (same interfaces as the per-component upsample methods) */
+
+EXTERN(void) jsimd_h2v1_upsample
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
+EXTERN(void) jsimd_h2v2_upsample
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
+EXTERN(void) jsimd_h2v1_fancy_upsample
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
+EXTERN(void) jsimd_h2v2_fancy_upsample
+    JPP((j_decompress_ptr cinfo, jpeg_component_info * compptr,
+	 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr));
+
+#endif /* JSIMD_H */
@@ -0,0 +1,425 @@
+/*
+ * jsimdtest.c
+ *
+ * This file is part of the Independent JPEG Group's software.
+ * For conditions of distribution and use, see the accompanying README file.
+ *
+ * This program checks that each of the SIMD routines of jsimd.c is
+ * bit-exact with the portable routine it replaces, on pseudo-random and
+ * extreme inputs of many widths.  The portable color converters and
+ * upsamplers are private to their modules, so those modules are compiled
+ * into this program, each in its own namespace, and their routines are
+ * called directly.
+ *
+ * It prints a line per routine and exits with a nonzero status if any
+ * output differs.  Routines that the processor (or JSIMD_FORCENONE=1)
+ * rules out are reported as skipped.
+ */
+
+#define JPEG_INTERNALS
+#include "jinclude.h"
+#include "jpeglib.h"
+#include "jdct.h"
+#include "jsimd.h"
+
+#undef FIX			/* the color converters define their own */
+
+namespace jccolor {
+#include "jccolor.cpp"
+}
+namespace jdcolor {
+#include "jdcolor.cpp"
+}
+namespace jdsample {
+#include "jdsample.cpp"
+}
+
+#define MAX_TEST_WIDTH  80	/* widths 1..MAX_TEST_WIDTH cover the vector loops and the edges */
+#define ROW_PADDING     64	/* readable (and writable) samples past the end of a row */
+#define TEST_BLOCKS     20000
+
+
+/* A deterministic pseudo-random number generator */
+
+static unsigned int seed = 1;
+
+LOCAL(int)
+random_int (int lo, int hi)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return lo + (int) ((seed >> 8) % (unsigned int) (hi - lo + 1));
+}
+
+
+/* The sample range-limiting table, as built by prepare_range_limit_table()
+ * in jdmaster.c (which cannot be compiled in, as it defines the application
+ * interface jpeg_calc_output_dimensions()).
+ */
+
+LOCAL(void)
+prepare_range_limit_table (j_decompress_ptr cinfo)
+{
+  JSAMPLE * table;
+  int i;
+
+  table = (JSAMPLE *)
+    (*cinfo->mem->alloc_small) ((j_common_ptr) cinfo, JPOOL_IMAGE,
+		(5 * (MAXJSAMPLE+1) + CENTERJSAMPLE) * SIZEOF(JSAMPLE));
+  table += (MAXJSAMPLE+1);
+  cinfo->sample_range_limit = table;
+  MEMZERO(table - (MAXJSAMPLE+1), (MAXJSAMPLE+1) * SIZEOF(JSAMPLE));
+  for (i = 0; i <= MAXJSAMPLE; i++)
+    table[i] = (JSAMPLE) i;
+  table += CENTERJSAMPLE;
+  for (i = CENTERJSAMPLE; i < 2*(MAXJSAMPLE+1); i++)
+    table[i] = MAXJSAMPLE;
+  MEMZERO(table + (2 * (MAXJSAMPLE+1)),
+	  (2 * (MAXJSAMPLE+1) - CENTERJSAMPLE) * SIZEOF(JSAMPLE));
+  MEMCOPY(table + (4 * (MAXJSAMPLE+1) - CENTERJSAMPLE),
+	  cinfo->sample_range_limit, CENTERJSAMPLE * SIZEOF(JSAMPLE));
+}
+
+
+/* Rows of samples, filled with random values */
+
+LOCAL(JSAMPARRAY)
+alloc_rows (int rows, int width)
+{
+  JSAMPARRAY array = (JSAMPARRAY) malloc(rows * SIZEOF(JSAMPROW));
+  int i, j;
+
+  for (i = 0; i < rows; i++) {
+    array[i] = (JSAMPROW) malloc(width + ROW_PADDING);
+    for (j = 0; j < width + ROW_PADDING; j++)
+      array[i][j] = (JSAMPLE) random_int(0, MAXJSAMPLE);
+  }
+  return array;
+}
+
+LOCAL(void)
+copy_rows (JSAMPARRAY from, JSAMPARRAY to, int rows, int width)
+{
+  int i;
+
+  for (i = 0; i < rows; i++)
+    MEMCOPY(to[i], from[i], (width + ROW_PADDING) * SIZEOF(JSAMPLE));
+}
+
+LOCAL(boolean)
+same_rows (JSAMPARRAY a, JSAMPARRAY b, int rows, int width)
+{
+  int i;
+
+  for (i = 0; i < rows; i++)
+    if (memcmp(a[i], b[i], (width + ROW_PADDING) * SIZEOF(JSAMPLE)) != 0)
+      return FALSE;
+  return TRUE;
+}
+
+LOCAL(void)
+free_rows (JSAMPARRAY array, int rows)
+{
+  int i;
+
+  for (i = 0; i < rows; i++)
+    free(array[i]);
+  free(array);
+}
+
+
+/* Reporting */
+
+static int failures = 0;
+
+LOCAL(void)
+report (const char * name, boolean supported, long cases, long mismatches)
+{
+  if (!supported)
+    printf("\t%-28s skipped (not supported)\n", name);
+  else if (mismatches)
+    printf("\t%-28s FAIL (%ld of %ld cases differ)\n", name, mismatches, cases);
+  else
+    printf("\t%-28s ok (%ld cases)\n", name, cases);
+  if (mismatches)
+    failures++;
+}
+
+
+/*
+ * Forward DCT, on level-shifted samples.
+ */
+
+LOCAL(void)
+test_fdct_islow (void)
+{
+  DCTELEM portable[DCTSIZE2], simd[DCTSIZE2];
+  long b, mismatches = 0;
+  int i, kind;
+
+  if (!jsimd_can_fdct_islow()) {
+    report("jsimd_fdct_islow", FALSE, 0, 0);
+    return;
+  }
+  for (b = 0; b < TEST_BLOCKS; b++) {
+    kind = (int) (b % 4);
+    for (i = 0; i < DCTSIZE2; i++) {
+      switch (kind) {
+      case 0:	portable[i] = random_int(-CENTERJSAMPLE, MAXJSAMPLE-CENTERJSAMPLE); break;
+      case 1:	portable[i] = random_int(0, 1) ? -CENTERJSAMPLE : MAXJSAMPLE-CENTERJSAMPLE; break;
+      case 2:	portable[i] = ((i / DCTSIZE + i % DCTSIZE) & 1) ? -CENTERJSAMPLE : MAXJSAMPLE-CENTERJSAMPLE; break;
+      default:	portable[i] = (DCTELEM) (b % (MAXJSAMPLE+1)) - CENTERJSAMPLE; break;
+      }
+      simd[i] = portable[i];
+    }
+    jpeg_fdct_islow(portable);
+    jsimd_fdct_islow(simd);
+    if (memcmp(portable, simd, SIZEOF(portable)) != 0)
+      mismatches++;
+  }
+  report("jsimd_fdct_islow", TRUE, TEST_BLOCKS, mismatches);
+}
+
+
+/*
+ * Inverse DCT, on coefficients ranging from typical to out-of-range (the
+ * latter take the SIMD routine's fallback to the portable one).
+ */
+
+LOCAL(void)
+test_idct_islow (j_decompress_ptr cinfo)
+{
+  jpeg_component_info component;
+  ISLOW_MULT_TYPE quant[DCTSIZE2];
+  JCOEF coef[DCTSIZE2];
+  JSAMPARRAY portable = alloc_rows(DCTSIZE, DCTSIZE);
+  JSAMPARRAY simd = alloc_rows(DCTSIZE, DCTSIZE);
+  long b, mismatches = 0;
+  int i, kind, range;
+
+  if (!jsimd_can_idct_islow()) {
+    report("jsimd_idct_islow", FALSE, 0, 0);
+    return;
+  }
+  MEMZERO(&component, SIZEOF(component));
+  component.dct_table = (void *) quant;
+  for (b = 0; b < TEST_BLOCKS; b++) {
+    kind = (int) (b % 4);
+    for (i = 0; i < DCTSIZE2; i++) {
+      switch (kind) {
+      case 0:	/* quantized image data: small coefficients, decaying with frequency */
+	quant[i] = (ISLOW_MULT_TYPE) random_int(1, 16 + 4 * i);
+	range = 1024 / quant[i] / (1 + i / 4);
+	coef[i] = (JCOEF) random_int(-range, range);
+	break;
+      case 1:	/* unit quantizers, full-range coefficients */
+	quant[i] = 1;
+	coef[i] = (JCOEF) random_int(-1024, 1023);
+	break;
+      case 2:	/* extreme values */
+	quant[i] = (ISLOW_MULT_TYPE) (random_int(0, 1) ? 255 : 1);
+	coef[i] = (JCOEF) (random_int(0, 1) ? -2048 : 2047);
+	break;
+      default:	/* arbitrary (including overflowing) products */
+	quant[i] = (ISLOW_MULT_TYPE) random_int(1, 255);
+	coef[i] = (JCOEF) random_int(-2048, 2047);
+	break;
+      }
+    }
+    copy_rows(portable, simd, DCTSIZE, DCTSIZE);
+    jpeg_idct_islow(cinfo, &component, coef, portable, 0);
+    jsimd_idct_islow(cinfo, &component, coef, simd, 0);
+    if (!same_rows(portable, simd, DCTSIZE, DCTSIZE))
+      mismatches++;
+  }
+  report("jsimd_idct_islow", TRUE, TEST_BLOCKS, mismatches);
+  free_rows(portable, DCTSIZE);
+  free_rows(simd, DCTSIZE);
+}
+
+
+/*
+ * RGB (or RGBA) to YCbCr, against jccolor.c.
+ */
+
+LOCAL(void)
+test_rgb_ycc (J_COLOR_SPACE space, const char * name)
+{
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPARRAY input, portable[3], simd[3];
+  int width, pixelsize = space == JCS_EXT_RGBA ? 4 : RGB_PIXELSIZE;
+  long cases = 0, mismatches = 0;
+  int c, rows = 4;
+
+  if (!jsimd_can_rgb_ycc()) {
+    report(name, FALSE, 0, 0);
+    return;
+  }
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+  cinfo.in_color_space = space;
+  cinfo.input_components = pixelsize;
+  cinfo.jpeg_color_space = JCS_YCbCr;
+  cinfo.num_components = 3;
+  jccolor::jinit_color_converter(&cinfo);
+  jccolor::rgb_ycc_start(&cinfo);
+  for (width = 1; width <= MAX_TEST_WIDTH; width++, cases++) {
+    cinfo.image_width = (JDIMENSION) width;
+    input = alloc_rows(rows, width * pixelsize);
+    for (c = 0; c < 3; c++) {
+      portable[c] = alloc_rows(rows, width);
+      simd[c] = alloc_rows(rows, width);
+      copy_rows(portable[c], simd[c], rows, width);
+    }
+    jccolor::rgb_ycc_convert(&cinfo, input, portable, 0, rows);
+    jsimd_rgb_ycc_convert(&cinfo, input, simd, 0, rows);
+    for (c = 0; c < 3; c++)
+      if (!same_rows(portable[c], simd[c], rows, width))
+	break;
+    if (c < 3)
+      mismatches++;
+    free_rows(input, rows);
+    for (c = 0; c < 3; c++) {
+      free_rows(portable[c], rows);
+      free_rows(simd[c], rows);
+    }
+  }
+  jpeg_destroy_compress(&cinfo);
+  report(name, TRUE, cases, mismatches);
+}
+
+
+/*
+ * YCbCr to RGB (or RGBA), against jdcolor.c.
+ */
+
+LOCAL(void)
+test_ycc_rgb (J_COLOR_SPACE space, const char * name)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  JSAMPARRAY input[3], portable, simd;
+  int width, pixelsize;
+  long cases = 0, mismatches = 0;
+  int c, rows = 4;
+
+  if (!jsimd_can_ycc_rgb()) {
+    report(name, FALSE, 0, 0);
+    return;
+  }
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  cinfo.jpeg_color_space = JCS_YCbCr;
+  cinfo.out_color_space = space;
+  cinfo.num_components = 3;
+  prepare_range_limit_table(&cinfo);
+  jdcolor::jinit_color_deconverter(&cinfo);
+  jdcolor::build_ycc_rgb_table(&cinfo);
+  pixelsize = cinfo.out_color_components;
+  for (width = 1; width <= MAX_TEST_WIDTH; width++, cases++) {
+    cinfo.output_width = (JDIMENSION) width;
+    for (c = 0; c < 3; c++)
+      input[c] = alloc_rows(rows, width);
+    portable = alloc_rows(rows, width * pixelsize);
+    simd = alloc_rows(rows, width * pixelsize);
+    copy_rows(portable, simd, rows, width * pixelsize);
+    if (space == JCS_EXT_RGBA)
+      jdcolor::ycc_rgba_convert(&cinfo, input, 0, portable, rows);
+    else
+      jdcolor::ycc_rgb_convert(&cinfo, input, 0, portable, rows);
+    jsimd_ycc_rgb_convert(&cinfo, input, 0, simd, rows);
+    if (!same_rows(portable, simd, rows, width * pixelsize))
+      mismatches++;
+    for (c = 0; c < 3; c++)
+      free_rows(input[c], rows);
+    free_rows(portable, rows);
+    free_rows(simd, rows);
+  }
+  jpeg_destroy_decompress(&cinfo);
+  report(name, TRUE, cases, mismatches);
+}
+
+
+/*
+ * Upsampling, against jdsample.c.  The input rows are preceded and followed
+ * by a context row, which the h2v2 fancy upsampler reads.
+ */
+
+typedef void (*upsample_method) (j_decompress_ptr cinfo, jpeg_component_info * compptr,
+				 JSAMPARRAY input_data, JSAMPARRAY * output_data_ptr);
+
+LOCAL(void)
+test_upsample (upsample_method portable_method, upsample_method simd_method,
+	       boolean supported, int v_expand, boolean fancy, const char * name)
+{
+  struct jpeg_decompress_struct cinfo;
+  jpeg_component_info component;
+  JSAMPARRAY input, portable, simd;
+  int width, max_v_samp_factor = 2;
+  int in_rows = max_v_samp_factor / v_expand + 2;
+  long cases = 0, mismatches = 0;
+
+  if (!supported) {
+    report(name, FALSE, 0, 0);
+    return;
+  }
+  MEMZERO(&cinfo, SIZEOF(cinfo));
+  MEMZERO(&component, SIZEOF(component));
+  cinfo.max_v_samp_factor = max_v_samp_factor;
+  /* The fancy upsamplers need two input columns; the plain ones are also
+   * given odd output widths.
+   */
+  for (width = fancy ? 2 : 1; width <= MAX_TEST_WIDTH; width++) {
+    int odd;
+    for (odd = 0; odd <= (fancy ? 0 : 1); odd++, cases++) {
+      component.downsampled_width = (JDIMENSION) width;
+      cinfo.output_width = (JDIMENSION) (2 * width - odd);
+      input = alloc_rows(in_rows, width);
+      portable = alloc_rows(max_v_samp_factor, 2 * width);
+      simd = alloc_rows(max_v_samp_factor, 2 * width);
+      copy_rows(portable, simd, max_v_samp_factor, 2 * width);
+      (*portable_method) (&cinfo, &component, input + 1, &portable);
+      (*simd_method) (&cinfo, &component, input + 1, &simd);
+      if (!same_rows(portable, simd, max_v_samp_factor, 2 * width))
+	mismatches++;
+      free_rows(input, in_rows);
+      free_rows(portable, max_v_samp_factor);
+      free_rows(simd, max_v_samp_factor);
+    }
+  }
+  report(name, TRUE, cases, mismatches);
+}
+
+
+int
+main (int argc, char ** argv)
+{
+  struct jpeg_decompress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+
+  /* The inverse DCT only needs the sample range-limiting table */
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  prepare_range_limit_table(&cinfo);
+
+  printf("SIMD routines against the portable ones:\n");
+  test_fdct_islow();
+  test_idct_islow(&cinfo);
+  test_rgb_ycc(JCS_RGB, "jsimd_rgb_ycc_convert");
+  test_rgb_ycc(JCS_EXT_RGBA, "jsimd_rgb_ycc_convert (RGBA)");
+  test_ycc_rgb(JCS_RGB, "jsimd_ycc_rgb_convert");
+  test_ycc_rgb(JCS_EXT_RGBA, "jsimd_ycc_rgb_convert (RGBA)");
+  test_upsample(jdsample::h2v1_upsample, jsimd_h2v1_upsample,
+		jsimd_can_h2v1_upsample(), 1, FALSE, "jsimd_h2v1_upsample");
+  test_upsample(jdsample::h2v2_upsample, jsimd_h2v2_upsample,
+		jsimd_can_h2v2_upsample(), 2, FALSE, "jsimd_h2v2_upsample");
+  test_upsample(jdsample::h2v1_fancy_upsample, jsimd_h2v1_fancy_upsample,
+		jsimd_can_h2v1_fancy_upsample(), 1, TRUE, "jsimd_h2v1_fancy_upsample");
+  test_upsample(jdsample::h2v2_fancy_upsample, jsimd_h2v2_fancy_upsample,
+		jsimd_can_h2v2_fancy_upsample(), 2, TRUE, "jsimd_h2v2_fancy_upsample");
+
+  jpeg_destroy_decompress(&cinfo);
+  if (failures)
+    printf("%d SIMD routine(s) not bit-exact\n", failures);
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -55,6 +55,9 @@ namespace Util
 		/** Try to set the argument from the list of command line arguments.
 		*** Returns thenumber of arguments ingested.*/ 
 		virtual int read( char **argv , int argc );
+
+		/** Restore the argument to its state before it was read */
+		virtual void reset( void );
 	};
 
 	/** This templated class represents a named argument of the prescribed type */
@@ -65,6 +68,9 @@ namespace Util
 		/** The value the parameter has been set to */
 		Type value;
 
+		/** The value the parameter is reset to */
+		Type defaultValue;
+
 		/** Constructor with the name of the argument */
 		CmdLineParameter( const std::string &name );
 
@@ -74,6 +80,9 @@ namespace Util
 		/** Try to set the argument from the list of command line arguments.
 		*** Returns thenumber of arguments ingested.*/ 
 		int read( char **argv , int argc );
+
+		/** Restore the default value */
+		void reset( void );
 	};
 
 	/** This templated class represents a named argument taking a fixed number of values of the prescribed type */
@@ -84,12 +93,18 @@ namespace Util
 		/** The values the parameter has been set to */
 		Type values[Dim];
 
+		/** The values the parameter is reset to */
+		Type defaultValues[Dim];
+
 		/** Constructor with the name of the argument and the default values */
 		CmdLineParameterArray( const std::string &name, const Type* v=NULL );
 
 		/** Try to set the argument from the list of command line arguments.
 		*** Returns thenumber of arguments ingested.*/ 
 		int read( char **argv , int argc );
+
+		/** Restore the default values */
+		void reset( void );
 	};
 
 	/** This templated class represents a named argument taking a variable number of values of of the prescribed type */
@@ -112,12 +127,19 @@ namespace Util
 		/** Try to set the argument from the list of command line arguments.
 		*** Returns thenumber of arguments ingested.*/ 
 		int read( char **argv , int argc );
+
+		/** Deallocate the array of values */
+		void reset( void );
 	};
 
 	/** This function takes a list of arguments and tries to set the parameters.
 	*** The last parameter must be a NULL pointer. */
 	void CmdLineParse( int argc , char **argv, CmdLineReadable **params );
 
+	/** This function restores the parameters to their state before they were parsed, so that another list of arguments can be parsed.
+	*** The last parameter must be a NULL pointer. */
+	void CmdLineReset( CmdLineReadable **params );
+
 	/** Converts a string to upper case*/
 	std::string ToUpper( const std::string &str );
 
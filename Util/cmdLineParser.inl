@@ -44,12 +44,14 @@ namespace Util
 	
 	inline int CmdLineReadable::read( char ** , int ){ set = true ; return 0; }
 
+	inline void CmdLineReadable::reset( void ){ set = false; }
+
 	//////////////////////
 	// CmdLineParameter //
 	//////////////////////
-	template< class Type > CmdLineParameter< Type >::CmdLineParameter( const std::string &name          ) : CmdLineReadable(name) { value = Type(); }
+	template< class Type > CmdLineParameter< Type >::CmdLineParameter( const std::string &name          ) : CmdLineReadable(name) { value = defaultValue = Type(); }
 
-	template< class Type > CmdLineParameter< Type >::CmdLineParameter( const std::string &name , Type v ) : CmdLineReadable(name) , value(v) {}
+	template< class Type > CmdLineParameter< Type >::CmdLineParameter( const std::string &name , Type v ) : CmdLineReadable(name) , value(v) , defaultValue(v) {}
 
 	template< class Type >
 	int CmdLineParameter< Type >::read( char **argv , int argc )
@@ -63,14 +65,21 @@ namespace Util
 		else return 0;
 	}
 
+	template< class Type >
+	void CmdLineParameter< Type >::reset( void )
+	{
+		value = defaultValue;
+		set = false;
+	}
+
 	///////////////////////////
 	// CmdLineParameterArray //
 	///////////////////////////
 	template< class Type , int Dim >
 	CmdLineParameterArray< Type , Dim >::CmdLineParameterArray( const std::string &name , const Type* v ) : CmdLineReadable(name)
 	{
-		if( v ) for( int i=0 ; i<Dim ; i++ ) values[i] = v[i];
-		else    for( int i=0 ; i<Dim ; i++ ) values[i] = Type();
+		if( v ) for( int i=0 ; i<Dim ; i++ ) values[i] = defaultValues[i] = v[i];
+		else    for( int i=0 ; i<Dim ; i++ ) values[i] = defaultValues[i] = Type();
 	}
 
 	template< class Type , int Dim >
@@ -85,6 +94,13 @@ namespace Util
 		else return 0;
 	}
 
+	template< class Type , int Dim >
+	void CmdLineParameterArray< Type , Dim >::reset( void )
+	{
+		for( int i=0 ; i<Dim ; i++ ) values[i] = defaultValues[i];
+		set = false;
+	}
+
 	///////////////////////
 	// CmdLineParameters //
 	///////////////////////
@@ -118,6 +134,15 @@ namespace Util
 		else return 0;
 	}
 
+	template< class Type >
+	void CmdLineParameters< Type >::reset( void )
+	{
+		if( values ) delete[] values;
+		values = NULL;
+		count = 0;
+		set = false;
+	}
+
 	//////////////////////
 	// Helper functions //
 	//////////////////////
@@ -146,6 +171,11 @@ namespace Util
 		}
 	}
 
+	inline void CmdLineReset( CmdLineReadable **params )
+	{
+		for( int i=0 ; params[i]!=NULL ; i++ ) params[i]->reset();
+	}
+
 	inline std::string ToUpper( const std::string &str )
 	{
 		auto _ToUpper = []( char c ){ return c>='a' && c<='z' ? c+'A'-'a' : c; };
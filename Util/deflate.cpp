@@ -0,0 +1,601 @@
+#include <string.h>
+#include <algorithm>
+#include <queue>
+#include "exceptions.h"
+#include "deflate.h"
+
+using namespace Util;
+
+///////////////
+// Checksums //
+///////////////
+namespace
+{
+	struct _CRCTable
+	{
+		unsigned int values[256];
+		_CRCTable( void )
+		{
+			for( unsigned int n=0 ; n<256 ; n++ )
+			{
+				unsigned int c = n;
+				for( int k=0 ; k<8 ; k++ ) c = ( c&1 ) ? 0xEDB88320u ^ (c>>1) : c>>1;
+				values[n] = c;
+			}
+		}
+	};
+}
+
+unsigned int Util::CRC32( const unsigned char *data , size_t size , unsigned int crc )
+{
+	static const _CRCTable Table;
+	crc = ~crc;
+	for( size_t i=0 ; i<size ; i++ ) crc = Table.values[ ( crc ^ data[i] ) & 0xff ] ^ ( crc>>8 );
+	return ~crc;
+}
+
+unsigned int Util::Adler32( const unsigned char *data , size_t size , unsigned int adler )
+{
+	// The sums are reduced every 5552 bytes, the most that can be added before the second one overflows
+	unsigned int a = adler & 0xffff , b = adler>>16;
+	while( size )
+	{
+		size_t n = std::min< size_t >( size , 5552 );
+		for( size_t i=0 ; i<n ; i++ ) a += data[i] , b += a;
+		a %= 65521 , b %= 65521;
+		data += n , size -= n;
+	}
+	return ( b<<16 ) | a;
+}
+
+/////////////////////
+// Deflate helpers //
+/////////////////////
+namespace
+{
+	// The base lengths and extra bits of the length symbols [257,285]
+	const unsigned short LengthBase[] = { 3 , 4 , 5 , 6 , 7 , 8 , 9 , 10 , 11 , 13 , 15 , 17 , 19 , 23 , 27 , 31 , 35 , 43 , 51 , 59 , 67 , 83 , 99 , 115 , 131 , 163 , 195 , 227 , 258 };
+	const unsigned char LengthExtra[] = { 0 , 0 , 0 , 0 , 0 , 0 , 0 , 0 , 1 , 1 , 1 , 1 , 2 , 2 , 2 , 2 , 3 , 3 , 3 , 3 , 4 , 4 , 4 , 4 , 5 , 5 , 5 , 5 , 0 };
+
+	// The base distances and extra bits of the distance symbols [0,29]
+	const unsigned short DistanceBase[] = { 1 , 2 , 3 , 4 , 5 , 7 , 9 , 13 , 17 , 25 , 33 , 49 , 65 , 97 , 129 , 193 , 257 , 385 , 513 , 769 , 1025 , 1537 , 2049 , 3073 , 4097 , 6145 , 8193 , 12289 , 16385 , 24577 };
+	const unsigned char DistanceExtra[] = { 0 , 0 , 0 , 0 , 1 , 1 , 2 , 2 , 3 , 3 , 4 , 4 , 5 , 5 , 6 , 6 , 7 , 7 , 8 , 8 , 9 , 9 , 10 , 10 , 11 , 11 , 12 , 12 , 13 , 13 };
+
+	// The order in which the lengths of the code-length code are transmitted
+	const unsigned char CodeLengthOrder[] = { 16 , 17 , 18 , 0 , 8 , 7 , 9 , 6 , 10 , 5 , 11 , 4 , 12 , 3 , 13 , 2 , 14 , 1 , 15 };
+
+	const int WindowSize = 1<<15;
+	const int MinMatch = 3 , MaxMatch = 258;
+	const int HashBits = 15;
+	const size_t BlockSize = 1<<17;
+
+	int LengthSymbol( int length )
+	{
+		int s = 0;
+		while( s<28 && LengthBase[s+1]<=length ) s++;
+		return s;
+	}
+
+	int DistanceSymbol( int distance )
+	{
+		int s = 0;
+		while( s<29 && DistanceBase[s+1]<=distance ) s++;
+		return s;
+	}
+
+	unsigned int Hash( const unsigned char *p ){ return ( ( p[0]<<10 ) ^ ( p[1]<<5 ) ^ p[2] ) & ( (1<<HashBits)-1 ); }
+
+	unsigned int ReverseBits( unsigned int code , int length )
+	{
+		unsigned int r = 0;
+		for( int i=0 ; i<length ; i++ ) r = ( r<<1 ) | ( ( code>>i ) & 1 );
+		return r;
+	}
+
+	// Sets the code lengths of the Huffman code for the frequencies, with no code longer than maxLength.
+	// At least two symbols are always given codes, so that the code is complete.
+	void HuffmanLengths( const std::vector< unsigned int > &frequencies , int maxLength , std::vector< unsigned char > &lengths )
+	{
+		int n = (int)frequencies.size();
+		lengths.assign( n , 0 );
+
+		std::vector< int > used;
+		for( int i=0 ; i<n ; i++ ) if( frequencies[i] ) used.push_back( i );
+		for( int i=0 ; i<n && used.size()<2 ; i++ ) if( !frequencies[i] ) used.push_back( i );
+
+		// Build the Huffman tree over the used symbols and read off the depths of the leaves
+		std::vector< int > parent( 2*used.size() , -1 );
+		typedef std::pair< unsigned long long , int > Node;
+		std::priority_queue< Node , std::vector< Node > , std::greater< Node > > queue;
+		for( int i=0 ; i<(int)used.size() ; i++ ) queue.push( Node( frequencies[ used[i] ] , i ) );
+		int next = (int)used.size();
+		while( queue.size()>1 )
+		{
+			Node a = queue.top() ; queue.pop();
+			Node b = queue.top() ; queue.pop();
+			parent[a.second] = parent[b.second] = next;
+			queue.push( Node( a.first+b.first , next++ ) );
+		}
+		std::vector< int > depth( next , 0 );
+		for( int i=next-2 ; i>=0 ; i-- ) depth[i] = depth[ parent[i] ] + 1;
+
+		// Clamp the lengths and restore the Kraft equality by lengthening codes (as in zlib and miniz)
+		std::vector< int > counts( maxLength+1 , 0 );
+		for( int i=0 ; i<(int)used.size() ; i++ ) counts[ std::min< int >( depth[i] , maxLength ) ]++;
+		unsigned long long total = 0;
+		for( int l=1 ; l<=maxLength ; l++ ) total += (unsigned long long)counts[l] << ( maxLength-l );
+		while( total>( 1ull<<maxLength ) )
+		{
+			counts[maxLength]--;
+			for( int l=maxLength-1 ; l>0 ; l-- ) if( counts[l] )
+			{
+				counts[l]--;
+				counts[l+1] += 2;
+				break;
+			}
+			total--;
+		}
+
+		// Assign the shortest lengths to the most frequent symbols
+		std::sort( used.begin() , used.end() , [&]( int a , int b ){ return frequencies[a]!=frequencies[b] ? frequencies[a]>frequencies[b] : a<b; } );
+		int idx = 0;
+		for( int l=1 ; l<=maxLength ; l++ ) for( int c=0 ; c<counts[l] ; c++ ) lengths[ used[idx++] ] = (unsigned char)l;
+	}
+
+	// Sets the (bit-reversed) canonical codes from the code lengths
+	void CanonicalCodes( const std::vector< unsigned char > &lengths , std::vector< unsigned short > &codes )
+	{
+		int counts[16] = { 0 } , next[16];
+		for( size_t i=0 ; i<lengths.size() ; i++ ) counts[ lengths[i] ]++;
+		counts[0] = 0;
+		int code = 0;
+		for( int l=1 ; l<16 ; l++ ) code = ( code + counts[l-1] )<<1 , next[l] = code;
+		codes.assign( lengths.size() , 0 );
+		for( size_t i=0 ; i<lengths.size() ; i++ ) if( lengths[i] ) codes[i] = (unsigned short)ReverseBits( next[ lengths[i] ]++ , lengths[i] );
+	}
+}
+
+//////////////
+// Deflater //
+//////////////
+Deflater::Deflater( std::function< void ( const unsigned char * , size_t ) > sink , int level ) : _sink(sink) , _history(0) , _bitBuffer(0) , _bitCount(0) , _adler(1) , _finished(false)
+{
+	if( level<1 || level>9 ) THROW( "Compression level must be in the range [1,9]: %d" , level );
+	_maxChain = 1<<( level+1 );
+	_head.resize( 1<<HashBits , 0 );
+
+	// The zlib header: deflate with a 32K window and the default compression level, with the check bits making it a multiple of 31
+	_out.push_back( 0x78 );
+	_out.push_back( 0x9C );
+}
+
+void Deflater::write( const void *data , size_t size )
+{
+	if( _finished ) THROW( "Deflater has already been finished" );
+	const unsigned char *_d = (const unsigned char *)data;
+	_adler = Adler32( _d , size , _adler );
+	while( size )
+	{
+		size_t n = std::min< size_t >( size , BlockSize - ( _data.size()-_history ) );
+		_data.insert( _data.end() , _d , _d+n );
+		_d += n , size -= n;
+		if( _data.size()-_history==BlockSize ) _compressBlock( false );
+	}
+}
+
+void Deflater::finish( void )
+{
+	if( _finished ) return;
+	_compressBlock( true );
+	_flush( true );
+	for( int i=3 ; i>=0 ; i-- ) _out.push_back( (unsigned char)( _adler>>(8*i) ) );
+	_flush( true );
+	_finished = true;
+}
+
+void Deflater::_compressBlock( bool final )
+{
+	size_t size = _data.size();
+	_previous.resize( size );
+	_tokens.resize( 0 );
+
+	auto Insert = [&]( size_t p )
+	{
+		if( p+MinMatch>size ) return;
+		unsigned int h = Hash( &_data[p] );
+		_previous[p] = _head[h];
+		_head[h] = (unsigned int)p+1;
+	};
+
+	size_t p = _history;
+	while( p<size )
+	{
+		int bestLength = 0 , bestDistance = 0;
+		if( p+MinMatch<=size )
+		{
+			int maxLength = (int)std::min< size_t >( MaxMatch , size-p );
+			unsigned int candidate = _head[ Hash( &_data[p] ) ];
+			for( int chain=0 ; candidate && chain<_maxChain ; chain++ )
+			{
+				size_t q = candidate-1;
+				if( p-q>WindowSize ) break;
+				if( _data[q+bestLength]==_data[p+bestLength] )
+				{
+					int l = 0;
+					while( l<maxLength && _data[q+l]==_data[p+l] ) l++;
+					if( l>bestLength )
+					{
+						bestLength = l , bestDistance = (int)(p-q);
+						if( l==maxLength ) break;
+					}
+				}
+				candidate = _previous[q];
+			}
+		}
+		if( bestLength>=MinMatch )
+		{
+			_tokens.push_back( std::make_pair( (unsigned short)bestLength , (unsigned short)bestDistance ) );
+			for( int i=0 ; i<bestLength ; i++ ) Insert( p+i );
+			p += bestLength;
+		}
+		else
+		{
+			_tokens.push_back( std::make_pair( (unsigned short)_data[p] , (unsigned short)0 ) );
+			Insert( p );
+			p++;
+		}
+	}
+	_writeBlock( final );
+
+	// Keep the last 32K as history for the next block, and re-index it
+	if( !final )
+	{
+		size_t history = std::min< size_t >( size , WindowSize );
+		_data.erase( _data.begin() , _data.end()-history );
+		_history = history;
+		std::fill( _head.begin() , _head.end() , 0 );
+		size = _data.size();
+		_previous.resize( size );
+		for( size_t i=0 ; i<size ; i++ ) Insert( i );
+	}
+	_flush( false );
+}
+
+void Deflater::_writeBlock( bool final )
+{
+	std::vector< unsigned int > literalFrequencies( 286 , 0 ) , distanceFrequencies( 30 , 0 );
+	for( size_t i=0 ; i<_tokens.size() ; i++ )
+		if( _tokens[i].second ) literalFrequencies[ 257+LengthSymbol( _tokens[i].first ) ]++ , distanceFrequencies[ DistanceSymbol( _tokens[i].second ) ]++;
+		else literalFrequencies[ _tokens[i].first ]++;
+	literalFrequencies[256] = 1;
+
+	std::vector< unsigned char > literalLengths , distanceLengths;
+	HuffmanLengths( literalFrequencies , 15 , literalLengths );
+	HuffmanLengths( distanceFrequencies , 15 , distanceLengths );
+	int literalCount = 286 , distanceCount = 30;
+	while( literalCount>257 && !literalLengths[literalCount-1] ) literalCount--;
+	while( distanceCount>1 && !distanceLengths[distanceCount-1] ) distanceCount--;
+
+	// Run-length encode the concatenated code lengths with the symbols 16 (repeat previous), 17 and 18 (repeat zero)
+	std::vector< unsigned char > lengths( literalLengths.begin() , literalLengths.begin()+literalCount );
+	lengths.insert( lengths.end() , distanceLengths.begin() , distanceLengths.begin()+distanceCount );
+	std::vector< std::pair< unsigned char , unsigned char > > runs;
+	for( size_t i=0 ; i<lengths.size() ; )
+	{
+		size_t j = i;
+		while( j<lengths.size() && lengths[j]==lengths[i] ) j++;
+		int run = (int)(j-i);
+		if( !lengths[i] )
+			while( run )
+			{
+				if     ( run>=11 ){ int r = std::min< int >( run , 138 ) ; runs.push_back( std::make_pair( (unsigned char)18 , (unsigned char)(r-11) ) ) ; run -= r; }
+				else if( run>= 3 ){ runs.push_back( std::make_pair( (unsigned char)17 , (unsigned char)(run-3) ) ) ; run = 0; }
+				else              { runs.push_back( std::make_pair( (unsigned char)0 , (unsigned char)0 ) ) ; run--; }
+			}
+		else
+		{
+			runs.push_back( std::make_pair( lengths[i] , (unsigned char)0 ) ) , run--;
+			while( run )
+			{
+				if( run>=3 ){ int r = std::min< int >( run , 6 ) ; runs.push_back( std::make_pair( (unsigned char)16 , (unsigned char)(r-3) ) ) ; run -= r; }
+				else        { runs.push_back( std::make_pair( lengths[i] , (unsigned char)0 ) ) ; run--; }
+			}
+		}
+		i = j;
+	}
+
+	std::vector< unsigned int > codeLengthFrequencies( 19 , 0 );
+	for( size_t i=0 ; i<runs.size() ; i++ ) codeLengthFrequencies[ runs[i].first ]++;
+	std::vector< unsigned char > codeLengthLengths;
+	HuffmanLengths( codeLengthFrequencies , 7 , codeLengthLengths );
+	int codeLengthCount = 19;
+	while( codeLengthCount>4 && !codeLengthLengths[ CodeLengthOrder[codeLengthCount-1] ] ) codeLengthCount--;
+
+	std::vector< unsigned short > literalCodes , distanceCodes , codeLengthCodes;
+	CanonicalCodes( literalLengths , literalCodes );
+	CanonicalCodes( distanceLengths , distanceCodes );
+	CanonicalCodes( codeLengthLengths , codeLengthCodes );
+
+	// The block header
+	_writeBits( final ? 1 : 0 , 1 );
+	_writeBits( 2 , 2 );
+	_writeBits( literalCount-257 , 5 );
+	_writeBits( distanceCount-1 , 5 );
+	_writeBits( codeLengthCount-4 , 4 );
+	for( int i=0 ; i<codeLengthCount ; i++ ) _writeBits( codeLengthLengths[ CodeLengthOrder[i] ] , 3 );
+	for( size_t i=0 ; i<runs.size() ; i++ )
+	{
+		int s = runs[i].first;
+		_writeBits( codeLengthCodes[s] , codeLengthLengths[s] );
+		if     ( s==16 ) _writeBits( runs[i].second , 2 );
+		else if( s==17 ) _writeBits( runs[i].second , 3 );
+		else if( s==18 ) _writeBits( runs[i].second , 7 );
+	}
+
+	// The block data
+	for( size_t i=0 ; i<_tokens.size() ; i++ )
+	{
+		if( _tokens[i].second )
+		{
+			int length = _tokens[i].first , distance = _tokens[i].second;
+			int ls = LengthSymbol( length ) , ds = DistanceSymbol( distance );
+			_writeBits( literalCodes[257+ls] , literalLengths[257+ls] );
+			_writeBits( length - LengthBase[ls] , LengthExtra[ls] );
+			_writeBits( distanceCodes[ds] , distanceLengths[ds] );
+			_writeBits( distance - DistanceBase[ds] , DistanceExtra[ds] );
+		}
+		else _writeBits( literalCodes[ _tokens[i].first ] , literalLengths[ _tokens[i].first ] );
+	}
+	_writeBits( literalCodes[256] , literalLengths[256] );
+}
+
+void Deflater::_writeBits( unsigned int bits , int count )
+{
+	_bitBuffer |= (unsigned long long)bits << _bitCount;
+	_bitCount += count;
+	while( _bitCount>=8 )
+	{
+		_out.push_back( (unsigned char)( _bitBuffer & 0xff ) );
+		_bitBuffer >>= 8;
+		_bitCount -= 8;
+	}
+}
+
+void Deflater::_flush( bool align )
+{
+	if( align && _bitCount ) _writeBits( 0 , 8-_bitCount );
+	if( _out.size() ) _sink( &_out[0] , _out.size() );
+	_out.resize( 0 );
+}
+
+//////////////
+// Inflater //
+//////////////
+bool Inflater::Code::set( const unsigned char *lengths , int symbolCount )
+{
+	memset( counts , 0 , sizeof(counts) );
+	memset( table , 0 , sizeof(table) );
+	for( int i=0 ; i<symbolCount ; i++ ) counts[ lengths[i] ]++;
+	counts[0] = 0;
+
+	// Reject over-subscribed codes
+	int left = 1;
+	for( int l=1 ; l<16 ; l++ )
+	{
+		left = ( left<<1 ) - counts[l];
+		if( left<0 ) return false;
+	}
+
+	int offsets[16] , next[16] , code = 0;
+	offsets[1] = 0;
+	for( int l=1 ; l<15 ; l++ ) offsets[l+1] = offsets[l] + counts[l];
+	for( int l=1 ; l<16 ; l++ ) code = ( code + counts[l-1] )<<1 , next[l] = code;
+	for( int i=0 ; i<symbolCount ; i++ ) if( lengths[i] )
+	{
+		int l = lengths[i];
+		symbols[ offsets[l]++ ] = (unsigned short)i;
+		if( l<=TableBits )
+		{
+			unsigned int r = ReverseBits( next[l] , l );
+			for( unsigned int fill=r ; fill<(1u<<TableBits) ; fill+=(1u<<l) ) table[fill] = (unsigned short)( ( i<<4 ) | l );
+		}
+		next[l]++;
+	}
+	return true;
+}
+
+Inflater::Inflater( std::function< size_t ( unsigned char * , size_t ) > source ) : _source(source) , _inPos(0) , _inSize(0) , _bitBuffer(0) , _bitCount(0) , _padding(0) , _outCount(0) , _state(HEADER) , _final(false) , _storedRemaining(0) , _copyLength(0) , _copyDistance(0) , _adler(1)
+{
+	_in.resize( 1<<16 );
+	_window.resize( WindowSize );
+}
+
+void Inflater::_need( int count )
+{
+	while( _bitCount<count )
+	{
+		if( _inPos==_inSize && !_padding )
+		{
+			_inSize = _source( &_in[0] , _in.size() );
+			_inPos = 0;
+		}
+		// Past the end of the input, zero bytes are appended so that the decoder can look ahead; consuming them is an error
+		unsigned long long b = 0;
+		if( _inPos<_inSize ) b = _in[_inPos++];
+		else _padding++;
+		_bitBuffer |= b << _bitCount;
+		_bitCount += 8;
+	}
+}
+
+unsigned int Inflater::_bits( int count )
+{
+	if( !count ) return 0;
+	_need( count );
+	unsigned int b = (unsigned int)( _bitBuffer & ( ( 1ull<<count )-1 ) );
+	_bitBuffer >>= count;
+	_bitCount -= count;
+	if( _bitCount<8*_padding ) THROW( "Truncated zlib stream" );
+	return b;
+}
+
+int Inflater::_decode( const Code &code )
+{
+	_need( 15 );
+	unsigned short entry = code.table[ _bitBuffer & ( (1<<Code::TableBits)-1 ) ];
+	if( entry )
+	{
+		_bits( entry & 15 );
+		return entry>>4;
+	}
+
+	// Codes longer than the table are decoded a bit at a time (as in zlib's puff)
+	int c = 0 , first = 0 , index = 0;
+	for( int l=1 ; l<16 ; l++ )
+	{
+		c |= ( _bitBuffer>>(l-1) ) & 1;
+		int count = code.counts[l];
+		if( c-first<count )
+		{
+			_bits( l );
+			return code.symbols[ index + c - first ];
+		}
+		index += count;
+		first = ( first + count )<<1;
+		c <<= 1;
+	}
+	THROW( "Invalid Huffman code in zlib stream" );
+	return -1;
+}
+
+void Inflater::_readBlockHeader( void )
+{
+	_final = _bits( 1 )!=0;
+	int type = _bits( 2 );
+	if( type==0 )
+	{
+		_bits( _bitCount & 7 );
+		unsigned int length = _bits( 16 ) , nLength = _bits( 16 );
+		if( ( length ^ 0xffff )!=nLength ) THROW( "Corrupt stored block in zlib stream" );
+		_storedRemaining = length;
+		_state = STORED;
+	}
+	else if( type==1 )
+	{
+		unsigned char lengths[288];
+		for( int i=0 ; i<144 ; i++ ) lengths[i] = 8;
+		for( int i=144 ; i<256 ; i++ ) lengths[i] = 9;
+		for( int i=256 ; i<280 ; i++ ) lengths[i] = 7;
+		for( int i=280 ; i<288 ; i++ ) lengths[i] = 8;
+		_literals.set( lengths , 288 );
+		for( int i=0 ; i<30 ; i++ ) lengths[i] = 5;
+		_distances.set( lengths , 30 );
+		_state = HUFFMAN;
+	}
+	else if( type==2 )
+	{
+		int literalCount = _bits( 5 ) + 257 , distanceCount = _bits( 5 ) + 1 , codeLengthCount = _bits( 4 ) + 4;
+		if( literalCount>286 || distanceCount>30 ) THROW( "Bad code counts in zlib stream: %d %d" , literalCount , distanceCount );
+		unsigned char lengths[ 286+30 ] = { 0 };
+		for( int i=0 ; i<codeLengthCount ; i++ ) lengths[ CodeLengthOrder[i] ] = (unsigned char)_bits( 3 );
+		Code codeLengths;
+		if( !codeLengths.set( lengths , 19 ) ) THROW( "Bad code-length code in zlib stream" );
+
+		int count = literalCount + distanceCount;
+		for( int i=0 ; i<count ; )
+		{
+			int s = _decode( codeLengths );
+			if( s<16 ){ lengths[i++] = (unsigned char)s ; continue; }
+			int repeat , value = 0;
+			if( s==16 )
+			{
+				if( !i ) THROW( "Repeat with no previous length in zlib stream" );
+				value = lengths[i-1] , repeat = 3 + _bits( 2 );
+			}
+			else if( s==17 ) repeat = 3 + _bits( 3 );
+			else             repeat = 11 + _bits( 7 );
+			if( i+repeat>count ) THROW( "Too many code lengths in zlib stream" );
+			while( repeat-- ) lengths[i++] = (unsigned char)value;
+		}
+		if( !lengths[256] ) THROW( "Missing end-of-block code in zlib stream" );
+		if( !_literals.set( lengths , literalCount ) || !_distances.set( lengths+literalCount , distanceCount ) ) THROW( "Bad Huffman code in zlib stream" );
+		_state = HUFFMAN;
+	}
+	else THROW( "Invalid block type in zlib stream" );
+}
+
+void Inflater::_readTrailer( void )
+{
+	_bits( _bitCount & 7 );
+	unsigned int adler = 0;
+	for( int i=0 ; i<4 ; i++ ) adler = ( adler<<8 ) | _bits( 8 );
+	if( adler!=_adler ) THROW( "Checksum mismatch in zlib stream" );
+}
+
+size_t Inflater::read( void *buffer , size_t size )
+{
+	unsigned char *out = (unsigned char *)buffer;
+	size_t count = 0;
+	auto Output = [&]( unsigned char b )
+	{
+		out[count++] = b;
+		_window[ _outCount & (WindowSize-1) ] = b;
+		_outCount++;
+	};
+
+	while( count<size && _state!=DONE )
+	{
+		switch( _state )
+		{
+		case HEADER:
+		{
+			unsigned int cmf = _bits( 8 ) , flg = _bits( 8 );
+			if( ( cmf & 15 )!=8 || ( cmf>>4 )>7 || ( cmf*256+flg )%31 || ( flg & 32 ) ) THROW( "Bad zlib header: %02x %02x" , cmf , flg );
+			_state = BLOCK;
+			break;
+		}
+		case BLOCK:
+			if( _final )
+			{
+				// The trailer holds the checksum of everything output, including the bytes of this call
+				_adler = Adler32( out , count , _adler );
+				_readTrailer();
+				_state = DONE;
+				return count;
+			}
+			_readBlockHeader();
+			break;
+		case STORED:
+			while( _storedRemaining && count<size ) Output( (unsigned char)_bits( 8 ) ) , _storedRemaining--;
+			if( !_storedRemaining ) _state = BLOCK;
+			break;
+		case HUFFMAN:
+			while( count<size )
+			{
+				if( _copyLength )
+				{
+					while( _copyLength && count<size ) Output( _window[ ( _outCount-_copyDistance ) & (WindowSize-1) ] ) , _copyLength--;
+					continue;
+				}
+				int s = _decode( _literals );
+				if( s<256 ) Output( (unsigned char)s );
+				else if( s==256 ){ _state = BLOCK ; break; }
+				else
+				{
+					s -= 257;
+					if( s>=29 ) THROW( "Invalid length symbol in zlib stream: %d" , s+257 );
+					_copyLength = LengthBase[s] + _bits( LengthExtra[s] );
+					int d = _decode( _distances );
+					if( d>=30 ) THROW( "Invalid distance symbol in zlib stream: %d" , d );
+					_copyDistance = DistanceBase[d] + _bits( DistanceExtra[d] );
+					if( _copyDistance>_outCount ) THROW( "Distance too far back in zlib stream: %u" , _copyDistance );
+				}
+			}
+			break;
+		case DONE:
+			break;
+		}
+	}
+	_adler = Adler32( out , count , _adler );
+	return count;
+}
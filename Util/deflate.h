@@ -0,0 +1,144 @@
+#ifndef DEFLATE_INCLUDED
+#define DEFLATE_INCLUDED
+
+#include <vector>
+#include <functional>
+
+namespace Util
+{
+	/** This function returns the CRC-32 (as used by PNG and gzip) of the data, continuing the CRC of the data preceding it */
+	unsigned int CRC32( const unsigned char *data , size_t size , unsigned int crc=0 );
+
+	/** This function returns the Adler-32 checksum (as used by zlib) of the data, continuing the checksum of the data preceding it */
+	unsigned int Adler32( const unsigned char *data , size_t size , unsigned int adler=1 );
+
+	/** This class compresses a stream of bytes into the zlib format (RFC 1950 and 1951).
+	*** The input is buffered into blocks, which are compressed with hash-chained LZ77 matching and dynamic Huffman codes,
+	*** and the compressed bytes are handed to the sink as each block is finished. */
+	class Deflater
+	{
+		/** The function receiving the compressed bytes */
+		std::function< void ( const unsigned char * , size_t ) > _sink;
+
+		/** The maximum number of positions searched for a match */
+		int _maxChain;
+
+		/** The uncompressed data: the 32K window already compressed, followed by the pending input */
+		std::vector< unsigned char > _data;
+
+		/** The number of bytes at the start of the data that are only used as matching history */
+		size_t _history;
+
+		/** The most recent position (plus one) with a given hash, and the previous position (plus one) with the same hash as a given position */
+		std::vector< unsigned int > _head , _previous;
+
+		/** The (literal/length,distance) pairs of the current block, with a distance of zero for a literal */
+		std::vector< std::pair< unsigned short , unsigned short > > _tokens;
+
+		/** The compressed bytes that have not been handed to the sink, and the bits that do not fill a byte */
+		std::vector< unsigned char > _out;
+		unsigned long long _bitBuffer;
+		int _bitCount;
+
+		/** The checksum of the uncompressed data */
+		unsigned int _adler;
+
+		/** Has the stream been finished? */
+		bool _finished;
+	public:
+		/** The constructor takes the sink, called as sink( data , size ), and the compression level in the range [1,9] */
+		Deflater( std::function< void ( const unsigned char * , size_t ) > sink , int level=6 );
+
+		/** This method compresses the data */
+		void write( const void *data , size_t size );
+
+		/** This method compresses the pending data and writes out the end of the stream */
+		void finish( void );
+	private:
+		/** This method finds the matches in the pending data and writes it out as a compressed block */
+		void _compressBlock( bool final );
+
+		/** This method writes the Huffman-coded block of the tokens */
+		void _writeBlock( bool final );
+
+		/** This method appends the bits (least significant first) to the output */
+		void _writeBits( unsigned int bits , int count );
+
+		/** This method pads the output to a byte boundary and hands it to the sink */
+		void _flush( bool align );
+	};
+
+	/** This class decompresses a zlib stream (RFC 1950 and 1951), pulling the compressed bytes from a source as they are needed,
+	*** so that the uncompressed data can be read in pieces of any size. */
+	class Inflater
+	{
+	public:
+		/** This class represents a canonical Huffman code, decoded through a table indexed by the next few bits of the stream */
+		struct Code
+		{
+			/** The number of bits indexing the table */
+			static const int TableBits = 10;
+
+			/** The table entries, holding the symbol (in the high bits) and the code length (in the low four), or zero for longer codes */
+			unsigned short table[ 1<<TableBits ];
+
+			/** The number of codes of each length, and the symbols ordered by code */
+			unsigned short counts[16] , symbols[320];
+
+			/** This method sets the code from the lengths of the symbols' codes, returning false if the lengths do not describe a valid code */
+			bool set( const unsigned char *lengths , int symbolCount );
+		};
+	private:
+		/** The function providing the compressed bytes */
+		std::function< size_t ( unsigned char * , size_t ) > _source;
+
+		/** The compressed bytes pulled from the source and the next one to be read */
+		std::vector< unsigned char > _in;
+		size_t _inPos , _inSize;
+
+		/** The bits read from the input and not yet consumed, and the number of zero bytes appended past the end of the input */
+		unsigned long long _bitBuffer;
+		int _bitCount , _padding;
+
+		/** The last 32K bytes of output, and the total number of bytes output */
+		std::vector< unsigned char > _window;
+		size_t _outCount;
+
+		/** The state of the decoder */
+		enum { HEADER , BLOCK , STORED , HUFFMAN , DONE } _state;
+		bool _final;
+		unsigned int _storedRemaining;
+
+		/** The length and distance of the match being copied */
+		unsigned int _copyLength , _copyDistance;
+
+		/** The codes of the current Huffman block */
+		Code _literals , _distances;
+
+		/** The checksum of the uncompressed data */
+		unsigned int _adler;
+	public:
+		/** The constructor takes the source, called as source( buffer , size ), which returns the number of bytes (at most size) it wrote, and zero at the end of the data */
+		Inflater( std::function< size_t ( unsigned char * , size_t ) > source );
+
+		/** This method decompresses the next bytes into the buffer, returning the number of bytes written, which is only smaller than the size at the end of the stream.
+		*** An exception is thrown if the stream is corrupt. */
+		size_t read( void *buffer , size_t size );
+	private:
+		/** This method makes sure the bit buffer holds at least the prescribed number of bits (at most 57) */
+		void _need( int count );
+
+		/** This method consumes and returns the prescribed number of bits */
+		unsigned int _bits( int count );
+
+		/** This method decodes the next symbol of the code */
+		int _decode( const Code &code );
+
+		/** This method reads the header of a block */
+		void _readBlockHeader( void );
+
+		/** This method reads the end of the stream and checks its checksum */
+		void _readTrailer( void );
+	};
+}
+#endif // DEFLATE_INCLUDED
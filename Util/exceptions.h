@@ -41,8 +41,10 @@ namespace Util
 #ifdef VERBOSE_MESSAGING
 	inline char *MakeMessageString( const char *header , const char *fileName , int line , const char *functionName , const char *format , ... )
 	{
-		va_list args;
+		va_list args , _args;
 		va_start( args , format );
+		// The arguments are traversed twice, once to size the message and once to format it
+		va_copy( _args , args );
 
 		// Formatting is:
 		// <header> <filename> (Line <line>)
@@ -63,7 +65,8 @@ namespace Util
 
 		// Line 3
 		size += strlen(header)+1;
-		size += vsnprintf( NULL , 0 , format , args );
+		size += vsnprintf( NULL , 0 , format , _args );
+		va_end( _args );
 
 		char *_buffer , *buffer = new char[ size+1 ];
 		_size = size , _buffer = buffer;
@@ -96,6 +99,7 @@ namespace Util
 		_size -= strlen(header)+1;
 
 		vsnprintf( _buffer , _size+1 , format , args );
+		va_end( args );
 
 		return buffer;
 	}
@@ -133,10 +137,13 @@ namespace Util
 #else // !VERBOSE_MESSAGING
 	inline char *MakeMessageString( const char *header , const char *functionName , const char *format , ... )
 	{
-		va_list args;
+		va_list args , _args;
 		va_start( args , format );
+		// The arguments are traversed twice, once to size the message and once to format it
+		va_copy( _args , args );
 
-		size_t _size , size = vsnprintf( NULL , 0 , format , args );
+		size_t _size , size = vsnprintf( NULL , 0 , format , _args );
+		va_end( _args );
 		size += strlen(header)+1;
 		size += strlen(functionName)+2;
 
@@ -152,6 +159,7 @@ namespace Util
 		_size -= strlen(functionName)+2;
 
 		vsnprintf( _buffer , _size+1 , format , args );
+		va_end( args );
 
 		return buffer;
 	}
@@ -0,0 +1,124 @@
+#include <math.h>
+#include <algorithm>
+#include "exceptions.h"
+#include "parallel.h"
+#include "geometry.h"
+#include "fft.h"
+
+using namespace Util;
+
+/////////
+// FFT //
+/////////
+FFT::FFT( int size ) : _size(size)
+{
+	if( size<=0 || ( size & (size-1) ) ) THROW( "FFT size must be a power of two: %d" , size );
+
+	_twiddles.resize( size/2 );
+	for( int k=0 ; k<size/2 ; k++ )
+	{
+		double theta = -2. * Pi * k / size;
+		_twiddles[k] = std::complex< float >( (float)cos( theta ) , (float)sin( theta ) );
+	}
+
+	int bits = 0;
+	while( (1<<bits)<size ) bits++;
+	_reversed.resize( size );
+	for( int i=0 ; i<size ; i++ )
+	{
+		int r = 0;
+		for( int b=0 ; b<bits ; b++ ) if( i & (1<<b) ) r |= 1<<(bits-1-b);
+		_reversed[i] = r;
+	}
+}
+
+int FFT::size( void ) const { return _size; }
+
+int FFT::PowerOfTwo( int size )
+{
+	int p = 1;
+	while( p<size ) p <<= 1;
+	return p;
+}
+
+void FFT::forward( std::complex< float > *data ) const { _transform( data , false ); }
+
+void FFT::inverse( std::complex< float > *data ) const { _transform( data , true ); }
+
+void FFT::_transform( std::complex< float > *data , bool inverse ) const
+{
+	for( int i=0 ; i<_size ; i++ ) if( i<_reversed[i] ) std::swap( data[i] , data[ _reversed[i] ] );
+
+	// Iterative decimation-in-time butterflies, with the twiddle factors for a span of length "len" taken with stride size/len
+	for( int len=2 ; len<=_size ; len<<=1 )
+	{
+		int half = len>>1 , stride = _size / len;
+		for( int start=0 ; start<_size ; start+=len )
+		{
+			std::complex< float > *a = data + start , *b = data + start + half;
+			for( int k=0 ; k<half ; k++ )
+			{
+				std::complex< float > w = _twiddles[ k*stride ];
+				if( inverse ) w = std::conj( w );
+				float re = b[k].real() * w.real() - b[k].imag() * w.imag();
+				float im = b[k].real() * w.imag() + b[k].imag() * w.real();
+				std::complex< float > t( re , im );
+				b[k] = a[k] - t;
+				a[k] = a[k] + t;
+			}
+		}
+	}
+}
+
+///////////
+// FFT2D //
+///////////
+FFT2D::FFT2D( int width , int height ) : _rows(width) , _columns(height) {}
+
+int FFT2D::width( void ) const { return _rows.size(); }
+
+int FFT2D::height( void ) const { return _columns.size(); }
+
+void FFT2D::forward( std::complex< float > *data , bool parallel ) const { _transform( data , false , parallel ); }
+
+void FFT2D::inverse( std::complex< float > *data , bool parallel ) const
+{
+	_transform( data , true , parallel );
+	const float scale = 1.f / ( (float)width() * height() );
+	for( size_t i=0 ; i<(size_t)width()*height() ; i++ ) data[i] *= scale;
+}
+
+void FFT2D::_transform( std::complex< float > *data , bool inverse , bool parallel ) const
+{
+	const int w = width() , h = height();
+	const int BlockSize = std::min< int >( 8 , w );
+
+	auto TransformRow = [&]( unsigned int , size_t j )
+	{
+		if( inverse ) _rows.inverse( data + j*w );
+		else          _rows.forward( data + j*w );
+	};
+
+	// Gather a block of columns into contiguous memory, transform each column, and scatter them back
+	auto TransformColumns = [&]( size_t block )
+	{
+		std::vector< std::complex< float > > scratch( (size_t)BlockSize*h );
+		int x0 = (int)block * BlockSize;
+		for( int y=0 ; y<h ; y++ ) for( int x=0 ; x<BlockSize ; x++ ) scratch[ (size_t)x*h+y ] = data[ (size_t)y*w + x0+x ];
+		for( int x=0 ; x<BlockSize ; x++ )
+			if( inverse ) _columns.inverse( &scratch[ (size_t)x*h ] );
+			else          _columns.forward( &scratch[ (size_t)x*h ] );
+		for( int y=0 ; y<h ; y++ ) for( int x=0 ; x<BlockSize ; x++ ) data[ (size_t)y*w + x0+x ] = scratch[ (size_t)x*h+y ];
+	};
+
+	if( parallel )
+	{
+		ParallelFor( 0 , h , TransformRow , 16 );
+		ParallelFor( 0 , w/BlockSize , [&]( unsigned int , size_t block ){ TransformColumns( block ); } );
+	}
+	else
+	{
+		for( int j=0 ; j<h ; j++ ) TransformRow( 0 , j );
+		for( int b=0 ; b<w/BlockSize ; b++ ) TransformColumns( b );
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef FFT_INCLUDED
+#define FFT_INCLUDED
+
+#include <complex>
+#include <vector>
+
+namespace Util
+{
+	/** This class represents a plan for computing one-dimensional, power-of-two sized, complex FFTs.
+	*** The twiddle factors and bit-reversal permutation are computed once, so a plan can be shared (read-only) across threads. */
+	class FFT
+	{
+		/** The size of the transform */
+		int _size;
+
+		/** The twiddle factors, exp( -2 pi i k / size ) for k in [0,size/2) */
+		std::vector< std::complex< float > > _twiddles;
+
+		/** The bit-reversal permutation */
+		std::vector< int > _reversed;
+	public:
+		/** The constructor creates a plan for transforms of the prescribed size.
+		*** An exception is thrown if the size is not a power of two. */
+		FFT( int size );
+
+		/** This method returns the size of the transform */
+		int size( void ) const;
+
+		/** This method computes the (in-place) forward transform */
+		void forward( std::complex< float > *data ) const;
+
+		/** This method computes the (in-place) inverse transform, without the 1/size normalization */
+		void inverse( std::complex< float > *data ) const;
+
+		/** This static method returns the smallest power of two that is greater than or equal to the input */
+		static int PowerOfTwo( int size );
+	private:
+		/** This method performs the radix-2 butterflies, conjugating the twiddle factors for the inverse transform */
+		void _transform( std::complex< float > *data , bool inverse ) const;
+	};
+
+	/** This class represents a plan for computing two-dimensional, power-of-two sized, complex FFTs on row-major data.
+	*** Rows are transformed in place, and columns are transformed in cache-sized blocks gathered into contiguous scratch memory. */
+	class FFT2D
+	{
+		/** The plans for the rows and columns */
+		FFT _rows , _columns;
+	public:
+		/** The constructor creates a plan for transforms of the prescribed dimensions */
+		FFT2D( int width , int height );
+
+		/** This method returns the width of the transform */
+		int width( void ) const;
+
+		/** This method returns the height of the transform */
+		int height( void ) const;
+
+		/** This method computes the (in-place) forward transform.
+		*** If the parallel flag is set, the rows and column blocks are distributed over the threads. */
+		void forward( std::complex< float > *data , bool parallel=true ) const;
+
+		/** This method computes the (in-place) inverse transform, including the 1/(width*height) normalization.
+		*** If the parallel flag is set, the rows and column blocks are distributed over the threads. */
+		void inverse( std::complex< float > *data , bool parallel=true ) const;
+	private:
+		/** This method transforms the rows and then the columns */
+		void _transform( std::complex< float > *data , bool inverse , bool parallel ) const;
+	};
+}
+#endif // FFT_INCLUDED
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "exceptions.h"
+#include "hash.h"
+
+using namespace Util;
+
+namespace
+{
+	const unsigned int _RoundConstants[] =
+	{
+		0x428a2f98 , 0x71374491 , 0xb5c0fbcf , 0xe9b5dba5 , 0x3956c25b , 0x59f111f1 , 0x923f82a4 , 0xab1c5ed5 ,
+		0xd807aa98 , 0x12835b01 , 0x243185be , 0x550c7dc3 , 0x72be5d74 , 0x80deb1fe , 0x9bdc06a7 , 0xc19bf174 ,
+		0xe49b69c1 , 0xefbe4786 , 0x0fc19dc6 , 0x240ca1cc , 0x2de92c6f , 0x4a7484aa , 0x5cb0a9dc , 0x76f988da ,
+		0x983e5152 , 0xa831c66d , 0xb00327c8 , 0xbf597fc7 , 0xc6e00bf3 , 0xd5a79147 , 0x06ca6351 , 0x14292967 ,
+		0x27b70a85 , 0x2e1b2138 , 0x4d2c6dfc , 0x53380d13 , 0x650a7354 , 0x766a0abb , 0x81c2c92e , 0x92722c85 ,
+		0xa2bfe8a1 , 0xa81a664b , 0xc24b8b70 , 0xc76c51a3 , 0xd192e819 , 0xd6990624 , 0xf40e3585 , 0x106aa070 ,
+		0x19a4c116 , 0x1e376c08 , 0x2748774c , 0x34b0bcb5 , 0x391c0cb3 , 0x4ed8aa4a , 0x5b9cca4f , 0x682e6ff3 ,
+		0x748f82ee , 0x78a5636f , 0x84c87814 , 0x8cc70208 , 0x90befffa , 0xa4506ceb , 0xbef9a3f7 , 0xc67178f2
+	};
+
+	inline unsigned int _Rotate( unsigned int x , int n ){ return ( x>>n ) | ( x<<(32-n) ); }
+}
+
+////////////
+// SHA256 //
+////////////
+SHA256::SHA256( void ) : _blockSize(0) , _length(0)
+{
+	const unsigned int state[] = { 0x6a09e667 , 0xbb67ae85 , 0x3c6ef372 , 0xa54ff53a , 0x510e527f , 0x9b05688c , 0x1f83d9ab , 0x5be0cd19 };
+	memcpy( _state , state , sizeof(_state) );
+}
+
+void SHA256::_compress( const unsigned char *block )
+{
+	unsigned int w[64];
+	for( int i=0 ; i<16 ; i++ ) w[i] = ( (unsigned int)block[4*i]<<24 ) | ( (unsigned int)block[4*i+1]<<16 ) | ( (unsigned int)block[4*i+2]<<8 ) | block[4*i+3];
+	for( int i=16 ; i<64 ; i++ )
+	{
+		unsigned int s0 = _Rotate( w[i-15] , 7 ) ^ _Rotate( w[i-15] , 18 ) ^ ( w[i-15]>>3 );
+		unsigned int s1 = _Rotate( w[i-2] , 17 ) ^ _Rotate( w[i-2] , 19 ) ^ ( w[i-2]>>10 );
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+	unsigned int a = _state[0] , b = _state[1] , c = _state[2] , d = _state[3] , e = _state[4] , f = _state[5] , g = _state[6] , h = _state[7];
+	for( int i=0 ; i<64 ; i++ )
+	{
+		unsigned int t1 = h + ( _Rotate( e , 6 ) ^ _Rotate( e , 11 ) ^ _Rotate( e , 25 ) ) + ( ( e & f ) ^ ( ~e & g ) ) + _RoundConstants[i] + w[i];
+		unsigned int t2 = ( _Rotate( a , 2 ) ^ _Rotate( a , 13 ) ^ _Rotate( a , 22 ) ) + ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+		h = g , g = f , f = e , e = d + t1 , d = c , c = b , b = a , a = t1 + t2;
+	}
+	_state[0] += a , _state[1] += b , _state[2] += c , _state[3] += d , _state[4] += e , _state[5] += f , _state[6] += g , _state[7] += h;
+}
+
+void SHA256::update( const void *data , size_t size )
+{
+	const unsigned char *bytes = (const unsigned char *)data;
+	_length += size;
+	if( _blockSize )
+	{
+		size_t count = std::min< size_t >( size , 64-_blockSize );
+		memcpy( _block+_blockSize , bytes , count );
+		_blockSize += count , bytes += count , size -= count;
+		if( _blockSize<64 ) return;
+		_compress( _block );
+		_blockSize = 0;
+	}
+	for( ; size>=64 ; bytes+=64 , size-=64 ) _compress( bytes );
+	memcpy( _block , bytes , size );
+	_blockSize = size;
+}
+
+std::string SHA256::digest( void )
+{
+	// Pad with a one bit, zeros, and the length in bits, to a whole number of blocks
+	unsigned long long bits = _length * 8;
+	unsigned char padding[72] = { 0x80 };
+	size_t count = ( _blockSize<56 ? 56 : 120 ) - _blockSize;
+	for( int i=0 ; i<8 ; i++ ) padding[count+i] = (unsigned char)( bits>>( 56-8*i ) );
+	update( padding , count+8 );
+
+	static const char hex[] = "0123456789abcdef";
+	std::string digest;
+	for( int i=0 ; i<8 ; i++ ) for( int j=28 ; j>=0 ; j-=4 ) digest += hex[ ( _state[i]>>j ) & 15 ];
+	return digest;
+}
+
+std::string SHA256::Digest( const void *data , size_t size )
+{
+	SHA256 sha;
+	sha.update( data , size );
+	return sha.digest();
+}
+
+std::string SHA256::FileDigest( std::string fileName )
+{
+	FILE *fp = fopen( fileName.c_str() , "rb" );
+	if( !fp ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
+	SHA256 sha;
+	std::vector< unsigned char > buffer( 1<<16 );
+	size_t size;
+	while( ( size=fread( &buffer[0] , 1 , buffer.size() , fp ) )>0 ) sha.update( &buffer[0] , size );
+	bool failed = ferror( fp )!=0;
+	fclose( fp );
+	if( failed ) THROW( "Failed to read file: %s" , fileName.c_str() );
+	return sha.digest();
+}
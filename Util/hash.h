@@ -0,0 +1,44 @@
+#ifndef HASH_INCLUDED
+#define HASH_INCLUDED
+
+#include <stddef.h>
+#include <string>
+
+namespace Util
+{
+	/** This class computes the SHA-256 digest of a stream of bytes, fed to it in pieces of any size */
+	class SHA256
+	{
+		/** The hash state */
+		unsigned int _state[8];
+
+		/** The bytes of the current (incomplete) block and their number */
+		unsigned char _block[64];
+		size_t _blockSize;
+
+		/** The total number of bytes */
+		unsigned long long _length;
+
+		/** This method folds a complete block into the hash state */
+		void _compress( const unsigned char *block );
+	public:
+		/** The constructor starts an empty stream */
+		SHA256( void );
+
+		/** This method appends the bytes to the stream */
+		void update( const void *data , size_t size );
+
+		/** This method appends the characters of the string to the stream */
+		void update( const std::string &str ){ update( str.data() , str.size() ); }
+
+		/** This method returns the digest of the stream, as 64 hexadecimal digits. No more bytes can be appended afterwards. */
+		std::string digest( void );
+
+		/** This static method returns the digest of the bytes */
+		static std::string Digest( const void *data , size_t size );
+
+		/** This static method returns the digest of the contents of the file. An exception is thrown if it cannot be read. */
+		static std::string FileDigest( std::string fileName );
+	};
+}
+#endif // HASH_INCLUDED
@@ -0,0 +1,261 @@
+#include <string.h>
+#include <errno.h>
+#ifndef WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#endif // WIN32
+#include <atomic>
+#include "exceptions.h"
+#include "ipc.h"
+
+using namespace Util;
+
+#ifdef WIN32
+/////////////////
+// LocalSocket //
+/////////////////
+LocalSocket::LocalSocket( int fd ) : _fd(fd) {}
+LocalSocket::LocalSocket( LocalSocket &&socket ) : _fd(socket._fd) { socket._fd = -1; }
+LocalSocket::~LocalSocket( void ){}
+LocalSocket &LocalSocket::operator = ( LocalSocket &&socket ){ std::swap( _fd , socket._fd ) ; return *this; }
+LocalSocket LocalSocket::Connect( std::string path ){ THROW( "Local sockets are not supported on Windows: %s" , path.c_str() ); }
+void LocalSocket::send( const void * , size_t , int ){ THROW( "Local sockets are not supported on Windows" ); }
+bool LocalSocket::receive( void * , size_t , int * ){ THROW( "Local sockets are not supported on Windows" ); }
+
+/////////////////
+// LocalServer //
+/////////////////
+LocalServer::LocalServer( std::string path ) : _fd(-1) , _path(path) { THROW( "Local sockets are not supported on Windows: %s" , path.c_str() ); }
+LocalServer::~LocalServer( void ){}
+LocalSocket LocalServer::accept( void ){ THROW( "Local sockets are not supported on Windows" ); }
+
+//////////////////
+// SharedMemory //
+//////////////////
+SharedMemory::SharedMemory( size_t size ) : _fd(-1) , _data(NULL) , _size(size) { THROW( "Shared memory descriptors are not supported on Windows" ); }
+SharedMemory::SharedMemory( int fd ) : _fd(fd) , _data(NULL) , _size(0) { THROW( "Shared memory descriptors are not supported on Windows" ); }
+SharedMemory::~SharedMemory( void ){}
+#else // !WIN32
+#ifdef MSG_NOSIGNAL
+static const int _SendFlags = MSG_NOSIGNAL;
+#else // !MSG_NOSIGNAL
+static const int _SendFlags = 0;
+#endif // MSG_NOSIGNAL
+
+/** This function fills in the address of the socket at the path */
+static void _SetAddress( const std::string &path , struct sockaddr_un &address )
+{
+	memset( &address , 0 , sizeof(address) );
+	address.sun_family = AF_UNIX;
+	if( path.size()>=sizeof(address.sun_path) ) THROW( "Socket path is too long: %s" , path.c_str() );
+	strcpy( address.sun_path , path.c_str() );
+}
+
+/////////////////
+// LocalSocket //
+/////////////////
+LocalSocket::LocalSocket( int fd ) : _fd(fd) {}
+
+LocalSocket::LocalSocket( LocalSocket &&socket ) : _fd(socket._fd) { socket._fd = -1; }
+
+LocalSocket::~LocalSocket( void ){ if( _fd>=0 ) close( _fd ); }
+
+LocalSocket &LocalSocket::operator = ( LocalSocket &&socket )
+{
+	std::swap( _fd , socket._fd );
+	return *this;
+}
+
+LocalSocket LocalSocket::Connect( std::string path )
+{
+	struct sockaddr_un address;
+	_SetAddress( path , address );
+	int fd = socket( AF_UNIX , SOCK_STREAM , 0 );
+	if( fd<0 ) THROW( "Failed to create socket: %s" , strerror( errno ) );
+	if( connect( fd , (struct sockaddr *)&address , sizeof(address) ) )
+	{
+		int error = errno;
+		close( fd );
+		THROW( "Failed to connect to %s: %s" , path.c_str() , strerror( error ) );
+	}
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt( fd , SOL_SOCKET , SO_NOSIGPIPE , &on , sizeof(on) );
+#endif // SO_NOSIGPIPE
+	return LocalSocket( fd );
+}
+
+void LocalSocket::send( const void *data , size_t size , int fd )
+{
+	const char *bytes = (const char *)data;
+	if( fd>=0 )
+	{
+		// The descriptor is sent as ancillary data with the first byte
+		if( !size ) THROW( "A descriptor must be sent with at least one byte" );
+		struct iovec iov;
+		iov.iov_base = (void *)bytes , iov.iov_len = 1;
+		union { struct cmsghdr header ; char buffer[ CMSG_SPACE( sizeof(int) ) ]; } control;
+		memset( &control , 0 , sizeof(control) );
+		struct msghdr message;
+		memset( &message , 0 , sizeof(message) );
+		message.msg_iov = &iov , message.msg_iovlen = 1;
+		message.msg_control = control.buffer , message.msg_controllen = sizeof(control.buffer);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR( &message );
+		cmsg->cmsg_level = SOL_SOCKET , cmsg->cmsg_type = SCM_RIGHTS , cmsg->cmsg_len = CMSG_LEN( sizeof(int) );
+		memcpy( CMSG_DATA( cmsg ) , &fd , sizeof(int) );
+		ssize_t sent;
+		while( ( sent=sendmsg( _fd , &message , _SendFlags ) )<0 && errno==EINTR ) ;
+		if( sent!=1 ) THROW( "Failed to send descriptor: %s" , strerror( errno ) );
+		bytes++ , size--;
+	}
+	while( size )
+	{
+		ssize_t sent = ::send( _fd , bytes , size , _SendFlags );
+		if( sent<0 && errno==EINTR ) continue;
+		if( sent<=0 ) THROW( "Failed to send: %s" , strerror( errno ) );
+		bytes += sent , size -= sent;
+	}
+}
+
+bool LocalSocket::receive( void *data , size_t size , int *fd )
+{
+	char *bytes = (char *)data;
+	size_t received = 0;
+	if( fd ) *fd = -1;
+	while( received<size )
+	{
+		union { struct cmsghdr header ; char buffer[ CMSG_SPACE( sizeof(int) ) ]; } control;
+		struct iovec iov;
+		iov.iov_base = bytes+received , iov.iov_len = size-received;
+		struct msghdr message;
+		memset( &message , 0 , sizeof(message) );
+		message.msg_iov = &iov , message.msg_iovlen = 1;
+		message.msg_control = control.buffer , message.msg_controllen = sizeof(control.buffer);
+		ssize_t r = recvmsg( _fd , &message , 0 );
+		if( r<0 && errno==EINTR ) continue;
+		if( r<0 ) THROW( "Failed to receive: %s" , strerror( errno ) );
+		if( r==0 )
+		{
+			if( !received ) return false;
+			THROW( "Connection closed after %zu of %zu bytes" , received , size );
+		}
+		for( struct cmsghdr *cmsg=CMSG_FIRSTHDR( &message ) ; cmsg ; cmsg=CMSG_NXTHDR( &message , cmsg ) )
+			if( cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SCM_RIGHTS )
+			{
+				int descriptor;
+				memcpy( &descriptor , CMSG_DATA( cmsg ) , sizeof(int) );
+				if( fd && *fd<0 ) *fd = descriptor;
+				else close( descriptor );
+			}
+		received += r;
+	}
+	return true;
+}
+
+/////////////////
+// LocalServer //
+/////////////////
+LocalServer::LocalServer( std::string path ) : _fd(-1) , _path(path)
+{
+	struct sockaddr_un address;
+	_SetAddress( path , address );
+
+	// Remove a socket file left behind by a server that is no longer running
+	struct stat info;
+	if( !stat( path.c_str() , &info ) && S_ISSOCK( info.st_mode ) )
+	{
+		int fd = socket( AF_UNIX , SOCK_STREAM , 0 );
+		bool running = fd>=0 && !connect( fd , (struct sockaddr *)&address , sizeof(address) );
+		if( fd>=0 ) close( fd );
+		if( running ) THROW( "A server is already listening at: %s" , path.c_str() );
+		unlink( path.c_str() );
+	}
+
+	_fd = socket( AF_UNIX , SOCK_STREAM , 0 );
+	if( _fd<0 ) THROW( "Failed to create socket: %s" , strerror( errno ) );
+	if( bind( _fd , (struct sockaddr *)&address , sizeof(address) ) || listen( _fd , 16 ) )
+	{
+		int error = errno;
+		close( _fd );
+		THROW( "Failed to listen at %s: %s" , path.c_str() , strerror( error ) );
+	}
+}
+
+LocalServer::~LocalServer( void )
+{
+	close( _fd );
+	unlink( _path.c_str() );
+}
+
+LocalSocket LocalServer::accept( void )
+{
+	int fd;
+	while( ( fd=::accept( _fd , NULL , NULL ) )<0 && errno==EINTR ) ;
+	if( fd<0 ) THROW( "Failed to accept connection: %s" , strerror( errno ) );
+#ifdef SO_NOSIGPIPE
+	int on = 1;
+	setsockopt( fd , SOL_SOCKET , SO_NOSIGPIPE , &on , sizeof(on) );
+#endif // SO_NOSIGPIPE
+	return LocalSocket( fd );
+}
+
+//////////////////
+// SharedMemory //
+//////////////////
+SharedMemory::SharedMemory( size_t size ) : _fd(-1) , _data(NULL) , _size(size)
+{
+	if( !size ) THROW( "Shared memory must not be empty" );
+#ifdef __linux__
+	_fd = memfd_create( "image" , MFD_CLOEXEC );
+#else // !__linux__
+	// Create a named object and remove the name at once, so that only the descriptor refers to it
+	static std::atomic< unsigned int > count( 0 );
+	std::string name = "/image." + std::to_string( (long long)getpid() ) + "." + std::to_string( (long long)count++ );
+	_fd = shm_open( name.c_str() , O_RDWR | O_CREAT | O_EXCL , 0600 );
+	if( _fd>=0 ) shm_unlink( name.c_str() );
+#endif // __linux__
+	if( _fd<0 ) THROW( "Failed to create shared memory: %s" , strerror( errno ) );
+	if( ftruncate( _fd , (off_t)size ) )
+	{
+		int error = errno;
+		close( _fd );
+		THROW( "Failed to size shared memory to %zu bytes: %s" , size , strerror( error ) );
+	}
+	_data = mmap( NULL , size , PROT_READ | PROT_WRITE , MAP_SHARED , _fd , 0 );
+	if( _data==MAP_FAILED )
+	{
+		int error = errno;
+		close( _fd );
+		THROW( "Failed to map shared memory: %s" , strerror( error ) );
+	}
+}
+
+SharedMemory::SharedMemory( int fd ) : _fd(fd) , _data(NULL) , _size(0)
+{
+	struct stat info;
+	if( fstat( _fd , &info ) || info.st_size<=0 )
+	{
+		close( _fd );
+		THROW( "Bad shared memory descriptor" );
+	}
+	_size = (size_t)info.st_size;
+	_data = mmap( NULL , _size , PROT_READ | PROT_WRITE , MAP_SHARED , _fd , 0 );
+	if( _data==MAP_FAILED )
+	{
+		int error = errno;
+		close( _fd );
+		THROW( "Failed to map shared memory: %s" , strerror( error ) );
+	}
+}
+
+SharedMemory::~SharedMemory( void )
+{
+	munmap( _data , _size );
+	close( _fd );
+}
+#endif // WIN32
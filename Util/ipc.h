@@ -0,0 +1,106 @@
+#ifndef IPC_INCLUDED
+#define IPC_INCLUDED
+
+#include <stddef.h>
+#include <string>
+
+namespace Util
+{
+	/** This class represents a connected local (Unix domain) stream socket, over which bytes and file descriptors are sent.
+	*** The socket is closed when the object is destroyed. Local sockets are not supported on Windows, where the methods throw. */
+	class LocalSocket
+	{
+		/** The descriptor of the socket */
+		int _fd;
+	public:
+		/** The constructor takes ownership of the descriptor of a connected socket */
+		LocalSocket( int fd=-1 );
+
+		/** The move constructor */
+		LocalSocket( LocalSocket &&socket );
+
+		/** The destructor closes the socket */
+		~LocalSocket( void );
+
+		/** The move assignment operator */
+		LocalSocket &operator = ( LocalSocket &&socket );
+
+		LocalSocket( const LocalSocket & ) = delete;
+		LocalSocket &operator = ( const LocalSocket & ) = delete;
+
+		/** This static method returns a socket connected to the server listening at the prescribed path */
+		static LocalSocket Connect( std::string path );
+
+		/** This method returns true if the object holds a socket */
+		bool valid( void ) const { return _fd>=0; }
+
+		/** This method sends the bytes, along with a copy of the file descriptor if it is non-negative (in which case size must be positive) */
+		void send( const void *data , size_t size , int fd=-1 );
+
+		/** This method receives the prescribed number of bytes. It returns false if the peer closed the connection before any byte was received,
+		*** and throws if it closed it part way. If fd is not NULL, it is set to the descriptor received with the bytes, or -1 if there was none. */
+		bool receive( void *data , size_t size , int *fd=NULL );
+	};
+
+	/** This class represents a server listening for connections on a local (Unix domain) socket.
+	*** The socket file is created by the constructor, replacing a stale one, and removed by the destructor. */
+	class LocalServer
+	{
+		/** The descriptor of the listening socket */
+		int _fd;
+
+		/** The path of the socket file */
+		std::string _path;
+	public:
+		/** The constructor starts listening at the prescribed path */
+		LocalServer( std::string path );
+
+		/** The destructor stops listening and removes the socket file */
+		~LocalServer( void );
+
+		LocalServer( const LocalServer & ) = delete;
+		LocalServer &operator = ( const LocalServer & ) = delete;
+
+		/** This method waits for a connection and returns the connected socket */
+		LocalSocket accept( void );
+	};
+
+	/** This class represents a block of memory that is shared between processes by passing its file descriptor over a LocalSocket.
+	*** The memory is unmapped and the descriptor closed when the object is destroyed. */
+	class SharedMemory
+	{
+		/** The descriptor of the memory */
+		int _fd;
+
+		/** The mapped memory */
+		void *_data;
+
+		/** The size of the memory, in bytes */
+		size_t _size;
+	public:
+		/** This constructor creates an anonymous block of memory of the prescribed (positive) size */
+		SharedMemory( size_t size );
+
+		/** This constructor takes ownership of the descriptor of a block of memory (received from another process) and maps it */
+		explicit SharedMemory( int fd );
+
+		/** The destructor unmaps the memory and closes the descriptor */
+		~SharedMemory( void );
+
+		SharedMemory( const SharedMemory & ) = delete;
+		SharedMemory &operator = ( const SharedMemory & ) = delete;
+
+		/** This method returns the descriptor of the memory */
+		int fd( void ) const { return _fd; }
+
+		/** This method returns a pointer to the memory */
+		void *data( void ){ return _data; }
+
+		/** This method returns a pointer to the memory */
+		const void *data( void ) const { return _data; }
+
+		/** This method returns the size of the memory, in bytes */
+		size_t size( void ) const { return _size; }
+	};
+}
+#endif // IPC_INCLUDED
@@ -0,0 +1,108 @@
+#ifndef PARALLEL_INCLUDED
+#define PARALLEL_INCLUDED
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+namespace Util
+{
+	/** This function returns a reference to the number of threads used by the parallel loops.
+	*** The value defaults to the hardware concurrency and can be overridden by the caller. */
+	inline unsigned int &ThreadCount( void )
+	{
+		static unsigned int threadCount = std::max< unsigned int >( 1 , std::thread::hardware_concurrency() );
+		return threadCount;
+	}
+
+	/** This templated function evaluates the functor for every index in the range [begin,end).
+	*** The range is split into blocks of the prescribed size that are handed out to the threads on demand.
+	*** The functor takes the index of the thread performing the evaluation (in the range [0,ThreadCount())) and the index being evaluated. */
+	template< typename Function >
+	void ParallelFor( size_t begin , size_t end , Function f , size_t blockSize=1 )
+	{
+		if( end<=begin ) return;
+		if( !blockSize ) blockSize = 1;
+		size_t blocks = ( end - begin + blockSize - 1 ) / blockSize;
+		unsigned int threads = (unsigned int)std::min< size_t >( ThreadCount() , blocks );
+
+		if( threads<=1 )
+		{
+			for( size_t i=begin ; i<end ; i++ ) f( 0 , i );
+			return;
+		}
+
+		std::atomic< size_t > nextBlock( 0 );
+		auto Worker = [&]( unsigned int t )
+		{
+			for( size_t b=nextBlock++ ; b<blocks ; b=nextBlock++ )
+			{
+				size_t _begin = begin + b*blockSize , _end = std::min< size_t >( _begin + blockSize , end );
+				for( size_t i=_begin ; i<_end ; i++ ) f( t , i );
+			}
+		};
+
+		std::vector< std::thread > workers;
+		workers.reserve( threads-1 );
+		for( unsigned int t=1 ; t<threads ; t++ ) workers.push_back( std::thread( Worker , t ) );
+		Worker( 0 );
+		for( unsigned int t=0 ; t<workers.size() ; t++ ) workers[t].join();
+	}
+
+	/** This templated class represents a first-in first-out queue, shared by threads, that holds at most the prescribed number of elements.
+	*** It connects the stages of a pipeline: pushing waits while the queue is full, and popping waits while it is empty and has not been closed. */
+	template< typename Data >
+	class BoundedQueue
+	{
+		/** The elements in the queue */
+		std::deque< Data > _data;
+
+		/** The maximum number of elements */
+		size_t _capacity;
+
+		/** Has the queue been closed */
+		bool _closed;
+
+		/** The lock guarding the queue and the conditions that the waiting threads are notified of */
+		std::mutex _mutex;
+		std::condition_variable _notFull , _notEmpty;
+	public:
+		/** The constructor creates an empty queue with the prescribed capacity (of at least one element) */
+		BoundedQueue( size_t capacity ) : _capacity( std::max< size_t >( capacity , 1 ) ) , _closed(false) {}
+
+		/** This method adds the element to the back of the queue, waiting until there is room */
+		void push( Data data )
+		{
+			std::unique_lock< std::mutex > lock( _mutex );
+			_notFull.wait( lock , [&]( void ){ return _data.size()<_capacity; } );
+			_data.push_back( std::move( data ) );
+			_notEmpty.notify_one();
+		}
+
+		/** This method removes the element at the front of the queue, waiting until there is one.
+		*** It returns false, without waiting, if the queue is empty and has been closed. */
+		bool pop( Data &data )
+		{
+			std::unique_lock< std::mutex > lock( _mutex );
+			_notEmpty.wait( lock , [&]( void ){ return _data.size() || _closed; } );
+			if( !_data.size() ) return false;
+			data = std::move( _data.front() );
+			_data.pop_front();
+			_notFull.notify_one();
+			return true;
+		}
+
+		/** This method closes the queue, indicating that no more elements will be pushed */
+		void close( void )
+		{
+			std::lock_guard< std::mutex > lock( _mutex );
+			_closed = true;
+			_notEmpty.notify_all();
+		}
+	};
+}
+#endif // PARALLEL_INCLUDED
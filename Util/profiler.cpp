@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <iomanip>
+#ifndef WIN32
+#include <sys/resource.h>
+#endif // WIN32
+#include "exceptions.h"
+#include "timer.h"
+#include "profiler.h"
+
+using namespace Util;
+
+std::atomic< bool > Profiler::_enabled( false );
+std::atomic< long long > Profiler::_allocated( 0 );
+
+namespace
+{
+	/** A timed scope */
+	struct _Event
+	{
+		const char *name , *category;
+		std::string detail;
+		unsigned int thread;
+		double start , duration;
+		long long peak;
+	};
+
+	/** A value of a counter (or of the tracked memory, if the name is NULL) */
+	struct _Sample
+	{
+		const char *name;
+		double time , value;
+	};
+
+	/** The data collected by the profiler, guarded by the lock */
+	struct _ProfilerState
+	{
+		std::mutex mutex;
+		Timer timer;
+		std::vector< _Event > events;
+		std::vector< _Sample > samples;
+		std::vector< ProfileScope * > open;
+		std::vector< std::pair< const char * , double > > counters;
+		std::unordered_map< std::thread::id , unsigned int > threads;
+		long long peak = 0;
+
+		/** This method returns the index of the calling thread, in the order in which the threads were first seen */
+		unsigned int thread( void )
+		{
+			auto iter = threads.find( std::this_thread::get_id() );
+			if( iter!=threads.end() ) return iter->second;
+			unsigned int index = (unsigned int)threads.size();
+			threads[ std::this_thread::get_id() ] = index;
+			return index;
+		}
+	};
+
+	_ProfilerState &_State( void )
+	{
+		static _ProfilerState state;
+		return state;
+	}
+
+	/** This function returns the string with the characters that cannot appear in a JSON string escaped */
+	std::string _Escape( const std::string &str )
+	{
+		std::string escaped;
+		for( char c : str )
+			if( c=='"' || c=='\\' ) escaped += '\\' , escaped += c;
+			else if( (unsigned char)c<0x20 ) escaped += ' ';
+			else escaped += c;
+		return escaped;
+	}
+
+	/** This function returns the peak resident memory of the process, in bytes, or zero if it is not available */
+	long long _PeakResident( void )
+	{
+#ifdef WIN32
+		return 0;
+#else // !WIN32
+		struct rusage usage;
+		if( getrusage( RUSAGE_SELF , &usage ) ) return 0;
+#ifdef __APPLE__
+		return (long long)usage.ru_maxrss;
+#else // !__APPLE__
+		return (long long)usage.ru_maxrss * 1024;
+#endif // __APPLE__
+#endif // WIN32
+	}
+}
+
+//////////////
+// Profiler //
+//////////////
+void Profiler::Enable( void )
+{
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	state.timer = Timer();
+	state.peak = _allocated;
+	state.thread();
+	_enabled = true;
+}
+
+void Profiler::Count( const char *name , double value )
+{
+	if( !_enabled ) return;
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	double total = value;
+	auto iter = std::find_if( state.counters.begin() , state.counters.end() , [&]( const std::pair< const char * , double > &c ){ return !strcmp( c.first , name ); } );
+	if( iter==state.counters.end() ) state.counters.push_back( std::make_pair( name , value ) );
+	else total = iter->second += value;
+	state.samples.push_back( _Sample{ name , state.timer.elapsed() , total } );
+}
+
+void Profiler::Allocate( long long bytes )
+{
+	long long allocated = _allocated += bytes;
+	if( !_enabled ) return;
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	state.peak = std::max< long long >( state.peak , allocated );
+	for( ProfileScope *scope : state.open ) scope->_peak = std::max< long long >( scope->_peak , allocated );
+	state.samples.push_back( _Sample{ NULL , state.timer.elapsed() , (double)allocated } );
+}
+
+void Profiler::Report( std::ostream &stream )
+{
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	double elapsed = state.timer.elapsed();
+
+	// Aggregate the scopes by category and name, in the order in which they were first entered
+	struct Stage
+	{
+		const char *name , *category;
+		size_t calls = 0;
+		double start = 0 , total = 0 , max = 0;
+		long long peak = 0;
+	};
+	std::vector< Stage > stages;
+	std::map< std::pair< std::string , std::string > , size_t > index;
+	for( const _Event &e : state.events )
+	{
+		auto key = std::make_pair( std::string( e.category ) , std::string( e.name ) );
+		auto iter = index.find( key );
+		if( iter==index.end() )
+		{
+			iter = index.insert( std::make_pair( key , stages.size() ) ).first;
+			stages.push_back( Stage() );
+			stages.back().name = e.name , stages.back().category = e.category , stages.back().start = e.start;
+		}
+		Stage &s = stages[ iter->second ];
+		s.calls++;
+		s.start = std::min< double >( s.start , e.start );
+		s.total += e.duration;
+		s.max = std::max< double >( s.max , e.duration );
+		s.peak = std::max< long long >( s.peak , e.peak );
+	}
+	std::stable_sort( stages.begin() , stages.end() , []( const Stage &s1 , const Stage &s2 ){ return s1.start<s2.start; } );
+
+	std::ios::fmtflags flags = stream.flags();
+	std::streamsize precision = stream.precision();
+	stream << std::fixed;
+	stream << "Profile: " << std::setprecision(3) << elapsed << " s on " << state.threads.size() << " thread(s)" << std::endl;
+	stream << "\t" << std::left << std::setw(10) << "category" << std::setw(24) << "stage" << std::right << std::setw(8) << "calls" << std::setw(12) << "total ms" << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << std::setw(9) << "share" << std::setw(12) << "peak MB" << std::endl;
+	for( const Stage &s : stages )
+	{
+		stream << "\t" << std::left << std::setw(10) << s.category << std::setw(24) << s.name << std::right << std::setw(8) << s.calls;
+		stream << std::setprecision(2) << std::setw(12) << s.total*1e3 << std::setw(12) << s.total*1e3/s.calls << std::setw(12) << s.max*1e3;
+		stream << std::setprecision(1) << std::setw(8) << ( elapsed>0 ? 100.*s.total/elapsed : 0. ) << "%";
+		stream << std::setprecision(2) << std::setw(12) << s.peak/1048576. << std::endl;
+	}
+	for( const auto &c : state.counters ) stream << "\t" << c.first << ": " << std::setprecision(0) << c.second << std::endl;
+	stream << "\tPeak image memory: " << std::setprecision(2) << state.peak/1048576. << " MB" << std::endl;
+	long long resident = _PeakResident();
+	if( resident ) stream << "\tPeak resident memory: " << std::setprecision(2) << resident/1048576. << " MB" << std::endl;
+	stream.flags( flags );
+	stream.precision( precision );
+}
+
+void Profiler::WriteTrace( std::string fileName )
+{
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	FILE *fp = fopen( fileName.c_str() , "w" );
+	if( !fp ) THROW( "Failed to open file for writing: %s" , fileName.c_str() );
+
+	// Times are in microseconds
+	bool first = true;
+	auto Separator = [&]( void ){ fprintf( fp , first ? "\n\t\t" : ",\n\t\t" ) ; first = false; };
+	fprintf( fp , "{\n\t\"displayTimeUnit\": \"ms\",\n\t\"traceEvents\": [" );
+	for( const auto &t : state.threads )
+	{
+		Separator();
+		if( t.second ) fprintf( fp , "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": { \"name\": \"thread %u\" } }" , t.second , t.second );
+		else           fprintf( fp , "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": { \"name\": \"main\" } }" );
+	}
+	for( const _Event &e : state.events )
+	{
+		Separator();
+		fprintf( fp , "{ \"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %u, \"args\": { " , _Escape( e.name ).c_str() , _Escape( e.category ).c_str() , e.start*1e6 , e.duration*1e6 , e.thread );
+		if( e.detail.size() ) fprintf( fp , "\"detail\": \"%s\", " , _Escape( e.detail ).c_str() );
+		fprintf( fp , "\"peak_bytes\": %lld } }" , e.peak );
+	}
+	for( const _Sample &s : state.samples )
+	{
+		Separator();
+		if( s.name ) fprintf( fp , "{ \"name\": \"%s\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"args\": { \"value\": %.17g } }" , _Escape( s.name ).c_str() , s.time*1e6 , s.value );
+		else         fprintf( fp , "{ \"name\": \"image memory\", \"ph\": \"C\", \"ts\": %.3f, \"pid\": 1, \"args\": { \"bytes\": %.17g } }" , s.time*1e6 , s.value );
+	}
+	fprintf( fp , "\n\t]\n}\n" );
+	fclose( fp );
+}
+
+//////////////////
+// ProfileScope //
+//////////////////
+ProfileScope::ProfileScope( const char *name , const char *category , const char *detail ) : _name(name) , _category(category) , _start(0) , _base(0) , _peak(0) , _active(false)
+{
+	if( !Profiler::Enabled() ) return;
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	if( detail ) _detail = detail;
+	_base = _peak = Profiler::Allocated();
+	state.open.push_back( this );
+	_active = true;
+	_start = state.timer.elapsed();
+}
+
+ProfileScope::~ProfileScope( void )
+{
+	if( !_active ) return;
+	_ProfilerState &state = _State();
+	std::lock_guard< std::mutex > lock( state.mutex );
+	double end = state.timer.elapsed();
+	state.open.erase( std::find( state.open.begin() , state.open.end() , this ) );
+	state.events.push_back( _Event{ _name , _category , _detail , state.thread() , _start , end-_start , _peak-_base } );
+}
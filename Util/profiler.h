@@ -0,0 +1,77 @@
+#ifndef PROFILER_INCLUDED
+#define PROFILER_INCLUDED
+
+#include <iostream>
+#include <string>
+#include <atomic>
+
+namespace Util
+{
+	/** This class collects the timings of the profiled scopes, the totals of the counters, and the memory held by the tracked allocations (the image buffers).
+	*** Profiling is disabled by default, in which case a profiled scope costs a test of a flag and the counters are ignored.
+	*** The collected data can be reported as a per-stage breakdown, or exported as a Chrome trace-event file (viewable in chrome://tracing or Perfetto). */
+	class Profiler
+	{
+		/** Is profiling enabled */
+		static std::atomic< bool > _enabled;
+
+		/** The number of bytes currently held by the tracked allocations */
+		static std::atomic< long long > _allocated;
+	public:
+		/** This static method enables profiling, with the times measured from the call */
+		static void Enable( void );
+
+		/** This static method returns true if profiling is enabled */
+		static bool Enabled( void ){ return _enabled; }
+
+		/** This static method adds the value to the named counter. The name must be a string literal (or otherwise outlive the profiler). */
+		static void Count( const char *name , double value=1. );
+
+		/** This static method records the allocation (or, with a negative size, the release) of the prescribed number of bytes.
+		*** It is called whenever the tracked buffers change size, whether or not profiling is enabled, so that the current total is always correct. */
+		static void Allocate( long long bytes );
+
+		/** This static method returns the number of bytes currently held by the tracked allocations */
+		static long long Allocated( void ){ return _allocated; }
+
+		/** This static method writes the per-stage breakdown to the stream: the number of calls, the total and mean time, the share of the
+		*** elapsed time, and the peak growth of the tracked memory of each scope, followed by the counters */
+		static void Report( std::ostream &stream );
+
+		/** This static method writes the scopes, counters, and tracked memory out as a Chrome trace-event JSON file */
+		static void WriteTrace( std::string fileName );
+	};
+
+	/** This class times the scope in which it is declared, when profiling is enabled.
+	*** Scopes with the same name and category are aggregated in the report. The name and category must be string literals (or otherwise outlive the profiler),
+	*** while the optional detail (e.g. a file name) is copied, and shown with the scope in the trace. */
+	class ProfileScope
+	{
+		friend class Profiler;
+
+		/** The name and category of the scope */
+		const char *_name , *_category;
+
+		/** The detail attached to the scope */
+		std::string _detail;
+
+		/** The time at which the scope was entered */
+		double _start;
+
+		/** The tracked memory when the scope was entered, and its peak while the scope was open */
+		long long _base , _peak;
+
+		/** Is the scope being timed */
+		bool _active;
+	public:
+		/** The constructor starts timing the scope, if profiling is enabled */
+		ProfileScope( const char *name , const char *category="Image32" , const char *detail=NULL );
+
+		/** The destructor records the scope, if it is being timed */
+		~ProfileScope( void );
+
+		ProfileScope( const ProfileScope & ) = delete;
+		ProfileScope &operator = ( const ProfileScope & ) = delete;
+	};
+}
+#endif // PROFILER_INCLUDED
@@ -0,0 +1,723 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include "Image/image.h"
+#include "Image/codec.h"
+#include "Image/jpeg.h"
+#include "Image/histogram.h"
+#include "Image/convolution.h"
+#include "Image/lineSegments.h"
+#include "Util/cmdLineParser.h"
+#include "Util/exceptions.h"
+#include "Util/parallel.h"
+#include "Util/timer.h"
+
+using namespace std;
+using namespace Util;
+using namespace Image;
+
+CmdLineParameters< double > Sizes( "sizes" );
+CmdLineParameters< int > Threads( "threads" );
+CmdLineParameter< int > Repeat( "repeat" , 3 );
+CmdLineParameter< string > Filter( "filter" );
+CmdLineParameter< string > JSON( "json" );
+CmdLineParameter< string > Label( "label" );
+CmdLineParameter< string > Golden( "golden" );
+#ifdef WIN32
+CmdLineParameter< string > Executable( "exe" , "Assignment1.exe" );
+#else // !WIN32
+CmdLineParameter< string > Executable( "exe" , "./Assignment1" );
+#endif // WIN32
+CmdLineReadable SIMDCheck( "simdCheck" );
+CmdLineParameter< string > Baseline( "baseline" );
+CmdLineParameter< double > Slowdown( "slowdown" , 1.1 );
+CmdLineReadable List( "list" );
+CmdLineReadable Help( "help" );
+
+CmdLineReadable* params[] =
+{
+	&Sizes , &Threads , &Repeat , &Filter , &JSON , &Label , &Golden , &Executable , &SIMDCheck , &Baseline , &Slowdown , &List , &Help ,
+	NULL
+};
+
+void ShowUsage( const string &ex )
+{
+	cout << "Usage " << ex << ":" << endl;
+	cout << "\t[--" << Sizes.name << " <number of sizes> <image sizes in megapixels>=2 1 4]" << endl;
+	cout << "\t[--" << Threads.name << " <number of thread counts> <thread counts>=2 1 " << std::thread::hardware_concurrency() << "]" << endl;
+	cout << "\t[--" << Repeat.name << " <timed runs per measurement>=" << Repeat.value << "]" << endl;
+	cout << "\t[--" << Filter.name << " <only run the benchmarks whose name contains the string>]" << endl;
+	cout << "\t[--" << JSON.name << " <output JSON file>]" << endl;
+	cout << "\t[--" << Label.name << " <label recorded in the JSON file, e.g. the release>]" << endl;
+	cout << "\t[--" << Golden.name << " <manifest of reference images and the " << Executable.value << " arguments regenerating them (replaces the microbenchmarks)>]" << endl;
+	cout << "\t[--" << Executable.name << " <executable run on the golden manifest>=" << Executable.value << "]" << endl;
+	cout << "\t[--" << SIMDCheck.name << " (check that the executable's JPEG encodes and decodes are bit-exact with and without the SIMD extensions, replaces the microbenchmarks)]" << endl;
+	cout << "\t[--" << Baseline.name << " <JSON file of an earlier run to compare the times with>]" << endl;
+	cout << "\t[--" << Slowdown.name << " <ratio to the baseline time above which a measurement is a regression>=" << Slowdown.value << "]" << endl;
+	cout << "\t[--" << List.name << " (list the benchmarks and exit)]" << endl;
+	cout << "\t[--" << Help.name << "]" << endl;
+}
+
+/** This structure describes a benchmark.
+*** The setup function is called (untimed) on the input image, and returns the function that is timed, which returns the number of bytes read and written. */
+struct Benchmark
+{
+	string name , category;
+	function< function< size_t ( void ) > ( const Image32 & ) > setup;
+
+	Benchmark( string name , string category , function< function< size_t ( void ) > ( const Image32 & ) > setup ) : name(name) , category(category) , setup(setup) {}
+};
+
+/** This structure describes the timings of a benchmark for an image size and thread count.
+*** For a golden image, it also describes the difference between the regenerated and the reference image. */
+struct Measurement
+{
+	string name , category;
+	int width , height , threads;
+	double median , min , bytes , speedup;
+	double psnr;
+	int maxError;
+	bool passed;
+
+	Measurement( void ) : width(0) , height(0) , threads(0) , median(0) , min(0) , bytes(0) , speedup(1) , psnr(0) , maxError(0) , passed(true) {}
+
+	double pixels( void ) const { return (double)width * height; }
+	double nsPerPixel( void ) const { return median * 1e9 / pixels(); }
+	double gbPerSecond( void ) const { return bytes / median / 1e9; }
+};
+
+/** This function returns the number of bytes in the image */
+size_t Bytes( const Image32 &img ){ return sizeof(Pixel32) * img.width() * img.height(); }
+
+/** This function returns a deterministic image with the prescribed number of megapixels, and a 4:3 aspect ratio,
+*** made of smooth gradients with pseudo-random noise so that neither the filters nor the codecs see trivial data */
+Image32 SyntheticImage( double megapixels )
+{
+	int width = std::max< int >( 1 , (int)floor( sqrt( megapixels * 1e6 * 4. / 3. ) + 0.5 ) );
+	int height = std::max< int >( 1 , (int)floor( width * 3. / 4. + 0.5 ) );
+	Image32 img;
+	img.setSize( width , height );
+	ParallelFor( 0 , height , [&]( unsigned int , size_t j )
+		{
+			unsigned int seed = (unsigned int)j * 2654435761u + 1;
+			auto Noise = [&]( void ){ seed = seed * 1664525u + 1013904223u ; return (int)( seed>>27 ) - 16; };
+			auto Clamp = []( int v ){ return (unsigned char)std::max< int >( 0 , std::min< int >( 255 , v ) ); };
+			Pixel32 *row = img.row( (int)j );
+			for( int i=0 ; i<width ; i++ )
+			{
+				row[i].r = Clamp( ( 255 * i ) / width + Noise() );
+				row[i].g = Clamp( ( 255 * (int)j ) / height + Noise() );
+				row[i].b = Clamp( 128 + (int)( 96 * sin( 0.02 * ( i + (int)j ) ) ) + Noise() );
+				row[i].a = 255;
+			}
+		}
+	);
+	return img;
+}
+
+/** This function returns the benchmark timing the filter */
+Benchmark FilterBenchmark( string name , function< Image32 ( const Image32 & ) > filter )
+{
+	return Benchmark( name , "filter" , [=]( const Image32 &img )
+		{
+			return function< size_t ( void ) >( [&img,filter]( void ){ Image32 out = filter( img ) ; return Bytes( img ) + Bytes( out ); } );
+		}
+	);
+}
+
+/** The sink the statistics benchmark accumulates into, so that the computation of the statistics cannot be optimized away */
+volatile unsigned long long StatisticsSink = 0;
+
+/** This function returns the benchmark timing the computation of the image statistics (which only reads the image) */
+Benchmark StatisticsBenchmark( void )
+{
+	return Benchmark( "stats" , "filter" , []( const Image32 &img )
+		{
+			return function< size_t ( void ) >( [&img]( void )
+				{
+					ImageStatistics stats = img.stats();
+					unsigned long long sum = 0;
+					for( int c=0 ; c<ImageStatistics::COUNT ; c++ ) sum += stats.channels[c].sum();
+					StatisticsSink = StatisticsSink + sum;
+					return Bytes( img );
+				}
+			);
+		}
+	);
+}
+
+/** This function returns the codec registered under the name, throwing if there is none */
+const ImageCodec &Codec( string name )
+{
+	const ImageCodec *codec = ImageCodecFromName( name );
+	if( !codec ) THROW( "No codec registered as: %s" , name.c_str() );
+	return *codec;
+}
+
+/** This function returns a temporary file that is closed when the last reference is released */
+shared_ptr< FILE > TemporaryFile( void )
+{
+	FILE *fp = tmpfile();
+	if( !fp ) THROW( "Failed to create temporary file" );
+	return shared_ptr< FILE >( fp , fclose );
+}
+
+/** This function returns the benchmark timing the encoding of the image to a temporary file */
+Benchmark EncodeBenchmark( string name )
+{
+	return Benchmark( name + ".encode" , "codec" , [=]( const Image32 &img )
+		{
+			const ImageCodec &codec = Codec( name );
+			shared_ptr< FILE > fp = TemporaryFile();
+			return function< size_t ( void ) >( [&img,&codec,fp]( void )
+				{
+					rewind( fp.get() );
+					codec.write( img , fp.get() );
+					fflush( fp.get() );
+					return Bytes( img ) + (size_t)ftell( fp.get() );
+				}
+			);
+		}
+	);
+}
+
+/** This function returns the benchmark timing the decoding of the image, encoded (untimed) to a temporary file */
+Benchmark DecodeBenchmark( string name )
+{
+	return Benchmark( name + ".decode" , "codec" , [=]( const Image32 &img )
+		{
+			const ImageCodec &codec = Codec( name );
+			shared_ptr< FILE > fp = TemporaryFile();
+			codec.write( img , fp.get() );
+			fflush( fp.get() );
+			size_t size = (size_t)ftell( fp.get() );
+			return function< size_t ( void ) >( [&codec,fp,size]( void )
+				{
+					Image32 out;
+					rewind( fp.get() );
+					codec.read( fp.get() , out );
+					return size + Bytes( out );
+				}
+			);
+		}
+	);
+}
+
+/** This function returns the benchmark timing the decoding and re-encoding of many small JPEGs, the tiles of the image (encoded untimed),
+*** either with the one-shot functions, which set up the library for each image, or with a JPEGCodec kept across the images */
+Benchmark SmallJPEGBenchmark( bool reuse )
+{
+	return Benchmark( string( "JPEG.tiles." ) + ( reuse ? "codec" : "oneShot" ) , "codec" , [=]( const Image32 &img )
+		{
+			const int tileSize = 16;
+			shared_ptr< vector< vector< unsigned char > > > tiles = make_shared< vector< vector< unsigned char > > >();
+			for( int j=0 ; j+tileSize<=img.height() ; j+=tileSize ) for( int i=0 ; i+tileSize<=img.width() ; i+=tileSize )
+			{
+				tiles->push_back( vector< unsigned char >() );
+				JPEGWriteImage( img.crop( i , j , i+tileSize , j+tileSize ) , tiles->back() , JPEGWriteOptions( 90 ) );
+			}
+			shared_ptr< JPEGCodec > codec = make_shared< JPEGCodec >();
+			return function< size_t ( void ) >( [tiles,codec,reuse]( void )
+				{
+					Image32 tile;
+					vector< unsigned char > encoded;
+					size_t bytes = 0;
+					for( const vector< unsigned char > &data : *tiles )
+					{
+						if( reuse ) codec->read( &data[0] , data.size() , tile ) , codec->write( tile , encoded , JPEGWriteOptions( 90 ) );
+						else        JPEGReadImage( &data[0] , data.size() , tile ) , JPEGWriteImage( tile , encoded , JPEGWriteOptions( 90 ) );
+						bytes += data.size() + 2*Bytes( tile ) + encoded.size();
+					}
+					return bytes;
+				}
+			);
+		}
+	);
+}
+
+/** This function returns the benchmarks: the Image32 operators, followed by the encoding and decoding of each codec */
+vector< Benchmark > Benchmarks( void )
+{
+	vector< Benchmark > benchmarks;
+	auto Add = [&]( string name , function< Image32 ( const Image32 & ) > filter ){ benchmarks.push_back( FilterBenchmark( name , filter ) ); };
+
+	Add( "addRandomNoise" , []( const Image32 &img ){ return img.addRandomNoise( 0.1 ); } );
+	Add( "brighten" , []( const Image32 &img ){ return img.brighten( 1.2 ); } );
+	Add( "luminance" , []( const Image32 &img ){ return img.luminance(); } );
+	Add( "contrast" , []( const Image32 &img ){ return img.contrast( 1.5 ); } );
+	Add( "saturate" , []( const Image32 &img ){ return img.saturate( 1.5 ); } );
+	Add( "quantize" , []( const Image32 &img ){ return img.quantize( 4 ); } );
+	Add( "randomDither" , []( const Image32 &img ){ return img.randomDither( 4 ); } );
+	Add( "orderedDither2X2" , []( const Image32 &img ){ return img.orderedDither2X2( 4 ); } );
+	Add( "floydSteinbergDither" , []( const Image32 &img ){ return img.floydSteinbergDither( 4 ); } );
+	Add( "quantizePalette.medianCut" , []( const Image32 &img ){ return img.quantizePalette( 64 , PaletteMethod::MEDIAN_CUT ); } );
+	Add( "quantizePalette.kMeans" , []( const Image32 &img ){ return img.quantizePalette( 64 , PaletteMethod::K_MEANS ); } );
+	Add( "blur3X3" , []( const Image32 &img ){ return img.blur3X3(); } );
+	Add( "edgeDetect3X3" , []( const Image32 &img ){ return img.edgeDetect3X3(); } );
+	Add( "blurNXN" , []( const Image32 &img ){ return img.blurNXN( 5 , 1. ); } );
+	Add( "gradientMagnitude" , []( const Image32 &img ){ return img.gradientMagnitude(); } );
+	Add( "canny" , []( const Image32 &img ){ return img.canny( 40. , 120. ); } );
+	Add( "convolve.separable5x5" , []( const Image32 &img ){ return img.convolve( Kernel::Gaussian( 1. , 2 ) , ConvolutionMethod::SEPARABLE ); } );
+	Add( "convolve.direct7x7" , []( const Image32 &img ){ return img.convolve( Kernel::Gaussian( 1.5 , 3 ) , ConvolutionMethod::DIRECT ); } );
+	Add( "convolveFFT.31x31" , []( const Image32 &img ){ return img.convolveFFT( Kernel::Gaussian( 5. , 15 ) ); } );
+	Add( "lowPass" , []( const Image32 &img ){ return img.lowPass( 0.5 ); } );
+	Add( "highPass" , []( const Image32 &img ){ return img.highPass( 0.5 ); } );
+	Add( "bandPass" , []( const Image32 &img ){ return img.bandPass( 0.2 , 0.6 ); } );
+	Add( "scaleNearest" , []( const Image32 &img ){ return img.scaleNearest( 0.7 ); } );
+	Add( "scaleBilinear" , []( const Image32 &img ){ return img.scaleBilinear( 0.7 ); } );
+	Add( "scaleGaussian" , []( const Image32 &img ){ return img.scaleGaussian( 0.7 ); } );
+	Add( "rotateNearest" , []( const Image32 &img ){ return img.rotateNearest( 30. ); } );
+	Add( "rotateBilinear" , []( const Image32 &img ){ return img.rotateBilinear( 30. ); } );
+	Add( "rotateGaussian" , []( const Image32 &img ){ return img.rotateGaussian( 30. ); } );
+	Add( "composite" , []( const Image32 &img ){ Image32 overlay = img.scaleNearest( 1. ) ; overlay.setAlpha( img.luminance() ) ; return img.composite( overlay ); } );
+	Add( "crop" , []( const Image32 &img ){ return img.crop( img.width()/4 , img.height()/4 , 3*img.width()/4 , 3*img.height()/4 ); } );
+	benchmarks.push_back( StatisticsBenchmark() );
+	Add( "equalize" , []( const Image32 &img ){ return img.equalize(); } );
+	Add( "autoLevels" , []( const Image32 &img ){ return img.autoLevels( 0.01 , 0.99 ); } );
+	Add( "funFilter" , []( const Image32 &img ){ return img.funFilter( 8 , 2 ); } );
+	Add( "shiftChannel" , []( const Image32 &img ){ Image32 copy = img ; return copy.shiftChannel( 1 , 16 ); } );
+	Add( "warp" , []( const Image32 &img )
+		{
+			OrientedLineSegmentPairs olsp;
+			olsp.resize( 2 );
+			double w = img.width() , h = img.height();
+			olsp[0].first.endPoints[0] = Point2D( 0.2*w , 0.2*h ) , olsp[0].first.endPoints[1] = Point2D( 0.8*w , 0.2*h );
+			olsp[0].second.endPoints[0] = Point2D( 0.25*w , 0.3*h ) , olsp[0].second.endPoints[1] = Point2D( 0.75*w , 0.25*h );
+			olsp[1].first.endPoints[0] = Point2D( 0.2*w , 0.8*h ) , olsp[1].first.endPoints[1] = Point2D( 0.8*w , 0.8*h );
+			olsp[1].second.endPoints[0] = Point2D( 0.2*w , 0.75*h ) , olsp[1].second.endPoints[1] = Point2D( 0.8*w , 0.85*h );
+			return img.warp( olsp );
+		}
+	);
+
+	const char *codecs[] = { "BMP" , "JPEG" , "PNG" , "QOI" , "PPM" };
+	for( const char *codec : codecs )
+	{
+		benchmarks.push_back( EncodeBenchmark( codec ) );
+		benchmarks.push_back( DecodeBenchmark( codec ) );
+	}
+	benchmarks.push_back( SmallJPEGBenchmark( false ) );
+	benchmarks.push_back( SmallJPEGBenchmark( true ) );
+	return benchmarks;
+}
+
+/** This function runs the benchmark on the image with the prescribed number of threads, returning the median and minimum of the timed runs */
+Measurement Run( const Benchmark &benchmark , const Image32 &img , unsigned int threads , int repeat )
+{
+	ThreadCount() = threads;
+	function< size_t ( void ) > run = benchmark.setup( img );
+	vector< double > times( repeat );
+	size_t bytes = 0;
+	for( int r=0 ; r<repeat ; r++ )
+	{
+		Timer timer;
+		bytes = run();
+		times[r] = timer.elapsed();
+	}
+	sort( times.begin() , times.end() );
+
+	Measurement m;
+	m.name = benchmark.name , m.category = benchmark.category;
+	m.width = img.width() , m.height = img.height() , m.threads = threads;
+	m.median = repeat&1 ? times[repeat/2] : ( times[repeat/2-1] + times[repeat/2] ) / 2;
+	m.min = times[0];
+	m.bytes = (double)bytes;
+	m.speedup = 1.;
+	return m;
+}
+
+/** This function returns the string with the characters that cannot appear in a JSON string escaped */
+string Escape( const string &str )
+{
+	string escaped;
+	for( char c : str )
+		if( c=='"' || c=='\\' ) escaped += '\\' , escaped += c;
+		else if( (unsigned char)c<0x20 ) escaped += ' ';
+		else escaped += c;
+	return escaped;
+}
+
+/** This structure describes an entry of the golden-image manifest: the reference image, the tolerances, and the arguments that regenerate it */
+struct GoldenEntry
+{
+	string reference , arguments;
+	double minPSNR;
+	int maxError;
+};
+
+/** This function reads the golden-image manifest. Each line holds the reference image, the minimum PSNR (in dB) and the maximum absolute error of a color channel,
+*** followed by the arguments of the executable (without --out). Empty lines and lines starting with '#' are skipped, and the paths are relative to the working directory. */
+vector< GoldenEntry > ReadManifest( string fileName )
+{
+	ifstream stream( fileName );
+	if( !stream ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
+	vector< GoldenEntry > entries;
+	string line;
+	for( int l=1 ; getline( stream , line ) ; l++ )
+	{
+		if( line.size() && line.back()=='\r' ) line.pop_back();
+		size_t start = line.find_first_not_of( " \t" );
+		if( start==string::npos || line[start]=='#' ) continue;
+		stringstream ss( line );
+		GoldenEntry entry;
+		if( !( ss >> entry.reference >> entry.minPSNR >> entry.maxError ) ) THROW( "Bad manifest entry on line %d of %s" , l , fileName.c_str() );
+		getline( ss , entry.arguments );
+		entries.push_back( entry );
+	}
+	return entries;
+}
+
+/** This function computes the peak signal-to-noise ratio (in dB, and infinite for identical images) and the maximum absolute error of the color channels of the images,
+*** which must have the same dimensions */
+void CompareImages( const Image32 &img1 , const Image32 &img2 , double &psnr , int &maxError )
+{
+	double squaredError = 0;
+	maxError = 0;
+	for( int j=0 ; j<img1.height() ; j++ )
+	{
+		const Pixel32 *row1 = img1.row(j) , *row2 = img2.row(j);
+		for( int i=0 ; i<img1.width() ; i++ )
+		{
+			int d[] = { row1[i].r-row2[i].r , row1[i].g-row2[i].g , row1[i].b-row2[i].b };
+			for( int c=0 ; c<3 ; c++ ) squaredError += d[c]*d[c] , maxError = std::max< int >( maxError , abs( d[c] ) );
+		}
+	}
+	double mse = squaredError / ( 3. * img1.width() * img1.height() );
+	psnr = mse>0 ? 10. * log10( 255. * 255. / mse ) : numeric_limits< double >::infinity();
+}
+
+/** This function runs the executable with the arguments, writing the output image to the standard output (as the prescribed file type), and returns the bytes written.
+*** The (wall-clock) running time, including the start-up of the process and the decoding and encoding of the images, is returned in seconds. */
+vector< unsigned char > RunExecutable( const string &arguments , const string &extension , double &seconds )
+{
+#ifdef WIN32
+	string command = "\"\"" + Executable.value + "\" " + arguments + " --out " + extension + ":- 2>NUL\"";
+	Timer timer;
+	FILE *pipe = _popen( command.c_str() , "rb" );
+#else // !WIN32
+	string command = "\"" + Executable.value + "\" " + arguments + " --out " + extension + ":- 2>/dev/null";
+	Timer timer;
+	FILE *pipe = popen( command.c_str() , "r" );
+#endif // WIN32
+	if( !pipe ) THROW( "Failed to run: %s" , command.c_str() );
+	vector< unsigned char > buffer;
+	unsigned char chunk[1<<16];
+	size_t read;
+	while( ( read=fread( chunk , 1 , sizeof(chunk) , pipe ) )>0 ) buffer.insert( buffer.end() , chunk , chunk+read );
+#ifdef WIN32
+	int status = _pclose( pipe );
+#else // !WIN32
+	int status = pclose( pipe );
+#endif // WIN32
+	seconds = timer.elapsed();
+	if( status ) THROW( "Failed with status %d: %s" , status , command.c_str() );
+	if( buffer.empty() ) THROW( "No output from: %s" , command.c_str() );
+	return buffer;
+}
+
+/** This function runs the executable with the arguments, writing the output image to the standard output, and returns the decoded image.
+*** The (wall-clock) running time, including the start-up of the process and the decoding and encoding of the images, is returned in seconds. */
+Image32 RunExecutable( const string &arguments , double &seconds )
+{
+	vector< unsigned char > buffer = RunExecutable( arguments , "bmp" , seconds );
+
+	const ImageCodec *codec = ImageCodecFromMagic( &buffer[0] , std::min< size_t >( buffer.size() , ImageCodecMagicSize ) );
+	if( !codec ) THROW( "Unrecognized output of: %s %s" , Executable.value.c_str() , arguments.c_str() );
+	shared_ptr< FILE > fp = TemporaryFile();
+	if( fwrite( &buffer[0] , 1 , buffer.size() , fp.get() )!=buffer.size() ) THROW( "Failed to write temporary file" );
+	rewind( fp.get() );
+	Image32 img;
+	codec->read( fp.get() , img );
+	return img;
+}
+
+/** This function sets (or clears) the environment variable through which the JPEG library is made to use its scalar code instead of the SIMD extensions.
+*** Since the library reads the variable once per process, it is set in the benchmark and inherited by the executable it runs. */
+void SetForceScalarJPEG( bool forceScalar )
+{
+#ifdef WIN32
+	_putenv_s( "JSIMD_FORCENONE" , forceScalar ? "1" : "" );
+#else // !WIN32
+	if( forceScalar ) setenv( "JSIMD_FORCENONE" , "1" , 1 );
+	else              unsetenv( "JSIMD_FORCENONE" );
+#endif // WIN32
+}
+
+/** This function runs the executable on JPEG encodes, decodes, and transcodes, with and without the SIMD extensions of the JPEG library,
+*** and returns the number of them for which the two outputs are not bit-exact.
+*** This checks the JPEG library that the executable links (the system one under Linux); the SIMD routines of the bundled library
+*** are checked against the portable ones by "make -f Makefile1 jsimdtest".
+*** The floating-point DCT is not checked, as the library only guarantees its SIMD and scalar versions to agree up to rounding. */
+int RunSIMDCheck( void )
+{
+	struct Case
+	{
+		string arguments , extension;
+		Case( string arguments , string extension ) : arguments(arguments) , extension(extension) {}
+	};
+	vector< Case > cases;
+	const string bmp = "--in Output/Brightness/yoda_original_image.bmp" , jpegs[] = { "Output/Composite/OriginalImage.jpg" , "Output/Composite/overlay.jpg" };
+	for( const char *subsampling : { "444" , "422" , "420" } ) for( const char *dct : { "islow" , "ifast" } )
+		cases.push_back( Case( bmp + " --jpegSubsampling " + subsampling + " --jpegDCT " + dct , "jpg" ) );
+	cases.push_back( Case( bmp + " --jpegProgressive --jpegOptimize" , "jpg" ) );
+	for( const string &jpeg : jpegs )
+	{
+		cases.push_back( Case( "--in " + jpeg , "bmp" ) );
+		for( const char *subsampling : { "444" , "422" } ) cases.push_back( Case( "--in " + jpeg + " --jpegSubsampling " + subsampling , "jpg" ) );
+	}
+
+	int failures = 0;
+	cout << "SIMD vs. scalar JPEG (JSIMD_FORCENONE=1): " << Executable.value << endl;
+	cout << "\t" << left << setw(100) << "arguments" << right << setw(12) << "SIMD ms" << setw(12) << "scalar ms" << "  result" << endl;
+	for( const Case &c : cases )
+	{
+		if( Filter.set && c.arguments.find( Filter.value )==string::npos ) continue;
+		double simdSeconds = 0 , scalarSeconds = 0;
+		string result;
+		try
+		{
+			SetForceScalarJPEG( false );
+			vector< unsigned char > simd = RunExecutable( c.arguments , c.extension , simdSeconds );
+			SetForceScalarJPEG( true );
+			vector< unsigned char > scalar = RunExecutable( c.arguments , c.extension , scalarSeconds );
+			SetForceScalarJPEG( false );
+			if( simd==scalar ) result = "ok";
+			else
+			{
+				size_t i = 0;
+				while( i<simd.size() && i<scalar.size() && simd[i]==scalar[i] ) i++;
+				stringstream ss;
+				ss << "differ at byte " << i << " (" << simd.size() << " vs. " << scalar.size() << " bytes)";
+				result = ss.str();
+			}
+		}
+		catch( const exception& e )
+		{
+			SetForceScalarJPEG( false );
+			result = e.what();
+		}
+		if( result!="ok" ) failures++;
+		cout << fixed;
+		cout << "\t" << left << setw(100) << ( c.arguments + " --out " + c.extension + ":-" ) << right << setw(12) << setprecision(2) << simdSeconds*1e3 << setw(12) << scalarSeconds*1e3 << "  " << result << endl;
+		cout << defaultfloat;
+	}
+	return failures;
+}
+
+/** This function regenerates the images of the golden manifest, comparing them to the references, and returns the number of them that are not within the tolerances */
+int RunGolden( vector< Measurement > &measurements )
+{
+	int failures = 0;
+	cout << "Golden images: " << Golden.value << endl;
+	cout << "\t" << left << setw(48) << "reference" << right << setw(12) << "ms" << setw(10) << "PSNR" << setw(8) << "error" << "  result" << endl;
+	for( const GoldenEntry &entry : ReadManifest( Golden.value ) )
+	{
+		if( Filter.set && entry.reference.find( Filter.value )==string::npos ) continue;
+		Measurement m;
+		m.name = entry.reference , m.category = "golden" , m.threads = ThreadCount();
+		string result;
+		try
+		{
+			Image32 reference , output;
+			reference.read( entry.reference );
+			vector< double > times( Repeat.value );
+			for( int r=0 ; r<Repeat.value ; r++ ) output = RunExecutable( entry.arguments , times[r] );
+			sort( times.begin() , times.end() );
+			m.width = output.width() , m.height = output.height();
+			m.median = Repeat.value&1 ? times[Repeat.value/2] : ( times[Repeat.value/2-1] + times[Repeat.value/2] ) / 2;
+			m.min = times[0];
+			m.bytes = (double)Bytes( output );
+			if( output.width()!=reference.width() || output.height()!=reference.height() )
+			{
+				stringstream ss;
+				ss << "dimensions " << output.width() << " x " << output.height() << " != " << reference.width() << " x " << reference.height();
+				result = ss.str();
+				m.passed = false;
+			}
+			else
+			{
+				CompareImages( output , reference , m.psnr , m.maxError );
+				m.passed = m.psnr>=entry.minPSNR && m.maxError<=entry.maxError;
+				result = m.passed ? "ok" : "outside tolerance";
+			}
+		}
+		catch( const exception& e )
+		{
+			result = e.what();
+			m.passed = false;
+		}
+		if( !m.passed ) failures++;
+		measurements.push_back( m );
+		cout << fixed;
+		cout << "\t" << left << setw(48) << m.name << right << setw(12) << setprecision(2) << m.median*1e3 << setw(10) << setprecision(2) << m.psnr << setw(8) << m.maxError << "  " << result << endl;
+		cout << defaultfloat;
+	}
+	return failures;
+}
+
+/** This function returns the key identifying a measurement in a baseline */
+string BaselineKey( const string &name , int width , int height , int threads )
+{
+	stringstream ss;
+	ss << name << " " << width << "x" << height << " " << threads;
+	return ss.str();
+}
+
+/** This function reads the median times of the measurements from a JSON file written by WriteJSON (which writes a measurement per line), indexed by BaselineKey */
+map< string , double > ReadBaseline( string fileName )
+{
+	ifstream stream( fileName );
+	if( !stream ) THROW( "Failed to open file for reading: %s" , fileName.c_str() );
+	auto Field = []( const string &line , const string &key )
+	{
+		size_t start = line.find( "\"" + key + "\": " );
+		if( start==string::npos ) return string();
+		start += key.size() + 4;
+		if( line[start]=='"' ) return line.substr( start+1 , line.find( "\", " , start+1 ) - start - 1 );
+		return line.substr( start , line.find_first_of( ", }" , start ) - start );
+	};
+	map< string , double > baseline;
+	string line;
+	while( getline( stream , line ) )
+	{
+		string name = Field( line , "name" ) , median = Field( line , "median_seconds" );
+		if( name.empty() || median.empty() ) continue;
+		baseline[ BaselineKey( name , atoi( Field( line , "width" ).c_str() ) , atoi( Field( line , "height" ).c_str() ) , atoi( Field( line , "threads" ).c_str() ) ) ] = atof( median.c_str() );
+	}
+	return baseline;
+}
+
+/** This function compares the median times of the measurements with those of the baseline, and returns the number of them that are slower by more than the prescribed ratio */
+int CompareBaseline( const vector< Measurement > &measurements )
+{
+	map< string , double > baseline = ReadBaseline( Baseline.value );
+	int regressions = 0;
+	cout << "Baseline: " << Baseline.value << endl;
+	cout << "\t" << left << setw(48) << "measurement" << right << setw(12) << "baseline ms" << setw(12) << "ms" << setw(10) << "ratio" << endl;
+	for( const Measurement &m : measurements )
+	{
+		auto iter = baseline.find( BaselineKey( Escape( m.name ) , m.width , m.height , m.threads ) );
+		if( iter==baseline.end() || iter->second<=0 || m.median<=0 ) continue;
+		double ratio = m.median / iter->second;
+		if( ratio>Slowdown.value ) regressions++;
+		cout << fixed;
+		cout << "\t" << left << setw(48) << BaselineKey( m.name , m.width , m.height , m.threads ) << right << setw(12) << setprecision(2) << iter->second*1e3 << setw(12) << m.median*1e3 << setw(10) << setprecision(3) << ratio;
+		cout << ( ratio>Slowdown.value ? "  slower" : ratio<1./Slowdown.value ? "  faster" : "" ) << endl;
+		cout << defaultfloat;
+	}
+	return regressions;
+}
+
+/** This function writes the measurements out as JSON */
+void WriteJSON( string fileName , const vector< Measurement > &measurements , unsigned int hardwareThreads )
+{
+	FILE *fp = fopen( fileName.c_str() , "w" );
+	if( !fp ) THROW( "Failed to open file for writing: %s" , fileName.c_str() );
+
+	fprintf( fp , "{\n" );
+	fprintf( fp , "\t\"version\": 1,\n" );
+	fprintf( fp , "\t\"label\": \"%s\",\n" , Escape( Label.value ).c_str() );
+#ifdef __VERSION__
+	fprintf( fp , "\t\"compiler\": \"%s\",\n" , Escape( __VERSION__ ).c_str() );
+#endif // __VERSION__
+	fprintf( fp , "\t\"hardware_threads\": %u,\n" , hardwareThreads );
+	fprintf( fp , "\t\"repeat\": %d,\n" , Repeat.value );
+	fprintf( fp , "\t\"results\": [\n" );
+	for( size_t i=0 ; i<measurements.size() ; i++ )
+	{
+		const Measurement &m = measurements[i];
+		fprintf( fp , "\t\t{ \"name\": \"%s\", \"category\": \"%s\", \"width\": %d, \"height\": %d, \"megapixels\": %.3f, \"threads\": %d, " , Escape( m.name ).c_str() , m.category.c_str() , m.width , m.height , m.pixels()/1e6 , m.threads );
+		fprintf( fp , "\"median_seconds\": %.6g, \"min_seconds\": %.6g, \"ns_per_pixel\": %.6g, \"gb_per_second\": %.6g, \"speedup\": %.4g" , m.median , m.min , m.nsPerPixel() , m.gbPerSecond() , m.speedup );
+		if( m.category=="golden" )
+		{
+			if( m.psnr==numeric_limits< double >::infinity() ) fprintf( fp , ", \"psnr\": null" );
+			else                                                fprintf( fp , ", \"psnr\": %.4f" , m.psnr );
+			fprintf( fp , ", \"max_error\": %d, \"pass\": %s" , m.maxError , m.passed ? "true" : "false" );
+		}
+		fprintf( fp , " }%s\n" , i+1<measurements.size() ? "," : "" );
+	}
+	fprintf( fp , "\t]\n" );
+	fprintf( fp , "}\n" );
+	fclose( fp );
+}
+
+/** This function runs the benchmarks on synthetic images of each of the sizes, with each of the thread counts */
+void RunBenchmarks( const vector< Benchmark > &benchmarks , const vector< double > &sizes , const vector< unsigned int > &threads , vector< Measurement > &measurements )
+{
+	const unsigned int hardwareThreads = ThreadCount();
+	for( double size : sizes )
+	{
+		Image32 img = SyntheticImage( size );
+		cout << "Image: " << img.width() << " x " << img.height() << " (" << setprecision(3) << img.width()*(double)img.height()/1e6 << " MP)" << endl;
+		cout << "\t" << left << setw(28) << "benchmark" << right << setw(8) << "threads" << setw(12) << "ms" << setw(12) << "ns/pixel" << setw(10) << "GB/s" << setw(10) << "speedup" << endl;
+		for( const Benchmark &b : benchmarks )
+		{
+			double serial = 0;
+			for( size_t t=0 ; t<threads.size() ; t++ )
+			{
+				Measurement m = Run( b , img , threads[t] , Repeat.value );
+				if( t==0 ) serial = m.median;
+				m.speedup = serial / m.median;
+				measurements.push_back( m );
+				cout << fixed;
+				cout << "\t" << left << setw(28) << m.name << right << setw(8) << m.threads << setw(12) << setprecision(2) << m.median*1e3 << setw(12) << m.nsPerPixel() << setw(10) << setprecision(3) << m.gbPerSecond() << setw(10) << setprecision(2) << m.speedup << endl;
+				cout << defaultfloat;
+			}
+		}
+		ThreadCount() = hardwareThreads;
+	}
+}
+
+int main( int argc , char *argv[] )
+{
+	CmdLineParse( argc-1 , argv+1 , params );
+	if( Help.set ){ ShowUsage( argv[0] ) ; return EXIT_SUCCESS; }
+
+	vector< Benchmark > benchmarks;
+	for( const Benchmark &b : Benchmarks() ) if( !Filter.set || b.name.find( Filter.value )!=string::npos ) benchmarks.push_back( b );
+	if( List.set )
+	{
+		for( const Benchmark &b : benchmarks ) cout << b.name << endl;
+		return EXIT_SUCCESS;
+	}
+
+	const unsigned int hardwareThreads = ThreadCount();
+	vector< double > sizes = Sizes.set ? vector< double >( Sizes.values , Sizes.values+Sizes.count ) : vector< double >{ 1. , 4. };
+	vector< unsigned int > threads;
+	if( Threads.set ) for( int i=0 ; i<Threads.count ; i++ ) threads.push_back( (unsigned int)std::max< int >( 1 , Threads.values[i] ) );
+	else
+	{
+		threads.push_back( 1 );
+		if( hardwareThreads>1 ) threads.push_back( hardwareThreads );
+	}
+	if( Repeat.value<1 ){ cerr << "Repeat count must be positive: " << Repeat.value << endl ; return EXIT_FAILURE; }
+
+	vector< Measurement > measurements;
+	int failures = 0 , mismatches = 0 , regressions = 0;
+	try
+	{
+		if( Golden.set ) failures = RunGolden( measurements );
+		else if( SIMDCheck.set ) mismatches = RunSIMDCheck();
+		else             RunBenchmarks( benchmarks , sizes , threads , measurements );
+		if( Baseline.set ) regressions = CompareBaseline( measurements );
+		if( JSON.set ) WriteJSON( JSON.value , measurements , hardwareThreads );
+	}
+	catch( const exception& e )
+	{
+		cerr << e.what() << endl;
+		return EXIT_FAILURE;
+	}
+	if( failures ) cerr << failures << " golden image(s) outside the tolerances" << endl;
+	if( mismatches ) cerr << mismatches << " JPEG output(s) differing between the SIMD and scalar code" << endl;
+	if( regressions ) cerr << regressions << " measurement(s) slower than the baseline by more than a factor of " << Slowdown.value << endl;
+	return failures || mismatches || regressions ? EXIT_FAILURE : EXIT_SUCCESS;
+}
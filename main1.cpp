@@ -1,158 +1,1208 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <iomanip>
+#include <algorithm>
+#ifdef WIN32
+#include <windows.h>
+#else // !WIN32
+#include <glob.h>
+#endif // WIN32
 #include "Image/bmp.h"
 #include "Image/jpeg.h"
 #include "Image/image.h"
+#include "Image/imageT.h"
+#include "Image/pipeline.h"
+#include "Image/tiled.h"
+#include "Image/histogram.h"
+#include "Image/convolution.h"
+#include "Image/cache.h"
 #include "Util/cmdLineParser.h"
+#include "Util/hash.h"
+#include "Util/ipc.h"
+#include "Util/parallel.h"
+#include "Util/profiler.h"
+#include "Util/timer.h"
 
 using namespace std;
 using namespace Util;
 using namespace Image;
 
-CmdLineParameter< string > Input( "in" );
-CmdLineParameter< string > Output( "out" );
-CmdLineParameterArray< string , 2 > Composite( "composite" );
-CmdLineParameterArray< string , 3 > BeierNeelyMorph( "bnMorph" );
-CmdLineParameterArray< int , 4 > Crop( "crop" );
-CmdLineParameterArray< double, 2 > BlurNXN("blurNXN");
-CmdLineParameterArray< int, 2 > Fun("fun");
-
-CmdLineParameter< double > Noisify( "noisify" , 0. );
-CmdLineParameter< double > Brighten( "brighten" , 1.  );
-CmdLineParameter< double > Contrast( "contrast" , 1. );
-CmdLineParameter< double > Saturate( "saturate" , 1. );
-CmdLineParameter< double > ScaleNearest( "scaleNearest" , 1. );
-CmdLineParameter< double > ScaleBilinear( "scaleBilinear" , 1. );
-CmdLineParameter< double > ScaleGaussian( "scaleGaussian" , 1. );
-CmdLineParameter< double > RotateNearest( "rotateNearest" , 0. );
-CmdLineParameter< double > RotateBilinear( "rotateBilinear" , 0. );
-CmdLineParameter< double > RotateGaussian( "rotateGaussian" , 0. );
-CmdLineParameter< int > Quantize( "quantize" , 8 );
-CmdLineParameter< int > RandomDither( "rDither" , 8 );
-CmdLineParameter< int > OrderedDither2X2( "oDither2x2" , 8 );
-CmdLineParameter< int > FloydSteinbergDither( "fsDither" , 8 );
-CmdLineReadable Gray( "gray" );
-CmdLineReadable Blur3X3( "blur3x3" );
-CmdLineReadable Edges3X3( "edges3x3" );
-
-CmdLineParameterArray< int, 2 > ShiftChannel("shiftChannel");
-
-
-
-CmdLineReadable* params[] =
-{
-	&Input , &Output , &Composite , &BeierNeelyMorph , &Crop , &Noisify , &Brighten , &Contrast , &Saturate ,
-	&ScaleNearest , &ScaleBilinear , &ScaleGaussian , &RotateNearest , &RotateBilinear , &RotateGaussian ,
-	&Quantize , &RandomDither , &OrderedDither2X2 , &FloydSteinbergDither , &Gray , &Blur3X3 , &Edges3X3 , &Fun , &BlurNXN, &ShiftChannel,
-	NULL
+/** This structure holds the parameters of a run, as set on the command line or by the arguments of a request to the server */
+struct Parameters
+{
+	CmdLineParameter< string > Input{ "in" };
+	CmdLineParameter< double > ReadScale{ "readScale" , 1. };
+	CmdLineParameter< string > Output{ "out" };
+	CmdLineParameter< string > Batch{ "batch" };
+	CmdLineParameter< int > BatchWorkers{ "batchWorkers" , 1 };
+	CmdLineParameter< int > BatchDepth{ "batchDepth" , 2 };
+	CmdLineParameter< int > Stream{ "stream" , 64 };
+	CmdLineParameter< int > Tiles{ "tiles" , 256 };
+	CmdLineParameter< double > TileCache{ "tileCache" , 1024. };
+	CmdLineParameter< string > Scratch{ "scratch" };
+	CmdLineParameter< int > JPEGQuality{ "jpegQuality" , 100 };
+	CmdLineReadable JPEGOptimize{ "jpegOptimize" };
+	CmdLineReadable JPEGProgressive{ "jpegProgressive" };
+	CmdLineParameter< string > JPEGSubsamplingName{ "jpegSubsampling" , JPEGSubsampling::Names[ JPEGSubsampling::S420 ] };
+	CmdLineParameter< int > JPEGRestart{ "jpegRestart" , 1 };
+	CmdLineParameter< string > JPEGDCTMethodName{ "jpegDCT" , JPEGDCTMethod::Names[ JPEGDCTMethod::ISLOW ] };
+	CmdLineParameter< string > JPEGTransformName{ "jpegTransform" , JPEGTransform::Names[ JPEGTransform::NONE ] };
+	CmdLineParameterArray< string , 2 > Composite{ "composite" };
+	CmdLineParameterArray< string , 3 > BeierNeelyMorph{ "bnMorph" };
+	CmdLineParameterArray< int , 4 > Crop{ "crop" };
+	CmdLineParameterArray< double, 2 > BlurNXN{ "blurNXN" };
+	CmdLineParameterArray< int, 2 > Fun{ "fun" };
+	CmdLineParameterArray< double , 2 > AutoLevels{ "autoLevels" };
+	CmdLineParameterArray< double , 2 > Canny{ "canny" };
+	CmdLineParameter< string > Convolve{ "convolve" };
+	CmdLineParameters< double > KernelValues{ "kernel" };
+	CmdLineParameter< string > ConvolutionMethodName{ "convolutionMethod" , ConvolutionMethod::Names[ ConvolutionMethod::AUTO ] };
+	CmdLineParameter< double > LowPass{ "lowPass" , 1. };
+	CmdLineParameter< double > HighPass{ "highPass" , 0. };
+	CmdLineParameterArray< double , 2 > BandPass{ "bandPass" };
+	CmdLineParameter< int > QuantizePalette{ "palette" , 256 };
+	CmdLineParameter< string > PaletteMethodName{ "paletteMethod" , PaletteMethod::Names[ PaletteMethod::MEDIAN_CUT ] };
+	CmdLineParameter< string > PaletteDither{ "paletteDither" , DitherMode::Names[ DitherMode::NONE ] };
+	CmdLineParameter< string > EdgeOperatorName{ "edgeOperator" , EdgeOperator::Names[ EdgeOperator::SOBEL ] };
+
+	CmdLineParameter< double > Noisify{ "noisify" , 0. };
+	CmdLineParameter< double > Brighten{ "brighten" , 1. };
+	CmdLineParameter< double > Contrast{ "contrast" , 1. };
+	CmdLineParameter< double > Saturate{ "saturate" , 1. };
+	CmdLineParameter< double > ScaleNearest{ "scaleNearest" , 1. };
+	CmdLineParameter< double > ScaleBilinear{ "scaleBilinear" , 1. };
+	CmdLineParameter< double > ScaleGaussian{ "scaleGaussian" , 1. };
+	CmdLineParameter< double > RotateNearest{ "rotateNearest" , 0. };
+	CmdLineParameter< double > RotateBilinear{ "rotateBilinear" , 0. };
+	CmdLineParameter< double > RotateGaussian{ "rotateGaussian" , 0. };
+	CmdLineParameter< int > Quantize{ "quantize" , 8 };
+	CmdLineParameter< int > RandomDither{ "rDither" , 8 };
+	CmdLineParameter< int > OrderedDither2X2{ "oDither2x2" , 8 };
+	CmdLineParameter< int > FloydSteinbergDither{ "fsDither" , 8 };
+	CmdLineReadable Gray{ "gray" };
+	CmdLineReadable Blur3X3{ "blur3x3" };
+	CmdLineReadable Edges3X3{ "edges3x3" };
+	CmdLineReadable Equalize{ "equalize" };
+	CmdLineReadable Gradient{ "gradient" };
+	CmdLineReadable Stats{ "stats" };
+	CmdLineReadable FloatPipeline{ "float" };
+	CmdLineReadable Profile{ "profile" };
+	CmdLineParameter< string > Trace{ "trace" };
+	CmdLineParameter< string > CacheDirectory{ "cache" };
+	CmdLineParameter< double > CacheSize{ "cacheSize" , 1024. };
+	CmdLineParameter< string > Serve{ "serve" };
+	CmdLineParameter< string > Connect{ "connect" };
+	CmdLineParameter< string > TransferName{ "transfer" , "file" };
+
+	CmdLineParameterArray< int, 2 > ShiftChannel{ "shiftChannel" };
+
+	Parameters( void ){}
+	Parameters( const Parameters& ) = delete;
+	Parameters& operator = ( const Parameters& ) = delete;
+
+	/** This method returns the parameters, terminated by a NULL pointer */
+	vector< CmdLineReadable * > list( void )
+	{
+		return
+		{
+			&Input , &ReadScale , &Output , &Batch , &BatchWorkers , &BatchDepth , &Stream , &Tiles , &TileCache , &Scratch , &FloatPipeline , &Profile , &Trace , &CacheDirectory , &CacheSize , &Serve , &Connect , &TransferName , &JPEGQuality , &JPEGOptimize , &JPEGProgressive , &JPEGSubsamplingName , &JPEGRestart , &JPEGDCTMethodName , &JPEGTransformName ,
+			&Composite , &BeierNeelyMorph , &Crop , &Noisify , &Brighten , &Contrast , &Saturate ,
+			&ScaleNearest , &ScaleBilinear , &ScaleGaussian , &RotateNearest , &RotateBilinear , &RotateGaussian ,
+			&Quantize , &RandomDither , &OrderedDither2X2 , &FloydSteinbergDither , &Gray , &Blur3X3 , &Edges3X3 , &Fun , &BlurNXN, &ShiftChannel,
+			&Equalize , &AutoLevels , &Stats , &Gradient , &Canny , &EdgeOperatorName ,
+			&Convolve , &KernelValues , &ConvolutionMethodName , &LowPass , &HighPass , &BandPass ,
+			&QuantizePalette , &PaletteMethodName , &PaletteDither ,
+			NULL
+		};
+	}
+
+	/** This method sets the parameters from the list of arguments */
+	void parse( int argc , char **argv ){ vector< CmdLineReadable * > l = list() ; CmdLineParse( argc , argv , &l[0] ); }
 };
 
-void ShowUsage( const string &ex )
+void ShowUsage( const string &ex , const Parameters &p )
 {
 	cout << "Usage " << ex << ":" << endl;
-	cout << "\t --" << Input.name    << " <input image>" << endl;
-	cout << "\t[--" << Output.name   << " <output image>]" << endl;
-	cout << "\t[--" << Noisify.name  << " <size of noise>=" << Noisify.value << "]" << endl;
-	cout << "\t[--" << Brighten.name << " <brightening factor>=" << Brighten.value << "]" << endl;
-	cout << "\t[--" << Contrast.name << " <contrast factor>=" << Contrast.value << "]" << endl;
-	cout << "\t[--" << Saturate.name << " <saturation factor>=" << Saturate.value << "]" << endl;
-	cout << "\t[--" << Quantize.name << " <bits per channel>=" << Quantize.value << "]" << endl;
-	cout << "\t[--" << RandomDither.name << " <bits per channel with random dithering>=" << RandomDither.value << "]" << endl;
-	cout << "\t[--" << OrderedDither2X2.name << " <bits per channel with ordered dithering>=" << OrderedDither2X2.value << "]" << endl;
-	cout << "\t[--" << FloydSteinbergDither.name << " <bits per channel with Floyd-Steinberg dithering>=" << FloydSteinbergDither.value << "]" << endl;
-	cout << "\t[--" << Composite.name << " <overlay image> <matte image>]" << endl;
-	cout << "\t[--" << BeierNeelyMorph.name << " <destination image> <line segment pair list> <time step>]" << endl;
-	cout << "\t[--" << Crop.name << " <x1> <y1> <x2> <y2>]" << endl;
-	cout << "\t[--" << ScaleNearest.name << " <scale factor>=" << ScaleNearest.value << "]" << endl;
-	cout << "\t[--" << ScaleBilinear.name << " <scale factor>=" << ScaleBilinear.value << "]" << endl;
-	cout << "\t[--" << ScaleGaussian.name << " <scale factor>=" << ScaleGaussian.value << "]" << endl;
-	cout << "\t[--" << RotateNearest.name << " <angle (in degrees)>=" << RotateNearest.value << "]" << endl;
-	cout << "\t[--" << RotateBilinear.name << " <angle (in degrees)>=" << RotateBilinear.value << "]" << endl;
-	cout << "\t[--" << RotateGaussian.name << " <angle (in degrees)>=" << RotateGaussian.value << "]" << endl;
-	cout << "\t[--" << Blur3X3.name << "]" << endl;
-	cout << "\t[--" << Edges3X3.name << "]" << endl;
-	cout << "\t[--" << Fun.name << "]" << endl;
-	cout << "\t[--" << Gray.name << "]" << endl;
-	cout << "\t[--" << BlurNXN.name << " <radius> <sigma> " << endl;
-	cout << "\t[--" << ShiftChannel.name << " <channel (0 for a, 1 for r, 2 for g, 3 for b)> <amount>" << endl;
+	cout << "\t --" << p.Input.name    << " <input image (- for the standard input)>" << endl;
+	cout << "\t[--" << p.ReadScale.name << " <scale factor applied while reading the input>=" << p.ReadScale.value << "]" << endl;
+	cout << "\t[--" << p.Output.name   << " <output image (- or <extension>:- for the standard output, or with %s standing for the input's name in batch mode)>]" << endl;
+	cout << "\t[--" << p.Batch.name << " <manifest of input and output images, one pair per line, or wildcard pattern of input images>]" << endl;
+	cout << "\t[--" << p.BatchWorkers.name << " <threads per batch stage>=" << p.BatchWorkers.value << "]" << endl;
+	cout << "\t[--" << p.BatchDepth.name << " <images queued between batch stages>=" << p.BatchDepth.value << "]" << endl;
+	cout << "\t[--" << p.Stream.name << " <rows per band when streaming the image through the filters>=" << p.Stream.value << "]" << endl;
+	cout << "\t[--" << p.Tiles.name << " <width and height of the tiles when filtering the image out of core>=" << p.Tiles.value << "]" << endl;
+	cout << "\t[--" << p.TileCache.name << " <memory held by the tiles (in MB)>=" << p.TileCache.value << "]" << endl;
+	cout << "\t[--" << p.Scratch.name << " <directory of the scratch files holding the tiles that do not fit in memory>]" << endl;
+	cout << "\t[--" << p.FloatPipeline.name << " (apply the supported filters to float channels, quantizing once)]" << endl;
+	cout << "\t[--" << p.Profile.name << " (output the time and image memory taken by each stage)]" << endl;
+	cout << "\t[--" << p.Trace.name << " <Chrome trace-event file of the profiled stages>]" << endl;
+	cout << "\t[--" << p.CacheDirectory.name << " <directory caching the results of the filter chain, and of its prefixes>]" << endl;
+	cout << "\t[--" << p.CacheSize.name << " <maximum size of the cache (in MB)>=" << p.CacheSize.value << "]" << endl;
+	cout << "\t[--" << p.Serve.name << " <socket at which to serve requests, each with the arguments of a command line>]" << endl;
+	cout << "\t[--" << p.Connect.name << " <socket of the server to send the filters to, for the input image or the batch>]" << endl;
+	cout << "\t[--" << p.TransferName.name << " <how the pixels pass to and from the server (file, inline, or shared)>=" << p.TransferName.value << "]" << endl;
+	cout << "\t[--" << p.JPEGQuality.name << " <JPEG output quality>=" << p.JPEGQuality.value << "]" << endl;
+	cout << "\t[--" << p.JPEGOptimize.name << "]" << endl;
+	cout << "\t[--" << p.JPEGProgressive.name << "]" << endl;
+	cout << "\t[--" << p.JPEGSubsamplingName.name << " <JPEG chroma subsampling (444, 422, or 420)>=" << p.JPEGSubsamplingName.value << "]" << endl;
+	cout << "\t[--" << p.JPEGRestart.name << " <MCU rows between JPEG restart markers (0 for none)>=" << p.JPEGRestart.value << "]" << endl;
+	cout << "\t[--" << p.JPEGDCTMethodName.name << " <JPEG DCT method (islow, ifast, or float)>=" << p.JPEGDCTMethodName.value << "]" << endl;
+	cout << "\t[--" << p.JPEGTransformName.name << " <lossless JPEG-to-JPEG transform, followed by the crop if any, and combined with no other option (none, flipH, flipV, transpose, transverse, rot90, rot180, or rot270)>=" << p.JPEGTransformName.value << "]" << endl;
+	cout << "\t[--" << p.Noisify.name  << " <size of noise>=" << p.Noisify.value << "]" << endl;
+	cout << "\t[--" << p.Brighten.name << " <brightening factor>=" << p.Brighten.value << "]" << endl;
+	cout << "\t[--" << p.Contrast.name << " <contrast factor>=" << p.Contrast.value << "]" << endl;
+	cout << "\t[--" << p.Saturate.name << " <saturation factor>=" << p.Saturate.value << "]" << endl;
+	cout << "\t[--" << p.Quantize.name << " <bits per channel>=" << p.Quantize.value << "]" << endl;
+	cout << "\t[--" << p.RandomDither.name << " <bits per channel with random dithering>=" << p.RandomDither.value << "]" << endl;
+	cout << "\t[--" << p.OrderedDither2X2.name << " <bits per channel with ordered dithering>=" << p.OrderedDither2X2.value << "]" << endl;
+	cout << "\t[--" << p.FloydSteinbergDither.name << " <bits per channel with Floyd-Steinberg dithering>=" << p.FloydSteinbergDither.value << "]" << endl;
+	cout << "\t[--" << p.QuantizePalette.name << " <number of palette colors>=" << p.QuantizePalette.value << "]" << endl;
+	cout << "\t[--" << p.PaletteMethodName.name << " <palette method (medianCut or kMeans)>=" << p.PaletteMethodName.value << "]" << endl;
+	cout << "\t[--" << p.PaletteDither.name << " <palette dithering (none, ordered, or floydSteinberg)>=" << p.PaletteDither.value << "]" << endl;
+	cout << "\t[--" << p.Composite.name << " <overlay image> <matte image>]" << endl;
+	cout << "\t[--" << p.BeierNeelyMorph.name << " <destination image> <line segment pair list> <time step>]" << endl;
+	cout << "\t[--" << p.Crop.name << " <x1> <y1> <x2> <y2>]" << endl;
+	cout << "\t[--" << p.ScaleNearest.name << " <scale factor>=" << p.ScaleNearest.value << "]" << endl;
+	cout << "\t[--" << p.ScaleBilinear.name << " <scale factor>=" << p.ScaleBilinear.value << "]" << endl;
+	cout << "\t[--" << p.ScaleGaussian.name << " <scale factor>=" << p.ScaleGaussian.value << "]" << endl;
+	cout << "\t[--" << p.RotateNearest.name << " <angle (in degrees)>=" << p.RotateNearest.value << "]" << endl;
+	cout << "\t[--" << p.RotateBilinear.name << " <angle (in degrees)>=" << p.RotateBilinear.value << "]" << endl;
+	cout << "\t[--" << p.RotateGaussian.name << " <angle (in degrees)>=" << p.RotateGaussian.value << "]" << endl;
+	cout << "\t[--" << p.Blur3X3.name << "]" << endl;
+	cout << "\t[--" << p.Edges3X3.name << "]" << endl;
+	cout << "\t[--" << p.Fun.name << "]" << endl;
+	cout << "\t[--" << p.Gray.name << "]" << endl;
+	cout << "\t[--" << p.BlurNXN.name << " <radius> <sigma> " << endl;
+	cout << "\t[--" << p.ShiftChannel.name << " <channel (0 for a, 1 for r, 2 for g, 3 for b)> <amount>" << endl;
+	cout << "\t[--" << p.Equalize.name << "]" << endl;
+	cout << "\t[--" << p.AutoLevels.name << " <low percentile> <high percentile>]" << endl;
+	cout << "\t[--" << p.Stats.name << "]" << endl;
+	cout << "\t[--" << p.Gradient.name << "]" << endl;
+	cout << "\t[--" << p.Canny.name << " <low threshold> <high threshold> (gradient magnitudes, with a black to white step at 255)]" << endl;
+	cout << "\t[--" << p.Convolve.name << " <kernel file>]" << endl;
+	cout << "\t[--" << p.KernelValues.name << " <number of values> <values of the square kernel in row-major order>]" << endl;
+	cout << "\t[--" << p.ConvolutionMethodName.name << " <convolution method (auto, direct, separable, or fft; only auto with --float)>=" << p.ConvolutionMethodName.value << "]" << endl;
+	cout << "\t[--" << p.LowPass.name << " <cutoff (fraction of Nyquist)>=" << p.LowPass.value << "]" << endl;
+	cout << "\t[--" << p.HighPass.name << " <cutoff (fraction of Nyquist)>=" << p.HighPass.value << "]" << endl;
+	cout << "\t[--" << p.BandPass.name << " <low cutoff> <high cutoff>]" << endl;
+	cout << "\t[--" << p.EdgeOperatorName.name << " <edge operator (sobel or scharr)>=" << p.EdgeOperatorName.value << "]" << endl;
 }
 
-int main( int argc , char *argv[] )
-{
-	CmdLineParse( argc-1 , argv+1 , params );
-	if( !Input.set ) { ShowUsage( argv[0] ) ; return EXIT_FAILURE; }
+/** The cache of filter chain results, if --cache is set */
+ImageCache *Cache = NULL;
 
-	// Try to read in the input image
+/** This structure holds the image passing through the filter chain. With --float, the filters supported by ImageF are applied to float channels,
+*** and the image is only quantized when a filter that requires an Image32 (or the output) is reached. */
+struct ChainImage
+{
 	Image32 image;
-	image.read( Input.value );
-	cout << "Input dimensions: " << image.width() << " x " << image.height() << endl;;
+	ImageF floatImage;
+	bool isFloat;
 
-	try
-	{
-		// Filter the image
-		if( Noisify.set )              image = image.addRandomNoise( Noisify.value );
-		if( Brighten.set )             image = image.brighten( Brighten.value );
-		if( Gray.set )                 image = image.luminance();
-		if( Contrast.set )             image = image.contrast( Contrast.value );
-		if( Saturate.set )             image = image.saturate( Saturate.value );
-		if( Quantize.set )             image = image.quantize( Quantize.value );
-		if( RandomDither.set )         image = image.randomDither( RandomDither.value );
-		if( OrderedDither2X2.set )     image = image.orderedDither2X2( OrderedDither2X2.value );
-		if( FloydSteinbergDither.set ) image = image.floydSteinbergDither( FloydSteinbergDither.value );
+	/** Are the filters supported by ImageF applied to float channels */
+	bool useFloat;
+
+	ChainImage( Image32 image , bool useFloat ) : image( std::move( image ) ) , isFloat(false) , useFloat(useFloat) {}
+
+	/** This method returns the image in float channels */
+	ImageF &asFloat( void ){ if( !isFloat ) floatImage = ImageF( image ) , isFloat = true ; return floatImage; }
+
+	/** This method returns the image in fixed channels */
+	Image32 &asFixed( void ){ if( isFloat ) image = floatImage.toImage32() , isFloat = false ; return image; }
+
+	/** This method applies a filter that is supported by both Image32 and ImageF, to float channels with --float */
+	template< typename Filter >
+	void filter( Filter f ){ if( useFloat ) asFloat() = f( asFloat() ); else image = f( image ); }
+};
+
+/** This structure describes a stage of the filter chain */
+struct FilterStage
+{
+	/** The canonical description of the stage: its name and arguments, with the files it reads identified by their contents when caching */
+	string description;
+
+	/** Does the stage always map the same input to the same output */
+	bool deterministic;
+
+	/** The function applying the stage */
+	function< void ( ChainImage & ) > apply;
+};
+
+/** This class builds the canonical description of a stage, with the numbers written at full precision */
+class StageDescription
+{
+	ostringstream _stream;
+public:
+	StageDescription( const char *name ){ _stream << setprecision( 17 ) << name; }
+	template< typename Data > StageDescription &operator << ( const Data &data ){ _stream << " " << data ; return *this; }
+	operator string ( void ) const { return _stream.str(); }
+};
 
-		if( Composite.set )
+/** This function returns how a file read by a stage is described: by the digest of its contents when caching, and otherwise by its name */
+string FileDescription( const string &fileName ){ return Cache ? SHA256::FileDigest( fileName ) : fileName; }
+
+/** This function returns the stages of the filter chain set on the command line, in the order in which they are applied */
+vector< FilterStage > FilterChain( const Parameters &p )
+{
+	vector< FilterStage > stages;
+	auto Stage = [&]( string description , function< void ( ChainImage & ) > apply , bool deterministic=true ){ stages.push_back( FilterStage{ description , deterministic , apply } ); };
+
+	if( p.Noisify.set )              Stage( StageDescription( "noisify" ) << p.Noisify.value , [&p]( ChainImage &c ){ c.image = c.asFixed().addRandomNoise( p.Noisify.value ); } , false );
+	if( p.Brighten.set )             Stage( StageDescription( "brighten" ) << p.Brighten.value , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.brighten( p.Brighten.value ); } ); } );
+	if( p.Gray.set )                 Stage( StageDescription( "gray" ) , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.luminance(); } ); } );
+	if( p.Contrast.set )             Stage( StageDescription( "contrast" ) << p.Contrast.value , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.contrast( p.Contrast.value ); } ); } );
+	if( p.Saturate.set )             Stage( StageDescription( "saturate" ) << p.Saturate.value , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.saturate( p.Saturate.value ); } ); } );
+	if( p.Equalize.set )             Stage( StageDescription( "equalize" ) , [&p]( ChainImage &c ){ c.image = c.asFixed().equalize(); } );
+	if( p.AutoLevels.set )           Stage( StageDescription( "autoLevels" ) << p.AutoLevels.values[0] << p.AutoLevels.values[1] , [&p]( ChainImage &c ){ c.image = c.asFixed().autoLevels( p.AutoLevels.values[0] , p.AutoLevels.values[1] ); } );
+	if( p.Quantize.set )             Stage( StageDescription( "quantize" ) << p.Quantize.value , [&p]( ChainImage &c ){ c.image = c.asFixed().quantize( p.Quantize.value ); } );
+	if( p.RandomDither.set )         Stage( StageDescription( "rDither" ) << p.RandomDither.value , [&p]( ChainImage &c ){ c.image = c.asFixed().randomDither( p.RandomDither.value ); } , false );
+	if( p.OrderedDither2X2.set )     Stage( StageDescription( "oDither2x2" ) << p.OrderedDither2X2.value , [&p]( ChainImage &c ){ c.image = c.asFixed().orderedDither2X2( p.OrderedDither2X2.value ); } );
+	if( p.FloydSteinbergDither.set ) Stage( StageDescription( "fsDither" ) << p.FloydSteinbergDither.value , [&p]( ChainImage &c ){ c.image = c.asFixed().floydSteinbergDither( p.FloydSteinbergDither.value ); } );
+	if( p.QuantizePalette.set )
+		Stage( StageDescription( "palette" ) << p.QuantizePalette.value << PaletteMethod::Names[ PaletteMethod::Parse( p.PaletteMethodName.value ) ] << DitherMode::Names[ DitherMode::Parse( p.PaletteDither.value ) ] ,
+			[&p]( ChainImage &c ){ c.image = c.asFixed().quantizePalette( p.QuantizePalette.value , PaletteMethod::Parse( p.PaletteMethodName.value ) , DitherMode::Parse( p.PaletteDither.value ) ); } );
+
+	if( p.Composite.set )
+		Stage( StageDescription( "composite" ) << FileDescription( p.Composite.values[0] ) << FileDescription( p.Composite.values[1] ) , [&p]( ChainImage &c )
 		{
 			Image32 overlay , matte;
 			// Read in the target image
-			overlay.read( Composite.values[0] );
+			overlay.read( p.Composite.values[0] );
 			// Read in the matte image
-			matte.read( Composite.values[1] );
+			matte.read( p.Composite.values[1] );
 			// Set the alpha value of the overlay image using the values of the matte image
 			overlay.setAlpha( matte );
 			// Perform the compositing
-			image = image.composite( overlay );
-		}
-		if( Blur3X3.set )  image = image.blur3X3();
-		if( Edges3X3.set ) image = image.edgeDetect3X3();
-		if( ScaleNearest.set )  image = image.scaleNearest ( ScaleNearest.value  );
-		if( ScaleBilinear.set ) image = image.scaleBilinear( ScaleBilinear.value );
-		if( ScaleGaussian.set ) image = image.scaleGaussian( ScaleGaussian.value );
-		if( RotateNearest.set )  image = image.rotateNearest ( RotateNearest.value  );
-		if( RotateBilinear.set ) image = image.rotateBilinear( RotateBilinear.value );
-		if( RotateGaussian.set ) image = image.rotateGaussian( RotateGaussian.value );
-		if (ShiftChannel.set) image = image.shiftChannel(ShiftChannel.values[0], ShiftChannel.values[1]);
-		if( Fun.set ) image = image.funFilter(Fun.values[0], Fun.values[1]);
-		if( Crop.set ) image = image.crop( Crop.values[0] , Crop.values[1] , Crop.values[2] , Crop.values[3] );
-		if (BlurNXN.set) image = image.blurNXN(BlurNXN.values[0], BlurNXN.values[1]);
-
-		if( BeierNeelyMorph.set )
-		{
-			double timeStep = atof( BeierNeelyMorph.values[2].c_str() );
+			c.image = c.asFixed().composite( overlay );
+		} );
+	if( p.Blur3X3.set )  Stage( StageDescription( "blur3x3" ) , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.blur3X3(); } ); } );
+	if( p.Edges3X3.set ) Stage( StageDescription( "edges3x3" ) , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.edgeDetect3X3(); } ); } );
+	// The float convolution chooses between the direct and separable methods itself, so the method is neither set nor part of the description
+	if( ( p.Convolve.set || p.KernelValues.set ) && p.FloatPipeline.set && ConvolutionMethod::Parse( p.ConvolutionMethodName.value )!=ConvolutionMethod::AUTO )
+		THROW( "--%s %s is not supported with --%s" , p.ConvolutionMethodName.name.c_str() , p.ConvolutionMethodName.value.c_str() , p.FloatPipeline.name.c_str() );
+	if( p.Convolve.set )
+	{
+		StageDescription description( "convolve" );
+		description << FileDescription( p.Convolve.value );
+		if( !p.FloatPipeline.set ) description << ConvolutionMethod::Names[ ConvolutionMethod::Parse( p.ConvolutionMethodName.value ) ];
+		Stage( description , [&p]( ChainImage &c )
+		{
+			Kernel kernel;
+			kernel.read( p.Convolve.value );
+			if( p.FloatPipeline.set ) c.asFloat() = c.asFloat().convolve( kernel );
+			else                    c.image = c.asFixed().convolve( kernel , ConvolutionMethod::Parse( p.ConvolutionMethodName.value ) );
+		} );
+	}
+	if( p.KernelValues.set )
+	{
+		StageDescription description( "kernel" );
+		for( int i=0 ; i<p.KernelValues.count ; i++ ) description << p.KernelValues.values[i];
+		if( !p.FloatPipeline.set ) description << ConvolutionMethod::Names[ ConvolutionMethod::Parse( p.ConvolutionMethodName.value ) ];
+		Stage( description , [&p]( ChainImage &c )
+		{
+			int size = (int)floor( sqrt( (double)p.KernelValues.count ) + 0.5 );
+			if( size*size!=p.KernelValues.count ) THROW( "Number of kernel values is not a square: %d" , p.KernelValues.count );
+			Kernel kernel( size , size );
+			for( int y=0 ; y<size ; y++ ) for( int x=0 ; x<size ; x++ ) kernel(x,y) = p.KernelValues.values[ y*size+x ];
+			if( p.FloatPipeline.set ) c.asFloat() = c.asFloat().convolve( kernel );
+			else                    c.image = c.asFixed().convolve( kernel , ConvolutionMethod::Parse( p.ConvolutionMethodName.value ) );
+		} );
+	}
+	if( p.LowPass.set )  Stage( StageDescription( "lowPass" ) << p.LowPass.value , [&p]( ChainImage &c ){ c.image = c.asFixed().lowPass( p.LowPass.value ); } );
+	if( p.HighPass.set ) Stage( StageDescription( "highPass" ) << p.HighPass.value , [&p]( ChainImage &c ){ c.image = c.asFixed().highPass( p.HighPass.value ); } );
+	if( p.BandPass.set ) Stage( StageDescription( "bandPass" ) << p.BandPass.values[0] << p.BandPass.values[1] , [&p]( ChainImage &c ){ c.image = c.asFixed().bandPass( p.BandPass.values[0] , p.BandPass.values[1] ); } );
+	if( p.Gradient.set ) Stage( StageDescription( "gradient" ) << EdgeOperator::Names[ EdgeOperator::Parse( p.EdgeOperatorName.value ) ] , [&p]( ChainImage &c ){ c.image = c.asFixed().gradientMagnitude( EdgeOperator::Parse( p.EdgeOperatorName.value ) ); } );
+	if( p.Canny.set )    Stage( StageDescription( "canny" ) << p.Canny.values[0] << p.Canny.values[1] << EdgeOperator::Names[ EdgeOperator::Parse( p.EdgeOperatorName.value ) ] , [&p]( ChainImage &c ){ c.image = c.asFixed().canny( p.Canny.values[0] , p.Canny.values[1] , EdgeOperator::Parse( p.EdgeOperatorName.value ) ); } );
+	if( p.ScaleNearest.set )  Stage( StageDescription( "scaleNearest" ) << p.ScaleNearest.value , [&p]( ChainImage &c ){ c.image = c.asFixed().scaleNearest ( p.ScaleNearest.value  ); } );
+	if( p.ScaleBilinear.set ) Stage( StageDescription( "scaleBilinear" ) << p.ScaleBilinear.value , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.scaleBilinear( p.ScaleBilinear.value ); } ); } );
+	if( p.ScaleGaussian.set ) Stage( StageDescription( "scaleGaussian" ) << p.ScaleGaussian.value , [&p]( ChainImage &c ){ c.image = c.asFixed().scaleGaussian( p.ScaleGaussian.value ); } );
+	if( p.RotateNearest.set )  Stage( StageDescription( "rotateNearest" ) << p.RotateNearest.value , [&p]( ChainImage &c ){ c.image = c.asFixed().rotateNearest ( p.RotateNearest.value  ); } );
+	if( p.RotateBilinear.set ) Stage( StageDescription( "rotateBilinear" ) << p.RotateBilinear.value , [&p]( ChainImage &c ){ c.image = c.asFixed().rotateBilinear( p.RotateBilinear.value ); } );
+	if( p.RotateGaussian.set ) Stage( StageDescription( "rotateGaussian" ) << p.RotateGaussian.value , [&p]( ChainImage &c ){ c.image = c.asFixed().rotateGaussian( p.RotateGaussian.value ); } );
+	if (p.ShiftChannel.set) Stage( StageDescription( "shiftChannel" ) << p.ShiftChannel.values[0] << p.ShiftChannel.values[1] , [&p]( ChainImage &c ){ c.image = c.asFixed().shiftChannel(p.ShiftChannel.values[0], p.ShiftChannel.values[1]); } );
+	if( p.Fun.set ) Stage( StageDescription( "fun" ) << p.Fun.values[0] << p.Fun.values[1] , [&p]( ChainImage &c ){ c.image = c.asFixed().funFilter(p.Fun.values[0], p.Fun.values[1]); } );
+	if( p.Crop.set ) Stage( StageDescription( "crop" ) << p.Crop.values[0] << p.Crop.values[1] << p.Crop.values[2] << p.Crop.values[3] , [&p]( ChainImage &c ){ c.filter( [&]( const auto &img ){ return img.crop( p.Crop.values[0] , p.Crop.values[1] , p.Crop.values[2] , p.Crop.values[3] ); } ); } );
+	if (p.BlurNXN.set) Stage( StageDescription( "blurNXN" ) << p.BlurNXN.values[0] << p.BlurNXN.values[1] , [&p]( ChainImage &c ){ c.image = c.asFixed().blurNXN(p.BlurNXN.values[0], p.BlurNXN.values[1]); } );
+
+	if( p.BeierNeelyMorph.set )
+		Stage( StageDescription( "bnMorph" ) << FileDescription( p.BeierNeelyMorph.values[0] ) << FileDescription( p.BeierNeelyMorph.values[1] ) << p.BeierNeelyMorph.values[2] , [&p]( ChainImage &c )
+		{
+			double timeStep = atof( p.BeierNeelyMorph.values[2].c_str() );
 			timeStep = timeStep / 9.0;
 			Image32 dest;
 			OrientedLineSegmentPairs olsp;
 
 			// Read the destination image
-			dest.read( BeierNeelyMorph.values[0] );
+			dest.read( p.BeierNeelyMorph.values[0] );
 			// Read in the list of corresponding line segments
 			ifstream istream;
-			istream.open( BeierNeelyMorph.values[1] );
-			if( !istream ) THROW( "Failed to open file for reading: %s\n" , BeierNeelyMorph.values[1].c_str() );
+			istream.open( p.BeierNeelyMorph.values[1] );
+			if( !istream ) THROW( "Failed to open file for reading: %s\n" , p.BeierNeelyMorph.values[1].c_str() );
 			try{ istream >> olsp; }
-			catch( Util::Exception e ){ THROW( "failed to read OrientedLineSegmentPairs: %s\n%s" , BeierNeelyMorph.values[1].c_str() , e.what() ); }
-			image = Image32::BeierNeelyMorph( image , dest , olsp , timeStep );
+			catch( Util::Exception e ){ THROW( "failed to read OrientedLineSegmentPairs: %s\n%s" , p.BeierNeelyMorph.values[1].c_str() , e.what() ); }
+			c.image = Image32::BeierNeelyMorph( c.asFixed() , dest , olsp , timeStep );
+		} );
+	return stages;
+}
+
+/** This function returns the cache keys of the results of the prefixes of the filter chain applied to the source image.
+*** The key is empty for a result that is not cached: one following a stage that is not deterministic, or, with --float, any but the final one. */
+vector< string > ChainKeys( const Parameters &p , const string &source , const vector< FilterStage > &stages )
+{
+	vector< string > keys( stages.size() );
+	SHA256 sha;
+	sha.update( "Image32 filter chain 1\n" + source + ( p.FloatPipeline.set ? " float" : "" ) + "\n" );
+	for( size_t i=0 ; i<stages.size() && stages[i].deterministic ; i++ )
+	{
+		sha.update( stages[i].description + "\n" );
+		if( !p.FloatPipeline.set || i+1==stages.size() ) keys[i] = SHA256( sha ).digest();
+	}
+	return keys;
+}
+
+/** This function returns the description of the source image read from the file (scaled while reading if requested), or an empty string if the result is not cached */
+string FileSource( const Parameters &p , const string &fileName )
+{
+	if( !Cache || fileName=="-" ) return string();
+	if( p.ReadScale.set ) return StageDescription( "file" ) << SHA256::FileDigest( fileName ) << "scale" << p.ReadScale.value;
+	else                return StageDescription( "file" ) << SHA256::FileDigest( fileName );
+}
+
+/** This function returns the description of a source image by its pixels, or an empty string if the result is not cached */
+string ImageSource( const Image32 &image )
+{
+	if( !Cache || !image.width() || !image.height() ) return string();
+	SHA256 sha;
+	for( int y=0 ; y<image.height() ; y++ ) sha.update( image.row(y) , sizeof(Pixel32)*image.width() );
+	return StageDescription( "pixels" ) << image.width() << image.height() << sha.digest();
+}
+
+/** This function returns true, setting the image, if the result of the whole filter chain applied to the source image is cached */
+bool CachedResult( const Parameters &p , const string &source , Image32 &image )
+{
+	if( !Cache || source.empty() ) return false;
+	vector< string > keys = ChainKeys( p , source , FilterChain( p ) );
+	return keys.size() && keys.back().size() && Cache->load( keys.back() , image );
+}
+
+/** This function applies the filters to the image. With --cache, and the description of the source image, the stages whose results are cached
+*** (for the longest prefix of the chain) are skipped, and the results of the remaining stages are cached, so chains sharing a prefix share its work. */
+Image32 Process( const Parameters &p , Image32 image , const string &source=string() )
+{
+	ProfileScope scope( "process" , "main" );
+	vector< FilterStage > stages = FilterChain( p );
+	ChainImage chain( std::move( image ) , p.FloatPipeline.set );
+
+	vector< string > keys;
+	size_t start = 0;
+	if( Cache && source.size() ) keys = ChainKeys( p , source , stages );
+	for( size_t i=keys.size() ; i>0 && !start ; i-- ) if( keys[i-1].size() && Cache->load( keys[i-1] , chain.image ) ) start = i;
+
+	// Filter the image
+	for( size_t i=start ; i<stages.size() ; i++ )
+	{
+		stages[i].apply( chain );
+		if( i<keys.size() && keys[i].size() ) Cache->store( keys[i] , chain.asFixed() );
+	}
+	return chain.asFixed();
+}
+
+/** This function reads in the image, scaled while reading if requested */
+Image32 Read( const Parameters &p , string fileName )
+{
+	Image32 image;
+	if( p.ReadScale.set ) image.read( fileName , p.ReadScale.value );
+	else                image.read( fileName );
+	return image;
+}
+
+/** This function reads in the image and applies the filters, reporting the input's dimensions.
+*** If the result of the whole filter chain is cached, the image is not decoded (unless it is scaled while read, as its dimensions are then only known once decoded). */
+Image32 ReadAndProcess( const Parameters &p , const string &fileName , ostream &messages )
+{
+	string source = FileSource( p , fileName );
+	Image32 image;
+	if( !p.ReadScale.set && CachedResult( p , source , image ) )
+	{
+		ImageFileReader reader( fileName );
+		messages << "Input dimensions: " << reader.width() << " x " << reader.height() << endl;
+		return image;
+	}
+	image = Read( p , fileName );
+	messages << "Input dimensions: " << image.width() << " x " << image.height() << endl;
+	return Process( p , std::move( image ) , source );
+}
+
+/** This function returns the options for writing JPEGs */
+JPEGWriteOptions JPEGOptions( const Parameters &p )
+{
+	JPEGWriteOptions jpegOptions( p.JPEGQuality.value );
+	jpegOptions.optimize = p.JPEGOptimize.set;
+	jpegOptions.progressive = p.JPEGProgressive.set;
+	jpegOptions.subsampling = JPEGSubsampling::Parse( p.JPEGSubsamplingName.value );
+	jpegOptions.restartRows = p.JPEGRestart.value;
+	jpegOptions.dctMethod = JPEGDCTMethod::Parse( p.JPEGDCTMethodName.value );
+	return jpegOptions;
+}
+
+/** This function writes out the image, with the JPEG options if it is written as a JPEG */
+void Write( const Parameters &p , const Image32 &image , string fileName ){ image.write( fileName , JPEGOptions( p ) ); }
+
+/** This function returns the filters that are set as band filters, for streaming the image through them.
+*** An exception is thrown if a filter that is set needs more than a bounded number of rows around each output row, or changes the dimensions. */
+vector< BandFilter > BandFilters( const Parameters &p )
+{
+	const CmdLineReadable *unstreamable[] =
+	{
+		&p.ReadScale , &p.Noisify , &p.Contrast , &p.Equalize , &p.AutoLevels , &p.RandomDither , &p.OrderedDither2X2 , &p.FloydSteinbergDither , &p.QuantizePalette , &p.Composite ,
+		&p.Edges3X3 , &p.LowPass , &p.HighPass , &p.BandPass , &p.Gradient , &p.Canny , &p.ScaleNearest , &p.ScaleBilinear , &p.ScaleGaussian , &p.RotateNearest , &p.RotateBilinear , &p.RotateGaussian ,
+		&p.Fun , &p.Crop , &p.BeierNeelyMorph , &p.FloatPipeline , &p.Stats
+	};
+	for( size_t i=0 ; i<sizeof(unstreamable)/sizeof(CmdLineReadable*) ; i++ ) if( unstreamable[i]->set ) THROW( "Cannot stream or tile the image with --%s" , unstreamable[i]->name.c_str() );
+
+	// The filters, in the order in which Process applies them
+	vector< BandFilter > filters;
+	auto Convolution = [&]( const Kernel &kernel )
+	{
+		int method = ConvolutionMethod::Parse( p.ConvolutionMethodName.value );
+		filters.push_back( BandFilter( std::max< int >( kernel.width() , kernel.height() )/2 , [=]( const Image32 &band ){ return band.convolve( kernel , method ); } ) );
+	};
+	if( p.Brighten.set ) filters.push_back( BandFilter( 0 , [&p]( const Image32 &band ){ return band.brighten( p.Brighten.value ); } ) );
+	if( p.Gray.set )     filters.push_back( BandFilter( 0 , [&p]( const Image32 &band ){ return band.luminance(); } ) );
+	if( p.Saturate.set ) filters.push_back( BandFilter( 0 , [&p]( const Image32 &band ){ return band.saturate( p.Saturate.value ); } ) );
+	if( p.Quantize.set ) filters.push_back( BandFilter( 0 , [&p]( const Image32 &band ){ return band.quantize( p.Quantize.value ); } ) );
+	if( p.Blur3X3.set )  filters.push_back( BandFilter( 1 , [&p]( const Image32 &band ){ return band.blur3X3(); } ) );
+	if( p.Convolve.set )
+	{
+		Kernel kernel;
+		kernel.read( p.Convolve.value );
+		Convolution( kernel );
+	}
+	if( p.KernelValues.set )
+	{
+		int size = (int)floor( sqrt( (double)p.KernelValues.count ) + 0.5 );
+		if( size*size!=p.KernelValues.count ) THROW( "Number of kernel values is not a square: %d" , p.KernelValues.count );
+		Kernel kernel( size , size );
+		for( int y=0 ; y<size ; y++ ) for( int x=0 ; x<size ; x++ ) kernel(x,y) = p.KernelValues.values[ y*size+x ];
+		Convolution( kernel );
+	}
+	if( p.ShiftChannel.set ) filters.push_back( BandFilter( 0 , [&p]( const Image32 &band ){ return Image32( band ).shiftChannel( p.ShiftChannel.values[0] , p.ShiftChannel.values[1] ); } ) );
+	if( p.BlurNXN.set ) filters.push_back( BandFilter( (int)p.BlurNXN.values[0]/2+1 , [&p]( const Image32 &band ){ return band.blurNXN( p.BlurNXN.values[0] , p.BlurNXN.values[1] ); } ) );
+	return filters;
+}
+
+/** This class is an image writer that discards the rows, for streaming an image without an output */
+class NullImageWriter : public ImageWriter
+{
+public:
+	void writeRow( const Pixel32 * ){}
+};
+
+/** This function streams the image from the input through the filters to the output, a band of rows at a time (see StreamImage) */
+void RunStream( const Parameters &p , ostream &messages )
+{
+	ProfileScope scope( "stream" , "main" );
+	vector< BandFilter > filters = BandFilters( p );
+	ImageFileReader reader( p.Input.value );
+	messages << "Input dimensions: " << reader.width() << " x " << reader.height() << endl;
+	if( p.Output.set )
+	{
+		string fileName = p.Output.value;
+		const ImageCodec *codec = &ImageCodecForWriting( fileName );
+		JPEGImageCodec jpeg( JPEGOptions( p ) );
+		if( dynamic_cast< const JPEGImageCodec * >( codec ) ) codec = &jpeg;
+		ImageFileWriter writer( fileName , reader.width() , reader.height() , codec );
+		StreamImage( reader , filters , writer , p.Stream.value , 2 );
+	}
+	else
+	{
+		NullImageWriter writer;
+		StreamImage( reader , filters , writer , p.Stream.value , 2 );
+	}
+	messages << "Output dimensions: " << reader.width() << " x " << reader.height() << endl;
+}
+
+/** This function filters the image from the input to the output a tile at a time, holding a bounded number of tiles in memory (see TiledImage and FilterTiles).
+*** The memory is split between the image being filtered and the filtered image. */
+void RunTiled( const Parameters &p , ostream &messages )
+{
+	ProfileScope scope( "tiles" , "main" );
+	vector< BandFilter > filters = BandFilters( p );
+	ImageFileReader reader( p.Input.value );
+	messages << "Input dimensions: " << reader.width() << " x " << reader.height() << endl;
+	if( reader.buffered() ) WARN( "Input is not streamed, so the whole image is held in memory: %s" , p.Input.value.c_str() );
+	long long cacheBytes = (long long)( p.TileCache.value * (1<<20) ) / 2;
+	TiledImage image( reader.width() , reader.height() , p.Tiles.value , cacheBytes , p.Scratch.value );
+	image.read( reader );
+	long long loads = 0 , stores = 0;
+	for( size_t i=0 ; i<filters.size() ; i++ )
+	{
+		TiledImage filtered = FilterTiles( image , filters[i] );
+		loads += image.loads() , stores += image.stores();
+		image = std::move( filtered );
+	}
+	if( p.Output.set )
+	{
+		string fileName = p.Output.value;
+		const ImageCodec *codec = &ImageCodecForWriting( fileName );
+		JPEGImageCodec jpeg( JPEGOptions( p ) );
+		if( dynamic_cast< const JPEGImageCodec * >( codec ) ) codec = &jpeg;
+		ImageFileWriter writer( fileName , reader.width() , reader.height() , codec );
+		if( writer.buffered() ) WARN( "Output is not streamed, so the whole image is held in memory: %s" , p.Output.value.c_str() );
+		image.write( writer );
+	}
+	loads += image.loads() , stores += image.stores();
+	messages << "Output dimensions: " << image.width() << " x " << image.height() << endl;
+	if( p.Profile.set ) messages << "Tiles: " << loads << " loaded from and " << stores << " stored to the scratch files" << endl;
+}
+
+/** This function returns the files matching the wildcard pattern, in sorted order */
+vector< string > Glob( const string &pattern )
+{
+	vector< string > fileNames;
+#ifdef WIN32
+	size_t slash = pattern.find_last_of( "/\\" );
+	string directory = slash==string::npos ? string() : pattern.substr( 0 , slash+1 );
+	WIN32_FIND_DATAA data;
+	HANDLE handle = FindFirstFileA( pattern.c_str() , &data );
+	if( handle!=INVALID_HANDLE_VALUE )
+	{
+		do if( !( data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) ) fileNames.push_back( directory + data.cFileName );
+		while( FindNextFileA( handle , &data ) );
+		FindClose( handle );
+	}
+	sort( fileNames.begin() , fileNames.end() );
+#else // !WIN32
+	glob_t g;
+	if( !glob( pattern.c_str() , 0 , NULL , &g ) ) for( size_t i=0 ; i<g.gl_pathc ; i++ ) fileNames.push_back( g.gl_pathv[i] );
+	globfree( &g );
+#endif // WIN32
+	return fileNames;
+}
+
+/** This function returns the output file name for the input, replacing every "%s" in the pattern with the input's name (without its directory and extension) */
+string BatchOutputName( string pattern , const string &input )
+{
+	size_t slash = input.find_last_of( "/\\" );
+	string name = slash==string::npos ? input : input.substr( slash+1 );
+	size_t dot = name.find_last_of( '.' );
+	if( dot!=string::npos && dot ) name = name.substr( 0 , dot );
+	for( size_t pos=pattern.find( "%s" ) ; pos!=string::npos ; pos=pattern.find( "%s" , pos+name.size() ) ) pattern.replace( pos , 2 , name );
+	return pattern;
+}
+
+/** This structure describes an image passing through the batch pipeline */
+struct BatchImage
+{
+	string input , output;
+	Image32 image;
+
+	/** The description of the source image, for caching, and whether the image is the cached result of the filter chain */
+	string source;
+	bool cached = false;
+};
+
+/** This structure accumulates the work done by a stage of the batch pipeline */
+struct BatchStage
+{
+	/** The name of the stage */
+	const char *name;
+
+	/** The number of images, their pixels, and the time spent on them, summed over the threads of the stage */
+	size_t images;
+	double pixels , seconds;
+
+	/** The lock guarding the counts */
+	mutex lock;
+
+	BatchStage( const char *name ) : name(name) , images(0) , pixels(0) , seconds(0) {}
+
+	/** This method adds an image to the counts */
+	void add( const Image32 &image , double seconds )
+	{
+		lock_guard< mutex > guard( lock );
+		images++ , pixels += (double)image.width() * image.height() , this->seconds += seconds;
+	}
+};
+
+/** This function returns the input and output names of the batch, from the wildcard pattern or the manifest.
+*** An exception is thrown if the batch is empty, or if the outputs are not distinct files. */
+vector< pair< string , string > > BatchJobs( const Parameters &p )
+{
+	vector< pair< string , string > > jobs;
+	if( p.Batch.value.find_first_of( "*?" )!=string::npos )
+	{
+		vector< string > inputs = Glob( p.Batch.value );
+		for( size_t i=0 ; i<inputs.size() ; i++ ) jobs.push_back( make_pair( inputs[i] , p.Output.set ? BatchOutputName( p.Output.value , inputs[i] ) : string() ) );
+	}
+	else
+	{
+		ifstream manifest( p.Batch.value );
+		if( !manifest ) THROW( "Failed to open file for reading: %s" , p.Batch.value.c_str() );
+		string line;
+		while( getline( manifest , line ) )
+		{
+			stringstream stream( line );
+			string input , output;
+			if( !( stream >> input ) || input[0]=='#' ) continue;
+			if( !( stream >> output ) && p.Output.set ) output = BatchOutputName( p.Output.value , input );
+			jobs.push_back( make_pair( input , output ) );
+		}
+	}
+	if( !jobs.size() ) THROW( "No images in batch: %s" , p.Batch.value.c_str() );
+	for( size_t i=0 ; i<jobs.size() ; i++ ) if( jobs[i].second=="-" || ( jobs[i].second.size()>2 && jobs[i].second.compare( jobs[i].second.size()-2 , 2 , ":-" )==0 ) )
+		THROW( "Batch output cannot be written to the standard output: %s" , jobs[i].first.c_str() );
+	{
+		vector< string > outputs;
+		for( size_t i=0 ; i<jobs.size() ; i++ ) if( jobs[i].second.size() ) outputs.push_back( jobs[i].second );
+		sort( outputs.begin() , outputs.end() );
+		for( size_t i=1 ; i<outputs.size() ; i++ ) if( outputs[i]==outputs[i-1] ) THROW( "Batch outputs are not distinct (use %%s in the output name): %s" , outputs[i].c_str() );
+	}
+	return jobs;
+}
+
+/** This function applies the filters to a batch of images, returning true if all of them succeeded.
+*** The images are decoded, processed, and encoded in a pipeline, so that while one image is filtered the next is decoded and the previous encoded.
+*** Each stage runs on its own threads, and the stages are connected by bounded queues, limiting the number of images held in memory. */
+bool RunBatch( const Parameters &p )
+{
+	vector< pair< string , string > > jobs = BatchJobs( p );
+
+	BatchStage decode( "Decode" ) , process( "Process" ) , encode( "Encode" );
+	BoundedQueue< BatchImage > decoded( p.BatchDepth.value ) , processed( p.BatchDepth.value );
+	atomic< size_t > next( 0 ) , failures( 0 );
+	mutex messageLock;
+
+	auto Fail = [&]( const BatchImage &image , const exception &e )
+	{
+		lock_guard< mutex > guard( messageLock );
+		cerr << image.input << ": " << e.what() << endl;
+		failures++;
+	};
+
+	auto DecodeStage = [&]( void )
+	{
+		for( size_t i=next++ ; i<jobs.size() ; i=next++ )
+		{
+			BatchImage image;
+			image.input = jobs[i].first , image.output = jobs[i].second;
+			try
+			{
+				Timer timer;
+				image.source = FileSource( p , image.input );
+				image.cached = CachedResult( p , image.source , image.image );
+				if( !image.cached ) image.image = Read( p , image.input );
+				decode.add( image.image , timer.elapsed() );
+			}
+			catch( const exception &e ){ Fail( image , e ) ; continue; }
+			decoded.push( std::move( image ) );
+		}
+	};
+
+	auto ProcessStage = [&]( void )
+	{
+		BatchImage image;
+		while( decoded.pop( image ) )
+		{
+			try
+			{
+				Timer timer;
+				if( !image.cached ) image.image = Process( p , std::move( image.image ) , image.source );
+				process.add( image.image , timer.elapsed() );
+				if( p.Stats.set )
+				{
+					lock_guard< mutex > guard( messageLock );
+					cout << image.input << ":" << endl << image.image.stats();
+				}
+			}
+			catch( const exception &e ){ Fail( image , e ) ; continue; }
+			processed.push( std::move( image ) );
+		}
+	};
+
+	auto EncodeStage = [&]( void )
+	{
+		BatchImage image;
+		while( processed.pop( image ) )
+		{
+			try
+			{
+				Timer timer;
+				if( image.output.size() ) Write( p , image.image , image.output );
+				encode.add( image.image , timer.elapsed() );
+			}
+			catch( const exception &e ){ Fail( image , e ); }
+			image.image = Image32();
+		}
+	};
+
+	// Start all the stages before waiting on any, as a stage blocks when the queue after it is full
+	Timer timer;
+	int workers = std::max< int >( p.BatchWorkers.value , 1 );
+	vector< thread > decoders , processors , encoders;
+	for( int t=0 ; t<workers ; t++ ) decoders.push_back( thread( DecodeStage ) ) , processors.push_back( thread( ProcessStage ) ) , encoders.push_back( thread( EncodeStage ) );
+	for( int t=0 ; t<workers ; t++ ) decoders[t].join();
+	decoded.close();
+	for( int t=0 ; t<workers ; t++ ) processors[t].join();
+	processed.close();
+	for( int t=0 ; t<workers ; t++ ) encoders[t].join();
+	double seconds = timer.elapsed();
+
+	// Report the throughput of the batch and the work done by each stage
+	cout << "Batch: " << jobs.size() << " images, " << failures << " failed, " << seconds << " (s) -> " << ( jobs.size()-failures ) / seconds << " images/s" << endl;
+	BatchStage *stages[] = { &decode , &process , &encode };
+	for( int s=0 ; s<3 ; s++ )
+	{
+		cout << "\t" << stages[s]->name << ": " << stages[s]->images << " images, " << stages[s]->pixels/1e6 << " Mpixels, " << stages[s]->seconds << " (s)";
+		if( stages[s]->seconds>0 ) cout << " -> " << stages[s]->images / stages[s]->seconds << " images/s, " << stages[s]->pixels / 1e6 / stages[s]->seconds << " Mpixels/s";
+		cout << endl;
+	}
+	return !failures;
+}
+
+/** This class describes how the pixels of the input and output images pass between a client and the server */
+class PixelTransfer
+{
+public:
+	enum
+	{
+		FILES ,		// The server reads and writes the files named in the request
+		INLINE ,	// The pixels are sent over the socket, after the header
+		SHARED ,	// The pixels are in shared memory, whose descriptor is sent with the header
+		COUNT
+	};
+	static const char *Names[];
+	static int Parse( const string &name )
+	{
+		for( int i=0 ; i<COUNT ; i++ ) if( name==Names[i] ) return i;
+		THROW( "Unrecognized pixel transfer: %s" , name.c_str() );
+		return -1;
+	}
+};
+const char *PixelTransfer::Names[] = { "file" , "inline" , "shared" };
+
+/** The header of a request, followed on the socket by the arguments (each terminated by a zero byte) and, for an inline transfer, the input pixels.
+*** As the client and server run on the same machine, the fields are in the native byte order. */
+struct RequestHeader
+{
+	static const unsigned int Magic = 0x31514552; // "REQ1"
+	unsigned int magic , id , transfer , argumentsSize;
+	int width , height;
+};
+
+/** The header of a reply, followed on the socket by the messages (or the error) and, for an inline transfer, the output pixels */
+struct ReplyHeader
+{
+	static const unsigned int Magic = 0x31504552; // "REP1"
+	unsigned int magic , id , failed , messageSize;
+	int width , height;
+};
+
+/** This function processes a request, with the arguments parsed into its own parameters as if they were on the command line, so that requests run concurrently.
+*** If the image was not passed with the request, it is read from the input file, and the output is written to the output file. */
+Image32 ProcessRequest( const vector< string > &arguments , Image32 image , bool passed , ostream &messages )
+{
+	Parameters p;
+	vector< char * > argv;
+	for( size_t i=0 ; i<arguments.size() ; i++ ) argv.push_back( const_cast< char * >( arguments[i].c_str() ) );
+	p.parse( (int)argv.size() , argv.size() ? &argv[0] : NULL );
+	const CmdLineReadable *unsupported[] = { &p.Batch , &p.BatchWorkers , &p.BatchDepth , &p.Stream , &p.Tiles , &p.TileCache , &p.Scratch , &p.JPEGTransformName , &p.Profile , &p.Trace , &p.CacheDirectory , &p.CacheSize , &p.Serve , &p.Connect , &p.TransferName };
+	for( const CmdLineReadable *u : unsupported ) if( u->set ) THROW( "Unsupported in a request: --%s" , u->name.c_str() );
+
+	if( passed )
+	{
+		messages << "Input dimensions: " << image.width() << " x " << image.height() << endl;
+		string source = ImageSource( image );
+		image = Process( p , std::move( image ) , source );
+	}
+	else
+	{
+		if( !p.Input.set ) THROW( "Request has no input image" );
+		image = ReadAndProcess( p , p.Input.value , messages );
+	}
+	messages << "Output dimensions: " << image.width() << " x " << image.height() << endl;
+	if( p.Stats.set ) messages << image.stats();
+	if( !passed && p.Output.set ) Write( p , image , p.Output.value );
+	return image;
+}
+
+/** This function serves the requests of a connection, until the client closes it.
+*** The requests are read and answered in order, so a client can send several before reading the replies.
+*** Each connection is served on its own thread, which keeps its JPEG codec (see JPEGImageCodec) and its buffers from one request to the next:
+*** in particular, the pixels of a reply are received into by the next request when the dimensions are the same. */
+void ServeConnection( LocalSocket socket )
+{
+	try
+	{
+		RequestHeader request;
+		int fd;
+		vector< char > buffer;
+		stringstream messages;
+		Image32 image;
+		while( socket.receive( &request , sizeof(request) , &fd ) )
+		{
+			unique_ptr< SharedMemory > input;
+			if( fd>=0 ) input.reset( new SharedMemory( fd ) );
+			if( request.magic!=RequestHeader::Magic || request.transfer>=PixelTransfer::COUNT ) THROW( "Bad request header" );
+			vector< string > arguments;
+			if( request.argumentsSize )
+			{
+				buffer.resize( request.argumentsSize );
+				if( !socket.receive( &buffer[0] , buffer.size() ) ) THROW( "Connection closed in request" );
+				if( buffer.back() ) THROW( "Bad request arguments" );
+				for( size_t i=0 ; i<buffer.size() ; i+=arguments.back().size()+1 ) arguments.push_back( string( &buffer[i] ) );
+			}
+
+			// Receive the input pixels, before processing, so that the connection stays in step if the request fails
+			ReplyHeader reply;
+			messages.str( string() ) , messages.clear();
+			bool passed = request.transfer!=PixelTransfer::FILES;
+			try
+			{
+				if( passed )
+				{
+					if( request.width<=0 || request.height<=0 ) THROW( "Bad image dimensions: %d x %d" , request.width , request.height );
+					size_t bytes = sizeof(Pixel32) * request.width * request.height;
+					image.setSize( request.width , request.height );
+					if( request.transfer==PixelTransfer::INLINE )
+					{
+						if( !socket.receive( image.row(0) , bytes ) ) THROW( "Connection closed in request" );
+					}
+					else
+					{
+						if( !input || input->size()<bytes ) THROW( "Shared memory is smaller than the image" );
+						memcpy( image.row(0) , input->data() , bytes );
+					}
+				}
+				input.reset();
+				image = ProcessRequest( arguments , std::move( image ) , passed , messages );
+				reply.failed = 0;
+			}
+			catch( const exception &e )
+			{
+				messages.str( e.what() );
+				reply.failed = 1;
+				image = Image32();
+			}
+
+			string message = messages.str();
+			size_t bytes = sizeof(Pixel32) * image.width() * image.height();
+			unique_ptr< SharedMemory > output;
+			if( passed && bytes && request.transfer==PixelTransfer::SHARED )
+			{
+				output.reset( new SharedMemory( bytes ) );
+				memcpy( output->data() , image.row(0) , bytes );
+			}
+			reply.magic = ReplyHeader::Magic , reply.id = request.id , reply.messageSize = (unsigned int)message.size();
+			reply.width = passed ? image.width() : 0 , reply.height = passed ? image.height() : 0;
+			socket.send( &reply , sizeof(reply) , output ? output->fd() : -1 );
+			if( message.size() ) socket.send( message.data() , message.size() );
+			if( passed && bytes && request.transfer==PixelTransfer::INLINE ) socket.send( image.row(0) , bytes );
+		}
+	}
+	catch( const exception &e ){ cerr << e.what() << endl; }
+}
+
+/** This function listens at the socket, serving each connection on its own thread. It only returns by throwing. */
+void RunServer( const Parameters &p )
+{
+	string path = p.Serve.value;
+	LocalServer server( path );
+	cout << "Serving at: " << path << endl;
+	while( true ) thread( ServeConnection , server.accept() ).detach();
+}
+
+/** This function sends a request, along with the input image if the transfer passes the pixels */
+void SendRequest( LocalSocket &socket , unsigned int id , const vector< string > &arguments , int transfer , const Image32 &image )
+{
+	RequestHeader request;
+	string packed;
+	for( size_t i=0 ; i<arguments.size() ; i++ ) packed += arguments[i] , packed += '\0';
+	size_t bytes = sizeof(Pixel32) * image.width() * image.height();
+	unique_ptr< SharedMemory > input;
+	if( transfer==PixelTransfer::SHARED )
+	{
+		input.reset( new SharedMemory( bytes ) );
+		memcpy( input->data() , image.row(0) , bytes );
+	}
+	request.magic = RequestHeader::Magic , request.id = id , request.transfer = transfer , request.argumentsSize = (unsigned int)packed.size();
+	request.width = image.width() , request.height = image.height();
+	socket.send( &request , sizeof(request) , input ? input->fd() : -1 );
+	if( packed.size() ) socket.send( packed.data() , packed.size() );
+	if( transfer==PixelTransfer::INLINE ) socket.send( image.row(0) , bytes );
+}
+
+/** This function receives the reply to a request, setting the output image if the transfer passes the pixels.
+*** It returns false, with the server's error, if the request failed, and throws if the connection did. */
+bool ReceiveReply( LocalSocket &socket , unsigned int id , int transfer , Image32 &image , ostream &messages , string &error )
+{
+	ReplyHeader reply;
+	int fd;
+	if( !socket.receive( &reply , sizeof(reply) , &fd ) ) THROW( "Server closed the connection" );
+	unique_ptr< SharedMemory > output;
+	if( fd>=0 ) output.reset( new SharedMemory( fd ) );
+	if( reply.magic!=ReplyHeader::Magic || reply.id!=id ) THROW( "Bad reply header" );
+	string message( reply.messageSize , '\0' );
+	if( message.size() && !socket.receive( &message[0] , message.size() ) ) THROW( "Server closed the connection" );
+	if( reply.failed ){ error = message ; return false; }
+	messages << message;
+
+	if( transfer!=PixelTransfer::FILES )
+	{
+		if( reply.width<=0 || reply.height<=0 ) THROW( "Bad image dimensions: %d x %d" , reply.width , reply.height );
+		size_t bytes = sizeof(Pixel32) * reply.width * reply.height;
+		image.setSize( reply.width , reply.height );
+		if( transfer==PixelTransfer::INLINE )
+		{
+			if( !socket.receive( image.row(0) , bytes ) ) THROW( "Server closed the connection" );
+		}
+		else
+		{
+			if( !output || output->size()<bytes ) THROW( "Shared memory is smaller than the image" );
+			memcpy( image.row(0) , output->data() , bytes );
+		}
+	}
+	return true;
+}
+
+/** This function sends the filters on the command line to the server, for the input image or for each image of the batch, returning true if all of them succeeded.
+*** With the file transfer the server reads and writes the images, and otherwise they are read and written here, and the pixels passed.
+*** The requests are pipelined: they are sent from their own thread, up to the batch depth ahead of the replies. */
+bool RunClient( const Parameters &p , int argc , char *argv[] , ostream &messages )
+{
+	int transfer = PixelTransfer::Parse( p.TransferName.value );
+
+	// The filters are passed on as they are, without the options handled here
+	vector< string > arguments;
+	const CmdLineReadable *local[] = { &p.Input , &p.Output , &p.Batch , &p.BatchWorkers , &p.BatchDepth , &p.Profile , &p.Trace , &p.Connect , &p.TransferName };
+	for( int i=1 ; i<argc ; i++ )
+	{
+		bool skip = false;
+		for( const CmdLineReadable *l : local ) if( argv[i]=="--"+l->name ) skip = true;
+		if( skip ) i++;
+		else arguments.push_back( argv[i] );
+	}
+
+	vector< pair< string , string > > jobs;
+	if( p.Batch.set ) jobs = BatchJobs( p );
+	else
+	{
+		if( p.Output.set && ( p.Output.value=="-" || ( p.Output.value.size()>2 && p.Output.value.compare( p.Output.value.size()-2 , 2 , ":-" )==0 ) ) && transfer==PixelTransfer::FILES )
+			THROW( "The server cannot write to the standard output (use --%s %s)" , p.TransferName.name.c_str() , PixelTransfer::Names[ PixelTransfer::SHARED ] );
+		jobs.push_back( make_pair( p.Input.value , p.Output.set ? p.Output.value : string() ) );
+	}
+
+	LocalSocket socket = LocalSocket::Connect( p.Connect.value );
+	vector< string > errors( jobs.size() );
+	BoundedQueue< size_t > inFlight( std::max< int >( p.BatchDepth.value , 1 ) );
+	Timer timer;
+
+	// A request that cannot be prepared is still sent, without its arguments, so that the replies stay in step
+	thread sender( [&]( void )
+	{
+		try
+		{
+			for( size_t i=0 ; i<jobs.size() ; i++ )
+			{
+				vector< string > request = arguments;
+				Image32 image;
+				try
+				{
+					if( transfer==PixelTransfer::FILES )
+					{
+						request.push_back( "--"+p.Input.name ) , request.push_back( jobs[i].first );
+						if( jobs[i].second.size() ) request.push_back( "--"+p.Output.name ) , request.push_back( jobs[i].second );
+					}
+					else image = Read( p , jobs[i].first );
+				}
+				catch( const exception &e ){ errors[i] = e.what() , request.clear() , image = Image32(); }
+				inFlight.push( i );
+				SendRequest( socket , (unsigned int)i , request , errors[i].size() ? (int)PixelTransfer::FILES : transfer , image );
+			}
+		}
+		catch( const exception &e ){ cerr << e.what() << endl; }
+		inFlight.close();
+	} );
+
+	// Once the connection fails, the remaining requests are counted as failed
+	size_t succeeded = 0 , i;
+	bool connected = true;
+	while( inFlight.pop( i ) )
+	{
+		string error;
+		if( connected )
+		{
+			Image32 image;
+			bool replied = false;
+			try{ replied = ReceiveReply( socket , (unsigned int)i , errors[i].size() ? (int)PixelTransfer::FILES : transfer , image , messages , error ); }
+			catch( const exception &e ){ error = e.what() , connected = false; }
+			if( replied && errors[i].empty() && transfer!=PixelTransfer::FILES && jobs[i].second.size() )
+			{
+				try{ Write( p , image , jobs[i].second ); }
+				catch( const exception &e ){ error = e.what(); }
+			}
+		}
+		if( errors[i].size() ) error = errors[i];
+		else if( !connected && error.empty() ) error = "No reply from the server";
+		if( error.size() ) cerr << jobs[i].first << ": " << error << endl;
+		else succeeded++;
+	}
+	sender.join();
+	size_t failures = jobs.size() - succeeded;
+	if( p.Batch.set )
+	{
+		double seconds = timer.elapsed();
+		messages << "Batch: " << jobs.size() << " images, " << failures << " failed, " << seconds << " (s) -> " << ( jobs.size()-failures ) / seconds << " images/s" << endl;
+	}
+	return !failures;
+}
+
+/** This function outputs the profile, if profiling is enabled, and returns the exit status */
+int Finish( const Parameters &p , int status , ostream &messages )
+{
+	if( Cache ) messages << "Cache: " << Cache->hits() << " results loaded, " << Cache->stores() << " stored" << endl;
+	if( p.Profile.set ) Profiler::Report( messages );
+	if( p.Trace.set )
+	{
+		try{ Profiler::WriteTrace( p.Trace.value ); }
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+	return status;
+}
+
+int main( int argc , char *argv[] )
+{
+	Parameters p;
+	p.parse( argc-1 , argv+1 );
+	if( !p.Input.set && !p.Batch.set && !p.Serve.set ) { ShowUsage( argv[0] , p ) ; return EXIT_FAILURE; }
+	if( p.Profile.set || p.Trace.set ) Profiler::Enable();
+	// A client leaves caching to the server
+	if( p.CacheDirectory.set && !p.Connect.set )
+	{
+		try{ Cache = new ImageCache( p.CacheDirectory.value , (long long)( p.CacheSize.value * (1<<20) ) ); }
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The lossless transform only crops, so it cannot be combined with any filter or with another mode
+	if( p.JPEGTransformName.set )
+	{
+		vector< CmdLineReadable * > params = p.list();
+		CmdLineReadable *supported[] = { &p.Input , &p.Output , &p.Crop , &p.JPEGTransformName };
+		try
+		{
+			for( int i=0 ; params[i] ; i++ ) if( params[i]->set && find( begin( supported ) , end( supported ) , params[i] )==end( supported ) )
+				THROW( "--%s cannot be combined with --%s" , p.JPEGTransformName.name.c_str() , params[i]->name.c_str() );
+		}
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
 		}
+	}
+
+	if( p.Serve.set )
+	{
+		try{ RunServer( p ); }
+		catch( const exception& e ) { cerr << e.what() << endl; }
+		return EXIT_FAILURE;
+	}
+
+	if( p.Connect.set )
+	{
+		// When the image is written to the standard output, the messages go to the standard error
+		ostream &messages = p.Output.set && !p.Batch.set && ( p.Output.value=="-" || ( p.Output.value.size()>2 && p.Output.value.compare( p.Output.value.size()-2 , 2 , ":-" )==0 ) ) ? cerr : cout;
+		try{ return Finish( p , RunClient( p , argc , argv , messages ) ? EXIT_SUCCESS : EXIT_FAILURE , messages ); }
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return Finish( p , EXIT_FAILURE , messages );
+		}
+	}
+
+	if( p.Batch.set )
+	{
+		try{ return Finish( p , RunBatch( p ) ? EXIT_SUCCESS : EXIT_FAILURE , cout ); }
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return Finish( p , EXIT_FAILURE , cout );
+		}
+	}
+
+	// Transform (and crop) a JPEG in the DCT domain, without decoding it
+	if( p.JPEGTransformName.set )
+	{
+		try
+		{
+			string inExt = ToLower( GetFileExtension( p.Input.value ) ) , outExt = ToLower( GetFileExtension( p.Output.value ) );
+			if( !p.Output.set ) THROW( "Lossless transform requires an output file" );
+			if( ( inExt!="jpg" && inExt!="jpeg" ) || ( outExt!="jpg" && outExt!="jpeg" ) ) THROW( "Lossless transform requires JPEG input and output: %s -> %s" , p.Input.value.c_str() , p.Output.value.c_str() );
+			int transform = JPEGTransform::Parse( p.JPEGTransformName.value );
+			if( p.Crop.set ) JPEGTransformImage( p.Input.value , p.Output.value , transform , p.Crop.values[0] , p.Crop.values[1] , p.Crop.values[2] , p.Crop.values[3] );
+			else           JPEGTransformImage( p.Input.value , p.Output.value , transform );
+		}
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+
+	// When the image is written to the standard output, the messages go to the standard error
+	bool standardOutput = p.Output.set && ( p.Output.value=="-" || ( p.Output.value.size()>2 && p.Output.value.compare( p.Output.value.size()-2 , 2 , ":-" )==0 ) );
+	ostream &messages = standardOutput ? cerr : cout;
+
+	if( p.Tiles.set )
+	{
+		try{ RunTiled( p , messages ); }
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return Finish( p , EXIT_FAILURE , messages );
+		}
+		return Finish( p , EXIT_SUCCESS , messages );
+	}
 
-		cout << "Output dimensions: " << image.width() << " x " << image.height() << endl;
+	if( p.Stream.set )
+	{
+		try{ RunStream( p , messages ); }
+		catch( const exception& e )
+		{
+			cerr << e.what() << endl;
+			return Finish( p , EXIT_FAILURE , messages );
+		}
+		return Finish( p , EXIT_SUCCESS , messages );
+	}
+
+	try
+	{
+		Image32 image = ReadAndProcess( p , p.Input.value , messages );
+		messages << "Output dimensions: " << image.width() << " x " << image.height() << endl;
+		if( p.Stats.set ) messages << image.stats();
 
 		// Try to write out the output image
-		if( Output.set ) image.write( Output.value );
+		if( p.Output.set ) Write( p , image , p.Output.value );
 	}
 	catch( const exception& e )
 	{
 		cerr << e.what() << endl;
-		return EXIT_FAILURE;
+		return Finish( p , EXIT_FAILURE , messages );
 	};
-	return EXIT_SUCCESS;
+	return Finish( p , EXIT_SUCCESS , messages );
 }